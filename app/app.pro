@@ -103,6 +103,16 @@ unix:!macx {
             PKGCONFIG += libdrm
             CONFIG += libdrm
         }
+
+        packagesExist(egl) {
+            PKGCONFIG += egl
+            CONFIG += egl
+        }
+
+        packagesExist(ffnvcodec) {
+            PKGCONFIG += ffnvcodec
+            CONFIG += ffnvcodec
+        }
     }
 
     packagesExist(wayland-client) {
@@ -146,6 +156,7 @@ SOURCES += \
     cli/commandlineparser.cpp \
     cli/quitstream.cpp \
     cli/startstream.cpp \
+    cli/benchmarkcopy.cpp \
     settings/streamingpreferences.cpp \
     streaming/input/abstouch.cpp \
     streaming/input/gamepad.cpp \
@@ -154,6 +165,8 @@ SOURCES += \
     streaming/input/mouse.cpp \
     streaming/input/reltouch.cpp \
     streaming/session.cpp \
+    streaming/tracer.cpp \
+    streaming/video/planecopy.cpp \
     streaming/audio/audio.cpp \
     streaming/audio/renderers/sdlaud.cpp \
     gui/computermodel.cpp \
@@ -164,6 +177,9 @@ SOURCES += \
     settings/mappingmanager.cpp \
     gui/sdlgamepadkeynavigation.cpp \
     streaming/video/overlaymanager.cpp \
+    streaming/video/glyphatlas.cpp \
+    streaming/video/framegraph.cpp \
+    streaming/video/decoderprobecache.cpp \
     backend/systemproperties.cpp \
     wm.cpp
 
@@ -181,20 +197,27 @@ HEADERS += \
     cli/commandlineparser.h \
     cli/quitstream.h \
     cli/startstream.h \
+    cli/benchmarkcopy.h \
     settings/streamingpreferences.h \
     streaming/input/input.h \
     streaming/session.h \
+    streaming/tracer.h \
+    streaming/video/planecopy.h \
     streaming/audio/renderers/renderer.h \
     streaming/audio/renderers/sdl.h \
     gui/computermodel.h \
     gui/appmodel.h \
     streaming/video/decoder.h \
+    streaming/video/latencyhistogram.h \
     streaming/streamutils.h \
     backend/autoupdatechecker.h \
     path.h \
     settings/mappingmanager.h \
     gui/sdlgamepadkeynavigation.h \
     streaming/video/overlaymanager.h \
+    streaming/video/glyphatlas.h \
+    streaming/video/framegraph.h \
+    streaming/video/decoderprobecache.h \
     backend/systemproperties.h
 
 # Platform-specific renderers and decoders
@@ -203,19 +226,42 @@ ffmpeg {
 
     DEFINES += HAVE_FFMPEG
     SOURCES += \
+        cli/benchmarkdecode.cpp \
+        cli/benchmarkpacer.cpp \
         streaming/video/ffmpeg.cpp \
+        streaming/video/decodecapture.cpp \
+        streaming/video/framereadback.cpp \
+        streaming/video/videostatschannel.cpp \
         streaming/video/ffmpeg-renderers/sdlvid.cpp \
+        streaming/video/ffmpeg-renderers/glvid.cpp \
         streaming/video/ffmpeg-renderers/cuda.cpp \
+        streaming/video/ffmpeg-renderers/null.cpp \
         streaming/video/ffmpeg-renderers/pacer/pacer.cpp \
-        streaming/video/ffmpeg-renderers/pacer/nullthreadedvsyncsource.cpp
+        streaming/video/ffmpeg-renderers/pacer/nullthreadedvsyncsource.cpp \
+        streaming/video/ffmpeg-renderers/pacer/timervsyncsource.cpp \
+        streaming/video/ffmpeg-renderers/pacer/vsyncpredictor.cpp \
+        streaming/video/ffmpeg-renderers/pacer/rendercostmodel.cpp \
+        streaming/video/ffmpeg-renderers/pacer/jitterbuffer.cpp
 
     HEADERS += \
+        cli/benchmarkdecode.h \
+        cli/benchmarkpacer.h \
         streaming/video/ffmpeg.h \
+        streaming/video/decodecapture.h \
+        streaming/video/framereadback.h \
+        streaming/video/videostatschannel.h \
+        streaming/video/spscring.h \
         streaming/video/ffmpeg-renderers/renderer.h \
         streaming/video/ffmpeg-renderers/sdlvid.h \
+        streaming/video/ffmpeg-renderers/glvid.h \
         streaming/video/ffmpeg-renderers/cuda.h \
+        streaming/video/ffmpeg-renderers/null.h \
         streaming/video/ffmpeg-renderers/pacer/pacer.h \
-        streaming/video/ffmpeg-renderers/pacer/nullthreadedvsyncsource.h
+        streaming/video/ffmpeg-renderers/pacer/nullthreadedvsyncsource.h \
+        streaming/video/ffmpeg-renderers/pacer/timervsyncsource.h \
+        streaming/video/ffmpeg-renderers/pacer/vsyncpredictor.h \
+        streaming/video/ffmpeg-renderers/pacer/rendercostmodel.h \
+        streaming/video/ffmpeg-renderers/pacer/jitterbuffer.h
 }
 libva {
     message(VAAPI renderer selected)
@@ -261,8 +307,22 @@ libdrm {
     message(DRM renderer selected)
 
     DEFINES += HAVE_DRM
-    SOURCES += streaming/video/ffmpeg-renderers/drm.cpp
-    HEADERS += streaming/video/ffmpeg-renderers/drm.h
+    SOURCES += \
+        streaming/video/ffmpeg-renderers/drm.cpp \
+        streaming/video/ffmpeg-renderers/pacer/drmvsyncsource.cpp
+    HEADERS += \
+        streaming/video/ffmpeg-renderers/drm.h \
+        streaming/video/ffmpeg-renderers/pacer/drmvsyncsource.h
+}
+egl {
+    message(EGL frame import enabled)
+
+    DEFINES += HAVE_EGL
+}
+ffnvcodec {
+    message(CUDA page-locked read-back enabled)
+
+    DEFINES += HAVE_FFNVCODEC
 }
 config_SL {
     message(Steam Link build configuration selected)
@@ -0,0 +1,318 @@
+#include "benchmarkcopy.h"
+#include "streaming/streamutils.h"
+#include "streaming/video/planecopy.h"
+
+#include <SDL.h>
+
+#include <functional>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Decoders pad their rows, so the source pitch doesn't match the width
+#define SOURCE_PITCH(bytes) ((((bytes) + 63) & ~63) + 64)
+
+namespace CliBenchmarkCopy
+{
+
+typedef struct _BENCHMARK_BUFFERS {
+    int width;
+    int height;
+    int chromaWidth;
+    int chromaHeight;
+
+    std::vector<uint8_t> srcY;
+    std::vector<uint8_t> srcU;
+    std::vector<uint8_t> srcV;
+    std::vector<uint8_t> srcUV;
+    std::vector<uint8_t> srcP010;
+    int srcYPitch;
+    int srcChromaPitch;
+    int srcUVPitch;
+    int srcP010Pitch;
+
+    std::vector<uint8_t> dstY;
+    std::vector<uint8_t> dstU;
+    std::vector<uint8_t> dstV;
+    std::vector<uint8_t> dstUV;
+} BENCHMARK_BUFFERS, *PBENCHMARK_BUFFERS;
+
+typedef struct _BENCHMARK_TEST {
+    const char* name;
+    std::function<void(BENCHMARK_BUFFERS&)> run;
+    std::function<size_t(const BENCHMARK_BUFFERS&)> outputBytes;
+    std::vector<uint8_t> reference;
+} BENCHMARK_TEST, *PBENCHMARK_TEST;
+
+// Tone maps a whole yuv420p10 frame like SdlRenderer does
+static void toneMapMain10Frame(BENCHMARK_BUFFERS& buffers)
+{
+    // The chroma planes are smaller, so they can share the source plane
+    uint8_t* const dst[3] = { buffers.dstY.data(), buffers.dstU.data(), buffers.dstV.data() };
+    const int dstPitch[3] = { buffers.width, buffers.chromaWidth, buffers.chromaWidth };
+    const uint16_t* src = (const uint16_t*)buffers.srcP010.data();
+    const uint16_t* const srcPlanes[3] = { src, src, src };
+    const int srcPitch[3] = { buffers.srcP010Pitch, buffers.srcP010Pitch, buffers.srcP010Pitch };
+
+    PlaneCopy::toneMapFrame(dst, dstPitch, 1, srcPlanes, srcPitch, 1,
+                            buffers.width, buffers.height, 0, false);
+}
+
+// Converts a whole yuv420p10 frame like SdlRenderer does and returns
+// the time per frame in microseconds
+static double timeMain10Frame(BENCHMARK_BUFFERS& buffers, int iterations, bool toneMap)
+{
+    const uint16_t* src = (const uint16_t*)buffers.srcP010.data();
+
+    uint64_t startTimeUs = StreamUtils::getMicroseconds();
+    for (int i = 0; i < iterations; i++) {
+        if (toneMap) {
+            toneMapMain10Frame(buffers);
+            continue;
+        }
+
+        PlaneCopy::ditherPlane(buffers.dstY.data(), buffers.width,
+                               src, buffers.srcP010Pitch,
+                               buffers.width, buffers.height, 2);
+        PlaneCopy::ditherPlane(buffers.dstU.data(), buffers.chromaWidth,
+                               src, buffers.srcP010Pitch,
+                               buffers.chromaWidth, buffers.chromaHeight, 2);
+        PlaneCopy::ditherPlane(buffers.dstV.data(), buffers.chromaWidth,
+                               src, buffers.srcP010Pitch,
+                               buffers.chromaWidth, buffers.chromaHeight, 2);
+    }
+
+    return (double)(StreamUtils::getMicroseconds() - startTimeUs) / iterations;
+}
+
+static void fillRandom(std::vector<uint8_t>& buffer, size_t size)
+{
+    buffer.resize(size);
+    for (size_t i = 0; i < size; i++) {
+        buffer[i] = (uint8_t)rand();
+    }
+}
+
+// Gathers the visible bytes of every output so kernels can be compared
+static std::vector<uint8_t> getOutput(const BENCHMARK_BUFFERS& buffers)
+{
+    std::vector<uint8_t> output;
+    output.insert(output.end(), buffers.dstY.begin(), buffers.dstY.end());
+    output.insert(output.end(), buffers.dstU.begin(), buffers.dstU.end());
+    output.insert(output.end(), buffers.dstV.begin(), buffers.dstV.end());
+    output.insert(output.end(), buffers.dstUV.begin(), buffers.dstUV.end());
+    return output;
+}
+
+static void clearOutput(BENCHMARK_BUFFERS& buffers)
+{
+    memset(buffers.dstY.data(), 0, buffers.dstY.size());
+    memset(buffers.dstU.data(), 0, buffers.dstU.size());
+    memset(buffers.dstV.data(), 0, buffers.dstV.size());
+    memset(buffers.dstUV.data(), 0, buffers.dstUV.size());
+}
+
+// Returns GB/s written to the destination
+static double timeTest(BENCHMARK_TEST& test, BENCHMARK_BUFFERS& buffers, int iterations)
+{
+    // Warm up the caches and the kernel selection
+    test.run(buffers);
+
+    uint64_t startTimeUs = StreamUtils::getMicroseconds();
+    for (int i = 0; i < iterations; i++) {
+        test.run(buffers);
+    }
+    uint64_t elapsedUs = SDL_max(StreamUtils::getMicroseconds() - startTimeUs, (uint64_t)1);
+
+    return (double)test.outputBytes(buffers) * iterations / elapsedUs / 1000.0;
+}
+
+int run(int width, int height, int iterations)
+{
+    BENCHMARK_BUFFERS buffers;
+
+    if (width <= 0 || height <= 0 || iterations <= 0) {
+        fprintf(stderr, "Invalid benchmark parameters\n");
+        return 1;
+    }
+
+    buffers.width = width;
+    buffers.height = height;
+    buffers.chromaWidth = (width + 1) / 2;
+    buffers.chromaHeight = (height + 1) / 2;
+
+    buffers.srcYPitch = SOURCE_PITCH(width);
+    buffers.srcChromaPitch = SOURCE_PITCH(buffers.chromaWidth);
+    buffers.srcUVPitch = SOURCE_PITCH(buffers.chromaWidth * 2);
+    buffers.srcP010Pitch = SOURCE_PITCH(width * 2);
+
+    fillRandom(buffers.srcY, (size_t)buffers.srcYPitch * height);
+    fillRandom(buffers.srcU, (size_t)buffers.srcChromaPitch * buffers.chromaHeight);
+    fillRandom(buffers.srcV, (size_t)buffers.srcChromaPitch * buffers.chromaHeight);
+    fillRandom(buffers.srcUV, (size_t)buffers.srcUVPitch * buffers.chromaHeight);
+    fillRandom(buffers.srcP010, (size_t)buffers.srcP010Pitch * height);
+
+    // Destinations are tightly packed like a texture would be
+    buffers.dstY.resize((size_t)width * height);
+    buffers.dstU.resize((size_t)buffers.chromaWidth * buffers.chromaHeight);
+    buffers.dstV.resize((size_t)buffers.chromaWidth * buffers.chromaHeight);
+    buffers.dstUV.resize((size_t)buffers.chromaWidth * 2 * buffers.chromaHeight);
+
+    std::vector<BENCHMARK_TEST> tests = {
+        {
+            "Copy",
+            [](BENCHMARK_BUFFERS& b) {
+                PlaneCopy::copyPlane(b.dstY.data(), b.width,
+                                     b.srcY.data(), b.srcYPitch,
+                                     b.width, b.height);
+            },
+            [](const BENCHMARK_BUFFERS& b) { return b.dstY.size(); },
+            {}
+        },
+        {
+            "Interleave",
+            [](BENCHMARK_BUFFERS& b) {
+                PlaneCopy::interleavePlanes(b.dstUV.data(), b.chromaWidth * 2,
+                                            b.srcU.data(), b.srcChromaPitch,
+                                            b.srcV.data(), b.srcChromaPitch,
+                                            b.chromaWidth, b.chromaHeight);
+            },
+            [](const BENCHMARK_BUFFERS& b) { return b.dstUV.size(); },
+            {}
+        },
+        {
+            "Deinterleave",
+            [](BENCHMARK_BUFFERS& b) {
+                PlaneCopy::deinterleavePlane(b.dstU.data(), b.chromaWidth,
+                                             b.dstV.data(), b.chromaWidth,
+                                             b.srcUV.data(), b.srcUVPitch,
+                                             b.chromaWidth, b.chromaHeight);
+            },
+            [](const BENCHMARK_BUFFERS& b) { return b.dstU.size() + b.dstV.size(); },
+            {}
+        },
+        {
+            "Narrow P010",
+            [](BENCHMARK_BUFFERS& b) {
+                PlaneCopy::narrowPlane(b.dstY.data(), b.width,
+                                       (const uint16_t*)b.srcP010.data(), b.srcP010Pitch,
+                                       b.width, b.height);
+            },
+            [](const BENCHMARK_BUFFERS& b) { return b.dstY.size(); },
+            {}
+        },
+        {
+            "Dither 10bit",
+            [](BENCHMARK_BUFFERS& b) {
+                PlaneCopy::ditherPlane(b.dstY.data(), b.width,
+                                       (const uint16_t*)b.srcP010.data(), b.srcP010Pitch,
+                                       b.width, b.height, 2);
+            },
+            [](const BENCHMARK_BUFFERS& b) { return b.dstY.size(); },
+            {}
+        },
+        {
+            "Tone map",
+            toneMapMain10Frame,
+            [](const BENCHMARK_BUFFERS& b) { return b.dstY.size() + b.dstU.size() + b.dstV.size(); },
+            {}
+        },
+    };
+
+    // The plain memcpy baselines for a plane copy
+    std::vector<BENCHMARK_TEST> baselines = {
+        {
+            "memcpy per row",
+            [](BENCHMARK_BUFFERS& b) {
+                for (int y = 0; y < b.height; y++) {
+                    memcpy(b.dstY.data() + y * b.width, b.srcY.data() + y * b.srcYPitch, b.width);
+                }
+            },
+            [](const BENCHMARK_BUFFERS& b) { return b.dstY.size(); },
+            {}
+        },
+        {
+            "memcpy whole plane",
+            [](BENCHMARK_BUFFERS& b) {
+                // Ignores the pitch, so this is only a bound
+                memcpy(b.dstY.data(), b.srcY.data(), b.dstY.size());
+            },
+            [](const BENCHMARK_BUFFERS& b) { return b.dstY.size(); },
+            {}
+        },
+    };
+
+    // Choose the default kernels before printing anything
+    int originalKernel = PlaneCopy::getSelectedKernel();
+
+    fprintf(stdout,
+            "\nPlane copy benchmark: %dx%d, %d iterations (GB/s written)\n\n",
+            width, height, iterations);
+
+    fprintf(stdout, "  %-20s", "Kernel");
+    for (const BENCHMARK_TEST& test : tests) {
+        fprintf(stdout, " %12s", test.name);
+    }
+    fprintf(stdout, "\n");
+
+    bool mismatch = false;
+
+    for (int i = 0; i < PlaneCopy::getKernelCount(); i++) {
+        fprintf(stdout, "  %-20s", PlaneCopy::getKernelName(i));
+
+        if (!PlaneCopy::isKernelSupported(i)) {
+            fprintf(stdout, " unsupported by this CPU\n");
+            continue;
+        }
+
+        PlaneCopy::selectKernel(i);
+
+        for (BENCHMARK_TEST& test : tests) {
+            clearOutput(buffers);
+            double rate = timeTest(test, buffers, iterations);
+
+            // The first kernel set is the scalar reference
+            std::vector<uint8_t> output = getOutput(buffers);
+            if (test.reference.empty()) {
+                test.reference = output;
+            }
+
+            if (output != test.reference) {
+                fprintf(stdout, " %12s", "MISMATCH");
+                mismatch = true;
+            }
+            else {
+                fprintf(stdout, " %12.2f", rate);
+            }
+        }
+
+        fprintf(stdout, "\n");
+    }
+
+    PlaneCopy::selectKernel(originalKernel);
+
+    for (BENCHMARK_TEST& baseline : baselines) {
+        clearOutput(buffers);
+        fprintf(stdout, "  %-20s %12.2f\n",
+                baseline.name,
+                timeTest(baseline, buffers, iterations));
+    }
+
+    fprintf(stdout, "\nDefault kernels: %s\n", PlaneCopy::getKernelName(originalKernel));
+
+    // Software HEVC Main10 needs this on top of decoding every frame
+    double frameTimeUs = timeMain10Frame(buffers, iterations, false);
+    double toneMappedFrameTimeUs = timeMain10Frame(buffers, iterations, true);
+    fprintf(stdout,
+            "Main10 frame conversion: %.2f ms (%.0f FPS), %.2f ms (%.0f FPS) with tone mapping\n",
+            frameTimeUs / 1000,
+            1000000 / SDL_max(frameTimeUs, 1.0),
+            toneMappedFrameTimeUs / 1000,
+            1000000 / SDL_max(toneMappedFrameTimeUs, 1.0));
+
+    return mismatch ? 1 : 0;
+}
+
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+namespace CliBenchmarkCopy
+{
+
+// Times each plane copy kernel set against plain memcpy on frames of
+// the given size and prints the results. Returns the process exit code.
+int run(int width, int height, int iterations);
+
+}
@@ -0,0 +1,305 @@
+#include "benchmarkdecode.h"
+#include "streaming/streamutils.h"
+#include "streaming/tracer.h"
+#include "streaming/video/decodecapture.h"
+#include "streaming/video/ffmpeg.h"
+#include "streaming/video/ffmpeg-renderers/glvid.h"
+#include "streaming/video/ffmpeg-renderers/null.h"
+
+#include <Limelight.h>
+#include <SDL.h>
+
+#include <QVector>
+
+// How long to wait for the last frames to come out of the decoder
+#define DRAIN_TIMEOUT_US (2 * 1000 * 1000)
+
+namespace CliBenchmarkDecode
+{
+
+typedef struct _BENCHMARK_RESULT {
+    QString backend;
+    QString decoderName;
+    bool initialized;
+    uint32_t submittedFrames;
+    uint64_t elapsedUs;
+    VIDEO_STATS stats;
+} BENCHMARK_RESULT, *PBENCHMARK_RESULT;
+
+static void pumpEvents(FFmpegVideoDecoder* decoder)
+{
+    SDL_Event event;
+
+    while (SDL_PollEvent(&event)) {
+        // Renderers that can't render off the main thread
+        // ask us to do it for them.
+        if (event.type == SDL_USEREVENT && event.user.code == SDL_CODE_FRAME_READY) {
+            decoder->renderFrameOnMainThread();
+        }
+    }
+}
+
+static void setEnv(const char* name, const QByteArray& value)
+{
+    if (value.isNull()) {
+        qunsetenv(name);
+    }
+    else {
+        qputenv(name, value);
+    }
+}
+
+static void runBackend(DecodeCaptureReader& reader, bool realtime, BENCHMARK_RESULT& result)
+{
+    DECODER_PARAMETERS params;
+
+    SDL_zero(params);
+    params.videoFormat = reader.getVideoFormat();
+    params.width = reader.getWidth();
+    params.height = reader.getHeight();
+    params.frameRate = reader.getFrameRate();
+
+    if (result.backend == "software") {
+        params.vds = StreamingPreferences::VDS_FORCE_SOFTWARE;
+    }
+    else {
+        params.vds = StreamingPreferences::VDS_FORCE_HARDWARE;
+        if (result.backend != "hardware") {
+            qputenv("HWACCEL_HINT", result.backend.toUtf8());
+        }
+    }
+
+    // The null renderer doesn't need a window, so we can run without a display
+    if (!NullRenderer::isRequested()) {
+        params.window = SDL_CreateWindow("Moonlight Decode Benchmark",
+                                         SDL_WINDOWPOS_UNDEFINED,
+                                         SDL_WINDOWPOS_UNDEFINED,
+                                         params.width,
+                                         params.height,
+                                         SDL_WINDOW_HIDDEN | SDL_WINDOW_ALLOW_HIGHDPI |
+                                             (GLRenderer::isRequested() ? SDL_WINDOW_OPENGL : 0));
+        if (params.window == nullptr) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                         "SDL_CreateWindow() failed: %s",
+                         SDL_GetError());
+            return;
+        }
+    }
+
+    FFmpegVideoDecoder* decoder = new FFmpegVideoDecoder(false);
+    if (!decoder->initialize(&params)) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "No decoder available for backend: %s",
+                     qPrintable(result.backend));
+        delete decoder;
+        if (params.window != nullptr) {
+            SDL_DestroyWindow(params.window);
+        }
+        return;
+    }
+
+    // HWACCEL_HINT only filters hwaccels, so a hardware decoder
+    // that isn't one can still be picked in its place
+    if (result.backend != "software" && result.backend != "hardware" &&
+            decoder->getHwaccelName() != result.backend) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "Backend %s was requested, but %s was selected",
+                     qPrintable(result.backend),
+                     qPrintable(decoder->getDecoderName()));
+        delete decoder;
+        if (params.window != nullptr) {
+            SDL_DestroyWindow(params.window);
+        }
+        return;
+    }
+
+    result.initialized = true;
+    result.decoderName = decoder->getDecoderName();
+
+    DECODE_UNIT du;
+    uint64_t receiveTimeUs;
+    uint64_t firstReceiveTimeUs = 0;
+    uint64_t startTimeUs = StreamUtils::getMicroseconds();
+
+    reader.rewind();
+    while (reader.readDecodeUnit(du, receiveTimeUs)) {
+        if (result.submittedFrames == 0) {
+            firstReceiveTimeUs = receiveTimeUs;
+        }
+
+        if (realtime) {
+            // Wait until this frame arrived in the original stream
+            while (StreamUtils::getMicroseconds() - startTimeUs < receiveTimeUs - firstReceiveTimeUs) {
+                pumpEvents(decoder);
+                SDL_Delay(1);
+            }
+        }
+
+        // We can't get an IDR frame from a recording if this asks
+        // for one, so decoding will just continue with artifacts.
+        du.receiveTimeMs = LiGetMillis();
+        decoder->submitDecodeUnit(&du);
+
+        result.submittedFrames++;
+        pumpEvents(decoder);
+    }
+
+    // Wait for the decoder to finish with the frames we've given it.
+    // The clock stops when we see the last frame come out, so neither
+    // waiting here nor timing out counts as decoding time.
+    uint64_t submitEndTimeUs = StreamUtils::getMicroseconds();
+    uint64_t lastDecodeTimeUs = submitEndTimeUs;
+    uint32_t lastDecodedFrames = 0;
+    for (;;) {
+        decoder->getVideoStats(result.stats);
+
+        uint64_t now = StreamUtils::getMicroseconds();
+        if (result.stats.decodedFrames != lastDecodedFrames) {
+            lastDecodedFrames = result.stats.decodedFrames;
+            lastDecodeTimeUs = now;
+        }
+
+        if (result.stats.decodedFrames + result.stats.decodeQueueDroppedFrames +
+                result.stats.decodeErrors >= result.submittedFrames) {
+            break;
+        }
+        else if (now - submitEndTimeUs > DRAIN_TIMEOUT_US) {
+            SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                        "Timed out waiting for the decoder to finish");
+            break;
+        }
+
+        pumpEvents(decoder);
+        SDL_Delay(1);
+    }
+
+    result.elapsedUs = lastDecodeTimeUs - startTimeUs;
+
+    delete decoder;
+    if (params.window != nullptr) {
+        SDL_DestroyWindow(params.window);
+    }
+}
+
+static void printLatency(const char* name, const LatencyHistogram& histogram)
+{
+    if (histogram.count() == 0) {
+        return;
+    }
+
+    fprintf(stdout,
+            "  %-20s %8.2f %8.2f %8.2f %8.2f ms\n",
+            name,
+            histogram.percentileUs(50) / 1000.0f,
+            histogram.percentileUs(95) / 1000.0f,
+            histogram.percentileUs(99) / 1000.0f,
+            histogram.maxUs() / 1000.0f);
+}
+
+static void printResult(const BENCHMARK_RESULT& result)
+{
+    fprintf(stdout, "\n%s", qPrintable(result.backend));
+    if (!result.initialized) {
+        fprintf(stdout, ": unavailable\n");
+        return;
+    }
+
+    const VIDEO_STATS& stats = result.stats;
+    float elapsedSecs = result.elapsedUs / 1000000.0f;
+
+    fprintf(stdout, " [%s]\n", qPrintable(result.decoderName));
+    fprintf(stdout,
+            "  Frames: %u submitted, %u decoded, %u rendered in %.2f s\n"
+            "  Decode throughput: %.2f FPS\n"
+            "  Dropped frames: %u by decode queue, %u by pacer\n"
+            "  Decode errors: %u\n",
+            result.submittedFrames,
+            stats.decodedFrames,
+            stats.renderedFrames,
+            elapsedSecs,
+            elapsedSecs > 0 ? stats.decodedFrames / elapsedSecs : 0.0f,
+            stats.decodeQueueDroppedFrames,
+            stats.pacerDroppedFrames,
+            stats.decodeErrors);
+    fprintf(stdout, "  %-20s %8s %8s %8s %8s\n", "Latency", "p50", "p95", "p99", "max");
+    printLatency("Decode queue delay", stats.decodeQueueTime);
+    printLatency("Decoding time", stats.decodeTime);
+    printLatency("Frame queue delay", stats.pacerTime);
+    printLatency("Rendering time", stats.renderTime);
+}
+
+int run(const QString& fileName, const QStringList& backends, bool realtime)
+{
+    DecodeCaptureReader reader;
+    if (!reader.open(fileName)) {
+        fprintf(stderr, "Unable to read decode capture: %s\n", qPrintable(fileName));
+        return 1;
+    }
+
+    bool headless = NullRenderer::isRequested();
+    if (!headless && SDL_InitSubSystem(SDL_INIT_VIDEO) != 0) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "SDL_InitSubSystem(SDL_INIT_VIDEO) failed: %s",
+                     SDL_GetError());
+        return 1;
+    }
+
+    Tracer::initialize();
+    Tracer::setThreadName("Main");
+
+    // Without a host to request IDR frames from, dropping frames when the
+    // decoder falls behind would corrupt the rest of the stream. Apply
+    // backpressure instead, unless we're trying to mimic a live stream.
+    QByteArray originalOverflow = qgetenv("DECODE_QUEUE_OVERFLOW");
+    if (!realtime) {
+        qputenv("DECODE_QUEUE_OVERFLOW", "block");
+    }
+
+    QByteArray originalHwaccelHint = qgetenv("HWACCEL_HINT");
+
+    QVector<BENCHMARK_RESULT> results;
+    for (const QString& backend : backends) {
+        BENCHMARK_RESULT result;
+
+        SDL_zero(result.stats);
+        result.backend = backend.toLower();
+        result.initialized = false;
+        result.submittedFrames = 0;
+        result.elapsedUs = 0;
+
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                    "Benchmarking backend: %s",
+                    qPrintable(result.backend));
+
+        runBackend(reader, realtime, result);
+        results.append(result);
+
+        setEnv("HWACCEL_HINT", originalHwaccelHint);
+    }
+
+    setEnv("DECODE_QUEUE_OVERFLOW", originalOverflow);
+
+    if (Tracer::isDumpOnExitEnabled()) {
+        Tracer::dump();
+    }
+
+    if (!headless) {
+        SDL_QuitSubSystem(SDL_INIT_VIDEO);
+    }
+
+    fprintf(stdout,
+            "\nDecode benchmark: %s (%dx%d, %d FPS, %s%s)\n",
+            qPrintable(fileName),
+            reader.getWidth(),
+            reader.getHeight(),
+            reader.getFrameRate(),
+            realtime ? "recorded pacing" : "maximum speed",
+            headless ? ", null renderer" : "");
+    for (const BENCHMARK_RESULT& result : results) {
+        printResult(result);
+    }
+
+    return 0;
+}
+
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <QString>
+#include <QStringList>
+
+namespace CliBenchmarkDecode
+{
+
+// Replays a decode capture through each backend in turn and prints
+// the results. Returns the process exit code.
+int run(const QString& fileName, const QStringList& backends, bool realtime);
+
+}
@@ -0,0 +1,275 @@
+#include "benchmarkpacer.h"
+#include "streaming/streamutils.h"
+#include "streaming/video/ffmpeg-renderers/null.h"
+#include "streaming/video/ffmpeg-renderers/pacer/pacer.h"
+#include "streaming/video/ffmpeg-renderers/pacer/rendercostmodel.h"
+#include "streaming/video/ffmpeg-renderers/pacer/vsyncpredictor.h"
+
+#include <SDL.h>
+
+#include <stdio.h>
+
+// Time for the render thread to finish the last frames before we stop it
+#define DRAIN_TIME_MS 100
+
+// The simulated display runs at the NTSC-style rate 1000/1001 below
+// the advertised one, like 59.94 Hz for 60 Hz
+#define SIM_DISPLAY_RATE_SCALE (1000.0 / 1001.0)
+
+// Presents land up to this long after V-blank
+#define SIM_PRESENT_JITTER_US 300
+
+// Percent of frames that miss a V-blank and present on the next one,
+// and percent that are late by up to half a period for other reasons
+#define SIM_MISSED_VSYNC_PERCENT 20
+#define SIM_LATE_PRESENT_PERCENT 5
+
+// Simulated renders take the base cost plus up to the jitter, and some
+// percent take up to another quarter period, like on a shader compile
+#define SIM_RENDER_COST_US 1000
+#define SIM_RENDER_JITTER_US 1000
+#define SIM_RENDER_SPIKE_PERCENT 2
+
+// Like Pacer's starting render cost and wake-up margin for
+// just-in-time rendering
+#define SIM_INITIAL_RENDER_COST_US 2000
+#define SIM_WAKEUP_MARGIN_US 1000
+
+namespace CliBenchmarkPacer
+{
+
+static void printLatency(const char* name, const LatencyHistogram& histogram)
+{
+    if (histogram.count() == 0) {
+        return;
+    }
+
+    fprintf(stdout,
+            "  %-20s %8u %8u %8u %8u %8.1f us\n",
+            name,
+            histogram.percentileUs(50),
+            histogram.percentileUs(95),
+            histogram.percentileUs(99),
+            histogram.maxUs(),
+            histogram.meanUs());
+}
+
+// Sleeps most of the way and spins the rest, since
+// SDL_Delay() is far too coarse at high frame rates
+static void waitUntil(uint64_t timeUs)
+{
+    uint64_t now = StreamUtils::getMicroseconds();
+    if (timeUs > now + 2000) {
+        SDL_Delay((Uint32)((timeUs - now) / 1000) - 1);
+    }
+
+    while (StreamUtils::getMicroseconds() < timeUs);
+}
+
+int run(int frames, int fps)
+{
+    VIDEO_STATS stats;
+    LatencyHistogram submitTime;
+
+    if (frames <= 0 || fps <= 0) {
+        fprintf(stderr, "Invalid benchmark parameters\n");
+        return 1;
+    }
+
+    SDL_zero(stats);
+    SDL_zero(submitTime);
+
+    NullRenderer renderer;
+    Pacer* pacer = new Pacer(&renderer, nullptr);
+
+    // Without a window, there's no V-sync source to pace against,
+    // so this measures the handoff straight to the render thread.
+    if (!pacer->initialize(nullptr, fps, false, StreamingPreferences::PB_FIXED)) {
+        fprintf(stderr, "Unable to initialize Pacer\n");
+        delete pacer;
+        return 1;
+    }
+
+    uint64_t frameIntervalUs = 1000000 / fps;
+    uint64_t startTimeUs = StreamUtils::getMicroseconds();
+
+    for (int i = 0; i < frames; i++) {
+        waitUntil(startTimeUs + i * frameIntervalUs);
+
+        AVFrame* frame = av_frame_alloc();
+        if (frame == nullptr) {
+            fprintf(stderr, "Unable to allocate frame\n");
+            break;
+        }
+
+        frame->opaque = (void*)(intptr_t)i;
+
+        // Pacer measures its queue delay from here
+        uint64_t beforeSubmit = StreamUtils::getMicroseconds();
+        frame->pkt_dts = beforeSubmit;
+        pacer->submitFrame(frame);
+        submitTime.add((uint32_t)(StreamUtils::getMicroseconds() - beforeSubmit));
+    }
+
+    SDL_Delay(DRAIN_TIME_MS);
+
+    pacer->collectVideoStats(stats);
+    delete pacer;
+
+    fprintf(stdout,
+            "\nPacer benchmark: %d frames at %d FPS\n\n"
+            "  Frames: %d submitted, %u rendered, %u dropped by pacer\n\n",
+            frames, fps,
+            frames,
+            stats.renderedFrames,
+            stats.pacerDroppedFrames);
+    fprintf(stdout, "  %-20s %8s %8s %8s %8s %8s\n", "Latency", "p50", "p95", "p99", "max", "mean");
+    printLatency("submitFrame()", submitTime);
+    printLatency("Render handoff", stats.pacerTime);
+
+    return 0;
+}
+
+// Small deterministic generator, so simulations are repeatable
+static uint32_t nextRandom(uint32_t& state)
+{
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+// Renders just in time for each V-blank like Pacer does, starting as late
+// as the learned render cost allows, and prints how often that misses
+static void simulateRender(const char* name, bool waitsForVsync, int frames,
+                           double periodUs, uint32_t& randomState)
+{
+    LatencyHistogram lead;
+    int missedVsyncs = 0;
+    int vblank = 0;
+    uint64_t lastEndUs = 0;
+
+    SDL_zero(lead);
+
+    RenderCostModel renderCost(SIM_INITIAL_RENDER_COST_US, waitsForVsync);
+
+    for (int i = 0; i < frames; i++) {
+        // Render for the first V-blank after the last render is done,
+        // since that's when the render thread looks for the next one
+        do {
+            vblank++;
+        } while (1000000.0 + vblank * periodUs <= lastEndUs);
+
+        uint64_t vsyncUs = (uint64_t)(1000000.0 + vblank * periodUs);
+        uint32_t budgetUs = renderCost.getEstimateUs() + SIM_WAKEUP_MARGIN_US;
+
+        // Start no earlier than the last render is done
+        uint64_t startUs = budgetUs < vsyncUs - lastEndUs ? vsyncUs - budgetUs : lastEndUs;
+
+        uint32_t costUs = SIM_RENDER_COST_US + nextRandom(randomState) % SIM_RENDER_JITTER_US;
+        if (nextRandom(randomState) % 100 < SIM_RENDER_SPIKE_PERCENT) {
+            costUs += nextRandom(randomState) % (uint32_t)(periodUs / 4);
+        }
+
+        uint64_t endUs = startUs + costUs;
+        if (waitsForVsync) {
+            // Presenting returns a little after the first V-blank
+            // after the render
+            double presentVblankUs = vsyncUs;
+            while (presentVblankUs < endUs) {
+                presentVblankUs += periodUs;
+            }
+            endUs = (uint64_t)presentVblankUs + nextRandom(randomState) % SIM_PRESENT_JITTER_US;
+        }
+
+        if (!renderCost.addRender(startUs, endUs, vsyncUs, (uint32_t)periodUs)) {
+            missedVsyncs++;
+        }
+
+        lead.add((uint32_t)(vsyncUs - startUs));
+        lastEndUs = endUs;
+    }
+
+    fprintf(stdout,
+            "  %-20s %8u %8u %8u %8u %8.1f us, %d missed V-syncs\n",
+            name,
+            lead.percentileUs(50),
+            lead.percentileUs(95),
+            lead.percentileUs(99),
+            lead.maxUs(),
+            lead.meanUs(),
+            missedVsyncs);
+}
+
+int simulate(int frames, int fps)
+{
+    LatencyHistogram predictionError;
+    uint32_t randomState = 1;
+    int lockedPresents = -1;
+
+    if (frames <= 0 || fps <= 0) {
+        fprintf(stderr, "Invalid simulation parameters\n");
+        return 1;
+    }
+
+    SDL_zero(predictionError);
+
+    // All times are on a virtual clock, starting at an arbitrary phase
+    double periodUs = 1000000.0 / (fps * SIM_DISPLAY_RATE_SCALE);
+    double firstVblankUs = 1000000.0 + periodUs / 3;
+    int vblank = 0;
+
+    VsyncPredictor predictor(fps);
+
+    for (int i = 0; i < frames; i++) {
+        if (nextRandom(randomState) % 100 < SIM_MISSED_VSYNC_PERCENT) {
+            vblank++;
+        }
+        vblank++;
+
+        double vblankUs = firstVblankUs + vblank * periodUs;
+
+        // Predict this V-blank from half a period before it, like the
+        // timer V-sync source does before sleeping until it
+        if (predictor.isLocked()) {
+            double predictedUs = (double)predictor.getNextVsync((uint64_t)(vblankUs - periodUs / 2));
+            predictionError.add((uint32_t)SDL_fabs(predictedUs - vblankUs));
+        }
+
+        double presentUs = vblankUs + nextRandom(randomState) % SIM_PRESENT_JITTER_US;
+        if (nextRandom(randomState) % 100 < SIM_LATE_PRESENT_PERCENT) {
+            presentUs += nextRandom(randomState) % (uint32_t)(periodUs / 2);
+        }
+
+        predictor.addTimestamp((uint64_t)presentUs);
+
+        if (lockedPresents < 0 && predictor.isLocked()) {
+            lockedPresents = i + 1;
+        }
+    }
+
+    fprintf(stdout,
+            "\nV-sync prediction: %d presents to a %.3f Hz display advertised as %d Hz\n"
+            "with %d us of present jitter, %d%% missed V-syncs and %d%% late presents\n\n"
+            "  Locked after %d presents, at %.3f Hz\n\n",
+            frames, 1000000.0 / periodUs, fps,
+            SIM_PRESENT_JITTER_US, SIM_MISSED_VSYNC_PERCENT, SIM_LATE_PRESENT_PERCENT,
+            lockedPresents,
+            1000000.0 / predictor.getPeriodUs());
+    fprintf(stdout, "  %-20s %8s %8s %8s %8s %8s\n", "Error", "p50", "p95", "p99", "max", "mean");
+    printLatency("Predicted V-sync", predictionError);
+
+    fprintf(stdout,
+            "\nJust-in-time rendering: %d renders of %d-%d us, with %d%% up to a\n"
+            "quarter period longer\n\n",
+            frames,
+            SIM_RENDER_COST_US, SIM_RENDER_COST_US + SIM_RENDER_JITTER_US,
+            SIM_RENDER_SPIKE_PERCENT);
+    fprintf(stdout, "  %-20s %8s %8s %8s %8s %8s\n", "Start before V-sync", "p50", "p95", "p99", "max", "mean");
+    simulateRender("Presents at once", false, frames, periodUs, randomState);
+    simulateRender("Waits for V-sync", true, frames, periodUs, randomState);
+
+    return 0;
+}
+
+}
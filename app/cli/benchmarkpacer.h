@@ -0,0 +1,16 @@
+#pragma once
+
+namespace CliBenchmarkPacer
+{
+
+// Submits empty frames to Pacer at the given rate and prints how long
+// they took to reach the render thread. Returns the process exit code.
+int run(int frames, int fps);
+
+// Feeds V-sync prediction and just-in-time rendering simulated presents
+// and renders on a virtual clock, and prints how far predictions land
+// from the simulated V-blanks and how many V-syncs renders miss.
+// Returns the process exit code.
+int simulate(int frames, int fps);
+
+}
@@ -166,6 +166,9 @@ GlobalCommandLineParser::ParseResult GlobalCommandLineParser::parse(const QStrin
         "Available actions:\n"
         "  quit            Quit the currently running app\n"
         "  stream          Start streaming an app\n"
+        "  benchmark-decode Replay a decode capture file\n"
+        "  benchmark-copy  Time the frame plane copy routines\n"
+        "  benchmark-pacer Time frame handoffs to the render thread\n"
         "\n"
         "See 'moonlight <action> --help' for help of specific action."
     );
@@ -193,6 +196,12 @@ GlobalCommandLineParser::ParseResult GlobalCommandLineParser::parse(const QStrin
                 return QuitRequested;
             } else if (action == "stream") {
                 return StreamRequested;
+            } else if (action == "benchmark-decode") {
+                return BenchmarkDecodeRequested;
+            } else if (action == "benchmark-copy") {
+                return BenchmarkCopyRequested;
+            } else if (action == "benchmark-pacer") {
+                return BenchmarkPacerRequested;
             }
         }
 
@@ -242,6 +251,218 @@ QString QuitCommandLineParser::getHost() const
     return m_Host;
 }
 
+BenchmarkDecodeCommandLineParser::BenchmarkDecodeCommandLineParser()
+    : m_Realtime(false),
+      m_NullRenderer(false)
+{
+}
+
+BenchmarkDecodeCommandLineParser::~BenchmarkDecodeCommandLineParser()
+{
+}
+
+void BenchmarkDecodeCommandLineParser::parse(const QStringList &args)
+{
+    CommandLineParser parser;
+    parser.setupCommonOptions();
+    parser.setApplicationDescription(
+        "\n"
+        "Decodes a capture file recorded with DECODE_CAPTURE=1 using each\n"
+        "backend in turn and reports decoding performance.\n"
+        "\n"
+        "To run without a display, use --null-renderer and set\n"
+        "QT_QPA_PLATFORM=offscreen."
+    );
+    parser.addPositionalArgument("benchmark-decode", "benchmark decoders");
+    parser.addPositionalArgument("file", "Decode capture file", "<file>");
+
+    parser.addOption(QCommandLineOption("backend",
+                                        "Backend to benchmark: software, hardware, or a hwaccel "
+                                        "type such as vaapi, vdpau, cuda, or dxva2. "
+                                        "May be given more than once. Defaults to software and hardware.",
+                                        "backend"));
+    parser.addFlagOption("realtime", "the recorded frame timing instead of decoding as fast as possible");
+    parser.addFlagOption("null-renderer", "a renderer that discards frames, so no display is required");
+
+    if (!parser.parse(args)) {
+        parser.showError(parser.errorText());
+    }
+
+    parser.handleUnknownOptions();
+
+    // This method will not return and terminates the process if --version or
+    // --help is specified
+    parser.handleHelpAndVersionOptions();
+
+    m_Backends = parser.values("backend");
+    if (m_Backends.isEmpty()) {
+        m_Backends << "software" << "hardware";
+    }
+
+    m_Realtime = parser.isSet("realtime");
+    m_NullRenderer = parser.isSet("null-renderer");
+
+    // Verify that the file has been provided
+    auto posArgs = parser.positionalArguments();
+    if (posArgs.length() < 2) {
+        parser.showError("File not provided");
+    }
+    m_FileName = parser.positionalArguments().at(1);
+}
+
+QString BenchmarkDecodeCommandLineParser::getFileName() const
+{
+    return m_FileName;
+}
+
+QStringList BenchmarkDecodeCommandLineParser::getBackends() const
+{
+    return m_Backends;
+}
+
+bool BenchmarkDecodeCommandLineParser::isRealtime() const
+{
+    return m_Realtime;
+}
+
+bool BenchmarkDecodeCommandLineParser::isNullRendererRequested() const
+{
+    return m_NullRenderer;
+}
+
+BenchmarkCopyCommandLineParser::BenchmarkCopyCommandLineParser()
+    : m_Width(1920),
+      m_Height(1080),
+      m_Iterations(200)
+{
+}
+
+BenchmarkCopyCommandLineParser::~BenchmarkCopyCommandLineParser()
+{
+}
+
+void BenchmarkCopyCommandLineParser::parse(const QStringList &args)
+{
+    CommandLineParser parser;
+    parser.setupCommonOptions();
+    parser.setApplicationDescription(
+        "\n"
+        "Times each set of plane copy kernels this CPU supports against\n"
+        "memcpy() and checks that they all produce the same output."
+    );
+    parser.addPositionalArgument("benchmark-copy", "benchmark plane copies");
+
+    parser.addValueOption("resolution", "custom <width>x<height> frame resolution");
+    parser.addValueOption("iterations", "number of copies to time");
+
+    if (!parser.parse(args)) {
+        parser.showError(parser.errorText());
+    }
+
+    parser.handleUnknownOptions();
+
+    // This method will not return and terminates the process if --version or
+    // --help is specified
+    parser.handleHelpAndVersionOptions();
+
+    if (parser.isSet("resolution")) {
+        auto resolution = parser.getResolutionOptionValue("resolution");
+        m_Width = resolution.first;
+        m_Height = resolution.second;
+    }
+
+    if (parser.isSet("iterations")) {
+        m_Iterations = parser.getIntOption("iterations");
+    }
+
+    if (m_Width <= 0 || m_Height <= 0 || m_Iterations <= 0) {
+        parser.showError("Width, height, and iterations must be positive");
+    }
+}
+
+int BenchmarkCopyCommandLineParser::getWidth() const
+{
+    return m_Width;
+}
+
+int BenchmarkCopyCommandLineParser::getHeight() const
+{
+    return m_Height;
+}
+
+int BenchmarkCopyCommandLineParser::getIterations() const
+{
+    return m_Iterations;
+}
+
+BenchmarkPacerCommandLineParser::BenchmarkPacerCommandLineParser()
+    : m_Frames(6000),
+      m_Fps(120),
+      m_Simulate(false)
+{
+}
+
+BenchmarkPacerCommandLineParser::~BenchmarkPacerCommandLineParser()
+{
+}
+
+void BenchmarkPacerCommandLineParser::parse(const QStringList &args)
+{
+    CommandLineParser parser;
+    parser.setupCommonOptions();
+    parser.setApplicationDescription(
+        "\n"
+        "Submits empty frames to the frame pacer like a decoder would and\n"
+        "measures how long they take to reach the render thread. With\n"
+        "--simulate, runs the pacer's timing models against a simulated\n"
+        "display instead, which is repeatable and needs no display."
+    );
+    parser.addPositionalArgument("benchmark-pacer", "benchmark frame pacer");
+
+    parser.addValueOption("frames", "number of frames to submit");
+    parser.addValueOption("fps", "rate to submit frames at");
+    parser.addFlagOption("simulate", "a simulated display on a virtual clock");
+
+    if (!parser.parse(args)) {
+        parser.showError(parser.errorText());
+    }
+
+    parser.handleUnknownOptions();
+
+    // This method will not return and terminates the process if --version or
+    // --help is specified
+    parser.handleHelpAndVersionOptions();
+
+    if (parser.isSet("frames")) {
+        m_Frames = parser.getIntOption("frames");
+    }
+
+    if (parser.isSet("fps")) {
+        m_Fps = parser.getIntOption("fps");
+    }
+
+    m_Simulate = parser.isSet("simulate");
+
+    if (m_Frames <= 0 || m_Fps <= 0) {
+        parser.showError("Frames and FPS must be positive");
+    }
+}
+
+int BenchmarkPacerCommandLineParser::getFrames() const
+{
+    return m_Frames;
+}
+
+int BenchmarkPacerCommandLineParser::getFps() const
+{
+    return m_Fps;
+}
+
+bool BenchmarkPacerCommandLineParser::isSimulationRequested() const
+{
+    return m_Simulate;
+}
+
 StreamCommandLineParser::StreamCommandLineParser()
 {
     m_WindowModeMap = {
@@ -264,6 +485,11 @@ StreamCommandLineParser::StreamCommandLineParser()
         {"software", StreamingPreferences::VDS_FORCE_HARDWARE},
         {"hardware", StreamingPreferences::VDS_FORCE_SOFTWARE},
     };
+    m_PacingBufferMap = {
+        {"fixed",          StreamingPreferences::PB_FIXED},
+        {"lowest-latency", StreamingPreferences::PB_LOWEST_LATENCY},
+        {"smoothest",      StreamingPreferences::PB_SMOOTHEST},
+    };
 }
 
 StreamCommandLineParser::~StreamCommandLineParser()
@@ -302,6 +528,7 @@ void StreamCommandLineParser::parse(const QStringList &args, StreamingPreference
     parser.addToggleOption("game-optimization", "game optimizations");
     parser.addToggleOption("audio-on-host", "audio on host PC");
     parser.addToggleOption("frame-pacing", "frame pacing");
+    parser.addChoiceOption("pacing-buffer", "frame pacing buffer", m_PacingBufferMap.keys());
     parser.addChoiceOption("video-codec", "video codec", m_VideoCodecMap.keys());
     parser.addChoiceOption("video-decoder", "video decoder", m_VideoDecoderMap.keys());
 
@@ -401,6 +628,11 @@ void StreamCommandLineParser::parse(const QStringList &args, StreamingPreference
     // Resolve --frame-pacing and --no-frame-pacing options
     preferences->framePacing = parser.getToggleOptionValue("frame-pacing", preferences->framePacing);
 
+    // Resolve --pacing-buffer option
+    if (parser.isSet("pacing-buffer")) {
+        preferences->pacingBuffer = mapValue(m_PacingBufferMap, parser.getChoiceOptionValue("pacing-buffer"));
+    }
+
     // Resolve --video-codec option
     if (parser.isSet("video-codec")) {
         preferences->videoCodecConfig = mapValue(m_VideoCodecMap, parser.getChoiceOptionValue("video-codec"));
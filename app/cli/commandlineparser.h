@@ -12,6 +12,9 @@ public:
         NormalStartRequested,
         StreamRequested,
         QuitRequested,
+        BenchmarkDecodeRequested,
+        BenchmarkCopyRequested,
+        BenchmarkPacerRequested,
     };
 
     GlobalCommandLineParser();
@@ -35,6 +38,62 @@ private:
     QString m_Host;
 };
 
+class BenchmarkDecodeCommandLineParser
+{
+public:
+    BenchmarkDecodeCommandLineParser();
+    virtual ~BenchmarkDecodeCommandLineParser();
+
+    void parse(const QStringList &args);
+
+    QString getFileName() const;
+    QStringList getBackends() const;
+    bool isRealtime() const;
+    bool isNullRendererRequested() const;
+
+private:
+    QString m_FileName;
+    QStringList m_Backends;
+    bool m_Realtime;
+    bool m_NullRenderer;
+};
+
+class BenchmarkCopyCommandLineParser
+{
+public:
+    BenchmarkCopyCommandLineParser();
+    virtual ~BenchmarkCopyCommandLineParser();
+
+    void parse(const QStringList &args);
+
+    int getWidth() const;
+    int getHeight() const;
+    int getIterations() const;
+
+private:
+    int m_Width;
+    int m_Height;
+    int m_Iterations;
+};
+
+class BenchmarkPacerCommandLineParser
+{
+public:
+    BenchmarkPacerCommandLineParser();
+    virtual ~BenchmarkPacerCommandLineParser();
+
+    void parse(const QStringList &args);
+
+    int getFrames() const;
+    int getFps() const;
+    bool isSimulationRequested() const;
+
+private:
+    int m_Frames;
+    int m_Fps;
+    bool m_Simulate;
+};
+
 class StreamCommandLineParser
 {
 public:
@@ -53,4 +112,5 @@ private:
     QMap<QString, StreamingPreferences::AudioConfig> m_AudioConfigMap;
     QMap<QString, StreamingPreferences::VideoCodecConfig> m_VideoCodecMap;
     QMap<QString, StreamingPreferences::VideoDecoderSelection> m_VideoDecoderMap;
+    QMap<QString, StreamingPreferences::PacingBuffer> m_PacingBufferMap;
 };
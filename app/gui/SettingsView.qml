@@ -430,6 +430,51 @@ Flickable {
                     ToolTip.visible: hovered
                     ToolTip.text: "Frame pacing reduces micro-stutter by delaying frames that come in too early"
                 }
+
+                AutoResizingComboBox {
+                    // ignore setting the index at first, and actually set it when the component is loaded
+                    Component.onCompleted: {
+                        var savedPb = StreamingPreferences.pacingBuffer
+                        currentIndex = 0
+                        for (var i = 0; i < pacingBufferListModel.count; i++) {
+                            var thisPb = pacingBufferListModel.get(i).val;
+                            if (savedPb === thisPb) {
+                                currentIndex = i
+                                break
+                            }
+                        }
+                        activated(currentIndex)
+                    }
+
+                    id: pacingBufferComboBox
+                    enabled: framePacingCheck.checked
+                    hoverEnabled: true
+                    textRole: "text"
+                    model: ListModel {
+                        id: pacingBufferListModel
+                        ListElement {
+                            text: "Fixed frame queue"
+                            val: StreamingPreferences.PB_FIXED
+                        }
+                        ListElement {
+                            text: "Adaptive: lowest latency"
+                            val: StreamingPreferences.PB_LOWEST_LATENCY
+                        }
+                        ListElement {
+                            text: "Adaptive: smoothest"
+                            val: StreamingPreferences.PB_SMOOTHEST
+                        }
+                    }
+                    // ::onActivated must be used, as it only listens for when the index is changed by a human
+                    onActivated : {
+                        StreamingPreferences.pacingBuffer = pacingBufferListModel.get(currentIndex).val
+                    }
+
+                    ToolTip.delay: 1000
+                    ToolTip.timeout: 5000
+                    ToolTip.visible: hovered
+                    ToolTip.text: "Adaptive modes queue more frames on networks that deliver them unevenly, like Wi-Fi. Smoothest queues more of them to drop fewer frames, at the cost of latency."
+                }
             }
         }
 
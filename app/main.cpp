@@ -20,6 +20,8 @@
 
 #ifdef HAVE_FFMPEG
 #include "streaming/video/ffmpeg.h"
+#include "cli/benchmarkdecode.h"
+#include "cli/benchmarkpacer.h"
 #endif
 
 #if defined(Q_OS_WIN32)
@@ -30,6 +32,7 @@
 
 #include "cli/quitstream.h"
 #include "cli/startstream.h"
+#include "cli/benchmarkcopy.h"
 #include "cli/commandlineparser.h"
 #include "path.h"
 #include "utils.h"
@@ -543,6 +546,46 @@ int main(int argc, char *argv[])
             engine.rootContext()->setContextProperty("launcher", launcher);
             break;
         }
+    case GlobalCommandLineParser::BenchmarkDecodeRequested:
+        {
+            BenchmarkDecodeCommandLineParser benchmarkParser;
+            benchmarkParser.parse(app.arguments());
+#ifdef HAVE_FFMPEG
+            if (benchmarkParser.isNullRendererRequested() && qgetenv("NULL_RENDERER").isEmpty()) {
+                qputenv("NULL_RENDERER", "1");
+            }
+            return CliBenchmarkDecode::run(benchmarkParser.getFileName(),
+                                           benchmarkParser.getBackends(),
+                                           benchmarkParser.isRealtime());
+#else
+            fprintf(stderr, "Decode benchmarking requires FFmpeg\n");
+            return 1;
+#endif
+        }
+    case GlobalCommandLineParser::BenchmarkCopyRequested:
+        {
+            BenchmarkCopyCommandLineParser benchmarkParser;
+            benchmarkParser.parse(app.arguments());
+            return CliBenchmarkCopy::run(benchmarkParser.getWidth(),
+                                         benchmarkParser.getHeight(),
+                                         benchmarkParser.getIterations());
+        }
+    case GlobalCommandLineParser::BenchmarkPacerRequested:
+        {
+            BenchmarkPacerCommandLineParser benchmarkParser;
+            benchmarkParser.parse(app.arguments());
+#ifdef HAVE_FFMPEG
+            if (benchmarkParser.isSimulationRequested()) {
+                return CliBenchmarkPacer::simulate(benchmarkParser.getFrames(),
+                                                   benchmarkParser.getFps());
+            }
+            return CliBenchmarkPacer::run(benchmarkParser.getFrames(),
+                                          benchmarkParser.getFps());
+#else
+            fprintf(stderr, "Pacer benchmarking requires FFmpeg\n");
+            return 1;
+#endif
+        }
     }
 
     engine.rootContext()->setContextProperty("initialView", initialView);
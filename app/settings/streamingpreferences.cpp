@@ -23,6 +23,7 @@
 #define SER_ABSTOUCHMODE "abstouchmode"
 #define SER_STARTWINDOWED "startwindowed"
 #define SER_FRAMEPACING "framepacing"
+#define SER_PACINGBUFFER "pacingbuffer"
 #define SER_CONNWARNINGS "connwarnings"
 #define SER_RICHPRESENCE "richpresence"
 #define SER_GAMEPADMOUSE "gamepadmouse"
@@ -78,6 +79,8 @@ void StreamingPreferences::reload()
                                                         // Try to load from the old preference value too
                                                         static_cast<int>(settings.value(SER_FULLSCREEN, true).toBool() ?
                                                                              recommendedFullScreenMode : WindowMode::WM_WINDOWED)).toInt());
+    pacingBuffer = static_cast<PacingBuffer>(settings.value(SER_PACINGBUFFER,
+                                                  static_cast<int>(PacingBuffer::PB_FIXED)).toInt());
 
     // Perform default settings updates as required based on last default version
     if (defaultVer == 0) {
@@ -117,6 +120,7 @@ void StreamingPreferences::save()
     settings.setValue(SER_VIDEOCFG, static_cast<int>(videoCodecConfig));
     settings.setValue(SER_VIDEODEC, static_cast<int>(videoDecoderSelection));
     settings.setValue(SER_WINDOWMODE, static_cast<int>(windowMode));
+    settings.setValue(SER_PACINGBUFFER, static_cast<int>(pacingBuffer));
     settings.setValue(SER_DEFAULTVER, CURRENT_DEFAULT_VER);
 }
 
@@ -50,6 +50,14 @@ public:
     };
     Q_ENUM(WindowMode)
 
+    enum PacingBuffer
+    {
+        PB_FIXED,
+        PB_LOWEST_LATENCY,
+        PB_SMOOTHEST
+    };
+    Q_ENUM(PacingBuffer)
+
     Q_PROPERTY(int width MEMBER width NOTIFY displayModeChanged)
     Q_PROPERTY(int height MEMBER height NOTIFY displayModeChanged)
     Q_PROPERTY(int fps MEMBER fps NOTIFY displayModeChanged)
@@ -65,6 +73,7 @@ public:
     Q_PROPERTY(bool absoluteTouchMode MEMBER absoluteTouchMode NOTIFY absoluteTouchModeChanged)
     Q_PROPERTY(bool startWindowed MEMBER startWindowed NOTIFY startWindowedChanged)
     Q_PROPERTY(bool framePacing MEMBER framePacing NOTIFY framePacingChanged)
+    Q_PROPERTY(PacingBuffer pacingBuffer MEMBER pacingBuffer NOTIFY pacingBufferChanged)
     Q_PROPERTY(bool connectionWarnings MEMBER connectionWarnings NOTIFY connectionWarningsChanged)
     Q_PROPERTY(bool richPresence MEMBER richPresence NOTIFY richPresenceChanged)
     Q_PROPERTY(bool gamepadMouse MEMBER gamepadMouse NOTIFY gamepadMouseChanged)
@@ -99,6 +108,7 @@ public:
     VideoDecoderSelection videoDecoderSelection;
     WindowMode windowMode;
     WindowMode recommendedFullScreenMode;
+    PacingBuffer pacingBuffer;
 
 signals:
     void displayModeChanged();
@@ -118,6 +128,7 @@ signals:
     void windowModeChanged();
     void startWindowedChanged();
     void framePacingChanged();
+    void pacingBufferChanged();
     void connectionWarningsChanged();
     void richPresenceChanged();
     void gamepadMouseChanged();
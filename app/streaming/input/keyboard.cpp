@@ -1,4 +1,5 @@
 #include "streaming/session.h"
+#include "streaming/tracer.h"
 
 #include <Limelight.h>
 #include <SDL.h>
@@ -104,6 +105,30 @@ void SdlInputHandler::handleKeyEvent(SDL_KeyboardEvent* event)
             raiseAllKeys();
             return;
         }
+        // Check for the frame graph combo (Ctrl+Alt+Shift+G)
+        else if (event->keysym.sym == SDLK_g) {
+            SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                        "Detected frame graph toggle combo (SDLK)");
+
+            Session::get()->getOverlayManager().setOverlayState(Overlay::OverlayFrameGraph,
+                                                                !Session::get()->getOverlayManager().isOverlayEnabled(Overlay::OverlayFrameGraph));
+
+            raiseAllKeys();
+            return;
+        }
+        // Check for the trace dump combo (Ctrl+Alt+Shift+T)
+        else if (event->keysym.sym == SDLK_t) {
+            SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                        "Detected trace dump combo (SDLK)");
+
+            // Holding the combo down shouldn't write a file per repeat
+            if (!event->repeat) {
+                Tracer::dumpAsync();
+            }
+
+            raiseAllKeys();
+            return;
+        }
         // Check for quit combo (Ctrl+Alt+Shift+Q)
         else if (event->keysym.scancode == SDL_SCANCODE_Q) {
             SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
@@ -168,6 +193,28 @@ void SdlInputHandler::handleKeyEvent(SDL_KeyboardEvent* event)
             raiseAllKeys();
             return;
         }
+        else if (event->keysym.scancode == SDL_SCANCODE_G) {
+            SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                        "Detected frame graph toggle combo (scancode)");
+
+            Session::get()->getOverlayManager().setOverlayState(Overlay::OverlayFrameGraph,
+                                                                !Session::get()->getOverlayManager().isOverlayEnabled(Overlay::OverlayFrameGraph));
+
+            raiseAllKeys();
+            return;
+        }
+        else if (event->keysym.scancode == SDL_SCANCODE_T) {
+            SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                        "Detected trace dump combo (scancode)");
+
+            // Holding the combo down shouldn't write a file per repeat
+            if (!event->repeat) {
+                Tracer::dumpAsync();
+            }
+
+            raiseAllKeys();
+            return;
+        }
     }
 
     if (event->repeat) {
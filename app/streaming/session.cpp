@@ -1,6 +1,7 @@
 #include "session.h"
 #include "settings/streamingpreferences.h"
 #include "streaming/streamutils.h"
+#include "streaming/tracer.h"
 #include "backend/richpresencemanager.h"
 
 #include <Limelight.h>
@@ -9,6 +10,7 @@
 
 #ifdef HAVE_FFMPEG
 #include "video/ffmpeg.h"
+#include "video/ffmpeg-renderers/glvid.h"
 #endif
 
 #ifdef HAVE_SLVIDEO
@@ -22,6 +24,10 @@
 #define ICON_SIZE 64
 #endif
 
+// Longest the main loop sleeps without events, so rich
+// presence callbacks still run
+#define IDLE_WAIT_TIMEOUT_MS 100
+
 #include <openssl/rand.h>
 
 #include <QtEndian>
@@ -152,7 +158,8 @@ void Session::clConnectionStatusUpdate(int connectionStatus)
 
 bool Session::chooseDecoder(StreamingPreferences::VideoDecoderSelection vds,
                             SDL_Window* window, int videoFormat, int width, int height,
-                            int frameRate, bool enableVsync, bool enableFramePacing, bool testOnly, IVideoDecoder*& chosenDecoder)
+                            int frameRate, bool enableVsync, bool enableFramePacing,
+                            StreamingPreferences::PacingBuffer pacingBuffer, bool testOnly, IVideoDecoder*& chosenDecoder)
 {
     DECODER_PARAMETERS params;
 
@@ -163,6 +170,7 @@ bool Session::chooseDecoder(StreamingPreferences::VideoDecoderSelection vds,
     params.window = window;
     params.enableVsync = enableVsync;
     params.enableFramePacing = enableFramePacing;
+    params.pacingBuffer = pacingBuffer;
     params.vds = vds;
 
     SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
@@ -226,6 +234,9 @@ int Session::drSetup(int videoFormat, int width, int height, int frameRate, void
 
 int Session::drSubmitDecodeUnit(PDECODE_UNIT du)
 {
+    Tracer::setThreadName("VideoReceive");
+    TraceScope trace("drSubmitDecodeUnit", du->frameNumber);
+
     // Use a lock since we'll be yanking this decoder out
     // from underneath the session when we initiate destruction.
     // We need to destroy the decoder on the main thread to satisfy
@@ -260,62 +271,104 @@ int Session::drSubmitDecodeUnit(PDECODE_UNIT du)
     }
 }
 
+bool Session::probeDecoder(StreamingPreferences::VideoDecoderSelection vds,
+                           SDL_Window* window, int videoFormat, int width, int height, int frameRate,
+                           DecoderProbeCache::PROBE_RESULT& result)
+{
+    if (DecoderProbeCache::lookup(vds, videoFormat, width, height, frameRate, result)) {
+        return true;
+    }
+
+    IVideoDecoder* decoder;
+
+    if (!chooseDecoder(vds, window, videoFormat, width, height, frameRate, true, false,
+                       StreamingPreferences::PB_FIXED, true, decoder)) {
+        // Failures aren't cached, since they may be transient
+        return false;
+    }
+
+    result.isHardwareAccelerated = decoder->isHardwareAccelerated();
+    result.isFullScreenOnly = decoder->isAlwaysFullScreen();
+    result.maxResolution = decoder->getDecoderMaxResolution();
+    result.capabilities = decoder->getDecoderCapabilities();
+    result.colorspace = decoder->getDecoderColorspace();
+
+    delete decoder;
+
+    DecoderProbeCache::store(vds, videoFormat, width, height, frameRate, result);
+
+    return true;
+}
+
+SDL_Window* Session::createVideoWindow(const char* title, int x, int y,
+                                       int width, int height, Uint32 flags)
+{
+#ifdef HAVE_FFMPEG
+    // GLRenderer can only draw to OpenGL windows. If OpenGL isn't
+    // available at all, it will fail and we'll use SdlRenderer.
+    if (GLRenderer::isRequested()) {
+        SDL_Window* window = SDL_CreateWindow(title, x, y, width, height, flags | SDL_WINDOW_OPENGL);
+        if (window != nullptr) {
+            return window;
+        }
+
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                    "Unable to create OpenGL window: %s",
+                    SDL_GetError());
+    }
+#endif
+
+    return SDL_CreateWindow(title, x, y, width, height, flags);
+}
+
 void Session::getDecoderInfo(SDL_Window* window,
                              bool& isHardwareAccelerated, bool& isFullScreenOnly, QSize& maxResolution)
 {
-    IVideoDecoder* decoder;
+    DecoderProbeCache::PROBE_RESULT result;
 
-    if (!chooseDecoder(StreamingPreferences::VDS_AUTO,
-                       window, VIDEO_FORMAT_H264, 1920, 1080, 60,
-                       true, false, true, decoder)) {
+    if (!probeDecoder(StreamingPreferences::VDS_AUTO,
+                      window, VIDEO_FORMAT_H264, 1920, 1080, 60,
+                      result)) {
         isHardwareAccelerated = isFullScreenOnly = false;
         return;
     }
 
-    isHardwareAccelerated = decoder->isHardwareAccelerated();
-    isFullScreenOnly = decoder->isAlwaysFullScreen();
-    maxResolution = decoder->getDecoderMaxResolution();
-
-    delete decoder;
+    isHardwareAccelerated = result.isHardwareAccelerated;
+    isFullScreenOnly = result.isFullScreenOnly;
+    maxResolution = result.maxResolution;
 }
 
 bool Session::isHardwareDecodeAvailable(SDL_Window* window,
                                         StreamingPreferences::VideoDecoderSelection vds,
                                         int videoFormat, int width, int height, int frameRate)
 {
-    IVideoDecoder* decoder;
+    DecoderProbeCache::PROBE_RESULT result;
 
-    if (!chooseDecoder(vds, window, videoFormat, width, height, frameRate, true, false, true, decoder)) {
+    if (!probeDecoder(vds, window, videoFormat, width, height, frameRate, result)) {
         return false;
     }
 
-    bool ret = decoder->isHardwareAccelerated();
-
-    delete decoder;
-
-    return ret;
+    return result.isHardwareAccelerated;
 }
 
 bool Session::populateDecoderProperties(SDL_Window* window)
 {
-    IVideoDecoder* decoder;
-
-    if (!chooseDecoder(m_Preferences->videoDecoderSelection,
-                       window,
-                       m_StreamConfig.enableHdr ? VIDEO_FORMAT_H265_MAIN10 :
-                            (m_StreamConfig.supportsHevc ? VIDEO_FORMAT_H265 : VIDEO_FORMAT_H264),
-                       m_StreamConfig.width,
-                       m_StreamConfig.height,
-                       m_StreamConfig.fps,
-                       true, false, true, decoder)) {
+    DecoderProbeCache::PROBE_RESULT result;
+
+    if (!probeDecoder(m_Preferences->videoDecoderSelection,
+                      window,
+                      m_StreamConfig.enableHdr ? VIDEO_FORMAT_H265_MAIN10 :
+                           (m_StreamConfig.supportsHevc ? VIDEO_FORMAT_H265 : VIDEO_FORMAT_H264),
+                      m_StreamConfig.width,
+                      m_StreamConfig.height,
+                      m_StreamConfig.fps,
+                      result)) {
         return false;
     }
 
-    m_VideoCallbacks.capabilities = decoder->getDecoderCapabilities();
+    m_VideoCallbacks.capabilities = result.capabilities;
 
-    m_StreamConfig.colorSpace = decoder->getDecoderColorspace();
-
-    delete decoder;
+    m_StreamConfig.colorSpace = result.colorspace;
 
     return true;
 }
@@ -363,7 +416,7 @@ bool Session::initialize()
     }
 
     // Create a hidden window to use for decoder initialization tests
-    SDL_Window* testWindow = SDL_CreateWindow("", 0, 0, 1280, 720, SDL_WINDOW_HIDDEN);
+    SDL_Window* testWindow = createVideoWindow("", 0, 0, 1280, 720, SDL_WINDOW_HIDDEN);
     if (!testWindow) {
         SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
                      "Failed to create window for hardware decode test: %s",
@@ -532,13 +585,7 @@ bool Session::validateLaunch(SDL_Window* testWindow)
     }
 
     if (m_Preferences->videoDecoderSelection == StreamingPreferences::VDS_FORCE_SOFTWARE) {
-        if (m_Preferences->videoCodecConfig == StreamingPreferences::VCC_FORCE_HEVC_HDR) {
-            emitLaunchWarning("HDR is not supported with software decoding.");
-            m_StreamConfig.enableHdr = false;
-        }
-        else {
-            emitLaunchWarning("Your settings selection to force software decoding may cause poor streaming performance.");
-        }
+        emitLaunchWarning("Your settings selection to force software decoding may cause poor streaming performance.");
     }
 
     if (m_Preferences->unsupportedFps && m_StreamConfig.fps > 60) {
@@ -596,13 +643,23 @@ bool Session::validateLaunch(SDL_Window* testWindow)
             emitLaunchWarning("Your host PC GPU doesn't support HDR streaming. "
                               "A GeForce GTX 1000-series (Pascal) or later GPU is required for HDR streaming.");
         }
+        else if (m_Preferences->videoDecoderSelection == StreamingPreferences::VDS_FORCE_SOFTWARE) {
+            // Software decoded HDR is tone mapped to SDR for display
+            m_StreamConfig.enableHdr = true;
+        }
         else if (!isHardwareDecodeAvailable(testWindow,
                                             m_Preferences->videoDecoderSelection,
                                             VIDEO_FORMAT_H265_MAIN10,
                                             m_StreamConfig.width,
                                             m_StreamConfig.height,
                                             m_StreamConfig.fps)) {
-            emitLaunchWarning("This PC's GPU doesn't support HEVC Main10 decoding for HDR streaming.");
+            if (m_Preferences->videoDecoderSelection == StreamingPreferences::VDS_FORCE_HARDWARE) {
+                emitLaunchWarning("This PC's GPU doesn't support HEVC Main10 decoding for HDR streaming.");
+            }
+            else {
+                emitLaunchWarning("This PC's GPU doesn't support HEVC Main10 decoding, so HDR will be decoded in software. This may cause poor streaming performance.");
+                m_StreamConfig.enableHdr = true;
+            }
         }
         else {
             // TODO: Also validate display capabilites
@@ -712,6 +769,11 @@ private:
         // Finish cleanup of the connection state
         LiStopConnection();
 
+        // All the threads we trace are gone now
+        if (Tracer::isDumpOnExitEnabled()) {
+            Tracer::dump();
+        }
+
         // Perform a best-effort app quit
         if (shouldQuit) {
             NvHTTP http(m_Session->m_Computer->activeAddress, m_Session->m_Computer->serverCert);
@@ -918,6 +980,9 @@ void Session::exec(int displayOriginX, int displayOriginY)
     m_DisplayOriginX = displayOriginX;
     m_DisplayOriginY = displayOriginY;
 
+    Tracer::initialize();
+    Tracer::setThreadName("Main");
+
     // Complete initialization in this deferred context to avoid
     // calling expensive functions in the constructor (during the
     // process of loading the StreamSegue).
@@ -1074,12 +1139,12 @@ void Session::exec(int displayOriginX, int displayOriginY)
     SDL_Delay(500);
 #endif
 
-    m_Window = SDL_CreateWindow("Moonlight",
-                                x,
-                                y,
-                                width,
-                                height,
-                                SDL_WINDOW_ALLOW_HIGHDPI);
+    m_Window = createVideoWindow("Moonlight",
+                                 x,
+                                 y,
+                                 width,
+                                 height,
+                                 SDL_WINDOW_ALLOW_HIGHDPI);
     if (!m_Window) {
         SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
                      "SDL_CreateWindow() failed: %s",
@@ -1187,15 +1252,34 @@ void Session::exec(int displayOriginX, int displayOriginY)
     // Start rich presence to indicate we're in game
     RichPresenceManager presence(prefs, m_App.name);
 
+    // Times this thread woke up after running out of events, and
+    // how long frame ready events took to be handled
+    uint32_t loopStartTime = SDL_GetTicks();
+    uint32_t idleWakeups = 0;
+    LatencyHistogram frameEventLatency;
+    SDL_zero(frameEventLatency);
+
     // Hijack this thread to be the SDL main thread. We have to do this
     // because we want to suspend all Qt processing until the stream is over.
     SDL_Event event;
     for (;;) {
-        // We explicitly use SDL_PollEvent() and SDL_Delay() because
-        // SDL_WaitEvent() has an internal SDL_Delay(10) inside which
-        // blocks this thread too long for high polling rate mice and high
-        // refresh rate displays.
         if (!SDL_PollEvent(&event)) {
+            presence.runCallbacks();
+            idleWakeups++;
+
+#if SDL_VERSION_ATLEAST(2, 0, 16)
+            // SDL_WaitEventTimeout() sleeps until the windowing system has
+            // an event for us or another thread pushes one, like Pacer's
+            // frame ready event. It only falls back to polling every 1 ms
+            // while it must poll gamepads.
+            if (!SDL_WaitEventTimeout(&event, IDLE_WAIT_TIMEOUT_MS)) {
+                continue;
+            }
+#else
+            // We explicitly use SDL_PollEvent() and SDL_Delay() because
+            // SDL_WaitEvent() has an internal SDL_Delay(10) inside which
+            // blocks this thread too long for high polling rate mice and high
+            // refresh rate displays.
 #ifndef STEAM_LINK
             SDL_Delay(1);
 #else
@@ -1203,8 +1287,8 @@ void Session::exec(int displayOriginX, int displayOriginY)
             // ARM core in the Steam Link, so we will wait 10 ms instead.
             SDL_Delay(10);
 #endif
-            presence.runCallbacks();
             continue;
+#endif
         }
         switch (event.type) {
         case SDL_QUIT:
@@ -1214,6 +1298,8 @@ void Session::exec(int displayOriginX, int displayOriginY)
 
         case SDL_USEREVENT:
             SDL_assert(event.user.code == SDL_CODE_FRAME_READY);
+            frameEventLatency.add((uint32_t)((uintptr_t)StreamUtils::getMicroseconds() -
+                                             (uintptr_t)event.user.data1));
             m_VideoDecoder->renderFrameOnMainThread();
             break;
 
@@ -1257,6 +1343,15 @@ void Session::exec(int displayOriginX, int displayOriginY)
                 SDL_SetWindowPosition(m_Window, x, y);
             }
 
+            // If we're just resizing on the same display, the renderer may be able
+            // to adapt without tearing down the decoder and waiting on an IDR frame.
+            if (event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED &&
+                    SDL_GetWindowDisplayIndex(m_Window) == currentDisplayIndex &&
+                    m_VideoDecoder != nullptr &&
+                    m_VideoDecoder->notifyWindowChanged()) {
+                break;
+            }
+
             // Fall through
         case SDL_RENDER_DEVICE_RESET:
         case SDL_RENDER_TARGETS_RESET:
@@ -1301,11 +1396,17 @@ void Session::exec(int displayOriginX, int displayOriginY)
                                    m_ActiveVideoHeight, m_ActiveVideoFrameRate,
                                    enableVsync,
                                    enableVsync && m_Preferences->framePacing,
+                                   m_Preferences->pacingBuffer,
                                    false,
                                    s_ActiveSession->m_VideoDecoder)) {
                     SDL_AtomicUnlock(&m_DecoderLock);
                     SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
                                  "Failed to recreate decoder after reset");
+
+                    // Our cached probe results said this would work, so
+                    // they may be stale. Probe again next time.
+                    DecoderProbeCache::invalidate();
+
                     emit displayLaunchError("Unable to initialize video decoder. Please check your streaming settings and try again.");
                     goto DispatchDeferredCleanup;
                 }
@@ -1354,6 +1455,21 @@ void Session::exec(int displayOriginX, int displayOriginY)
     }
 
 DispatchDeferredCleanup:
+    {
+        uint32_t loopTime = SDL_GetTicks() - loopStartTime;
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                    "Main loop idle wakeups: %u (%.1f per second)",
+                    idleWakeups,
+                    loopTime != 0 ? idleWakeups * 1000.0f / loopTime : 0.0f);
+        if (frameEventLatency.count() != 0) {
+            SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                        "Frame ready event latency p50/p99/max: %.2f/%.2f/%.2f ms",
+                        frameEventLatency.percentileUs(50) / 1000.0f,
+                        frameEventLatency.percentileUs(99) / 1000.0f,
+                        frameEventLatency.maxUs() / 1000.0f);
+        }
+    }
+
     // Uncapture the mouse and hide the window immediately,
     // so we can return to the Qt GUI ASAP.
     m_InputHandler->setCaptureActive(false);
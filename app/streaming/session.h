@@ -9,6 +9,7 @@
 #include "video/decoder.h"
 #include "audio/renderers/renderer.h"
 #include "video/overlaymanager.h"
+#include "video/decoderprobecache.h"
 
 class Session : public QObject
 {
@@ -77,15 +78,25 @@ private:
 
     void updateOptimalWindowDisplayMode();
 
+    static
+    SDL_Window* createVideoWindow(const char* title, int x, int y,
+                                  int width, int height, Uint32 flags);
+
     static
     bool isHardwareDecodeAvailable(SDL_Window* window,
                                    StreamingPreferences::VideoDecoderSelection vds,
                                    int videoFormat, int width, int height, int frameRate);
 
+    static
+    bool probeDecoder(StreamingPreferences::VideoDecoderSelection vds,
+                      SDL_Window* window, int videoFormat, int width, int height, int frameRate,
+                      DecoderProbeCache::PROBE_RESULT& result);
+
     static
     bool chooseDecoder(StreamingPreferences::VideoDecoderSelection vds,
                        SDL_Window* window, int videoFormat, int width, int height,
                        int frameRate, bool enableVsync, bool enableFramePacing,
+                       StreamingPreferences::PacingBuffer pacingBuffer,
                        bool testOnly,
                        IVideoDecoder*& chosenDecoder);
 
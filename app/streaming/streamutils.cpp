@@ -123,3 +123,12 @@ bool StreamUtils::getRealDesktopMode(int displayIndex, SDL_DisplayMode* mode)
 
     return true;
 }
+
+uint64_t StreamUtils::getMicroseconds()
+{
+    static const uint64_t frequency = SDL_GetPerformanceFrequency();
+
+    // Split the conversion to avoid overflowing the multiplication
+    uint64_t counter = SDL_GetPerformanceCounter();
+    return (counter / frequency) * 1000000 + ((counter % frequency) * 1000000) / frequency;
+}
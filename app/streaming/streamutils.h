@@ -13,4 +13,8 @@ public:
 
     static
     int getDisplayRefreshRate(SDL_Window* window);
+
+    // Monotonic clock with microsecond resolution
+    static
+    uint64_t getMicroseconds();
 };
@@ -0,0 +1,286 @@
+#include "tracer.h"
+#include "streamutils.h"
+#include "path.h"
+
+#include <QDir>
+#include <QFile>
+#include <QDateTime>
+#include <QHash>
+#include <QVector>
+
+// About 8 seconds of history per thread at 240 FPS
+#define TRACE_RING_SIZE 8192
+
+// Events this close to the writer may be overwritten while we copy them
+#define TRACE_RING_DUMP_SLACK 64
+
+#define MAX_TRACE_THREADS 64
+
+typedef struct _TRACE_EVENT {
+    uint64_t timestampUs;
+    const char* name;
+    int frameNumber;
+    SDL_threadID threadId;
+    const char* threadName;
+    char phase;
+} TRACE_EVENT, *PTRACE_EVENT;
+
+typedef struct _TRACE_RING {
+    // Set while a thread owns this ring. When that thread exits, the
+    // ring is handed to the next new thread, keeping the old events.
+    SDL_atomic_t inUse;
+
+    // Only advanced by the owning thread
+    SDL_atomic_t writeIndex;
+
+    TRACE_EVENT events[TRACE_RING_SIZE];
+} TRACE_RING, *PTRACE_RING;
+
+namespace {
+
+class TraceRingOwner
+{
+public:
+    TraceRingOwner()
+        : ring(nullptr),
+          threadName(nullptr)
+    {
+    }
+
+    ~TraceRingOwner()
+    {
+        if (ring != nullptr) {
+            SDL_AtomicSet(&ring->inUse, 0);
+        }
+    }
+
+    PTRACE_RING ring;
+    const char* threadName;
+};
+
+}
+
+bool Tracer::s_Enabled = false;
+bool Tracer::s_DumpOnExit = false;
+
+// Rings are allocated on first use and never freed, since the dumping
+// thread may be reading them at any time.
+static PTRACE_RING s_Rings[MAX_TRACE_THREADS];
+static SDL_atomic_t s_RingCount;
+
+// Numbers dump files written within the same millisecond
+static SDL_atomic_t s_DumpCount;
+
+static thread_local TraceRingOwner t_Owner;
+
+static PTRACE_RING claimRing()
+{
+    // Reuse a ring from a thread that has exited
+    int ringCount = SDL_AtomicGet(&s_RingCount);
+    for (int i = 0; i < ringCount; i++) {
+        PTRACE_RING ring = (PTRACE_RING)SDL_AtomicGetPtr((void**)&s_Rings[i]);
+        if (ring != nullptr && SDL_AtomicCAS(&ring->inUse, 0, 1)) {
+            return ring;
+        }
+    }
+
+    // Reserve a new slot
+    int index = SDL_AtomicAdd(&s_RingCount, 1);
+    if (index >= MAX_TRACE_THREADS) {
+        SDL_AtomicAdd(&s_RingCount, -1);
+        return nullptr;
+    }
+
+    PTRACE_RING ring = (PTRACE_RING)SDL_calloc(1, sizeof(TRACE_RING));
+    if (ring == nullptr) {
+        // Leave the slot empty
+        return nullptr;
+    }
+
+    SDL_AtomicSet(&ring->inUse, 1);
+    SDL_AtomicSetPtr((void**)&s_Rings[index], ring);
+    return ring;
+}
+
+static inline void recordEvent(const char* name, int frameNumber, char phase)
+{
+    PTRACE_RING ring = t_Owner.ring;
+    if (ring == nullptr) {
+        ring = t_Owner.ring = claimRing();
+        if (ring == nullptr) {
+            return;
+        }
+    }
+
+    int index = SDL_AtomicGet(&ring->writeIndex);
+    PTRACE_EVENT event = &ring->events[(unsigned int)index % TRACE_RING_SIZE];
+
+    event->timestampUs = StreamUtils::getMicroseconds();
+    event->name = name;
+    event->frameNumber = frameNumber;
+    event->threadId = SDL_ThreadID();
+    event->threadName = t_Owner.threadName;
+    event->phase = phase;
+
+    // Publish the event to the dumping thread
+    SDL_MemoryBarrierRelease();
+    SDL_AtomicSet(&ring->writeIndex, index + 1);
+}
+
+void Tracer::initialize()
+{
+    QByteArray frameTrace = qgetenv("FRAME_TRACE");
+
+    s_Enabled = frameTrace != "0";
+    s_DumpOnExit = frameTrace == "1";
+}
+
+bool Tracer::isDumpOnExitEnabled()
+{
+    return s_DumpOnExit;
+}
+
+void Tracer::begin(const char* name, int frameNumber)
+{
+    if (s_Enabled) {
+        recordEvent(name, frameNumber, 'B');
+    }
+}
+
+void Tracer::end(const char* name, int frameNumber)
+{
+    if (s_Enabled) {
+        recordEvent(name, frameNumber, 'E');
+    }
+}
+
+void Tracer::beginAsync(const char* name, int frameNumber)
+{
+    if (s_Enabled) {
+        recordEvent(name, frameNumber, 'b');
+    }
+}
+
+void Tracer::endAsync(const char* name, int frameNumber)
+{
+    if (s_Enabled) {
+        recordEvent(name, frameNumber, 'e');
+    }
+}
+
+void Tracer::setThreadName(const char* name)
+{
+    // Each event carries its thread's name, so names live exactly
+    // as long as the events that need them
+    t_Owner.threadName = name;
+}
+
+QString Tracer::dump()
+{
+    QVector<TRACE_EVENT> events;
+
+    int ringCount = SDL_min(SDL_AtomicGet(&s_RingCount), MAX_TRACE_THREADS);
+    for (int i = 0; i < ringCount; i++) {
+        PTRACE_RING ring = (PTRACE_RING)SDL_AtomicGetPtr((void**)&s_Rings[i]);
+        if (ring == nullptr) {
+            continue;
+        }
+
+        // Only events before this snapshot are complete
+        int end = SDL_AtomicGet(&ring->writeIndex);
+        SDL_MemoryBarrierAcquire();
+
+        int start = SDL_max(0, end - (TRACE_RING_SIZE - TRACE_RING_DUMP_SLACK));
+        int firstEvent = events.count();
+        for (int j = start; j < end; j++) {
+            events.append(ring->events[(unsigned int)j % TRACE_RING_SIZE]);
+        }
+
+        // Throw away anything the writer may have overwritten while we
+        // copied. The writer is also partway through the slot at its
+        // write index, which holds the event TRACE_RING_SIZE before it.
+        SDL_MemoryBarrierAcquire();
+        int writeIndex = SDL_AtomicGet(&ring->writeIndex);
+        int overwritten = writeIndex - TRACE_RING_SIZE + 1 - start;
+        if (overwritten > 0) {
+            events.remove(firstEvent, SDL_min(overwritten, end - start));
+        }
+    }
+
+    if (events.isEmpty()) {
+        return QString();
+    }
+
+    QDir logDir(Path::getLogDir());
+    QString fileName = logDir.filePath(QString("Moonlight-trace-%1-%2.json")
+                                       .arg(QDateTime::currentMSecsSinceEpoch())
+                                       .arg(SDL_AtomicAdd(&s_DumpCount, 1)));
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "Unable to open trace file: %s",
+                     qPrintable(fileName));
+        return QString();
+    }
+
+    file.write("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+    QHash<SDL_threadID, const char*> threadNames;
+    for (const TRACE_EVENT& event : events) {
+        if (event.threadName != nullptr) {
+            threadNames.insert(event.threadId, event.threadName);
+        }
+    }
+
+    for (auto it = threadNames.constBegin(); it != threadNames.constEnd(); ++it) {
+        file.write(QString("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%1,\"args\":{\"name\":\"%2\"}},\n")
+                   .arg((qulonglong)it.key())
+                   .arg(it.value())
+                   .toUtf8());
+    }
+
+    for (int i = 0; i < events.count(); i++) {
+        const TRACE_EVENT& event = events.at(i);
+        // Async spans are matched by category and ID rather than by thread
+        bool async = event.phase == 'b' || event.phase == 'e';
+        file.write(QString("{\"name\":\"%1\",\"ph\":\"%2\",\"ts\":%3,\"pid\":1,\"tid\":%4,%5\"args\":{\"frame\":%6}}%7\n")
+                   .arg(event.name)
+                   .arg(event.phase)
+                   .arg(event.timestampUs)
+                   .arg((qulonglong)event.threadId)
+                   .arg(async ? QString("\"cat\":\"frame\",\"id\":%1,").arg(event.frameNumber) : QString())
+                   .arg(event.frameNumber)
+                   .arg(i + 1 < events.count() ? "," : "")
+                   .toUtf8());
+    }
+
+    file.write("]}\n");
+    file.close();
+
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                "Wrote %d trace events to %s",
+                events.count(),
+                qPrintable(fileName));
+
+    return fileName;
+}
+
+int Tracer::dumpThread(void*)
+{
+    dump();
+    return 0;
+}
+
+void Tracer::dumpAsync()
+{
+    // Writing the file can take a while, so keep it off the main thread
+    SDL_Thread* thread = SDL_CreateThread(Tracer::dumpThread, "TraceDump", nullptr);
+    if (thread == nullptr) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "Unable to create trace dump thread: %s",
+                     SDL_GetError());
+        return;
+    }
+
+    SDL_DetachThread(thread);
+}
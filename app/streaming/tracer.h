@@ -0,0 +1,69 @@
+#pragma once
+
+#include <SDL.h>
+
+#include <QString>
+
+// Records begin/end events for each stage a frame passes through so
+// they can be viewed on a timeline in chrome://tracing or Perfetto.
+//
+// Each thread writes into its own ring buffer without taking any locks,
+// so this is cheap enough to leave on all the time. Only the last few
+// seconds of events are kept. Set FRAME_TRACE=0 to disable recording
+// or FRAME_TRACE=1 to also dump the events when the stream ends.
+//
+// Event and thread names must be string literals, since only the
+// pointer is stored.
+class Tracer
+{
+public:
+    static void initialize();
+
+    static bool isDumpOnExitEnabled();
+
+    static void begin(const char* name, int frameNumber);
+
+    static void end(const char* name, int frameNumber);
+
+    // For spans that begin and end on different threads, like time
+    // spent in a queue. The frame number identifies the span.
+    static void beginAsync(const char* name, int frameNumber);
+
+    static void endAsync(const char* name, int frameNumber);
+
+    // Cheap enough to call repeatedly from threads we don't own
+    static void setThreadName(const char* name);
+
+    // Writes all recorded events to a Chrome trace-event JSON file in
+    // the log directory. Returns an empty string on failure.
+    static QString dump();
+
+    // Like dump(), but writes the file on a separate thread
+    static void dumpAsync();
+
+private:
+    static int dumpThread(void* context);
+
+    static bool s_Enabled;
+    static bool s_DumpOnExit;
+};
+
+class TraceScope
+{
+public:
+    TraceScope(const char* name, int frameNumber)
+        : m_Name(name),
+          m_FrameNumber(frameNumber)
+    {
+        Tracer::begin(m_Name, m_FrameNumber);
+    }
+
+    ~TraceScope()
+    {
+        Tracer::end(m_Name, m_FrameNumber);
+    }
+
+private:
+    const char* m_Name;
+    int m_FrameNumber;
+};
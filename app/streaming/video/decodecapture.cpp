@@ -0,0 +1,326 @@
+#include "decodecapture.h"
+#include "path.h"
+#include "streaming/tracer.h"
+
+#include <QDateTime>
+#include <QDir>
+#include <QtEndian>
+
+// Anything larger than this is a corrupt file, not a frame
+#define MAX_CAPTURE_BUFFER_COUNT 1024
+#define MAX_CAPTURE_BUFFER_LENGTH (64 * 1024 * 1024)
+
+// If the writer thread falls this far behind, we stop capturing
+// rather than use up memory or leave gaps in the capture
+#define MAX_QUEUED_CAPTURE_BYTES (256 * 1024 * 1024)
+
+DecodeCaptureWriter::DecodeCaptureWriter()
+    : m_File(nullptr),
+      m_StartTimeMs(0),
+      m_Thread(nullptr),
+      m_RecordsLock(0),
+      m_RecordsQueued(SDL_CreateSemaphore(0)),
+      m_QueuedBytes(0),
+      m_Overflowed(false),
+      m_WriteFailed(false)
+{
+    SDL_AtomicSet(&m_Stopping, 0);
+}
+
+DecodeCaptureWriter::~DecodeCaptureWriter()
+{
+    if (m_Thread != nullptr) {
+        // The writer thread finishes the queued records first
+        SDL_AtomicSet(&m_Stopping, 1);
+        SDL_SemPost(m_RecordsQueued);
+        SDL_WaitThread(m_Thread, nullptr);
+    }
+
+    close();
+
+    SDL_DestroySemaphore(m_RecordsQueued);
+}
+
+bool DecodeCaptureWriter::open(PDECODER_PARAMETERS params)
+{
+    SDL_assert(m_File == nullptr);
+
+    QDir logDir(Path::getLogDir());
+    QString fileName = logDir.filePath(QString("Moonlight-capture-%1.mldc").arg(QDateTime::currentMSecsSinceEpoch()));
+
+    m_File = SDL_RWFromFile(fileName.toUtf8().constData(), "wb");
+    if (m_File == nullptr) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "Unable to create decode capture file: %s",
+                     SDL_GetError());
+        return false;
+    }
+
+    SDL_WriteLE32(m_File, DECODE_CAPTURE_MAGIC);
+    SDL_WriteLE32(m_File, DECODE_CAPTURE_VERSION);
+    SDL_WriteLE32(m_File, params->videoFormat);
+    SDL_WriteLE32(m_File, params->width);
+    SDL_WriteLE32(m_File, params->height);
+    SDL_WriteLE32(m_File, params->frameRate);
+
+    m_StartTimeMs = LiGetMillis();
+
+    m_Thread = SDL_CreateThread(DecodeCaptureWriter::writerThread, "DecodeCapture", this);
+    if (m_Thread == nullptr) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "Unable to create decode capture thread: %s",
+                     SDL_GetError());
+        close();
+        return false;
+    }
+
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                "Capturing decode units to %s",
+                qPrintable(fileName));
+    return true;
+}
+
+void DecodeCaptureWriter::writeDecodeUnit(PDECODE_UNIT du)
+{
+    if (m_Thread == nullptr || m_Overflowed) {
+        return;
+    }
+
+    Uint32 bufferCount = 0;
+    for (PLENTRY entry = du->bufferList; entry != nullptr; entry = entry->next) {
+        bufferCount++;
+    }
+
+    QByteArray record;
+    record.reserve(20 + bufferCount * 8 + du->fullLength);
+
+    quint32 header32[2] = {
+        qToLittleEndian<quint32>(du->frameNumber),
+        qToLittleEndian<quint32>(du->frameType),
+    };
+    // Record when the frame came off the network, not when it reached
+    // us, so replays keep the original arrival pattern
+    uint64_t receiveTimeMs = SDL_max(du->receiveTimeMs, m_StartTimeMs) - m_StartTimeMs;
+    quint64 receiveTimeUs = qToLittleEndian<quint64>(receiveTimeMs * 1000);
+    quint32 bufferCountLE = qToLittleEndian<quint32>(bufferCount);
+    record.append((const char*)header32, sizeof(header32));
+    record.append((const char*)&receiveTimeUs, sizeof(receiveTimeUs));
+    record.append((const char*)&bufferCountLE, sizeof(bufferCountLE));
+
+    for (PLENTRY entry = du->bufferList; entry != nullptr; entry = entry->next) {
+        quint32 entryHeader[2] = {
+            qToLittleEndian<quint32>(entry->bufferType),
+            qToLittleEndian<quint32>(entry->length),
+        };
+        record.append((const char*)entryHeader, sizeof(entryHeader));
+        record.append(entry->data, entry->length);
+    }
+
+    SDL_AtomicLock(&m_RecordsLock);
+    if (m_QueuedBytes + record.size() > MAX_QUEUED_CAPTURE_BYTES) {
+        m_Overflowed = true;
+    }
+    else {
+        m_QueuedBytes += record.size();
+        m_Records.enqueue(record);
+    }
+    SDL_AtomicUnlock(&m_RecordsLock);
+
+    if (m_Overflowed) {
+        // Records already queued are still written, so the file ends cleanly
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "Decode capture fell too far behind. Capture stopped at frame %d.",
+                     du->frameNumber);
+        return;
+    }
+
+    SDL_SemPost(m_RecordsQueued);
+}
+
+int DecodeCaptureWriter::writerThread(void* context)
+{
+    DecodeCaptureWriter* me = reinterpret_cast<DecodeCaptureWriter*>(context);
+
+    Tracer::setThreadName("DecodeCapture");
+
+    for (;;) {
+        SDL_SemWait(me->m_RecordsQueued);
+
+        SDL_AtomicLock(&me->m_RecordsLock);
+        bool haveRecord = !me->m_Records.isEmpty();
+        QByteArray record = haveRecord ? me->m_Records.dequeue() : QByteArray();
+        me->m_QueuedBytes -= record.size();
+        SDL_AtomicUnlock(&me->m_RecordsLock);
+
+        if (!haveRecord) {
+            // Every record is posted before the stop, so this was it
+            if (SDL_AtomicGet(&me->m_Stopping)) {
+                break;
+            }
+            continue;
+        }
+
+        if (!me->m_WriteFailed && SDL_RWwrite(me->m_File, record.constData(), record.size(), 1) != 1) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                         "Decode capture write failed: %s",
+                         SDL_GetError());
+
+            // Stop here so we don't leave more than one half-written
+            // record behind. We keep draining the queue.
+            me->m_WriteFailed = true;
+        }
+    }
+
+    return 0;
+}
+
+void DecodeCaptureWriter::close()
+{
+    if (m_File != nullptr) {
+        SDL_RWclose(m_File);
+        m_File = nullptr;
+    }
+}
+
+DecodeCaptureReader::DecodeCaptureReader()
+    : m_File(nullptr),
+      m_FirstRecordOffset(0),
+      m_VideoFormat(0),
+      m_Width(0),
+      m_Height(0),
+      m_FrameRate(0)
+{
+}
+
+DecodeCaptureReader::~DecodeCaptureReader()
+{
+    close();
+}
+
+bool DecodeCaptureReader::open(const QString& fileName)
+{
+    SDL_assert(m_File == nullptr);
+
+    m_File = SDL_RWFromFile(fileName.toUtf8().constData(), "rb");
+    if (m_File == nullptr) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "Unable to open decode capture file: %s",
+                     SDL_GetError());
+        return false;
+    }
+
+    if (SDL_ReadLE32(m_File) != DECODE_CAPTURE_MAGIC) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "%s is not a decode capture file",
+                     qPrintable(fileName));
+        close();
+        return false;
+    }
+
+    Uint32 version = SDL_ReadLE32(m_File);
+    if (version != DECODE_CAPTURE_VERSION) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "Unsupported decode capture version: %u",
+                     version);
+        close();
+        return false;
+    }
+
+    m_VideoFormat = SDL_ReadLE32(m_File);
+    m_Width = SDL_ReadLE32(m_File);
+    m_Height = SDL_ReadLE32(m_File);
+    m_FrameRate = SDL_ReadLE32(m_File);
+
+    m_FirstRecordOffset = SDL_RWtell(m_File);
+    return true;
+}
+
+bool DecodeCaptureReader::rewind()
+{
+    return SDL_RWseek(m_File, m_FirstRecordOffset, RW_SEEK_SET) == m_FirstRecordOffset;
+}
+
+bool DecodeCaptureReader::readDecodeUnit(DECODE_UNIT& du, uint64_t& receiveTimeUs)
+{
+    Uint32 frameNumber;
+
+    // SDL_ReadLE32() can't report errors, so detect EOF ourselves
+    if (SDL_RWread(m_File, &frameNumber, sizeof(frameNumber), 1) != 1) {
+        return false;
+    }
+
+    SDL_zero(du);
+    du.frameNumber = SDL_SwapLE32(frameNumber);
+    du.frameType = SDL_ReadLE32(m_File);
+    receiveTimeUs = SDL_ReadLE64(m_File);
+
+    Uint32 bufferCount = SDL_ReadLE32(m_File);
+    if (bufferCount == 0 || bufferCount > MAX_CAPTURE_BUFFER_COUNT) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "Corrupt decode capture record for frame %d",
+                     du.frameNumber);
+        return false;
+    }
+
+    // Reuse our buffers from the last decode unit
+    m_Entries.resize(bufferCount);
+    if (m_Buffers.size() < (int)bufferCount) {
+        m_Buffers.resize(bufferCount);
+    }
+
+    for (Uint32 i = 0; i < bufferCount; i++) {
+        PLENTRY entry = &m_Entries[i];
+
+        entry->bufferType = SDL_ReadLE32(m_File);
+        entry->length = SDL_ReadLE32(m_File);
+        if (entry->length <= 0 || entry->length > MAX_CAPTURE_BUFFER_LENGTH) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                         "Corrupt decode capture record for frame %d",
+                         du.frameNumber);
+            return false;
+        }
+
+        m_Buffers[i].resize(entry->length);
+        if (SDL_RWread(m_File, m_Buffers[i].data(), entry->length, 1) != 1) {
+            SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                        "Decode capture is truncated at frame %d",
+                        du.frameNumber);
+            return false;
+        }
+
+        entry->data = m_Buffers[i].data();
+        entry->next = i + 1 < bufferCount ? &m_Entries[i + 1] : nullptr;
+        du.fullLength += entry->length;
+    }
+
+    du.bufferList = &m_Entries[0];
+    return true;
+}
+
+int DecodeCaptureReader::getVideoFormat() const
+{
+    return m_VideoFormat;
+}
+
+int DecodeCaptureReader::getWidth() const
+{
+    return m_Width;
+}
+
+int DecodeCaptureReader::getHeight() const
+{
+    return m_Height;
+}
+
+int DecodeCaptureReader::getFrameRate() const
+{
+    return m_FrameRate;
+}
+
+void DecodeCaptureReader::close()
+{
+    if (m_File != nullptr) {
+        SDL_RWclose(m_File);
+        m_File = nullptr;
+    }
+}
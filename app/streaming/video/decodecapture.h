@@ -0,0 +1,88 @@
+#pragma once
+
+#include "decoder.h"
+
+#include <QByteArray>
+#include <QQueue>
+#include <QString>
+#include <QVector>
+
+// Decode units captured from a live stream, so decoder performance
+// can be measured offline without a host PC.
+//
+// All fields are little endian. The file starts with a header:
+//   magic ("MLDC"), version, videoFormat, width, height, frameRate
+// followed by one record per decode unit:
+//   frameNumber, frameType, receiveTimeUs (64-bit), bufferCount
+//   and bufferCount entries of: bufferType, length, data
+#define DECODE_CAPTURE_MAGIC 0x43444C4D
+#define DECODE_CAPTURE_VERSION 1
+
+// Writes records on its own thread, so a slow disk
+// doesn't hold up the thread submitting decode units
+class DecodeCaptureWriter
+{
+public:
+    DecodeCaptureWriter();
+    ~DecodeCaptureWriter();
+
+    // Creates a new capture file in the log directory
+    bool open(PDECODER_PARAMETERS params);
+
+    // Copies the decode unit into a record for the writer thread
+    void writeDecodeUnit(PDECODE_UNIT du);
+
+private:
+    static int writerThread(void* context);
+
+    void close();
+
+    SDL_RWops* m_File;
+    uint64_t m_StartTimeMs;
+    SDL_Thread* m_Thread;
+    SDL_atomic_t m_Stopping;
+
+    // Records waiting to be written and their total size. Once the
+    // writer falls too far behind, we stop queuing them for good.
+    SDL_SpinLock m_RecordsLock;
+    SDL_sem* m_RecordsQueued;
+    QQueue<QByteArray> m_Records;
+    int m_QueuedBytes;
+    bool m_Overflowed;
+
+    // Only touched by the writer thread
+    bool m_WriteFailed;
+};
+
+class DecodeCaptureReader
+{
+public:
+    DecodeCaptureReader();
+    ~DecodeCaptureReader();
+
+    bool open(const QString& fileName);
+
+    // Returns to the first decode unit in the file
+    bool rewind();
+
+    // The decode unit and its buffers remain valid until the next call.
+    // Returns false at the end of the file or on a truncated record.
+    bool readDecodeUnit(DECODE_UNIT& du, uint64_t& receiveTimeUs);
+
+    int getVideoFormat() const;
+    int getWidth() const;
+    int getHeight() const;
+    int getFrameRate() const;
+
+private:
+    void close();
+
+    SDL_RWops* m_File;
+    Sint64 m_FirstRecordOffset;
+    int m_VideoFormat;
+    int m_Width;
+    int m_Height;
+    int m_FrameRate;
+    QVector<LENTRY> m_Entries;
+    QVector<QByteArray> m_Buffers;
+};
@@ -3,7 +3,10 @@
 #include <Limelight.h>
 #include <SDL.h>
 #include "settings/streamingpreferences.h"
+#include "latencyhistogram.h"
 
+// data1 holds the time it was sent, from StreamUtils::getMicroseconds(),
+// truncated to the size of a pointer
 #define SDL_CODE_FRAME_READY 0
 
 #define MAX_SLICES 4
@@ -15,14 +18,35 @@ typedef struct _VIDEO_STATS {
     uint32_t totalFrames;
     uint32_t networkDroppedFrames;
     uint32_t pacerDroppedFrames;
-    uint32_t totalReassemblyTime;
-    uint32_t totalDecodeTime;
-    uint32_t totalPacerTime;
-    uint32_t totalRenderTime;
+    LatencyHistogram reassemblyTime;
+    LatencyHistogram decodeTime;
+    LatencyHistogram pacerTime;
+    LatencyHistogram renderTime;
+    uint32_t totalDecodeQueueDepth;
+    uint32_t maxDecodeQueueDepth;
+    LatencyHistogram decodeQueueTime;
+    uint32_t decodeQueueDroppedFrames;
+    uint32_t decodeErrors;
+    uint64_t totalBytesCopied;
+    uint32_t frameBufferRequests;
+    uint32_t frameBufferAllocations;
+    uint32_t directTextureFrames;
+    uint64_t totalBytesUploaded;
+    LatencyHistogram uploadTime;
+    LatencyHistogram readbackTime;
+    uint32_t renderBudgetUs;
+    uint32_t jitEarlierFrames;
+    uint32_t jitLaterFrames;
+    uint32_t jitMissedVsyncs;
+    int64_t jitSavedUs;
+    uint32_t jitterBufferDepth;
+    uint32_t arrivalJitterUs;
     float totalFps;
     float receivedFps;
     float decodedFps;
     float renderedFps;
+    float copiedBytesPerSec;
+    float uploadedBytesPerSec;
     uint32_t measurementStartTimestamp;
 } VIDEO_STATS, *PVIDEO_STATS;
 
@@ -36,6 +60,7 @@ typedef struct _DECODER_PARAMETERS {
     int frameRate;
     bool enableVsync;
     bool enableFramePacing;
+    StreamingPreferences::PacingBuffer pacingBuffer;
 } DECODER_PARAMETERS, *PDECODER_PARAMETERS;
 
 class IVideoDecoder {
@@ -49,4 +74,8 @@ public:
     virtual QSize getDecoderMaxResolution() = 0;
     virtual int submitDecodeUnit(PDECODE_UNIT du) = 0;
     virtual void renderFrameOnMainThread() = 0;
+
+    // Called on the main thread after the window is resized. Returns
+    // false if the decoder must be recreated to handle the new size.
+    virtual bool notifyWindowChanged() = 0;
 };
@@ -0,0 +1,231 @@
+#include "decoderprobecache.h"
+
+#include <QSettings>
+#include <QCryptographicHash>
+#include <QGuiApplication>
+#include <QSysInfo>
+#include <QDir>
+#include <QFileInfo>
+#include <QDateTime>
+
+#include <SDL.h>
+
+#ifdef HAVE_FFMPEG
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavutil/avutil.h>
+}
+#endif
+
+#ifdef Q_OS_WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#endif
+
+#define SER_PROBECACHE "decoderprobes"
+#define SER_FINGERPRINT "fingerprint"
+#define SER_RESULTS "results"
+
+QString DecoderProbeCache::s_Fingerprint;
+
+bool DecoderProbeCache::isEnabled()
+{
+    // Allow the cache to be bypassed for troubleshooting
+    return qgetenv("DECODER_PROBE_CACHE") != "0";
+}
+
+QString DecoderProbeCache::getProbeKey(StreamingPreferences::VideoDecoderSelection vds,
+                                       int videoFormat, int width, int height, int frameRate)
+{
+    return QString("%1-%2-%3x%4x%5").arg(vds).arg(videoFormat, 0, 16).arg(width).arg(height).arg(frameRate);
+}
+
+QString DecoderProbeCache::getGpuFingerprint()
+{
+    QString fingerprint;
+
+#if defined(Q_OS_WIN32)
+    DISPLAY_DEVICEW device;
+    device.cb = sizeof(device);
+    for (DWORD i = 0; EnumDisplayDevicesW(nullptr, i, &device, 0); i++) {
+        if (!(device.StateFlags & DISPLAY_DEVICE_ATTACHED_TO_DESKTOP)) {
+            continue;
+        }
+
+        QString deviceKey = QString::fromWCharArray(device.DeviceKey);
+
+        // The device key is a kernel registry path. Rewrite it
+        // into something QSettings can read the driver version from.
+        deviceKey.replace("\\Registry\\Machine\\", "HKEY_LOCAL_MACHINE\\", Qt::CaseInsensitive);
+        QSettings driverKey(deviceKey, QSettings::NativeFormat);
+
+        fingerprint += QString::fromWCharArray(device.DeviceString) + ";" +
+                QString::fromWCharArray(device.DeviceID) + ";" +
+                driverKey.value("DriverVersion").toString() + ";";
+    }
+#elif defined(Q_OS_LINUX)
+    // PCI IDs and kernel driver of each DRM device
+    QDir drmDir("/sys/class/drm");
+    for (const QString& card : drmDir.entryList(QStringList() << "card*", QDir::AllEntries | QDir::System, QDir::Name)) {
+        if (card.contains('-')) {
+            // Skip connectors (card0-HDMI-A-1, etc)
+            continue;
+        }
+
+        QString devicePath = drmDir.filePath(card) + "/device/";
+        QString driverName = QFileInfo(devicePath + "driver").symLinkTarget().section('/', -1);
+
+        QFile vendorFile(devicePath + "vendor");
+        QFile deviceFile(devicePath + "device");
+        QFile driverVersionFile("/sys/module/" + driverName + "/version");
+        vendorFile.open(QIODevice::ReadOnly);
+        deviceFile.open(QIODevice::ReadOnly);
+        driverVersionFile.open(QIODevice::ReadOnly);
+
+        fingerprint += card + ";" +
+                vendorFile.readAll().trimmed() + ";" +
+                deviceFile.readAll().trimmed() + ";" +
+                driverName + ";" +
+                driverVersionFile.readAll().trimmed() + ";";
+    }
+
+    // There's no way to query the VAAPI or VDPAU driver strings without
+    // initializing the drivers, which is what we're trying to avoid. Instead,
+    // we identify the installed user-mode drivers by their size and timestamp
+    // so that a driver update will invalidate the cache.
+    QStringList driverDirs;
+    driverDirs << qEnvironmentVariable("LIBVA_DRIVERS_PATH").split(':', QString::SkipEmptyParts)
+               << "/usr/lib64/dri" << "/usr/lib64/va/drivers" << "/usr/lib64/vdpau"
+               << "/usr/lib/dri" << "/usr/lib/va/drivers" << "/usr/lib/vdpau"
+               << "/usr/lib/x86_64-linux-gnu/dri" << "/usr/lib/x86_64-linux-gnu/vdpau"
+               << "/usr/lib/i386-linux-gnu/dri" << "/usr/lib/i386-linux-gnu/vdpau"
+               << "/usr/lib/aarch64-linux-gnu/dri" << "/usr/lib/aarch64-linux-gnu/vdpau"
+               << "/usr/lib/arm-linux-gnueabihf/dri" << "/usr/lib/arm-linux-gnueabihf/vdpau";
+    for (const QString& dirName : driverDirs) {
+        QDir dir(dirName);
+        for (const QFileInfo& driver : dir.entryInfoList(QStringList() << "*_drv_video.so" << "libvdpau_*.so*",
+                                                         QDir::Files, QDir::Name)) {
+            fingerprint += driver.absoluteFilePath() + ";" +
+                    QString::number(driver.size()) + ";" +
+                    QString::number(driver.lastModified().toMSecsSinceEpoch()) + ";";
+        }
+    }
+#endif
+
+    return fingerprint;
+}
+
+QString DecoderProbeCache::getFingerprint()
+{
+    // This doesn't change while we're running
+    if (!s_Fingerprint.isEmpty()) {
+        return s_Fingerprint;
+    }
+
+    QString fingerprint;
+
+    // Our own decoder selection logic may change between versions
+    fingerprint += QString(VERSION_STR) + ";";
+
+    fingerprint += QSysInfo::kernelVersion() + ";" + QSysInfo::productVersion() + ";";
+    fingerprint += QGuiApplication::platformName() + ";";
+
+    const char* videoDriver = SDL_GetCurrentVideoDriver();
+    fingerprint += QString(videoDriver ? videoDriver : "") + ";";
+
+#ifdef HAVE_FFMPEG
+    fingerprint += QString("%1;%2;%3;").arg(avcodec_version()).arg(avutil_version()).arg(av_version_info());
+#endif
+
+    // These variables change how we select or initialize decoders
+    static const char* envVars[] = {
+        "H264_DECODER_HINT", "HEVC_DECODER_HINT", "HWACCEL_HINT", "NULL_RENDERER", "GL_RENDERER", "FORCE_VAAPI", "DRM_DEV",
+        "LIBVA_DRIVER_NAME", "LIBVA_DRIVERS_PATH", "VDPAU_DRIVER"
+    };
+    for (const char* envVar : envVars) {
+        fingerprint += QString(envVar) + "=" + qgetenv(envVar) + ";";
+    }
+
+    fingerprint += getGpuFingerprint();
+
+    s_Fingerprint = QCryptographicHash::hash(fingerprint.toUtf8(), QCryptographicHash::Sha1).toHex();
+
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                "Decoder probe cache fingerprint: %s",
+                qPrintable(s_Fingerprint));
+
+    return s_Fingerprint;
+}
+
+bool DecoderProbeCache::lookup(StreamingPreferences::VideoDecoderSelection vds,
+                               int videoFormat, int width, int height, int frameRate,
+                               PROBE_RESULT& result)
+{
+    if (!isEnabled()) {
+        return false;
+    }
+
+    QSettings settings;
+    settings.beginGroup(SER_PROBECACHE);
+
+    if (settings.value(SER_FINGERPRINT).toString() != getFingerprint()) {
+        // Results were cached on different hardware or software. store()
+        // will clear them when it records a new result.
+        return false;
+    }
+
+    settings.beginGroup(SER_RESULTS);
+    QVariantList values = settings.value(getProbeKey(vds, videoFormat, width, height, frameRate)).toList();
+    if (values.size() != 6) {
+        return false;
+    }
+
+    result.isHardwareAccelerated = values[0].toBool();
+    result.isFullScreenOnly = values[1].toBool();
+    result.maxResolution = QSize(values[2].toInt(), values[3].toInt());
+    result.capabilities = values[4].toInt();
+    result.colorspace = values[5].toInt();
+
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                "Using cached decoder probe result for %s",
+                qPrintable(getProbeKey(vds, videoFormat, width, height, frameRate)));
+
+    return true;
+}
+
+void DecoderProbeCache::store(StreamingPreferences::VideoDecoderSelection vds,
+                              int videoFormat, int width, int height, int frameRate,
+                              const PROBE_RESULT& result)
+{
+    if (!isEnabled()) {
+        return;
+    }
+
+    QSettings settings;
+    settings.beginGroup(SER_PROBECACHE);
+
+    QString fingerprint = getFingerprint();
+    if (settings.value(SER_FINGERPRINT).toString() != fingerprint) {
+        // Throw out results from the old configuration
+        settings.remove("");
+        settings.setValue(SER_FINGERPRINT, fingerprint);
+    }
+
+    settings.beginGroup(SER_RESULTS);
+    settings.setValue(getProbeKey(vds, videoFormat, width, height, frameRate),
+                      QVariantList() << result.isHardwareAccelerated
+                                     << result.isFullScreenOnly
+                                     << result.maxResolution.width()
+                                     << result.maxResolution.height()
+                                     << result.capabilities
+                                     << result.colorspace);
+}
+
+void DecoderProbeCache::invalidate()
+{
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                "Invalidating decoder probe cache");
+
+    QSettings settings;
+    settings.remove(SER_PROBECACHE);
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <QSize>
+#include <QString>
+
+#include "settings/streamingpreferences.h"
+
+// Persists the results of test-only decoder probes across launches.
+//
+// Probing a decoder requires initializing the hardware and decoding a
+// test frame for each candidate, which can take seconds. The results
+// only change when the GPU, its drivers, or our decoding libraries
+// change, so the cache is keyed by a fingerprint of those and thrown
+// away automatically when the fingerprint no longer matches.
+class DecoderProbeCache
+{
+public:
+    typedef struct _PROBE_RESULT {
+        bool isHardwareAccelerated;
+        bool isFullScreenOnly;
+        QSize maxResolution;
+        int capabilities;
+        int colorspace;
+    } PROBE_RESULT, *PPROBE_RESULT;
+
+    static
+    bool lookup(StreamingPreferences::VideoDecoderSelection vds,
+                int videoFormat, int width, int height, int frameRate,
+                PROBE_RESULT& result);
+
+    static
+    void store(StreamingPreferences::VideoDecoderSelection vds,
+               int videoFormat, int width, int height, int frameRate,
+               const PROBE_RESULT& result);
+
+    // Drops all cached results
+    static
+    void invalidate();
+
+private:
+    static
+    bool isEnabled();
+
+    static
+    QString getProbeKey(StreamingPreferences::VideoDecoderSelection vds,
+                        int videoFormat, int width, int height, int frameRate);
+
+    static
+    QString getFingerprint();
+
+    static
+    QString getGpuFingerprint();
+
+    static QString s_Fingerprint;
+};
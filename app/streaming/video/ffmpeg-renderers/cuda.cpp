@@ -1,13 +1,76 @@
 #include "cuda.h"
 
+#ifdef HAVE_FFNVCODEC
+#include <ffnvcodec/dynlink_loader.h>
+
+extern "C" {
+#include <libavutil/hwcontext_cuda.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+}
+
+#ifndef CU_MEMHOSTALLOC_PORTABLE
+#define CU_MEMHOSTALLOC_PORTABLE 0x01
+#endif
+
+// Shared by the renderer and each buffer it allocates, since pooled
+// buffers may be freed after the renderer has been destroyed
+typedef struct _CUDA_READBACK {
+    SDL_atomic_t refCount;
+
+    // Keeps the CUDA context alive until the last buffer is freed
+    AVBufferRef* deviceRef;
+    CUcontext context;
+    CUstream stream;
+
+    CudaFunctions* funcs;
+
+    // The loader doesn't cover the page-locked allocator
+    void* library;
+    CUresult (CUDAAPI *cuMemHostAlloc)(void**, size_t, unsigned int);
+    CUresult (CUDAAPI *cuMemFreeHost)(void*);
+} CUDA_READBACK;
+
+static void releaseReadback(CUDA_READBACK* readback)
+{
+    if (!SDL_AtomicDecRef(&readback->refCount)) {
+        return;
+    }
+
+    if (readback->stream != nullptr &&
+            readback->funcs->cuCtxPushCurrent(readback->context) == CUDA_SUCCESS) {
+        CUcontext dummy;
+
+        readback->funcs->cuStreamDestroy(readback->stream);
+        readback->funcs->cuCtxPopCurrent(&dummy);
+    }
+
+    if (readback->library != nullptr) {
+        SDL_UnloadObject(readback->library);
+    }
+
+    cuda_free_functions(&readback->funcs);
+    av_buffer_unref(&readback->deviceRef);
+    delete readback;
+}
+#endif
+
 CUDARenderer::CUDARenderer()
     : m_HwContext(nullptr)
+#ifdef HAVE_FFNVCODEC
+    , m_Readback(nullptr)
+#endif
 {
 
 }
 
 CUDARenderer::~CUDARenderer()
 {
+#ifdef HAVE_FFNVCODEC
+    // Buffers still in use keep the read-back state alive
+    cleanupReadback();
+#endif
+
     if (m_HwContext != nullptr) {
         av_buffer_unref(&m_HwContext);
     }
@@ -25,9 +88,215 @@ bool CUDARenderer::initialize(PDECODER_PARAMETERS)
         return false;
     }
 
+#ifdef HAVE_FFNVCODEC
+    // Set CUDA_PINNED_READBACK=0 to let FFmpeg read back frames
+    if (qgetenv("CUDA_PINNED_READBACK") != "0" && !initializeReadback()) {
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                    "Falling back to FFmpeg CUDA read-back");
+        cleanupReadback();
+    }
+#endif
+
+    return true;
+}
+
+#ifdef HAVE_FFNVCODEC
+
+bool CUDARenderer::initializeReadback()
+{
+    auto deviceContext = (AVHWDeviceContext*)m_HwContext->data;
+    auto cudaDeviceContext = (AVCUDADeviceContext*)deviceContext->hwctx;
+
+    m_Readback = new CUDA_READBACK();
+    SDL_AtomicSet(&m_Readback->refCount, 1);
+    m_Readback->deviceRef = av_buffer_ref(m_HwContext);
+    m_Readback->context = cudaDeviceContext->cuda_ctx;
+
+    if (m_Readback->deviceRef == nullptr) {
+        return false;
+    }
+
+    if (cuda_load_functions(&m_Readback->funcs, nullptr) != 0) {
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                    "Unable to load CUDA functions");
+        return false;
+    }
+
+    m_Readback->library = SDL_LoadObject(CUDA_LIBNAME);
+    if (m_Readback->library == nullptr) {
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                    "Unable to load %s: %s",
+                    CUDA_LIBNAME,
+                    SDL_GetError());
+        return false;
+    }
+
+#define LOAD_CUDA_FUNCTION(name, symbol) \
+    m_Readback->name = (decltype(m_Readback->name))SDL_LoadFunction(m_Readback->library, symbol); \
+    if (m_Readback->name == nullptr) { \
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, \
+                    "Missing CUDA function: " symbol); \
+        return false; \
+    }
+
+    LOAD_CUDA_FUNCTION(cuMemHostAlloc, "cuMemHostAlloc");
+    LOAD_CUDA_FUNCTION(cuMemFreeHost, "cuMemFreeHost");
+
+#undef LOAD_CUDA_FUNCTION
+
+    CudaFunctions* funcs = m_Readback->funcs;
+    if (funcs->cuCtxPushCurrent(m_Readback->context) != CUDA_SUCCESS) {
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                    "cuCtxPushCurrent() failed");
+        return false;
+    }
+
+    // Our own stream lets read-back overlap with work FFmpeg queues on
+    // its stream. It's a blocking stream, so it still waits for FFmpeg's
+    // copies out of the decoder on the default stream to finish first.
+    CUresult res = funcs->cuStreamCreate(&m_Readback->stream, 0);
+
+    CUcontext dummy;
+    funcs->cuCtxPopCurrent(&dummy);
+
+    if (res != CUDA_SUCCESS) {
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                    "cuStreamCreate() failed: %d",
+                    res);
+        m_Readback->stream = nullptr;
+        return false;
+    }
+
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                "Using page-locked CUDA read-back");
+    return true;
+}
+
+void CUDARenderer::cleanupReadback()
+{
+    if (m_Readback != nullptr) {
+        releaseReadback(m_Readback);
+        m_Readback = nullptr;
+    }
+}
+
+void CUDARenderer::freeReadbackBuffer(void* opaque, uint8_t* data)
+{
+    auto readback = (CUDA_READBACK*)opaque;
+
+    if (readback->funcs->cuCtxPushCurrent(readback->context) == CUDA_SUCCESS) {
+        CUcontext dummy;
+
+        readback->cuMemFreeHost(data);
+        readback->funcs->cuCtxPopCurrent(&dummy);
+    }
+
+    // Drop the reference this buffer held
+    releaseReadback(readback);
+}
+
+AVBufferRef* CUDARenderer::allocateReadbackBuffer(int size)
+{
+    if (m_Readback == nullptr) {
+        return nullptr;
+    }
+
+    CudaFunctions* funcs = m_Readback->funcs;
+    if (funcs->cuCtxPushCurrent(m_Readback->context) != CUDA_SUCCESS) {
+        return nullptr;
+    }
+
+    // Page-locked memory can be written by DMA at the full bus rate,
+    // instead of being staged through a driver buffer like pageable
+    // memory. It's a scarce resource, but the pool only holds a few.
+    void* data;
+    CUresult res = m_Readback->cuMemHostAlloc(&data, size, CU_MEMHOSTALLOC_PORTABLE);
+
+    CUcontext dummy;
+    funcs->cuCtxPopCurrent(&dummy);
+
+    if (res != CUDA_SUCCESS) {
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                    "cuMemHostAlloc(%d) failed: %d",
+                    size,
+                    res);
+        return nullptr;
+    }
+
+    // Each buffer keeps the read-back state alive until it's freed
+    SDL_AtomicIncRef(&m_Readback->refCount);
+
+    AVBufferRef* buffer = av_buffer_create((uint8_t*)data, size, freeReadbackBuffer, m_Readback, 0);
+    if (buffer == nullptr) {
+        freeReadbackBuffer(m_Readback, (uint8_t*)data);
+    }
+
+    return buffer;
+}
+
+bool CUDARenderer::transferHwFrame(AVFrame* swFrame, AVFrame* hwFrame)
+{
+    if (m_Readback == nullptr) {
+        return false;
+    }
+
+    // The decoder's surfaces already are in the read-back format
+    // (NV12 or P010), so each plane is a straight 2D copy.
+    auto hwFrameCtx = (AVHWFramesContext*)hwFrame->hw_frames_ctx->data;
+    if (swFrame->format != hwFrameCtx->sw_format) {
+        return false;
+    }
+
+    const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get((enum AVPixelFormat)swFrame->format);
+    int rowBytes[4];
+    if (desc == nullptr || av_image_fill_linesizes(rowBytes, (enum AVPixelFormat)swFrame->format, swFrame->width) < 0) {
+        return false;
+    }
+
+    CudaFunctions* funcs = m_Readback->funcs;
+    if (funcs->cuCtxPushCurrent(m_Readback->context) != CUDA_SUCCESS) {
+        return false;
+    }
+
+    CUresult res = CUDA_SUCCESS;
+    int planeCount = av_pix_fmt_count_planes((enum AVPixelFormat)swFrame->format);
+    for (int i = 0; i < planeCount && res == CUDA_SUCCESS; i++) {
+        CUDA_MEMCPY2D copy;
+
+        SDL_zero(copy);
+        copy.srcMemoryType = CU_MEMORYTYPE_DEVICE;
+        copy.srcDevice = (CUdeviceptr)hwFrame->data[i];
+        copy.srcPitch = hwFrame->linesize[i];
+        copy.dstMemoryType = CU_MEMORYTYPE_HOST;
+        copy.dstHost = swFrame->data[i];
+        copy.dstPitch = swFrame->linesize[i];
+        copy.WidthInBytes = rowBytes[i];
+        copy.Height = (i == 1 || i == 2) ?
+                    AV_CEIL_RSHIFT(swFrame->height, desc->log2_chroma_h) : swFrame->height;
+
+        res = funcs->cuMemcpy2DAsync(&copy, m_Readback->stream);
+    }
+
+    // Wait for all planes at once rather than after each copy
+    if (res == CUDA_SUCCESS) {
+        res = funcs->cuStreamSynchronize(m_Readback->stream);
+    }
+
+    CUcontext dummy;
+    funcs->cuCtxPopCurrent(&dummy);
+
+    if (res != CUDA_SUCCESS) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "CUDA read-back failed: %d",
+                     res);
+        return false;
+    }
+
     return true;
 }
 
+#endif
+
 bool CUDARenderer::prepareDecoderContext(AVCodecContext* context, AVDictionary**)
 {
     context->hw_device_ctx = av_buffer_ref(m_HwContext);
@@ -54,4 +323,3 @@ bool CUDARenderer::isDirectRenderingSupported()
     // We only support rendering via SDL read-back
     return false;
 }
-
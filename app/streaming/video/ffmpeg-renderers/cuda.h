@@ -11,8 +11,25 @@ public:
     virtual void renderFrame(AVFrame* frame) override;
     virtual bool needsTestFrame() override;
     virtual bool isDirectRenderingSupported() override;
+#ifdef HAVE_FFNVCODEC
+    virtual AVBufferRef* allocateReadbackBuffer(int size) override;
+    virtual bool transferHwFrame(AVFrame* swFrame, AVFrame* hwFrame) override;
+#endif
 
 private:
+#ifdef HAVE_FFNVCODEC
+    bool initializeReadback();
+
+    void cleanupReadback();
+
+    static void freeReadbackBuffer(void* opaque, uint8_t* data);
+#endif
+
     AVBufferRef* m_HwContext;
-};
 
+#ifdef HAVE_FFNVCODEC
+    // CUDA driver state for read-back into page-locked memory,
+    // or nullptr if FFmpeg does the read-back
+    struct _CUDA_READBACK* m_Readback;
+#endif
+};
@@ -8,29 +8,94 @@ extern "C" {
 
 #include <unistd.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
 
+#include "pacer/pacer.h"
 #include "streaming/streamutils.h"
+#include "streaming/tracer.h"
 #include "streaming/session.h"
 
 #include <Limelight.h>
 
+// Longest we'll wait for the last page flip before presenting again
+#define PAGE_FLIP_TIMEOUT_MS 100
+
 DrmRenderer::DrmRenderer()
     : m_DrmFd(-1),
       m_CrtcId(0),
       m_PlaneId(0),
-      m_CurrentFbId(0)
+      m_FbCacheClock(0),
+      m_FbCacheFramesContext(nullptr),
+      m_PresentedFrames(0),
+      m_CreatedFbs(0),
+      m_Atomic(false),
+      m_FlipEventThread(nullptr),
+      m_StopFd(-1),
+      m_FlipDone(SDL_CreateSemaphore(0)),
+      m_FlipLock(0),
+      m_FlipPending(false),
+      m_PendingFrame(nullptr),
+      m_DisplayedFrame(nullptr),
+      m_PendingFbId(0),
+      m_DisplayedFbId(0),
+      m_VsyncSource(nullptr),
+      m_FlipSequence(0),
+      m_FrameGraphPlaneId(0),
+      m_NextFrameGraphBuffer(0),
+      m_FrameGraphVisible(false)
 {
+    SDL_zero(m_FbCache);
+    SDL_zero(m_PlaneProperties);
+    SDL_zero(m_FrameGraphPlaneProperties);
+    SDL_zero(m_FrameGraphBuffers);
 }
 
 DrmRenderer::~DrmRenderer()
 {
-    if (m_CurrentFbId != 0) {
-        drmModeRmFB(m_DrmFd, m_CurrentFbId);
+    if (m_FlipEventThread != nullptr) {
+        uint64_t stop = 1;
+
+        // Wake the thread up if it's waiting for an event
+        if (write(m_StopFd, &stop, sizeof(stop)) < 0) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                         "Failed to stop page flip event thread: %d",
+                         errno);
+        }
+
+        SDL_WaitThread(m_FlipEventThread, nullptr);
+    }
+
+    if (m_PresentedFrames > 0) {
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                    "Presented %d frames with %d DRM framebuffers",
+                    m_PresentedFrames,
+                    m_CreatedFbs);
     }
 
+    // Removing the FBs takes them off the planes
+    for (int i = 0; i < DRM_FB_CACHE_SIZE; i++) {
+        freeFrameBuffer(&m_FbCache[i]);
+    }
+
+    destroyFrameGraphBuffers();
+
+    // Nothing is scanning these out anymore
+    av_frame_free(&m_PendingFrame);
+    av_frame_free(&m_DisplayedFrame);
+    freeRetiredFrames();
+
     if (m_DrmFd != -1) {
         close(m_DrmFd);
     }
+
+    if (m_StopFd != -1) {
+        close(m_StopFd);
+    }
+
+    SDL_DestroySemaphore(m_FlipDone);
 }
 
 bool DrmRenderer::prepareDecoderContext(AVCodecContext*, AVDictionary**)
@@ -143,39 +208,32 @@ bool DrmRenderer::initialize(PDECODER_PARAMETERS)
         return false;
     }
 
-    // Find an NV12 overlay plane to render on
+    // Find an NV12 overlay plane to render on, and an ARGB overlay plane
+    // for the frame graph. Planes are usually stacked in the order they're
+    // listed, so the frame graph only takes planes after the video's.
     m_PlaneId = 0;
-    for (uint32_t i = 0; i < planeRes->count_planes && m_PlaneId == 0; i++) {
+    m_FrameGraphPlaneId = 0;
+    for (uint32_t i = 0; i < planeRes->count_planes && m_FrameGraphPlaneId == 0; i++) {
         drmModePlane* plane = drmModeGetPlane(m_DrmFd, planeRes->planes[i]);
         if (plane != nullptr) {
-            bool matchingFormat = false;
+            bool hasNv12 = false;
+            bool hasArgb = false;
             for (uint32_t j = 0; j < plane->count_formats; j++) {
                 if (plane->formats[j] == DRM_FORMAT_NV12) {
-                    matchingFormat = true;
-                    break;
+                    hasNv12 = true;
+                }
+                else if (plane->formats[j] == DRM_FORMAT_ARGB8888) {
+                    hasArgb = true;
                 }
             }
 
-            if (matchingFormat == false) {
-                drmModeFreePlane(plane);
-                continue;
-            }
-
-            if ((plane->possible_crtcs & (1 << crtcIndex)) && plane->crtc_id == 0) {
-                drmModeObjectPropertiesPtr props = drmModeObjectGetProperties(m_DrmFd, planeRes->planes[i], DRM_MODE_OBJECT_PLANE);
-                if (props != nullptr) {
-                    for (uint32_t j = 0; j < props->count_props && m_PlaneId == 0; j++) {
-                        drmModePropertyPtr prop = drmModeGetProperty(m_DrmFd, props->props[j]);
-                        if (prop != nullptr) {
-                            if (!strcmp(prop->name, "type") && props->prop_values[j] == DRM_PLANE_TYPE_OVERLAY) {
-                                m_PlaneId = plane->plane_id;
-                            }
-
-                            drmModeFreeProperty(prop);
-                        }
-                    }
-
-                    drmModeFreeObjectProperties(props);
+            if ((plane->possible_crtcs & (1 << crtcIndex)) && plane->crtc_id == 0 &&
+                    isOverlayPlane(planeRes->planes[i])) {
+                if (m_PlaneId == 0 && hasNv12) {
+                    m_PlaneId = plane->plane_id;
+                }
+                else if (m_PlaneId != 0 && hasArgb) {
+                    m_FrameGraphPlaneId = plane->plane_id;
                 }
             }
 
@@ -185,22 +243,289 @@ bool DrmRenderer::initialize(PDECODER_PARAMETERS)
 
     drmModeFreePlaneResources(planeRes);
 
+    if (m_FrameGraphPlaneId == 0) {
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                    "No overlay plane available for the frame graph");
+    }
+
+    // Atomic commits queue the flip without blocking and send an event
+    // once it's on screen. Without them, we use drmModeSetPlane().
+    const char* atomic = SDL_getenv("DRM_ATOMIC");
+    if (atomic != nullptr && !strcmp(atomic, "0")) {
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                    "Atomic modesetting disabled by DRM_ATOMIC");
+    }
+    else if (drmSetClientCap(m_DrmFd, DRM_CLIENT_CAP_ATOMIC, 1) < 0) {
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                    "Atomic modesetting is not supported: %d",
+                    errno);
+    }
+    else if (getPlaneProperties(m_PlaneId, &m_PlaneProperties)) {
+        // Make sure the driver takes atomic commits for our
+        // planes before we send every frame that way
+        if (!testAtomicCommit(false)) {
+            SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                        "Atomic test commit was rejected");
+        }
+        else {
+            m_Atomic = true;
+
+            if (m_FrameGraphPlaneId != 0 &&
+                    (!getPlaneProperties(m_FrameGraphPlaneId, &m_FrameGraphPlaneProperties) ||
+                     !testAtomicCommit(true))) {
+                m_FrameGraphPlaneId = 0;
+            }
+        }
+    }
+
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                "Presenting with %s",
+                m_Atomic ? "atomic page flips" : "drmModeSetPlane()");
+
+    if (m_Atomic) {
+        m_StopFd = eventfd(0, EFD_CLOEXEC);
+        if (m_StopFd < 0) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                         "eventfd() failed: %d",
+                         errno);
+            return false;
+        }
+
+        m_FlipEventThread = SDL_CreateThread(flipEventThread, "DRMFlipEvents", this);
+        if (m_FlipEventThread == nullptr) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                         "Unable to create page flip event thread: %s",
+                         SDL_GetError());
+            return false;
+        }
+    }
+
     return true;
 }
 
-enum AVPixelFormat DrmRenderer::getPreferredPixelFormat(int)
+bool DrmRenderer::isOverlayPlane(uint32_t planeId)
 {
-    // DRM PRIME buffers
-    return AV_PIX_FMT_DRM_PRIME;
+    bool overlay = false;
+
+    drmModeObjectPropertiesPtr props = drmModeObjectGetProperties(m_DrmFd, planeId, DRM_MODE_OBJECT_PLANE);
+    if (props != nullptr) {
+        for (uint32_t i = 0; i < props->count_props && !overlay; i++) {
+            drmModePropertyPtr prop = drmModeGetProperty(m_DrmFd, props->props[i]);
+            if (prop != nullptr) {
+                if (!strcmp(prop->name, "type") && props->prop_values[i] == DRM_PLANE_TYPE_OVERLAY) {
+                    overlay = true;
+                }
+
+                drmModeFreeProperty(prop);
+            }
+        }
+
+        drmModeFreeObjectProperties(props);
+    }
+
+    return overlay;
 }
 
-int DrmRenderer::getRendererAttributes()
+bool DrmRenderer::getPlaneProperties(uint32_t planeId, PLANE_PROPERTIES* properties)
 {
-    // This renderer can only draw in full-screen
-    return RENDERER_ATTRIBUTE_FULLSCREEN_ONLY;
+    const struct {
+        const char* name;
+        uint32_t* id;
+    } wanted[] = {
+        { "FB_ID", &properties->fbId },
+        { "CRTC_ID", &properties->crtcId },
+        { "SRC_X", &properties->srcX },
+        { "SRC_Y", &properties->srcY },
+        { "SRC_W", &properties->srcW },
+        { "SRC_H", &properties->srcH },
+        { "CRTC_X", &properties->crtcX },
+        { "CRTC_Y", &properties->crtcY },
+        { "CRTC_W", &properties->crtcW },
+        { "CRTC_H", &properties->crtcH },
+    };
+
+    SDL_zerop(properties);
+
+    drmModeObjectPropertiesPtr props = drmModeObjectGetProperties(m_DrmFd, planeId, DRM_MODE_OBJECT_PLANE);
+    if (props == nullptr) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "drmModeObjectGetProperties() failed: %d",
+                     errno);
+        return false;
+    }
+
+    for (uint32_t i = 0; i < props->count_props; i++) {
+        drmModePropertyPtr prop = drmModeGetProperty(m_DrmFd, props->props[i]);
+        if (prop != nullptr) {
+            for (size_t j = 0; j < SDL_arraysize(wanted); j++) {
+                if (!strcmp(prop->name, wanted[j].name)) {
+                    *wanted[j].id = prop->prop_id;
+                }
+            }
+
+            drmModeFreeProperty(prop);
+        }
+    }
+
+    drmModeFreeObjectProperties(props);
+
+    for (size_t i = 0; i < SDL_arraysize(wanted); i++) {
+        if (*wanted[i].id == 0) {
+            SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                        "Plane %u has no %s property",
+                        planeId,
+                        wanted[i].name);
+            return false;
+        }
+    }
+
+    return true;
 }
 
-void DrmRenderer::renderFrame(AVFrame* frame)
+// Taking our planes off the CRTC sets the same properties as
+// presenting a frame does, without needing a frame to test with
+bool DrmRenderer::testAtomicCommit(bool includeFrameGraph)
+{
+    drmModeAtomicReqPtr req = drmModeAtomicAlloc();
+    if (req == nullptr) {
+        return false;
+    }
+
+    SDL_Rect empty = {};
+    addPlaneToRequest(req, m_PlaneId, m_PlaneProperties, 0, empty, empty);
+    if (includeFrameGraph) {
+        addPlaneToRequest(req, m_FrameGraphPlaneId, m_FrameGraphPlaneProperties, 0, empty, empty);
+    }
+
+    int err = drmModeAtomicCommit(m_DrmFd, req, DRM_MODE_ATOMIC_TEST_ONLY, nullptr);
+    if (err < 0) {
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                    "drmModeAtomicCommit(DRM_MODE_ATOMIC_TEST_ONLY) failed%s: %d",
+                    includeFrameGraph ? " for the frame graph" : "",
+                    errno);
+    }
+
+    drmModeAtomicFree(req);
+    return err >= 0;
+}
+
+bool DrmRenderer::createFrameGraphBuffers()
+{
+    for (int i = 0; i < FRAME_GRAPH_BUFFER_COUNT; i++) {
+        DUMB_BUFFER* buffer = &m_FrameGraphBuffers[i];
+
+        struct drm_mode_create_dumb createBuf = {};
+        createBuf.width = FRAME_GRAPH_WIDTH;
+        createBuf.height = FRAME_GRAPH_HEIGHT;
+        createBuf.bpp = 32;
+        if (drmIoctl(m_DrmFd, DRM_IOCTL_MODE_CREATE_DUMB, &createBuf) < 0) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                         "DRM_IOCTL_MODE_CREATE_DUMB failed: %d",
+                         errno);
+            return false;
+        }
+
+        buffer->handle = createBuf.handle;
+        buffer->pitch = createBuf.pitch;
+        buffer->size = createBuf.size;
+
+        uint32_t handles[4] = { buffer->handle };
+        uint32_t pitches[4] = { buffer->pitch };
+        uint32_t offsets[4] = {};
+        if (drmModeAddFB2(m_DrmFd, FRAME_GRAPH_WIDTH, FRAME_GRAPH_HEIGHT,
+                          DRM_FORMAT_ARGB8888, handles, pitches, offsets,
+                          &buffer->fbId, 0) < 0) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                         "drmModeAddFB2() failed: %d",
+                         errno);
+            return false;
+        }
+
+        struct drm_mode_map_dumb mapBuf = {};
+        mapBuf.handle = buffer->handle;
+        if (drmIoctl(m_DrmFd, DRM_IOCTL_MODE_MAP_DUMB, &mapBuf) < 0) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                         "DRM_IOCTL_MODE_MAP_DUMB failed: %d",
+                         errno);
+            return false;
+        }
+
+        buffer->mapping = mmap(nullptr, buffer->size, PROT_READ | PROT_WRITE, MAP_SHARED, m_DrmFd, mapBuf.offset);
+        if (buffer->mapping == MAP_FAILED) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                         "mmap() failed: %d",
+                         errno);
+            buffer->mapping = nullptr;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void DrmRenderer::destroyFrameGraphBuffers()
+{
+    for (int i = 0; i < FRAME_GRAPH_BUFFER_COUNT; i++) {
+        DUMB_BUFFER* buffer = &m_FrameGraphBuffers[i];
+
+        if (buffer->mapping != nullptr) {
+            munmap(buffer->mapping, buffer->size);
+        }
+
+        // Removing the FB also takes it off the plane
+        if (buffer->fbId != 0) {
+            drmModeRmFB(m_DrmFd, buffer->fbId);
+        }
+
+        if (buffer->handle != 0) {
+            struct drm_mode_destroy_dumb destroyBuf = {};
+            destroyBuf.handle = buffer->handle;
+            drmIoctl(m_DrmFd, DRM_IOCTL_MODE_DESTROY_DUMB, &destroyBuf);
+        }
+    }
+
+    SDL_zero(m_FrameGraphBuffers);
+}
+
+// Returns true if the frame graph plane needs updating, with
+// the FB to show on it or 0 to take it down
+bool DrmRenderer::prepareFrameGraph(uint32_t* fbId)
+{
+    *fbId = 0;
+
+    if (m_FrameGraphPlaneId == 0) {
+        return false;
+    }
+
+    if (Session::get() == nullptr || !Session::get()->getOverlayManager().isOverlayEnabled(Overlay::OverlayFrameGraph)) {
+        return m_FrameGraphVisible;
+    }
+
+    if (m_FrameGraphBuffers[0].mapping == nullptr && !createFrameGraphBuffers()) {
+        // Don't retry on every frame
+        disableFrameGraph();
+        return false;
+    }
+
+    DUMB_BUFFER* buffer = &m_FrameGraphBuffers[m_NextFrameGraphBuffer];
+    m_NextFrameGraphBuffer = (m_NextFrameGraphBuffer + 1) % FRAME_GRAPH_BUFFER_COUNT;
+
+    // DRM_FORMAT_ARGB8888 is ARGB in a little-endian 32-bit word
+    Session::get()->getOverlayManager().getFrameGraph().draw(buffer->mapping, buffer->pitch,
+                                                             SDL_PIXELFORMAT_ARGB8888);
+
+    *fbId = buffer->fbId;
+    return true;
+}
+
+void DrmRenderer::disableFrameGraph()
+{
+    destroyFrameGraphBuffers();
+    m_FrameGraphPlaneId = 0;
+    m_FrameGraphVisible = false;
+}
+
+uint32_t DrmRenderer::getFrameBuffer(AVFrame* frame)
 {
     AVDRMFrameDescriptor* drmFrame = (AVDRMFrameDescriptor*)frame->data[0];
     int err;
@@ -209,24 +534,16 @@ void DrmRenderer::renderFrame(AVFrame* frame)
     uint32_t pitches[4] = {};
     uint32_t offsets[4] = {};
 
-    SDL_Rect src, dst;
-
-    src.x = src.y = 0;
-    src.w = frame->width;
-    src.h = frame->height;
-    dst = m_OutputRect;
-
-    StreamUtils::scaleSourceToDestinationSurface(&src, &dst);
-
     // Convert the FD in the AVDRMFrameDescriptor to a PRIME handle
-    // that can be used in drmModeAddFB2()
+    // that can be used in drmModeAddFB2(). Importing the same buffer
+    // again gives back the same handle, which is what we cache on.
     SDL_assert(drmFrame->nb_objects == 1);
     err = drmPrimeFDToHandle(m_DrmFd, drmFrame->objects[0].fd, &primeHandle);
     if (err < 0) {
         SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
                      "drmPrimeFDToHandle() failed: %d",
                      errno);
-        return;
+        return 0;
     }
 
     SDL_assert(drmFrame->nb_layers == 1);
@@ -237,38 +554,550 @@ void DrmRenderer::renderFrame(AVFrame* frame)
         offsets[i] = drmFrame->layers[0].planes[i].offset;
     }
 
-    // Remember the last FB object we created so we can free it
-    // when we are finished rendering this one (if successful).
-    uint32_t lastFbId = m_CurrentFbId;
+    // A new frames context means the decoder replaced its frame pool,
+    // so the buffers behind our other FBs are gone or soon will be
+    void* framesContext = frame->hw_frames_ctx != nullptr ? frame->hw_frames_ctx->data : nullptr;
+    if (framesContext != m_FbCacheFramesContext) {
+        evictFrameBuffers(0);
+        m_FbCacheFramesContext = framesContext;
+    }
+    else {
+        evictFrameBuffers(DRM_FB_MAX_IDLE_FRAMES);
+    }
+
+    FB_CACHE_ENTRY* entry = nullptr;
+    for (int i = 0; i < DRM_FB_CACHE_SIZE; i++) {
+        FB_CACHE_ENTRY* candidate = &m_FbCache[i];
+
+        if (candidate->fbId != 0 &&
+                candidate->handle == primeHandle &&
+                candidate->width == (uint32_t)frame->width &&
+                candidate->height == (uint32_t)frame->height &&
+                candidate->format == drmFrame->layers[0].format &&
+                !memcmp(candidate->pitches, pitches, sizeof(pitches)) &&
+                !memcmp(candidate->offsets, offsets, sizeof(offsets))) {
+            candidate->lastUsed = ++m_FbCacheClock;
+            return candidate->fbId;
+        }
+    }
+
+    // Take a free entry, or else the least recently used one
+    // that isn't on screen or about to be
+    for (int i = 0; i < DRM_FB_CACHE_SIZE; i++) {
+        FB_CACHE_ENTRY* candidate = &m_FbCache[i];
+
+        if (candidate->fbId == 0) {
+            entry = candidate;
+            break;
+        }
+        else if (isFrameBufferInUse(candidate->fbId)) {
+            continue;
+        }
+        else if (entry == nullptr || candidate->lastUsed < entry->lastUsed) {
+            entry = candidate;
+        }
+    }
+
+    SDL_assert(entry != nullptr);
+    freeFrameBuffer(entry);
+
+    entry->handle = primeHandle;
+    entry->width = frame->width;
+    entry->height = frame->height;
+    entry->format = drmFrame->layers[0].format;
+    memcpy(entry->pitches, pitches, sizeof(pitches));
+    memcpy(entry->offsets, offsets, sizeof(offsets));
+    entry->lastUsed = ++m_FbCacheClock;
 
     // Create a frame buffer object from the PRIME buffer
     err = drmModeAddFB2(m_DrmFd, frame->width, frame->height,
                         drmFrame->layers[0].format,
-                        handles, pitches, offsets, &m_CurrentFbId, 0);
+                        handles, pitches, offsets, &entry->fbId, 0);
     if (err < 0) {
         SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
                      "drmModeAddFB2() failed: %d",
                      errno);
-        m_CurrentFbId = lastFbId;
-        return;
+        entry->fbId = 0;
+        freeFrameBuffer(entry);
+        return 0;
+    }
+
+    m_CreatedFbs++;
+    return entry->fbId;
+}
+
+void DrmRenderer::freeFrameBuffer(FB_CACHE_ENTRY* entry)
+{
+    if (entry->fbId != 0) {
+        drmModeRmFB(m_DrmFd, entry->fbId);
+    }
+
+    if (entry->handle != 0) {
+        bool handleInUse = false;
+
+        // The same buffer may have an FB for another layout
+        for (int i = 0; i < DRM_FB_CACHE_SIZE; i++) {
+            if (&m_FbCache[i] != entry && m_FbCache[i].fbId != 0 && m_FbCache[i].handle == entry->handle) {
+                handleInUse = true;
+                break;
+            }
+        }
+
+        // Our handle keeps the buffer alive, even after the decoder frees it
+        if (!handleInUse) {
+            struct drm_gem_close gemClose = {};
+            gemClose.handle = entry->handle;
+            drmIoctl(m_DrmFd, DRM_IOCTL_GEM_CLOSE, &gemClose);
+        }
+    }
+
+    SDL_zerop(entry);
+}
+
+bool DrmRenderer::isFrameBufferInUse(uint32_t fbId)
+{
+    SDL_AtomicLock(&m_FlipLock);
+
+    bool inUse = fbId == m_DisplayedFbId || fbId == m_PendingFbId;
+    for (const RETIRED_FRAME& retired : m_RetiredFrames) {
+        inUse |= fbId == retired.fbId;
     }
 
+    SDL_AtomicUnlock(&m_FlipLock);
+
+    return inUse;
+}
+
+// Frees the FBs that weren't used in the last maxIdleFrames
+// frames, unless they may still be on screen
+void DrmRenderer::evictFrameBuffers(uint64_t maxIdleFrames)
+{
+    for (int i = 0; i < DRM_FB_CACHE_SIZE; i++) {
+        FB_CACHE_ENTRY* entry = &m_FbCache[i];
+
+        if (entry->fbId != 0 &&
+                entry->lastUsed + maxIdleFrames <= m_FbCacheClock &&
+                !isFrameBufferInUse(entry->fbId)) {
+            freeFrameBuffer(entry);
+        }
+    }
+}
+
+void DrmRenderer::freeRetiredFrames()
+{
+    QVector<RETIRED_FRAME> retiredFrames;
+
+    SDL_AtomicLock(&m_FlipLock);
+    retiredFrames.swap(m_RetiredFrames);
+    SDL_AtomicUnlock(&m_FlipLock);
+
+    for (RETIRED_FRAME& retired : retiredFrames) {
+        av_frame_free(&retired.frame);
+    }
+}
+
+void DrmRenderer::addPlaneToRequest(drmModeAtomicReqPtr req, uint32_t planeId, const PLANE_PROPERTIES& properties,
+                                    uint32_t fbId, const SDL_Rect& src, const SDL_Rect& dst)
+{
+    drmModeAtomicAddProperty(req, planeId, properties.fbId, fbId);
+
+    // A plane without an FB must be off the CRTC too
+    drmModeAtomicAddProperty(req, planeId, properties.crtcId, fbId != 0 ? m_CrtcId : 0);
+
+    if (fbId != 0) {
+        // Source coordinates are 16.16 fixed point
+        drmModeAtomicAddProperty(req, planeId, properties.srcX, (uint64_t)src.x << 16);
+        drmModeAtomicAddProperty(req, planeId, properties.srcY, (uint64_t)src.y << 16);
+        drmModeAtomicAddProperty(req, planeId, properties.srcW, (uint64_t)src.w << 16);
+        drmModeAtomicAddProperty(req, planeId, properties.srcH, (uint64_t)src.h << 16);
+        drmModeAtomicAddProperty(req, planeId, properties.crtcX, dst.x);
+        drmModeAtomicAddProperty(req, planeId, properties.crtcY, dst.y);
+        drmModeAtomicAddProperty(req, planeId, properties.crtcW, dst.w);
+        drmModeAtomicAddProperty(req, planeId, properties.crtcH, dst.h);
+    }
+}
+
+// Returns 0, or the errno of the call that failed
+int DrmRenderer::commitAtomic(uint32_t fbId, const SDL_Rect& src, const SDL_Rect& dst,
+                              bool updateFrameGraph, uint32_t frameGraphFbId, const SDL_Rect& frameGraphDst)
+{
+    drmModeAtomicReqPtr req = drmModeAtomicAlloc();
+    if (req == nullptr) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "drmModeAtomicAlloc() failed");
+        return ENOMEM;
+    }
+
+    addPlaneToRequest(req, m_PlaneId, m_PlaneProperties, fbId, src, dst);
+
+    if (updateFrameGraph) {
+        SDL_Rect frameGraphSrc = { 0, 0, FRAME_GRAPH_WIDTH, FRAME_GRAPH_HEIGHT };
+        addPlaneToRequest(req, m_FrameGraphPlaneId, m_FrameGraphPlaneProperties,
+                          frameGraphFbId, frameGraphSrc, frameGraphDst);
+    }
+
+    // Flip on the next V-blank without waiting for it here
+    int err = 0;
+    if (drmModeAtomicCommit(m_DrmFd, req, DRM_MODE_ATOMIC_NONBLOCK | DRM_MODE_PAGE_FLIP_EVENT,
+                            (void*)(uintptr_t)m_FlipSequence) < 0) {
+        err = errno;
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "drmModeAtomicCommit() failed: %d",
+                     err);
+    }
+
+    drmModeAtomicFree(req);
+    return err;
+}
+
+// Returns 0, or the errno of the call that failed
+int DrmRenderer::commitLegacy(uint32_t fbId, const SDL_Rect& src, const SDL_Rect& dst,
+                              bool updateFrameGraph, uint32_t frameGraphFbId, const SDL_Rect& frameGraphDst)
+{
+    int err;
+
     // Update the overlay
-    err = drmModeSetPlane(m_DrmFd, m_PlaneId, m_CrtcId, m_CurrentFbId, 0,
+    err = drmModeSetPlane(m_DrmFd, m_PlaneId, m_CrtcId, fbId, 0,
                           dst.x, dst.y,
                           dst.w, dst.h,
-                          0, 0,
-                          frame->width << 16,
-                          frame->height << 16);
+                          src.x << 16, src.y << 16,
+                          src.w << 16,
+                          src.h << 16);
     if (err < 0) {
+        err = errno;
         SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
                      "drmModeSetPlane() failed: %d",
-                     errno);
-        drmModeRmFB(m_DrmFd, m_CurrentFbId);
-        m_CurrentFbId = lastFbId;
+                     err);
+        return err;
+    }
+
+    if (updateFrameGraph) {
+        err = drmModeSetPlane(m_DrmFd, m_FrameGraphPlaneId, m_CrtcId, frameGraphFbId, 0,
+                              frameGraphDst.x, frameGraphDst.y,
+                              frameGraphDst.w, frameGraphDst.h,
+                              0, 0,
+                              FRAME_GRAPH_WIDTH << 16,
+                              FRAME_GRAPH_HEIGHT << 16);
+        if (err < 0) {
+            err = errno;
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                         "drmModeSetPlane() failed for the frame graph: %d",
+                         err);
+            return err;
+        }
+    }
+
+    return 0;
+}
+
+int DrmRenderer::commit(uint32_t fbId, const SDL_Rect& src, const SDL_Rect& dst,
+                        bool updateFrameGraph, uint32_t frameGraphFbId, const SDL_Rect& frameGraphDst)
+{
+    return m_Atomic ?
+                commitAtomic(fbId, src, dst, updateFrameGraph, frameGraphFbId, frameGraphDst) :
+                commitLegacy(fbId, src, dst, updateFrameGraph, frameGraphFbId, frameGraphDst);
+}
+
+// Returns false if the pending flip didn't complete in time
+bool DrmRenderer::waitForPageFlip(int timeoutMs)
+{
+    uint64_t deadlineUs = StreamUtils::getMicroseconds() + timeoutMs * 1000;
+
+    for (;;) {
+        SDL_AtomicLock(&m_FlipLock);
+        bool flipPending = m_FlipPending;
+        SDL_AtomicUnlock(&m_FlipLock);
+
+        if (!flipPending) {
+            return true;
+        }
+
+        // The semaphore may have been posted for a flip we gave up
+        // on, so this only returns once we see the flip is done
+        uint64_t now = StreamUtils::getMicroseconds();
+        if (now >= deadlineUs) {
+            SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                        "Page flip did not complete within %d ms",
+                        timeoutMs);
+            return false;
+        }
+
+        SDL_SemWaitTimeout(m_FlipDone, (Uint32)((deadlineUs - now + 999) / 1000));
+    }
+}
+
+// Called with the flip lock held. Returns the frame that's off screen
+// now, which the caller frees after dropping the lock.
+AVFrame* DrmRenderer::completeFlip()
+{
+    AVFrame* replacedFrame = m_DisplayedFrame;
+
+    m_DisplayedFrame = m_PendingFrame;
+    m_DisplayedFbId = m_PendingFbId;
+    m_PendingFrame = nullptr;
+    m_PendingFbId = 0;
+    m_FlipPending = false;
+
+    return replacedFrame;
+}
+
+// Called on the page flip event thread
+void DrmRenderer::pageFlipCompleted(uint32_t sequence, unsigned int tvSec, unsigned int tvUsec)
+{
+    AVFrame* replacedFrame;
+    QVector<RETIRED_FRAME> retiredFrames;
+
+    SDL_AtomicLock(&m_FlipLock);
+
+    // This may be a flip we gave up waiting for, and
+    // already treated as done, so we ignore it then
+    if (!m_FlipPending || sequence != m_FlipSequence) {
+        SDL_AtomicUnlock(&m_FlipLock);
         return;
     }
 
-    // Free the previous FB object which has now been superseded
-    drmModeRmFB(m_DrmFd, lastFbId);
+    replacedFrame = completeFlip();
+
+    // Frames from flips we gave up on are off screen by now too
+    retiredFrames.swap(m_RetiredFrames);
+
+    if (m_VsyncSource != nullptr) {
+        // The event carries the CLOCK_MONOTONIC time of the V-blank
+        // the flip happened on, which we move onto our own clock
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        uint64_t nowUs = (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+        uint64_t flipUs = (uint64_t)tvSec * 1000000 + tvUsec;
+
+        m_VsyncSource->framePresented(StreamUtils::getMicroseconds() - (nowUs - SDL_min(flipUs, nowUs)));
+    }
+
+    SDL_AtomicUnlock(&m_FlipLock);
+
+    av_frame_free(&replacedFrame);
+    for (RETIRED_FRAME& retired : retiredFrames) {
+        av_frame_free(&retired.frame);
+    }
+
+    SDL_SemPost(m_FlipDone);
+}
+
+int DrmRenderer::flipEventThread(void* context)
+{
+    DrmRenderer* me = reinterpret_cast<DrmRenderer*>(context);
+
+    Tracer::setThreadName("DRMFlipEvents");
+
+    for (;;) {
+        struct pollfd fds[2] = {
+            { me->m_DrmFd, POLLIN, 0 },
+            { me->m_StopFd, POLLIN, 0 },
+        };
+
+        int ret = poll(fds, 2, -1);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                         "poll() failed: %d",
+                         errno);
+            break;
+        }
+        else if (fds[1].revents != 0) {
+            break;
+        }
+
+        // drmHandleEvent() would only give the page flip handler our
+        // sequence number and not us, so we read the events ourselves
+        char buffer[1024];
+        ssize_t length = read(me->m_DrmFd, buffer, sizeof(buffer));
+        if (length < 0) {
+            if (errno == EINTR || errno == EAGAIN) {
+                continue;
+            }
+
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                         "Failed to read DRM events: %d",
+                         errno);
+            break;
+        }
+
+        for (ssize_t i = 0; i + (ssize_t)sizeof(struct drm_event) <= length;) {
+            struct drm_event* event = (struct drm_event*)&buffer[i];
+            if (event->length < sizeof(*event) || i + (ssize_t)event->length > length) {
+                break;
+            }
+
+            if (event->type == DRM_EVENT_FLIP_COMPLETE) {
+                struct drm_event_vblank* vblank = (struct drm_event_vblank*)event;
+                me->pageFlipCompleted((uint32_t)vblank->user_data, vblank->tv_sec, vblank->tv_usec);
+            }
+
+            i += event->length;
+        }
+    }
+
+    return 0;
+}
+
+enum AVPixelFormat DrmRenderer::getPreferredPixelFormat(int)
+{
+    // DRM PRIME buffers
+    return AV_PIX_FMT_DRM_PRIME;
+}
+
+int DrmRenderer::getRendererAttributes()
+{
+    // This renderer can only draw in full-screen
+    return RENDERER_ATTRIBUTE_FULLSCREEN_ONLY;
+}
+
+bool DrmRenderer::notifyWindowChanged()
+{
+    // We draw to a plane covering the whole CRTC, so the window size doesn't matter
+    return true;
+}
+
+bool DrmRenderer::isPresentTimeReported()
+{
+    // Page-flip events tell us when each frame reached the display
+    return m_Atomic;
+}
+
+void DrmRenderer::setVsyncSource(IVsyncSource* vsyncSource)
+{
+    // The page flip event thread may be using the last one
+    SDL_AtomicLock(&m_FlipLock);
+    m_VsyncSource = vsyncSource;
+    SDL_AtomicUnlock(&m_FlipLock);
+}
+
+void DrmRenderer::renderFrame(AVFrame* frame)
+{
+    SDL_Rect src, dst;
+
+    src.x = src.y = 0;
+    src.w = frame->width;
+    src.h = frame->height;
+    dst = m_OutputRect;
+
+    StreamUtils::scaleSourceToDestinationSurface(&src, &dst);
+
+    // Only one atomic commit can be in flight at a time. Waiting for
+    // it also frees up the frame graph buffer we're about to draw into.
+    if (m_Atomic && !waitForPageFlip(PAGE_FLIP_TIMEOUT_MS)) {
+        // Assume the event was lost rather than stall forever. If
+        // it turns up after all, its sequence number won't match.
+        // We can't tell whether the flip happened, so either frame
+        // may be on screen until a later flip completes.
+        SDL_AtomicLock(&m_FlipLock);
+        if (m_FlipPending) {
+            RETIRED_FRAME displayed = { m_DisplayedFrame, m_DisplayedFbId };
+            RETIRED_FRAME pending = { m_PendingFrame, m_PendingFbId };
+
+            m_RetiredFrames.append(displayed);
+            m_RetiredFrames.append(pending);
+
+            m_DisplayedFrame = nullptr;
+            m_DisplayedFbId = 0;
+            m_PendingFrame = nullptr;
+            m_PendingFbId = 0;
+            m_FlipPending = false;
+        }
+        SDL_AtomicUnlock(&m_FlipLock);
+    }
+
+    uint32_t fbId = getFrameBuffer(frame);
+    if (fbId == 0) {
+        return;
+    }
+
+    // Overlay planes can't always scale, so the graph is shown at its own size
+    SDL_Rect frameGraphDst;
+    frameGraphDst.x = dst.x + SDL_max(dst.w - FRAME_GRAPH_WIDTH, 0);
+    frameGraphDst.y = dst.y + SDL_max(dst.h - FRAME_GRAPH_HEIGHT, 0);
+    frameGraphDst.w = FRAME_GRAPH_WIDTH;
+    frameGraphDst.h = FRAME_GRAPH_HEIGHT;
+
+    uint32_t frameGraphFbId;
+    bool updateFrameGraph = prepareFrameGraph(&frameGraphFbId);
+
+    if (m_Atomic) {
+        // Keep the decoder from reusing the buffer while it's on screen.
+        // This is set up before the commit, since the flip event may
+        // arrive before the commit call returns.
+        SDL_AtomicLock(&m_FlipLock);
+        m_FlipSequence++;
+        m_PendingFrame = av_frame_clone(frame);
+        m_PendingFbId = fbId;
+        m_FlipPending = true;
+        SDL_AtomicUnlock(&m_FlipLock);
+    }
+
+    int err = commit(fbId, src, dst, updateFrameGraph, frameGraphFbId, frameGraphDst);
+
+    // EBUSY means a flip we gave up waiting for is still pending,
+    // which has nothing to do with the frame graph plane
+    if (err != 0 && err != EBUSY && updateFrameGraph) {
+        // The frame graph plane may be what the driver rejected
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                    "Disabling the frame graph plane");
+        disableFrameGraph();
+        updateFrameGraph = false;
+
+        err = commit(fbId, src, dst, false, 0, frameGraphDst);
+    }
+
+    if (err != 0 && m_Atomic) {
+        // No event will come for a commit that failed
+        SDL_AtomicLock(&m_FlipLock);
+        AVFrame* pendingFrame = m_PendingFrame;
+        m_PendingFrame = nullptr;
+        m_PendingFbId = 0;
+        m_FlipPending = false;
+        SDL_AtomicUnlock(&m_FlipLock);
+
+        av_frame_free(&pendingFrame);
+
+        // Anything but EBUSY means the driver won't take this commit,
+        // and likely none after it either. Switch to drmModeSetPlane()
+        // rather than drop every frame.
+        if (err != EBUSY) {
+            SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                        "Atomic commit rejected. Falling back to drmModeSetPlane().");
+            m_Atomic = false;
+
+            err = commitLegacy(fbId, src, dst, updateFrameGraph, frameGraphFbId, frameGraphDst);
+        }
+    }
+
+    if (err != 0) {
+        return;
+    }
+
+    if (updateFrameGraph) {
+        m_FrameGraphVisible = frameGraphFbId != 0;
+    }
+
+    m_PresentedFrames++;
+
+    // drmModeSetPlane() is done by the time it returns
+    if (!m_Atomic) {
+        av_frame_free(&m_DisplayedFrame);
+        m_DisplayedFrame = av_frame_clone(frame);
+        m_DisplayedFbId = fbId;
+
+        // Frames left from atomic commits before we fell back
+        // are off screen now, and Pacer still expects to hear
+        // when frames are presented.
+        freeRetiredFrames();
+
+        SDL_AtomicLock(&m_FlipLock);
+        if (m_VsyncSource != nullptr) {
+            m_VsyncSource->framePresented(StreamUtils::getMicroseconds());
+        }
+        SDL_AtomicUnlock(&m_FlipLock);
+    }
 }
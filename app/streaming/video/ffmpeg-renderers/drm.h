@@ -5,6 +5,20 @@
 #include <xf86drm.h>
 #include <xf86drmMode.h>
 
+#include <QVector>
+
+// Drawn into alternately, so the frame graph is never
+// drawn into the buffer that is being scanned out
+#define FRAME_GRAPH_BUFFER_COUNT 2
+
+// Decoders recycle a small pool of PRIME buffers, so we keep a
+// framebuffer for each rather than creating one every frame
+#define DRM_FB_CACHE_SIZE 32
+
+// FBs unused for this many frames are for buffers the decoder
+// has most likely freed, so our handle shouldn't keep them alive
+#define DRM_FB_MAX_IDLE_FRAMES 64
+
 class DrmRenderer : public IFFmpegRenderer {
 public:
     DrmRenderer();
@@ -14,12 +28,122 @@ public:
     virtual void renderFrame(AVFrame* frame) override;
     virtual enum AVPixelFormat getPreferredPixelFormat(int videoFormat) override;
     virtual int getRendererAttributes() override;
+    virtual bool notifyWindowChanged() override;
+    virtual bool isPresentTimeReported() override;
+    virtual void setVsyncSource(IVsyncSource* vsyncSource) override;
 
 private:
+    typedef struct _DUMB_BUFFER {
+        uint32_t handle;
+        uint32_t fbId;
+        uint32_t pitch;
+        uint64_t size;
+        void* mapping;
+    } DUMB_BUFFER;
+
+    typedef struct _FB_CACHE_ENTRY {
+        // GEM handle of the PRIME buffer, which stays the same
+        // each time the buffer is imported
+        uint32_t handle;
+        uint32_t fbId;
+        uint32_t width;
+        uint32_t height;
+        uint32_t format;
+        uint32_t pitches[4];
+        uint32_t offsets[4];
+        uint64_t lastUsed;
+    } FB_CACHE_ENTRY;
+
+    typedef struct _PLANE_PROPERTIES {
+        uint32_t fbId;
+        uint32_t crtcId;
+        uint32_t srcX;
+        uint32_t srcY;
+        uint32_t srcW;
+        uint32_t srcH;
+        uint32_t crtcX;
+        uint32_t crtcY;
+        uint32_t crtcW;
+        uint32_t crtcH;
+    } PLANE_PROPERTIES;
+
+    typedef struct _RETIRED_FRAME {
+        AVFrame* frame;
+        uint32_t fbId;
+    } RETIRED_FRAME;
+
+    bool isOverlayPlane(uint32_t planeId);
+    bool getPlaneProperties(uint32_t planeId, PLANE_PROPERTIES* properties);
+    bool testAtomicCommit(bool includeFrameGraph);
+    uint32_t getFrameBuffer(AVFrame* frame);
+    void freeFrameBuffer(FB_CACHE_ENTRY* entry);
+    bool isFrameBufferInUse(uint32_t fbId);
+    void evictFrameBuffers(uint64_t maxIdleFrames);
+    void freeRetiredFrames();
+    void addPlaneToRequest(drmModeAtomicReqPtr req, uint32_t planeId, const PLANE_PROPERTIES& properties,
+                           uint32_t fbId, const SDL_Rect& src, const SDL_Rect& dst);
+    int commitAtomic(uint32_t fbId, const SDL_Rect& src, const SDL_Rect& dst,
+                     bool updateFrameGraph, uint32_t frameGraphFbId, const SDL_Rect& frameGraphDst);
+    int commitLegacy(uint32_t fbId, const SDL_Rect& src, const SDL_Rect& dst,
+                     bool updateFrameGraph, uint32_t frameGraphFbId, const SDL_Rect& frameGraphDst);
+    int commit(uint32_t fbId, const SDL_Rect& src, const SDL_Rect& dst,
+               bool updateFrameGraph, uint32_t frameGraphFbId, const SDL_Rect& frameGraphDst);
+    bool waitForPageFlip(int timeoutMs);
+    AVFrame* completeFlip();
+    void pageFlipCompleted(uint32_t sequence, unsigned int tvSec, unsigned int tvUsec);
+    static int flipEventThread(void* context);
+    bool createFrameGraphBuffers();
+    void destroyFrameGraphBuffers();
+    bool prepareFrameGraph(uint32_t* fbId);
+    void disableFrameGraph();
+
     int m_DrmFd;
     uint32_t m_CrtcId;
     uint32_t m_PlaneId;
-    uint32_t m_CurrentFbId;
     SDL_Rect m_OutputRect;
+
+    FB_CACHE_ENTRY m_FbCache[DRM_FB_CACHE_SIZE];
+    uint64_t m_FbCacheClock;
+
+    // The decoder's frames context for the cached FBs. When it changes,
+    // the decoder has torn down the pool the cached buffers came from.
+    void* m_FbCacheFramesContext;
+
+    // Logged at the end, to show how well the FB cache works
+    int m_PresentedFrames;
+    int m_CreatedFbs;
+
+    // Atomic commits complete on the next V-blank, so the frame being
+    // flipped to and the one on screen are both kept until replaced
+    bool m_Atomic;
+    PLANE_PROPERTIES m_PlaneProperties;
+
+    // Page-flip events are handled on their own thread as soon as they
+    // arrive. The lock covers the flip state and the V-sync source.
+    SDL_Thread* m_FlipEventThread;
+    int m_StopFd;
+    SDL_sem* m_FlipDone;
+    SDL_SpinLock m_FlipLock;
+    bool m_FlipPending;
+    AVFrame* m_PendingFrame;
+    AVFrame* m_DisplayedFrame;
+    uint32_t m_PendingFbId;
+    uint32_t m_DisplayedFbId;
+    IVsyncSource* m_VsyncSource;
+
+    // Frames that may still be on screen after we gave up waiting
+    // for a flip. They're freed once a later flip completes.
+    QVector<RETIRED_FRAME> m_RetiredFrames;
+
+    // Each commit passes its own number as the event's user data, so
+    // an event for a flip we gave up waiting for can't complete a newer one
+    uint32_t m_FlipSequence;
+
+    // The frame graph goes on an ARGB plane above the video
+    uint32_t m_FrameGraphPlaneId;
+    PLANE_PROPERTIES m_FrameGraphPlaneProperties;
+    DUMB_BUFFER m_FrameGraphBuffers[FRAME_GRAPH_BUFFER_COUNT];
+    int m_NextFrameGraphBuffer;
+    bool m_FrameGraphVisible;
 };
 
@@ -29,6 +29,8 @@ DXVA2Renderer::DXVA2Renderer() :
     m_FrameIndex(0),
     m_DebugOverlayFont(nullptr),
     m_StatusOverlayFont(nullptr),
+    m_FrameGraphTexture(nullptr),
+    m_FrameGraphSprite(nullptr),
     m_BlockingPresent(false)
 {
     RtlZeroMemory(m_DecSurfaces, sizeof(m_DecSurfaces));
@@ -50,6 +52,8 @@ DXVA2Renderer::~DXVA2Renderer()
     SAFE_COM_RELEASE(m_Processor);
     SAFE_COM_RELEASE(m_DebugOverlayFont);
     SAFE_COM_RELEASE(m_StatusOverlayFont);
+    SAFE_COM_RELEASE(m_FrameGraphTexture);
+    SAFE_COM_RELEASE(m_FrameGraphSprite);
 
     for (int i = 0; i < ARRAYSIZE(m_DecSurfaces); i++) {
         SAFE_COM_RELEASE(m_DecSurfaces[i]);
@@ -790,12 +794,82 @@ void DXVA2Renderer::notifyOverlayUpdated(Overlay::OverlayType type)
         }
         break;
 
+    case Overlay::OverlayFrameGraph:
+        // Redrawn with each frame in renderFrameGraph()
+        break;
+
     default:
         SDL_assert(false);
         break;
     }
 }
 
+void DXVA2Renderer::renderFrameGraph(const RECT& viewport)
+{
+    HRESULT hr;
+
+    if (m_FrameGraphTexture == nullptr) {
+        hr = m_Device->CreateTexture(FRAME_GRAPH_WIDTH, FRAME_GRAPH_HEIGHT, 1,
+                                     D3DUSAGE_DYNAMIC, D3DFMT_A8R8G8B8, D3DPOOL_DEFAULT,
+                                     &m_FrameGraphTexture, nullptr);
+        if (FAILED(hr)) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                         "CreateTexture() failed: %x",
+                         hr);
+            m_FrameGraphTexture = nullptr;
+            return;
+        }
+    }
+
+    if (m_FrameGraphSprite == nullptr) {
+        hr = D3DXCreateSprite(m_Device, &m_FrameGraphSprite);
+        if (FAILED(hr)) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                         "D3DXCreateSprite() failed: %x",
+                         hr);
+            m_FrameGraphSprite = nullptr;
+            return;
+        }
+    }
+
+    D3DLOCKED_RECT lockedRect;
+    hr = m_FrameGraphTexture->LockRect(0, &lockedRect, nullptr, D3DLOCK_DISCARD);
+    if (FAILED(hr)) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "LockRect() failed: %x",
+                     hr);
+        return;
+    }
+
+    // D3DFMT_A8R8G8B8 is ARGB in a little-endian 32-bit word
+    Session::get()->getOverlayManager().getFrameGraph().draw(lockedRect.pBits, lockedRect.Pitch,
+                                                             SDL_PIXELFORMAT_ARGB8888);
+
+    m_FrameGraphTexture->UnlockRect(0);
+
+    SDL_Rect dst = FrameGraph::getDestination(viewport.right - viewport.left,
+                                              viewport.bottom - viewport.top);
+    D3DXMATRIX transform;
+    D3DXMatrixScaling(&transform,
+                      (float)dst.w / FRAME_GRAPH_WIDTH,
+                      (float)dst.h / FRAME_GRAPH_HEIGHT,
+                      1.0f);
+    transform._41 = (float)(viewport.left + dst.x);
+    transform._42 = (float)(viewport.top + dst.y);
+
+    hr = m_FrameGraphSprite->Begin(D3DXSPRITE_ALPHABLEND);
+    if (FAILED(hr)) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "ID3DXSprite::Begin() failed: %x",
+                     hr);
+        return;
+    }
+
+    m_FrameGraphSprite->SetTransform(&transform);
+    m_FrameGraphSprite->Draw(m_FrameGraphTexture, nullptr, nullptr, nullptr, D3DCOLOR_ARGB(255, 255, 255, 255));
+    m_FrameGraphSprite->End();
+}
+
 int DXVA2Renderer::getDecoderColorspace()
 {
     if (isDXVideoProcessorAPIBlacklisted()) {
@@ -810,6 +884,12 @@ int DXVA2Renderer::getDecoderColorspace()
     }
 }
 
+bool DXVA2Renderer::isPresentVsyncBlocked()
+{
+    // We retry PresentEx() until the V-sync it was waiting for
+    return m_BlockingPresent;
+}
+
 void DXVA2Renderer::renderFrame(AVFrame *frame)
 {
     IDirect3DSurface9* surface = reinterpret_cast<IDirect3DSurface9*>(frame->data[3]);
@@ -1017,6 +1097,10 @@ void DXVA2Renderer::renderFrame(AVFrame *frame)
         }
     }
 
+    if (Session::get()->getOverlayManager().isOverlayEnabled(Overlay::OverlayFrameGraph)) {
+        renderFrameGraph(sample.DstRect);
+    }
+
     hr = m_Device->EndScene();
     if (FAILED(hr)) {
         SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
@@ -21,6 +21,7 @@ public:
     virtual void renderFrame(AVFrame* frame) override;
     virtual void notifyOverlayUpdated(Overlay::OverlayType) override;
     virtual int getDecoderColorspace() override;
+    virtual bool isPresentVsyncBlocked() override;
 
 private:
     bool initializeDecoder();
@@ -28,6 +29,7 @@ private:
     bool initializeDevice(SDL_Window* window, bool enableVsync);
     bool isDecoderBlacklisted();
     bool isDXVideoProcessorAPIBlacklisted();
+    void renderFrameGraph(const RECT& viewport);
 
     static
     AVBufferRef* ffPoolAlloc(void* opaque, int size);
@@ -65,5 +67,7 @@ private:
     REFERENCE_TIME m_FrameIndex;
     LPD3DXFONT m_DebugOverlayFont;
     LPD3DXFONT m_StatusOverlayFont;
+    IDirect3DTexture9* m_FrameGraphTexture;
+    LPD3DXSPRITE m_FrameGraphSprite;
     bool m_BlockingPresent;
 };
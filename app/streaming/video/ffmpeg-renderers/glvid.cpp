@@ -0,0 +1,1348 @@
+#include "glvid.h"
+
+#include "streaming/session.h"
+#include "streaming/streamutils.h"
+#include "streaming/video/planecopy.h"
+#include "path.h"
+
+extern "C" {
+#include <libavutil/hwcontext.h>
+}
+
+static const char* k_VertexShader =
+        "in vec2 a_Position;\n"
+        "#ifdef GLYPHS\n"
+        "in vec2 a_TexCoord;\n"
+        "#endif\n"
+        "out vec2 v_TexCoord;\n"
+        "// Destination rectangle in normalized device coordinates\n"
+        "uniform vec4 u_Rect;\n"
+        "void main() {\n"
+        "#ifdef GLYPHS\n"
+        "    // Glyph positions are in pixels, so u_Rect holds the text\n"
+        "    // origin and the size of a pixel, negative in Y\n"
+        "    v_TexCoord = a_TexCoord;\n"
+        "#else\n"
+        "    // Textures are stored top row first\n"
+        "    v_TexCoord = vec2(a_Position.x, 1.0 - a_Position.y);\n"
+        "#endif\n"
+        "    gl_Position = vec4(u_Rect.xy + a_Position * u_Rect.zw, 0.0, 1.0);\n"
+        "}\n";
+
+static const char* k_VideoFragmentShader =
+        "in vec2 v_TexCoord;\n"
+        "out vec4 fragColor;\n"
+        "uniform sampler2D u_Plane0;\n"
+        "uniform sampler2D u_Plane1;\n"
+        "#ifndef SEMI_PLANAR\n"
+        "uniform sampler2D u_Plane2;\n"
+        "#endif\n"
+        "uniform mat3 u_YuvMatrix;\n"
+        "uniform vec3 u_YuvOffset;\n"
+        "uniform float u_SampleScale;\n"
+        "#ifdef TONE_MAP\n"
+        "// Same curve as SdlRenderer, applied to the luminance of linear RGB\n"
+        "const float referenceWhite = 203.0;\n"
+        "const float peak = 1000.0 / 203.0;\n"
+        "const float m1 = 2610.0 / 16384.0;\n"
+        "const float m2 = 2523.0 / 4096.0 * 128.0;\n"
+        "const float c1 = 3424.0 / 4096.0;\n"
+        "const float c2 = 2413.0 / 4096.0 * 32.0;\n"
+        "const float c3 = 2392.0 / 4096.0 * 32.0;\n"
+        "const mat3 bt2020ToBt709 = mat3(1.6605, -0.1246, -0.0182,\n"
+        "                                -0.5876, 1.1329, -0.1006,\n"
+        "                                -0.0728, -0.0083, 1.1187);\n"
+        "vec3 toneMap(vec3 pq) {\n"
+        "    vec3 p = pow(clamp(pq, 0.0, 1.0), vec3(1.0 / m2));\n"
+        "    vec3 nits = 10000.0 * pow(max(p - c1, 0.0) / (c2 - c3 * p), vec3(1.0 / m1));\n"
+        "    vec3 rgb = max(bt2020ToBt709 * (nits / referenceWhite), 0.0);\n"
+        "    float x = dot(rgb, vec3(0.2126, 0.7152, 0.0722));\n"
+        "    float sdr = x * (1.0 + x / (peak * peak)) / (1.0 + x);\n"
+        "    rgb *= sdr / max(x, 1e-6);\n"
+        "    return pow(clamp(rgb, 0.0, 1.0), vec3(1.0 / 2.4));\n"
+        "}\n"
+        "#endif\n"
+        "void main() {\n"
+        "    vec3 yuv;\n"
+        "    yuv.x = texture(u_Plane0, v_TexCoord).r;\n"
+        "#ifdef SEMI_PLANAR\n"
+        "    yuv.yz = texture(u_Plane1, v_TexCoord).rg;\n"
+        "#else\n"
+        "    yuv.y = texture(u_Plane1, v_TexCoord).r;\n"
+        "    yuv.z = texture(u_Plane2, v_TexCoord).r;\n"
+        "#endif\n"
+        "    vec3 rgb = u_YuvMatrix * (yuv * u_SampleScale - u_YuvOffset);\n"
+        "#ifdef TONE_MAP\n"
+        "    rgb = toneMap(rgb);\n"
+        "#endif\n"
+        "    fragColor = vec4(clamp(rgb, 0.0, 1.0), 1.0);\n"
+        "}\n";
+
+static const char* k_GlyphFragmentShader =
+        "in vec2 v_TexCoord;\n"
+        "out vec4 fragColor;\n"
+        "uniform sampler2D u_Plane0;\n"
+        "uniform vec4 u_Color;\n"
+        "void main() {\n"
+        "    // The atlas only carries coverage\n"
+        "    fragColor = vec4(u_Color.rgb, u_Color.a * texture(u_Plane0, v_TexCoord).a);\n"
+        "}\n";
+
+static const char* k_ImageFragmentShader =
+        "in vec2 v_TexCoord;\n"
+        "out vec4 fragColor;\n"
+        "uniform sampler2D u_Plane0;\n"
+        "void main() {\n"
+        "    fragColor = texture(u_Plane0, v_TexCoord);\n"
+        "}\n";
+
+// Two triangles of position and texture coordinates per glyph
+#define GLYPH_VERTEX_FLOATS 4
+#define GLYPH_VERTICES 6
+
+// A unit quad drawn as a triangle strip and scaled by u_Rect
+static const GLfloat k_QuadVertices[] = {
+    0.0f, 0.0f,
+    1.0f, 0.0f,
+    0.0f, 1.0f,
+    1.0f, 1.0f,
+};
+
+GLRenderer::GLRenderer(IFFmpegRenderer* backendRenderer)
+    : m_BackendRenderer(backendRenderer),
+      m_Window(nullptr),
+      m_Context(nullptr),
+      m_IsGLES(false),
+      m_VideoWidth(0),
+      m_VideoHeight(0),
+      m_VsyncEnabled(false),
+      m_VideoStats(nullptr),
+      m_SwPixelFormat(AV_PIX_FMT_NONE),
+      m_ToneMapEnabled(qgetenv("HDR_TONEMAP") != "0"),
+      m_FrameFormat(AV_PIX_FMT_NONE),
+      m_FrameWidth(0),
+      m_FrameHeight(0),
+      m_FrameColorspace(AVCOL_SPC_UNSPECIFIED),
+      m_FrameColorRange(AVCOL_RANGE_UNSPECIFIED),
+      m_FrameTransfer(AVCOL_TRC_UNSPECIFIED),
+      m_FrameImported(false),
+      m_PlaneCount(0),
+      m_PboSize(0),
+      m_NextPbo(0),
+#ifdef HAVE_EGL
+      m_EGLDisplay(EGL_NO_DISPLAY),
+      m_EGLImportEnabled(false),
+      m_EGLImageCount(0),
+      m_LastImportedFrame(nullptr),
+#endif
+      m_VertexArray(0),
+      m_VertexBuffer(0),
+      m_FontData(Path::readDataFile("ModeSeven.ttf"))
+{
+    SDL_AtomicSet(&m_WindowChanged, 0);
+    SDL_zero(m_Gl);
+    SDL_zero(m_Viewport);
+    SDL_zero(m_VideoProgram);
+    SDL_zero(m_OverlayProgram);
+    SDL_zero(m_FrameGraphProgram);
+    SDL_zero(m_Planes);
+    SDL_zero(m_Pbos);
+    SDL_zero(m_OverlayTextures);
+    SDL_zero(m_OverlayVertexArrays);
+    SDL_zero(m_OverlayVertexBuffers);
+    SDL_zero(m_OverlayVertexCounts);
+    SDL_zero(m_OverlayAtlases);
+#ifdef HAVE_EGL
+    SDL_zero(m_EGLImages);
+#endif
+
+    SDL_assert(TTF_WasInit() == 0);
+    if (TTF_Init() != 0) {
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                    "TTF_Init() failed: %s",
+                    TTF_GetError());
+        return;
+    }
+}
+
+GLRenderer::~GLRenderer()
+{
+    TTF_Quit();
+    SDL_assert(TTF_WasInit() == 0);
+
+    for (int i = 0; i < Overlay::OverlayMax; i++) {
+        delete m_OverlayAtlases[i];
+    }
+
+#ifdef HAVE_EGL
+    freeImportedFrame();
+#endif
+
+    // The render thread has released the context by now,
+    // so we can take it on this thread to clean up.
+    if (m_Context != nullptr && makeCurrent()) {
+        deleteVideoObjects();
+
+        for (int i = 0; i < Overlay::OverlayMax; i++) {
+            if (m_OverlayTextures[i] != 0) {
+                m_Gl.DeleteTextures(1, &m_OverlayTextures[i]);
+            }
+
+            if (m_OverlayVertexBuffers[i] != 0) {
+                m_Gl.DeleteBuffers(1, &m_OverlayVertexBuffers[i]);
+            }
+
+            if (m_OverlayVertexArrays[i] != 0) {
+                m_Gl.DeleteVertexArrays(1, &m_OverlayVertexArrays[i]);
+            }
+        }
+
+        if (m_OverlayProgram.program != 0) {
+            m_Gl.DeleteProgram(m_OverlayProgram.program);
+        }
+
+        if (m_FrameGraphProgram.program != 0) {
+            m_Gl.DeleteProgram(m_FrameGraphProgram.program);
+        }
+
+        if (m_VertexBuffer != 0) {
+            m_Gl.DeleteBuffers(1, &m_VertexBuffer);
+        }
+
+        if (m_VertexArray != 0) {
+            m_Gl.DeleteVertexArrays(1, &m_VertexArray);
+        }
+
+        SDL_GL_MakeCurrent(m_Window, nullptr);
+    }
+
+    if (m_Context != nullptr) {
+        SDL_GL_DeleteContext(m_Context);
+    }
+}
+
+bool GLRenderer::isRequested()
+{
+    // SdlRenderer is the default everywhere
+    return qgetenv("GL_RENDERER") == "1";
+}
+
+bool GLRenderer::prepareDecoderContext(AVCodecContext*, AVDictionary**)
+{
+    /* Nothing to do */
+
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                "Using OpenGL%s renderer",
+                m_IsGLES ? " ES" : "");
+
+    return true;
+}
+
+bool GLRenderer::createContext()
+{
+    static const struct {
+        int profile;
+        int majorVersion;
+        int minorVersion;
+    } versions[] = {
+        { SDL_GL_CONTEXT_PROFILE_CORE, 3, 3 },
+        { SDL_GL_CONTEXT_PROFILE_ES, 3, 0 },
+    };
+
+    // Put back the attributes that SDL renderers will see
+    int oldProfile, oldMajorVersion, oldMinorVersion, oldFlags;
+    SDL_GL_GetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, &oldProfile);
+    SDL_GL_GetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, &oldMajorVersion);
+    SDL_GL_GetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, &oldMinorVersion);
+    SDL_GL_GetAttribute(SDL_GL_CONTEXT_FLAGS, &oldFlags);
+
+    for (const auto& version : versions) {
+        int flags = 0;
+
+#ifdef Q_OS_DARWIN
+        // macOS only provides core profiles that are forward compatible
+        if (version.profile == SDL_GL_CONTEXT_PROFILE_CORE) {
+            flags |= SDL_GL_CONTEXT_FORWARD_COMPATIBLE_FLAG;
+        }
+#endif
+
+        SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, version.profile);
+        SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, version.majorVersion);
+        SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, version.minorVersion);
+        SDL_GL_SetAttribute(SDL_GL_CONTEXT_FLAGS, flags);
+
+        m_Context = SDL_GL_CreateContext(m_Window);
+        if (m_Context != nullptr) {
+            m_IsGLES = version.profile == SDL_GL_CONTEXT_PROFILE_ES;
+            break;
+        }
+
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                    "Unable to create OpenGL%s %d.%d context: %s",
+                    version.profile == SDL_GL_CONTEXT_PROFILE_ES ? " ES" : "",
+                    version.majorVersion,
+                    version.minorVersion,
+                    SDL_GetError());
+    }
+
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, oldProfile);
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, oldMajorVersion);
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, oldMinorVersion);
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_FLAGS, oldFlags);
+
+    if (m_Context == nullptr) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "No supported OpenGL context available");
+        return false;
+    }
+
+    if (!loadFunctions()) {
+        SDL_GL_MakeCurrent(m_Window, nullptr);
+        SDL_GL_DeleteContext(m_Context);
+        m_Context = nullptr;
+        return false;
+    }
+
+    return true;
+}
+
+bool GLRenderer::loadFunctions()
+{
+#define LOAD_GL_FUNCTION(name) \
+    m_Gl.name = (decltype(m_Gl.name))SDL_GL_GetProcAddress("gl" #name); \
+    if (m_Gl.name == nullptr) { \
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, \
+                     "Missing OpenGL function: gl" #name); \
+        return false; \
+    }
+
+    LOAD_GL_FUNCTION(GetString);
+    LOAD_GL_FUNCTION(GetError);
+    LOAD_GL_FUNCTION(Viewport);
+    LOAD_GL_FUNCTION(ClearColor);
+    LOAD_GL_FUNCTION(Clear);
+    LOAD_GL_FUNCTION(Enable);
+    LOAD_GL_FUNCTION(Disable);
+    LOAD_GL_FUNCTION(BlendFunc);
+    LOAD_GL_FUNCTION(PixelStorei);
+    LOAD_GL_FUNCTION(GenTextures);
+    LOAD_GL_FUNCTION(DeleteTextures);
+    LOAD_GL_FUNCTION(BindTexture);
+    LOAD_GL_FUNCTION(ActiveTexture);
+    LOAD_GL_FUNCTION(TexParameteri);
+    LOAD_GL_FUNCTION(TexImage2D);
+    LOAD_GL_FUNCTION(TexSubImage2D);
+    LOAD_GL_FUNCTION(CreateShader);
+    LOAD_GL_FUNCTION(ShaderSource);
+    LOAD_GL_FUNCTION(CompileShader);
+    LOAD_GL_FUNCTION(GetShaderiv);
+    LOAD_GL_FUNCTION(GetShaderInfoLog);
+    LOAD_GL_FUNCTION(DeleteShader);
+    LOAD_GL_FUNCTION(CreateProgram);
+    LOAD_GL_FUNCTION(AttachShader);
+    LOAD_GL_FUNCTION(BindAttribLocation);
+    LOAD_GL_FUNCTION(LinkProgram);
+    LOAD_GL_FUNCTION(GetProgramiv);
+    LOAD_GL_FUNCTION(GetProgramInfoLog);
+    LOAD_GL_FUNCTION(UseProgram);
+    LOAD_GL_FUNCTION(DeleteProgram);
+    LOAD_GL_FUNCTION(GetUniformLocation);
+    LOAD_GL_FUNCTION(Uniform1i);
+    LOAD_GL_FUNCTION(Uniform1f);
+    LOAD_GL_FUNCTION(Uniform3fv);
+    LOAD_GL_FUNCTION(Uniform4f);
+    LOAD_GL_FUNCTION(UniformMatrix3fv);
+    LOAD_GL_FUNCTION(GenBuffers);
+    LOAD_GL_FUNCTION(DeleteBuffers);
+    LOAD_GL_FUNCTION(BindBuffer);
+    LOAD_GL_FUNCTION(BufferData);
+    LOAD_GL_FUNCTION(MapBufferRange);
+    LOAD_GL_FUNCTION(UnmapBuffer);
+    LOAD_GL_FUNCTION(GenVertexArrays);
+    LOAD_GL_FUNCTION(DeleteVertexArrays);
+    LOAD_GL_FUNCTION(BindVertexArray);
+    LOAD_GL_FUNCTION(EnableVertexAttribArray);
+    LOAD_GL_FUNCTION(VertexAttribPointer);
+    LOAD_GL_FUNCTION(DrawArrays);
+
+#undef LOAD_GL_FUNCTION
+
+    m_Gl.EGLImageTargetTexture2DOES = (decltype(m_Gl.EGLImageTargetTexture2DOES))
+            SDL_GL_GetProcAddress("glEGLImageTargetTexture2DOES");
+
+    return true;
+}
+
+// The context is only current on one thread at a time. Pacer's
+// render thread takes it for the first frame and the main thread
+// takes it back after the render thread has exited.
+bool GLRenderer::makeCurrent()
+{
+    if (SDL_GL_GetCurrentContext() == m_Context) {
+        return true;
+    }
+
+    if (SDL_GL_MakeCurrent(m_Window, m_Context) != 0) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "SDL_GL_MakeCurrent() failed: %s",
+                     SDL_GetError());
+        return false;
+    }
+
+    return true;
+}
+
+void GLRenderer::cleanupRenderContext()
+{
+    if (m_Context != nullptr && SDL_GL_GetCurrentContext() == m_Context) {
+        SDL_GL_MakeCurrent(m_Window, nullptr);
+    }
+}
+
+GLuint GLRenderer::compileShader(GLenum type, const char* defines, const char* source)
+{
+    const char* sources[] = {
+        m_IsGLES ? "#version 300 es\nprecision highp float;\n" : "#version 330 core\n",
+        defines,
+        source
+    };
+
+    GLuint shader = m_Gl.CreateShader(type);
+    m_Gl.ShaderSource(shader, SDL_arraysize(sources), sources, nullptr);
+    m_Gl.CompileShader(shader);
+
+    GLint status;
+    m_Gl.GetShaderiv(shader, GL_COMPILE_STATUS, &status);
+    if (!status) {
+        char log[1024];
+        m_Gl.GetShaderInfoLog(shader, sizeof(log), nullptr, log);
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "Failed to compile shader: %s",
+                     log);
+        m_Gl.DeleteShader(shader);
+        return 0;
+    }
+
+    return shader;
+}
+
+bool GLRenderer::buildProgram(GL_PROGRAM& program, const char* defines, const char* fragmentSource)
+{
+    GLuint vertexShader = compileShader(GL_VERTEX_SHADER, defines, k_VertexShader);
+    if (vertexShader == 0) {
+        return false;
+    }
+
+    GLuint fragmentShader = compileShader(GL_FRAGMENT_SHADER, defines, fragmentSource);
+    if (fragmentShader == 0) {
+        m_Gl.DeleteShader(vertexShader);
+        return false;
+    }
+
+    program.program = m_Gl.CreateProgram();
+    m_Gl.AttachShader(program.program, vertexShader);
+    m_Gl.AttachShader(program.program, fragmentShader);
+    m_Gl.BindAttribLocation(program.program, 0, "a_Position");
+    m_Gl.BindAttribLocation(program.program, 1, "a_TexCoord");
+    m_Gl.LinkProgram(program.program);
+
+    // The program keeps the shaders alive while it needs them
+    m_Gl.DeleteShader(vertexShader);
+    m_Gl.DeleteShader(fragmentShader);
+
+    GLint status;
+    m_Gl.GetProgramiv(program.program, GL_LINK_STATUS, &status);
+    if (!status) {
+        char log[1024];
+        m_Gl.GetProgramInfoLog(program.program, sizeof(log), nullptr, log);
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "Failed to link shader program: %s",
+                     log);
+        m_Gl.DeleteProgram(program.program);
+        program.program = 0;
+        return false;
+    }
+
+    program.rectLocation = m_Gl.GetUniformLocation(program.program, "u_Rect");
+    program.yuvMatrixLocation = m_Gl.GetUniformLocation(program.program, "u_YuvMatrix");
+    program.yuvOffsetLocation = m_Gl.GetUniformLocation(program.program, "u_YuvOffset");
+    program.sampleScaleLocation = m_Gl.GetUniformLocation(program.program, "u_SampleScale");
+    program.colorLocation = m_Gl.GetUniformLocation(program.program, "u_Color");
+
+    // Plane N is always bound to texture unit N
+    m_Gl.UseProgram(program.program);
+    for (int i = 0; i < GL_PLANE_COUNT; i++) {
+        char name[] = "u_PlaneX";
+        name[7] = (char)('0' + i);
+
+        GLint location = m_Gl.GetUniformLocation(program.program, name);
+        if (location >= 0) {
+            m_Gl.Uniform1i(location, i);
+        }
+    }
+
+    return true;
+}
+
+bool GLRenderer::initialize(PDECODER_PARAMETERS params)
+{
+    m_Window = params->window;
+
+    if (m_Window == nullptr || !(SDL_GetWindowFlags(m_Window) & SDL_WINDOW_OPENGL)) {
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                    "OpenGL renderer requires an OpenGL window");
+        return false;
+    }
+
+    if (!createContext()) {
+        return false;
+    }
+
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                "OpenGL renderer: %s (%s)",
+                (const char*)m_Gl.GetString(GL_RENDERER),
+                (const char*)m_Gl.GetString(GL_VERSION));
+
+    int swapInterval = 0;
+    if ((SDL_GetWindowFlags(m_Window) & SDL_WINDOW_FULLSCREEN_DESKTOP) == SDL_WINDOW_FULLSCREEN) {
+        // Like SdlRenderer, only use V-sync in full-screen exclusive mode
+        if (params->enableVsync) {
+            swapInterval = 1;
+        }
+    }
+
+    if (SDL_GL_SetSwapInterval(swapInterval) != 0) {
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                    "SDL_GL_SetSwapInterval(%d) failed: %s",
+                    swapInterval,
+                    SDL_GetError());
+    }
+    else {
+        m_VsyncEnabled = swapInterval != 0;
+    }
+
+    if (!buildProgram(m_OverlayProgram, "#define GLYPHS\n", k_GlyphFragmentShader)) {
+        return false;
+    }
+
+    if (!buildProgram(m_FrameGraphProgram, "", k_ImageFragmentShader)) {
+        return false;
+    }
+
+    // Core profiles can't draw without a vertex array object
+    m_Gl.GenVertexArrays(1, &m_VertexArray);
+    m_Gl.BindVertexArray(m_VertexArray);
+    m_Gl.GenBuffers(1, &m_VertexBuffer);
+    m_Gl.BindBuffer(GL_ARRAY_BUFFER, m_VertexBuffer);
+    m_Gl.BufferData(GL_ARRAY_BUFFER, sizeof(k_QuadVertices), k_QuadVertices, GL_STATIC_DRAW);
+    m_Gl.EnableVertexAttribArray(0);
+    m_Gl.VertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
+
+    m_Gl.BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    m_Gl.PixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    m_VideoWidth = params->width;
+    m_VideoHeight = params->height;
+    updateViewport();
+
+#ifdef HAVE_EGL
+    if (m_BackendRenderer != nullptr && m_BackendRenderer->canExportEGL() &&
+            qgetenv("EGL_IMPORT") != "0") {
+        // SDL uses GLX on X11 unless told otherwise, and
+        // dmabufs can't be imported into a GLX context.
+        m_EGLDisplay = eglGetCurrentDisplay();
+        if (m_EGLDisplay == EGL_NO_DISPLAY) {
+            SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                        "OpenGL context is not an EGL context; hardware frames will be read back");
+        }
+        else if (m_Gl.EGLImageTargetTexture2DOES == nullptr) {
+            SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                        "GL_OES_EGL_image is not supported; hardware frames will be read back");
+        }
+        else if (m_BackendRenderer->initializeEGL(m_EGLDisplay)) {
+            SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                        "Importing hardware frames with EGL");
+            m_EGLImportEnabled = true;
+        }
+    }
+#endif
+
+    // Draw a black frame until the video stream starts rendering
+    m_Gl.ClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+    m_Gl.Clear(GL_COLOR_BUFFER_BIT);
+    SDL_GL_SwapWindow(m_Window);
+
+    GLenum err = m_Gl.GetError();
+    if (err != GL_NO_ERROR) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "OpenGL initialization failed: %x",
+                     err);
+        return false;
+    }
+
+    // Let the render thread take the context
+    SDL_GL_MakeCurrent(m_Window, nullptr);
+
+    return true;
+}
+
+bool GLRenderer::isPixelFormatSupported(int, AVPixelFormat pixelFormat)
+{
+    // Remember to keep this in sync with GLRenderer::setupVideo()!
+    switch (pixelFormat)
+    {
+    case AV_PIX_FMT_YUV420P:
+    case AV_PIX_FMT_NV12:
+    case AV_PIX_FMT_NV21:
+    case AV_PIX_FMT_YUV420P10:
+    case AV_PIX_FMT_P010:
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+void GLRenderer::updateViewport()
+{
+    // Calculate the video region size, scaling to fill the output size while
+    // preserving the aspect ratio of the video stream.
+    SDL_Rect src, dst;
+    src.x = src.y = 0;
+    src.w = m_VideoWidth;
+    src.h = m_VideoHeight;
+    dst.x = dst.y = 0;
+    SDL_GL_GetDrawableSize(m_Window, &dst.w, &dst.h);
+    StreamUtils::scaleSourceToDestinationSurface(&src, &dst);
+
+    // The video is centered, so flipping Y for OpenGL doesn't change it
+    m_Viewport = dst;
+    m_Gl.Viewport(dst.x, dst.y, dst.w, dst.h);
+}
+
+bool GLRenderer::notifyWindowChanged()
+{
+    // SDL resizes the default framebuffer itself, so
+    // renderFrame() just needs to recompute the viewport.
+    SDL_AtomicSet(&m_WindowChanged, 1);
+    return true;
+}
+
+bool GLRenderer::needsHwFrameReadback()
+{
+#ifdef HAVE_EGL
+    // Imported frames must stay in video memory
+    return !m_EGLImportEnabled;
+#else
+    return true;
+#endif
+}
+
+bool GLRenderer::isPresentVsyncBlocked()
+{
+    return m_VsyncEnabled;
+}
+
+void GLRenderer::setVideoStats(PVIDEO_STATS videoStats)
+{
+    m_VideoStats = videoStats;
+}
+
+void GLRenderer::notifyOverlayUpdated(Overlay::OverlayType type)
+{
+    // The frame graph is redrawn with every frame
+    if (type == Overlay::OverlayFrameGraph) {
+        return;
+    }
+
+    GlyphAtlas* atlas = (GlyphAtlas*)SDL_AtomicGetPtr((void**)&m_OverlayAtlases[type]);
+
+    // Rasterize the glyphs of the overlay font once
+    if (atlas == nullptr) {
+        if (m_FontData.isEmpty()) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                         "SDL overlay font failed to load");
+            return;
+        }
+
+        TTF_Font* font = TTF_OpenFontRW(SDL_RWFromConstMem(m_FontData.constData(), m_FontData.size()),
+                                        1,
+                                        Session::get()->getOverlayManager().getOverlayFontSize(type));
+        if (font == nullptr) {
+            SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                        "TTF_OpenFont() failed: %s",
+                        TTF_GetError());
+
+            // Can't proceed without a font
+            return;
+        }
+
+        atlas = new GlyphAtlas();
+        bool ok = atlas->initialize(font);
+        TTF_CloseFont(font);
+
+        if (!ok) {
+            delete atlas;
+            return;
+        }
+
+        // Another thread may have beaten us to it
+        if (!SDL_AtomicCASPtr((void**)&m_OverlayAtlases[type], nullptr, atlas)) {
+            delete atlas;
+            atlas = (GlyphAtlas*)SDL_AtomicGetPtr((void**)&m_OverlayAtlases[type]);
+        }
+    }
+
+    if (Session::get()->getOverlayManager().isOverlayEnabled(type)) {
+        m_OverlayLayouts[type].update(atlas, Session::get()->getOverlayManager().getOverlayText(type), 1000);
+    }
+    else {
+        m_OverlayLayouts[type].update(nullptr, nullptr, 0);
+    }
+}
+
+bool GLRenderer::uploadOverlayAtlas(Overlay::OverlayType type, GlyphAtlas* atlas)
+{
+    // Convert to the byte order glTexImage2D() expects
+    SDL_Surface* surface = SDL_ConvertSurfaceFormat(atlas->getSurface(), SDL_PIXELFORMAT_RGBA32, 0);
+    if (surface == nullptr) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "SDL_ConvertSurfaceFormat() failed: %s",
+                     SDL_GetError());
+        return false;
+    }
+
+    // Glyphs are drawn at their rasterized size, so there's nothing to filter
+    m_Gl.ActiveTexture(GL_TEXTURE0);
+    m_Gl.GenTextures(1, &m_OverlayTextures[type]);
+    m_Gl.BindTexture(GL_TEXTURE_2D, m_OverlayTextures[type]);
+    m_Gl.TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    m_Gl.TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    m_Gl.TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    m_Gl.TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    m_Gl.PixelStorei(GL_UNPACK_ROW_LENGTH, surface->pitch / 4);
+    m_Gl.TexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, surface->w, surface->h, 0,
+                    GL_RGBA, GL_UNSIGNED_BYTE, surface->pixels);
+    m_Gl.PixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    SDL_FreeSurface(surface);
+
+    m_Gl.GenVertexArrays(1, &m_OverlayVertexArrays[type]);
+    m_Gl.BindVertexArray(m_OverlayVertexArrays[type]);
+    m_Gl.GenBuffers(1, &m_OverlayVertexBuffers[type]);
+    m_Gl.BindBuffer(GL_ARRAY_BUFFER, m_OverlayVertexBuffers[type]);
+    m_Gl.EnableVertexAttribArray(0);
+    m_Gl.VertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE,
+                             GLYPH_VERTEX_FLOATS * sizeof(GLfloat), nullptr);
+    m_Gl.EnableVertexAttribArray(1);
+    m_Gl.VertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE,
+                             GLYPH_VERTEX_FLOATS * sizeof(GLfloat), (const void*)(2 * sizeof(GLfloat)));
+
+    return true;
+}
+
+void GLRenderer::updateOverlayVertices(Overlay::OverlayType type, GlyphAtlas* atlas)
+{
+    GlyphLayout* layout = &m_OverlayLayouts[type];
+    int quadCount = layout->getQuadCount();
+
+    m_OverlayVertexCounts[type] = 0;
+    if (quadCount == 0) {
+        return;
+    }
+
+    GLsizeiptr size = quadCount * GLYPH_VERTICES * GLYPH_VERTEX_FLOATS * sizeof(GLfloat);
+    m_Gl.BindBuffer(GL_ARRAY_BUFFER, m_OverlayVertexBuffers[type]);
+    m_Gl.BufferData(GL_ARRAY_BUFFER, size, nullptr, GL_DYNAMIC_DRAW);
+    auto vertices = (GLfloat*)m_Gl.MapBufferRange(GL_ARRAY_BUFFER, 0, size,
+                                                  GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (vertices == nullptr) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "glMapBufferRange() failed: %x",
+                     m_Gl.GetError());
+        return;
+    }
+
+    float atlasWidth = atlas->getSurface()->w;
+    float atlasHeight = atlas->getSurface()->h;
+    const GlyphAtlas::GLYPH_QUAD* quads = layout->getQuads();
+    for (int i = 0; i < quadCount; i++) {
+        const SDL_Rect& src = quads[i].src;
+        const SDL_Rect& dst = quads[i].dst;
+        const GLfloat corners[GLYPH_VERTICES][2] = {
+            { 0, 0 }, { 1, 0 }, { 0, 1 },
+            { 0, 1 }, { 1, 0 }, { 1, 1 },
+        };
+
+        for (int j = 0; j < GLYPH_VERTICES; j++) {
+            *vertices++ = dst.x + corners[j][0] * dst.w;
+            *vertices++ = dst.y + corners[j][1] * dst.h;
+            *vertices++ = (src.x + corners[j][0] * src.w) / atlasWidth;
+            *vertices++ = (src.y + corners[j][1] * src.h) / atlasHeight;
+        }
+    }
+
+    m_Gl.UnmapBuffer(GL_ARRAY_BUFFER);
+    m_OverlayVertexCounts[type] = quadCount * GLYPH_VERTICES;
+}
+
+void GLRenderer::renderOverlay(Overlay::OverlayType type)
+{
+    // There's no session when replaying a decode capture
+    if (Session::get() == nullptr || !Session::get()->getOverlayManager().isOverlayEnabled(type)) {
+        return;
+    }
+
+    if (type == Overlay::OverlayFrameGraph) {
+        renderFrameGraph();
+        return;
+    }
+
+    GlyphAtlas* atlas = (GlyphAtlas*)SDL_AtomicGetPtr((void**)&m_OverlayAtlases[type]);
+    if (atlas == nullptr) {
+        return;
+    }
+
+    if (m_OverlayTextures[type] == 0 && !uploadOverlayAtlas(type, atlas)) {
+        return;
+    }
+
+    m_Gl.BindVertexArray(m_OverlayVertexArrays[type]);
+
+    // Text updates only rebuild the vertices of its glyphs
+    GlyphLayout* layout = &m_OverlayLayouts[type];
+    if (layout->acquire()) {
+        updateOverlayVertices(type, atlas);
+    }
+
+    if (m_OverlayVertexCounts[type] == 0 || m_Viewport.w == 0 || m_Viewport.h == 0) {
+        return;
+    }
+
+    float y;
+    if (type == Overlay::OverlayStatusUpdate) {
+        // Bottom left
+        y = -1.0f + 2.0f * layout->getHeight() / m_Viewport.h;
+    }
+    else {
+        // Top left
+        y = 1.0f;
+    }
+
+    SDL_Color color = Session::get()->getOverlayManager().getOverlayColor(type);
+
+    m_Gl.UseProgram(m_OverlayProgram.program);
+    m_Gl.Uniform4f(m_OverlayProgram.rectLocation, -1.0f, y, 2.0f / m_Viewport.w, -2.0f / m_Viewport.h);
+    m_Gl.Uniform4f(m_OverlayProgram.colorLocation,
+                   color.r / 255.0f, color.g / 255.0f, color.b / 255.0f, color.a / 255.0f);
+    m_Gl.ActiveTexture(GL_TEXTURE0);
+    m_Gl.BindTexture(GL_TEXTURE_2D, m_OverlayTextures[type]);
+    m_Gl.DrawArrays(GL_TRIANGLES, 0, m_OverlayVertexCounts[type]);
+}
+
+void GLRenderer::renderFrameGraph()
+{
+    GLuint& texture = m_OverlayTextures[Overlay::OverlayFrameGraph];
+
+    if (m_Viewport.w == 0 || m_Viewport.h == 0) {
+        return;
+    }
+
+    m_Gl.ActiveTexture(GL_TEXTURE0);
+
+    if (texture == 0) {
+        m_Gl.GenTextures(1, &texture);
+        m_Gl.BindTexture(GL_TEXTURE_2D, texture);
+        m_Gl.TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        m_Gl.TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        m_Gl.TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        m_Gl.TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        m_Gl.TexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, FRAME_GRAPH_WIDTH, FRAME_GRAPH_HEIGHT, 0,
+                        GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    }
+    else {
+        m_Gl.BindTexture(GL_TEXTURE_2D, texture);
+    }
+
+    Session::get()->getOverlayManager().getFrameGraph().draw(m_FrameGraphPixels,
+                                                             FRAME_GRAPH_WIDTH * sizeof(Uint32),
+                                                             SDL_PIXELFORMAT_RGBA32);
+    m_Gl.TexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, FRAME_GRAPH_WIDTH, FRAME_GRAPH_HEIGHT,
+                       GL_RGBA, GL_UNSIGNED_BYTE, m_FrameGraphPixels);
+
+    // The viewport's origin is at the bottom left
+    SDL_Rect dst = FrameGraph::getDestination(m_Viewport.w, m_Viewport.h);
+    m_Gl.UseProgram(m_FrameGraphProgram.program);
+    m_Gl.Uniform4f(m_FrameGraphProgram.rectLocation,
+                   -1.0f + 2.0f * dst.x / m_Viewport.w,
+                   1.0f - 2.0f * (dst.y + dst.h) / m_Viewport.h,
+                   2.0f * dst.w / m_Viewport.w,
+                   2.0f * dst.h / m_Viewport.h);
+    m_Gl.BindVertexArray(m_VertexArray);
+    m_Gl.DrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+}
+
+void GLRenderer::deleteVideoObjects()
+{
+    for (int i = 0; i < GL_PLANE_COUNT; i++) {
+        if (m_Planes[i].texture != 0) {
+            m_Gl.DeleteTextures(1, &m_Planes[i].texture);
+        }
+    }
+    SDL_zero(m_Planes);
+    m_PlaneCount = 0;
+
+    if (m_Pbos[0] != 0) {
+        m_Gl.DeleteBuffers(GL_PBO_COUNT, m_Pbos);
+        SDL_zero(m_Pbos);
+    }
+    m_PboSize = 0;
+
+    if (m_VideoProgram.program != 0) {
+        m_Gl.DeleteProgram(m_VideoProgram.program);
+        SDL_zero(m_VideoProgram);
+    }
+
+    m_FrameFormat = AV_PIX_FMT_NONE;
+}
+
+void GLRenderer::updateColorspace(AVFrame* frame, int format, int bitDepth)
+{
+    float kr, kb;
+
+    switch (frame->colorspace) {
+    case AVCOL_SPC_BT709:
+        kr = 0.2126f;
+        kb = 0.0722f;
+        break;
+    case AVCOL_SPC_BT2020_NCL:
+        kr = 0.2627f;
+        kb = 0.0593f;
+        break;
+    case AVCOL_SPC_BT470BG:
+    case AVCOL_SPC_SMPTE170M:
+    default:
+        kr = 0.299f;
+        kb = 0.114f;
+        break;
+    }
+
+    float kg = 1.0f - kr - kb;
+    float maxCode = (float)((1 << bitDepth) - 1);
+    int shift = bitDepth - 8;
+    float yOffset, yRange, cRange;
+
+    if (frame->color_range == AVCOL_RANGE_JPEG) {
+        yOffset = 0.0f;
+        yRange = 1.0f;
+        cRange = 1.0f;
+    }
+    else {
+        yOffset = (16 << shift) / maxCode;
+        yRange = (219 << shift) / maxCode;
+        cRange = (224 << shift) / maxCode;
+    }
+
+    float cOffset = (128 << shift) / maxCode;
+
+    // Columns multiply Y, Cb and Cr
+    GLfloat matrix[9] = {
+        1.0f / yRange, 1.0f / yRange, 1.0f / yRange,
+        0.0f, -2.0f * kb * (1.0f - kb) / kg / cRange, 2.0f * (1.0f - kb) / cRange,
+        2.0f * (1.0f - kr) / cRange, -2.0f * kr * (1.0f - kr) / kg / cRange, 0.0f,
+    };
+
+    if (format == AV_PIX_FMT_NV21) {
+        // The chroma texture holds Cr then Cb
+        for (int i = 3; i < 6; i++) {
+            GLfloat temp = matrix[i];
+            matrix[i] = matrix[i + 3];
+            matrix[i + 3] = temp;
+        }
+    }
+
+    GLfloat offset[3] = { yOffset, cOffset, cOffset };
+
+    m_Gl.UseProgram(m_VideoProgram.program);
+    m_Gl.UniformMatrix3fv(m_VideoProgram.yuvMatrixLocation, 1, GL_FALSE, matrix);
+    m_Gl.Uniform3fv(m_VideoProgram.yuvOffsetLocation, 1, offset);
+}
+
+// Imported frames are bound to the plane textures as EGL images, so
+// they need no storage or PBOs of their own.
+bool GLRenderer::setupVideo(AVFrame* frame, int format, bool imported)
+{
+    deleteVideoObjects();
+
+    int chromaWidth = (frame->width + 1) / 2;
+    int chromaHeight = (frame->height + 1) / 2;
+    bool semiPlanar;
+    bool highBitDepth;
+    float sampleScale = 1.0f;
+
+    // Remember to keep this in sync with GLRenderer::isPixelFormatSupported()!
+    switch (format) {
+    case AV_PIX_FMT_YUV420P:
+    case AV_PIX_FMT_YUV420P10:
+        semiPlanar = false;
+        highBitDepth = format == AV_PIX_FMT_YUV420P10;
+        break;
+    case AV_PIX_FMT_NV12:
+    case AV_PIX_FMT_NV21:
+    case AV_PIX_FMT_P010:
+        semiPlanar = true;
+        highBitDepth = format == AV_PIX_FMT_P010;
+        break;
+    default:
+        SDL_assert(false);
+        return false;
+    }
+
+    // Imported 16-bit planes are always sampled as normalized
+    // 16-bit values, since we don't get to convert them.
+    bool sample16Bit = highBitDepth && (!m_IsGLES || imported);
+
+    m_PlaneCount = semiPlanar ? 2 : 3;
+    for (int i = 0; i < m_PlaneCount; i++) {
+        GL_PLANE* plane = &m_Planes[i];
+
+        plane->width = i == 0 ? frame->width : chromaWidth;
+        plane->height = i == 0 ? frame->height : chromaHeight;
+        plane->components = (semiPlanar && i == 1) ? 2 : 1;
+        plane->sampleBytes = highBitDepth ? 2 : 1;
+
+        if (sample16Bit) {
+            // Desktop GL can sample 16-bit normalized textures, so the
+            // shader sees every bit of the source.
+            plane->internalFormat = plane->components == 2 ? GL_RG16 : GL_R16;
+            plane->type = GL_UNSIGNED_SHORT;
+        }
+        else {
+            // OpenGL ES 3.0 has no 16-bit normalized textures, so
+            // 10-bit samples are dithered down like in SdlRenderer.
+            plane->internalFormat = plane->components == 2 ? GL_RG8 : GL_R8;
+            plane->type = GL_UNSIGNED_BYTE;
+            if (highBitDepth) {
+                plane->ditherShift = format == AV_PIX_FMT_P010 ? 8 : 2;
+            }
+        }
+        plane->format = plane->components == 2 ? GL_RG : GL_RED;
+
+        m_Gl.GenTextures(1, &plane->texture);
+        m_Gl.BindTexture(GL_TEXTURE_2D, plane->texture);
+        m_Gl.TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        m_Gl.TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        m_Gl.TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        m_Gl.TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+        if (imported) {
+            continue;
+        }
+
+        // Keep each plane 4-byte aligned within the PBO
+        int uploadBytes = plane->type == GL_UNSIGNED_SHORT ? 2 : 1;
+        plane->pboOffset = m_PboSize;
+        m_PboSize += FFALIGN((size_t)plane->width * plane->height * plane->components * uploadBytes, 4);
+
+        m_Gl.TexImage2D(GL_TEXTURE_2D, 0, plane->internalFormat,
+                        plane->width, plane->height, 0,
+                        plane->format, plane->type, nullptr);
+    }
+
+    if (sample16Bit) {
+        // Scale normalized 16-bit samples to normalized 10-bit values
+        sampleScale = format == AV_PIX_FMT_P010 ?
+                    65535.0f / (1023 << 6) : 65535.0f / 1023;
+    }
+
+    if (!imported) {
+        m_Gl.GenBuffers(GL_PBO_COUNT, m_Pbos);
+    }
+
+    bool toneMap = m_ToneMapEnabled && frame->color_trc == AVCOL_TRC_SMPTE2084;
+    QByteArray defines;
+    if (semiPlanar) {
+        defines += "#define SEMI_PLANAR\n";
+    }
+    if (toneMap) {
+        defines += "#define TONE_MAP\n";
+    }
+
+    if (!buildProgram(m_VideoProgram, defines.constData(), k_VideoFragmentShader)) {
+        deleteVideoObjects();
+        return false;
+    }
+
+    updateColorspace(frame, format, sample16Bit ? 10 : 8);
+    m_Gl.Uniform1f(m_VideoProgram.sampleScaleLocation, sampleScale);
+    m_Gl.Uniform4f(m_VideoProgram.rectLocation, -1.0f, -1.0f, 2.0f, 2.0f);
+
+    m_FrameFormat = format;
+    m_FrameImported = imported;
+    m_FrameWidth = frame->width;
+    m_FrameHeight = frame->height;
+    m_FrameColorspace = frame->colorspace;
+    m_FrameColorRange = frame->color_range;
+    m_FrameTransfer = frame->color_trc;
+
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                "OpenGL video setup: %dx%d, format %d, colorspace %d, range %d%s%s",
+                frame->width,
+                frame->height,
+                format,
+                frame->colorspace,
+                frame->color_range,
+                toneMap ? ", HDR tone mapping" : "",
+                imported ? ", EGL import" : "");
+
+    return true;
+}
+
+// Copies the frame into the next PBO in the ring and starts the
+// texture uploads from it. The driver copies from the PBO on its own
+// time, so we only wait if it's still using this PBO from 3 frames ago.
+bool GLRenderer::uploadFrame(AVFrame* frame)
+{
+    GLuint pbo = m_Pbos[m_NextPbo];
+    m_NextPbo = (m_NextPbo + 1) % GL_PBO_COUNT;
+
+    m_Gl.BindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+
+    // Orphan the old storage so mapping never waits for the GPU
+    m_Gl.BufferData(GL_PIXEL_UNPACK_BUFFER, m_PboSize, nullptr, GL_STREAM_DRAW);
+    auto pixels = (uint8_t*)m_Gl.MapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, m_PboSize,
+                                                GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (pixels == nullptr) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "glMapBufferRange() failed: %x",
+                     m_Gl.GetError());
+        m_Gl.BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        return false;
+    }
+
+    for (int i = 0; i < m_PlaneCount; i++) {
+        const GL_PLANE* plane = &m_Planes[i];
+        int samples = plane->width * plane->components;
+
+        if (plane->ditherShift != 0) {
+            PlaneCopy::ditherPlane(pixels + plane->pboOffset, samples,
+                                   (const uint16_t*)frame->data[i], frame->linesize[i],
+                                   samples, plane->height, plane->ditherShift);
+        }
+        else {
+            PlaneCopy::copyPlane(pixels + plane->pboOffset, samples * plane->sampleBytes,
+                                 frame->data[i], frame->linesize[i],
+                                 samples * plane->sampleBytes, plane->height);
+        }
+    }
+
+    m_Gl.UnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+    for (int i = 0; i < m_PlaneCount; i++) {
+        const GL_PLANE* plane = &m_Planes[i];
+
+        m_Gl.BindTexture(GL_TEXTURE_2D, plane->texture);
+        m_Gl.TexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, plane->width, plane->height,
+                           plane->format, plane->type, (const void*)(uintptr_t)plane->pboOffset);
+    }
+
+    m_Gl.BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    return true;
+}
+
+#ifdef HAVE_EGL
+
+// Binds the planes of a hardware frame to our textures without
+// copying them. The previous frame's images stay alive until now,
+// since the GPU may have been sampling them until the last swap.
+bool GLRenderer::importFrame(AVFrame* frame)
+{
+    auto hwFrameCtx = (AVHWFramesContext*)frame->hw_frames_ctx->data;
+
+    if (!isPixelFormatSupported(0, hwFrameCtx->sw_format)) {
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                    "Unable to import frames of format %d",
+                    hwFrameCtx->sw_format);
+        return false;
+    }
+
+    if (!m_FrameImported ||
+            hwFrameCtx->sw_format != m_FrameFormat ||
+            frame->width != m_FrameWidth ||
+            frame->height != m_FrameHeight ||
+            frame->colorspace != m_FrameColorspace ||
+            frame->color_range != m_FrameColorRange ||
+            frame->color_trc != m_FrameTransfer) {
+        if (!setupVideo(frame, hwFrameCtx->sw_format, true)) {
+            return false;
+        }
+    }
+
+    EGLImage images[EGL_MAX_PLANES];
+    ssize_t count = m_BackendRenderer->exportEGLImages(frame, m_EGLDisplay, images);
+    if (count < 0) {
+        return false;
+    }
+    else if (count != m_PlaneCount) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "Exported %d EGL images for %d planes",
+                     (int)count,
+                     m_PlaneCount);
+        m_BackendRenderer->freeEGLImages(m_EGLDisplay, images, count);
+        return false;
+    }
+
+    AVFrame* frameRef = av_frame_clone(frame);
+    if (frameRef == nullptr) {
+        m_BackendRenderer->freeEGLImages(m_EGLDisplay, images, count);
+        return false;
+    }
+
+    m_Gl.ActiveTexture(GL_TEXTURE0);
+    for (int i = 0; i < m_PlaneCount; i++) {
+        m_Gl.BindTexture(GL_TEXTURE_2D, m_Planes[i].texture);
+        m_Gl.EGLImageTargetTexture2DOES(GL_TEXTURE_2D, images[i]);
+    }
+
+    freeImportedFrame();
+
+    memcpy(m_EGLImages, images, sizeof(EGLImage) * count);
+    m_EGLImageCount = count;
+    m_LastImportedFrame = frameRef;
+
+    return true;
+}
+
+void GLRenderer::freeImportedFrame()
+{
+    if (m_EGLImageCount > 0) {
+        m_BackendRenderer->freeEGLImages(m_EGLDisplay, m_EGLImages, m_EGLImageCount);
+        m_EGLImageCount = 0;
+    }
+
+    av_frame_free(&m_LastImportedFrame);
+}
+
+#endif
+
+void GLRenderer::renderFrame(AVFrame* frame)
+{
+    int err;
+    AVFrame* swFrame = nullptr;
+    uint64_t uploadStartTimeUs;
+    bool imported = false;
+
+    if (!makeCurrent()) {
+        return;
+    }
+
+    if (SDL_AtomicCAS(&m_WindowChanged, 1, 0)) {
+        updateViewport();
+    }
+
+#ifdef HAVE_EGL
+    if (m_EGLImportEnabled && frame->hw_frames_ctx != nullptr) {
+        imported = importFrame(frame);
+        if (!imported) {
+            SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                        "EGL import failed; falling back to read-back");
+            m_EGLImportEnabled = false;
+            freeImportedFrame();
+        }
+    }
+#endif
+
+    if (frame->hw_frames_ctx != nullptr && !imported) {
+        // If we are acting as the frontend for a hardware
+        // accelerated decoder, we'll need to read the frame
+        // back to render it.
+
+        // Find the native read-back format
+        if (m_SwPixelFormat == AV_PIX_FMT_NONE) {
+            auto hwFrameCtx = (AVHWFramesContext*)frame->hw_frames_ctx->data;
+
+            m_SwPixelFormat = hwFrameCtx->sw_format;
+            SDL_assert(m_SwPixelFormat != AV_PIX_FMT_NONE);
+
+            SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                        "Selected read-back format: %d",
+                        m_SwPixelFormat);
+        }
+
+        swFrame = av_frame_alloc();
+        if (swFrame == nullptr) {
+            return;
+        }
+
+        swFrame->width = frame->width;
+        swFrame->height = frame->height;
+        swFrame->format = m_SwPixelFormat;
+
+        err = av_hwframe_transfer_data(swFrame, frame, 0);
+        if (err != 0) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                         "av_hwframe_transfer_data() failed: %d",
+                         err);
+            goto Exit;
+        }
+
+        // av_hwframe_transfer_data() can nuke frame metadata,
+        // so anything other than width, height, and format must
+        // be set *after* calling av_hwframe_transfer_data().
+        swFrame->colorspace = frame->colorspace;
+        swFrame->color_range = frame->color_range;
+        swFrame->color_trc = frame->color_trc;
+
+        frame = swFrame;
+    }
+
+    if (!imported) {
+        if (m_FrameImported ||
+                frame->format != m_FrameFormat ||
+                frame->width != m_FrameWidth ||
+                frame->height != m_FrameHeight ||
+                frame->colorspace != m_FrameColorspace ||
+                frame->color_range != m_FrameColorRange ||
+                frame->color_trc != m_FrameTransfer) {
+            if (!setupVideo(frame, frame->format, false)) {
+                goto Exit;
+            }
+        }
+
+        uploadStartTimeUs = StreamUtils::getMicroseconds();
+
+        if (!uploadFrame(frame)) {
+            goto Exit;
+        }
+
+        if (m_VideoStats != nullptr) {
+            m_VideoStats->totalBytesUploaded += m_PboSize;
+            m_VideoStats->uploadTime.add((uint32_t)(StreamUtils::getMicroseconds() - uploadStartTimeUs));
+        }
+    }
+
+    m_Gl.Clear(GL_COLOR_BUFFER_BIT);
+
+    // Draw the video content itself
+    m_Gl.UseProgram(m_VideoProgram.program);
+    for (int i = 0; i < m_PlaneCount; i++) {
+        m_Gl.ActiveTexture(GL_TEXTURE0 + i);
+        m_Gl.BindTexture(GL_TEXTURE_2D, m_Planes[i].texture);
+    }
+    m_Gl.DrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+    // Draw the overlays
+    m_Gl.Enable(GL_BLEND);
+    for (int i = 0; i < Overlay::OverlayMax; i++) {
+        renderOverlay((Overlay::OverlayType)i);
+    }
+    m_Gl.Disable(GL_BLEND);
+    m_Gl.BindVertexArray(m_VertexArray);
+
+    SDL_GL_SwapWindow(m_Window);
+
+Exit:
+    if (swFrame != nullptr) {
+        av_frame_free(&swFrame);
+    }
+}
@@ -0,0 +1,208 @@
+#pragma once
+
+#include "renderer.h"
+#include "streaming/video/glyphatlas.h"
+
+#include <SDL_opengl.h>
+#include <SDL_ttf.h>
+
+// Number of pixel unpack buffers we cycle through, so writing the
+// next frame doesn't wait for the GPU to finish reading the last one
+#define GL_PBO_COUNT 3
+
+#define GL_PLANE_COUNT 3
+
+// Renders YUV frames with OpenGL 3.3 or OpenGL ES 3.0 on its own
+// context, which is only current on Pacer's render thread while
+// streaming. YUV to RGB conversion and overlay blending happen on
+// the GPU. Set GL_RENDERER=1 to use it instead of SdlRenderer.
+//
+// When the backend renderer can export its frames as EGL images and
+// our context is an EGL context, hardware frames are sampled in place
+// instead of being read back. Set EGL_IMPORT=0 to always read back.
+class GLRenderer : public IFFmpegRenderer {
+public:
+    GLRenderer(IFFmpegRenderer* backendRenderer = nullptr);
+    virtual ~GLRenderer() override;
+    virtual bool initialize(PDECODER_PARAMETERS params) override;
+    virtual bool prepareDecoderContext(AVCodecContext* context, AVDictionary** options) override;
+    virtual void renderFrame(AVFrame* frame) override;
+    virtual void notifyOverlayUpdated(Overlay::OverlayType) override;
+    virtual bool isPixelFormatSupported(int videoFormat, enum AVPixelFormat pixelFormat) override;
+    virtual bool notifyWindowChanged() override;
+    virtual bool needsHwFrameReadback() override;
+    virtual void setVideoStats(PVIDEO_STATS videoStats) override;
+    virtual bool isPresentVsyncBlocked() override;
+    virtual void cleanupRenderContext() override;
+
+    static bool isRequested();
+
+private:
+    typedef struct _GL_FUNCTIONS {
+        const GLubyte* (APIENTRY *GetString)(GLenum);
+        GLenum (APIENTRY *GetError)(void);
+        void (APIENTRY *Viewport)(GLint, GLint, GLsizei, GLsizei);
+        void (APIENTRY *ClearColor)(GLfloat, GLfloat, GLfloat, GLfloat);
+        void (APIENTRY *Clear)(GLbitfield);
+        void (APIENTRY *Enable)(GLenum);
+        void (APIENTRY *Disable)(GLenum);
+        void (APIENTRY *BlendFunc)(GLenum, GLenum);
+        void (APIENTRY *PixelStorei)(GLenum, GLint);
+        void (APIENTRY *GenTextures)(GLsizei, GLuint*);
+        void (APIENTRY *DeleteTextures)(GLsizei, const GLuint*);
+        void (APIENTRY *BindTexture)(GLenum, GLuint);
+        void (APIENTRY *ActiveTexture)(GLenum);
+        void (APIENTRY *TexParameteri)(GLenum, GLenum, GLint);
+        void (APIENTRY *TexImage2D)(GLenum, GLint, GLint, GLsizei, GLsizei, GLint, GLenum, GLenum, const void*);
+        void (APIENTRY *TexSubImage2D)(GLenum, GLint, GLint, GLint, GLsizei, GLsizei, GLenum, GLenum, const void*);
+        GLuint (APIENTRY *CreateShader)(GLenum);
+        void (APIENTRY *ShaderSource)(GLuint, GLsizei, const GLchar* const*, const GLint*);
+        void (APIENTRY *CompileShader)(GLuint);
+        void (APIENTRY *GetShaderiv)(GLuint, GLenum, GLint*);
+        void (APIENTRY *GetShaderInfoLog)(GLuint, GLsizei, GLsizei*, GLchar*);
+        void (APIENTRY *DeleteShader)(GLuint);
+        GLuint (APIENTRY *CreateProgram)(void);
+        void (APIENTRY *AttachShader)(GLuint, GLuint);
+        void (APIENTRY *BindAttribLocation)(GLuint, GLuint, const GLchar*);
+        void (APIENTRY *LinkProgram)(GLuint);
+        void (APIENTRY *GetProgramiv)(GLuint, GLenum, GLint*);
+        void (APIENTRY *GetProgramInfoLog)(GLuint, GLsizei, GLsizei*, GLchar*);
+        void (APIENTRY *UseProgram)(GLuint);
+        void (APIENTRY *DeleteProgram)(GLuint);
+        GLint (APIENTRY *GetUniformLocation)(GLuint, const GLchar*);
+        void (APIENTRY *Uniform1i)(GLint, GLint);
+        void (APIENTRY *Uniform1f)(GLint, GLfloat);
+        void (APIENTRY *Uniform3fv)(GLint, GLsizei, const GLfloat*);
+        void (APIENTRY *Uniform4f)(GLint, GLfloat, GLfloat, GLfloat, GLfloat);
+        void (APIENTRY *UniformMatrix3fv)(GLint, GLsizei, GLboolean, const GLfloat*);
+        void (APIENTRY *GenBuffers)(GLsizei, GLuint*);
+        void (APIENTRY *DeleteBuffers)(GLsizei, const GLuint*);
+        void (APIENTRY *BindBuffer)(GLenum, GLuint);
+        void (APIENTRY *BufferData)(GLenum, GLsizeiptr, const void*, GLenum);
+        void* (APIENTRY *MapBufferRange)(GLenum, GLintptr, GLsizeiptr, GLbitfield);
+        GLboolean (APIENTRY *UnmapBuffer)(GLenum);
+        void (APIENTRY *GenVertexArrays)(GLsizei, GLuint*);
+        void (APIENTRY *DeleteVertexArrays)(GLsizei, const GLuint*);
+        void (APIENTRY *BindVertexArray)(GLuint);
+        void (APIENTRY *EnableVertexAttribArray)(GLuint);
+        void (APIENTRY *VertexAttribPointer)(GLuint, GLint, GLenum, GLboolean, GLsizei, const void*);
+        void (APIENTRY *DrawArrays)(GLenum, GLint, GLsizei);
+
+        // Optional, from GL_OES_EGL_image
+        void (APIENTRY *EGLImageTargetTexture2DOES)(GLenum, void*);
+    } GL_FUNCTIONS;
+
+    typedef struct _GL_PROGRAM {
+        GLuint program;
+        GLint rectLocation;
+        GLint yuvMatrixLocation;
+        GLint yuvOffsetLocation;
+        GLint sampleScaleLocation;
+        GLint colorLocation;
+    } GL_PROGRAM;
+
+    typedef struct _GL_PLANE {
+        GLuint texture;
+        int width;
+        int height;
+        // 1 for Y, U or V and 2 for interleaved UV
+        int components;
+        // Bytes per component of the source frame
+        int sampleBytes;
+        // Bits to drop when narrowing 16-bit samples to 8 bits,
+        // or 0 to upload the samples unchanged
+        int ditherShift;
+        GLint internalFormat;
+        GLenum format;
+        GLenum type;
+        size_t pboOffset;
+    } GL_PLANE;
+
+    bool createContext();
+
+    bool makeCurrent();
+
+    bool loadFunctions();
+
+    GLuint compileShader(GLenum type, const char* defines, const char* source);
+
+    bool buildProgram(GL_PROGRAM& program, const char* defines, const char* fragmentSource);
+
+    bool setupVideo(AVFrame* frame, int format, bool imported);
+
+    void deleteVideoObjects();
+
+    bool uploadFrame(AVFrame* frame);
+
+#ifdef HAVE_EGL
+    bool importFrame(AVFrame* frame);
+
+    void freeImportedFrame();
+#endif
+
+    void updateColorspace(AVFrame* frame, int format, int bitDepth);
+
+    void updateViewport();
+
+    bool uploadOverlayAtlas(Overlay::OverlayType type, GlyphAtlas* atlas);
+
+    void updateOverlayVertices(Overlay::OverlayType type, GlyphAtlas* atlas);
+
+    void renderOverlay(Overlay::OverlayType type);
+
+    void renderFrameGraph();
+
+    IFFmpegRenderer* m_BackendRenderer;
+    SDL_Window* m_Window;
+    SDL_GLContext m_Context;
+    bool m_IsGLES;
+    GL_FUNCTIONS m_Gl;
+    SDL_atomic_t m_WindowChanged;
+    int m_VideoWidth;
+    int m_VideoHeight;
+    SDL_Rect m_Viewport;
+    bool m_VsyncEnabled;
+    PVIDEO_STATS m_VideoStats;
+    int m_SwPixelFormat;
+    bool m_ToneMapEnabled;
+
+    // Video state, recreated if the frame format changes
+    int m_FrameFormat;
+    int m_FrameWidth;
+    int m_FrameHeight;
+    int m_FrameColorspace;
+    int m_FrameColorRange;
+    int m_FrameTransfer;
+    bool m_FrameImported;
+    GL_PROGRAM m_VideoProgram;
+    GL_PLANE m_Planes[GL_PLANE_COUNT];
+    int m_PlaneCount;
+    GLuint m_Pbos[GL_PBO_COUNT];
+    size_t m_PboSize;
+    int m_NextPbo;
+
+#ifdef HAVE_EGL
+    EGLDisplay m_EGLDisplay;
+    bool m_EGLImportEnabled;
+    EGLImage m_EGLImages[EGL_MAX_PLANES];
+    ssize_t m_EGLImageCount;
+
+    // Keeps the decoder from reusing the surface behind
+    // m_EGLImages while the GPU may still be sampling it
+    AVFrame* m_LastImportedFrame;
+#endif
+
+    GL_PROGRAM m_OverlayProgram;
+    GL_PROGRAM m_FrameGraphProgram;
+    GLuint m_VertexArray;
+    GLuint m_VertexBuffer;
+
+    QByteArray m_FontData;
+    GlyphAtlas* m_OverlayAtlases[Overlay::OverlayMax];
+    GlyphLayout m_OverlayLayouts[Overlay::OverlayMax];
+    GLuint m_OverlayTextures[Overlay::OverlayMax];
+    GLuint m_OverlayVertexArrays[Overlay::OverlayMax];
+    GLuint m_OverlayVertexBuffers[Overlay::OverlayMax];
+    int m_OverlayVertexCounts[Overlay::OverlayMax];
+    Uint32 m_FrameGraphPixels[FRAME_GRAPH_WIDTH * FRAME_GRAPH_HEIGHT];
+};
@@ -0,0 +1,126 @@
+#include "null.h"
+
+#include "streaming/streamutils.h"
+
+extern "C" {
+#include <libavutil/pixdesc.h>
+}
+
+NullRenderer::NullRenderer()
+    : m_Readback(qgetenv("NULL_RENDERER") == "readback"),
+      m_Checksum(0),
+      m_RenderedFrames(0)
+{
+    SDL_zero(m_ReadbackTime);
+}
+
+NullRenderer::~NullRenderer()
+{
+    if (m_Readback && m_RenderedFrames != 0) {
+        // Logging the checksum also keeps the compiler from
+        // optimizing away our reads of the frame data.
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                    "Null renderer read back %u frames (checksum %08x): %.2f/%.2f/%.2f/%.2f ms p50/p95/p99/max",
+                    m_RenderedFrames,
+                    m_Checksum,
+                    m_ReadbackTime.percentileUs(50) / 1000.0f,
+                    m_ReadbackTime.percentileUs(95) / 1000.0f,
+                    m_ReadbackTime.percentileUs(99) / 1000.0f,
+                    m_ReadbackTime.maxUs() / 1000.0f);
+    }
+}
+
+bool NullRenderer::isRequested()
+{
+    QByteArray nullRenderer = qgetenv("NULL_RENDERER");
+    return !nullRenderer.isEmpty() && nullRenderer != "0";
+}
+
+bool NullRenderer::initialize(PDECODER_PARAMETERS)
+{
+    SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                "Using null renderer (NULL_RENDERER). Video will not be displayed!");
+    return true;
+}
+
+bool NullRenderer::prepareDecoderContext(AVCodecContext*, AVDictionary**)
+{
+    // Nothing to do
+    return true;
+}
+
+bool NullRenderer::isPixelFormatSupported(int, enum AVPixelFormat)
+{
+    // We don't care what the frames look like
+    return true;
+}
+
+bool NullRenderer::notifyWindowChanged()
+{
+    // We don't draw to the window
+    return true;
+}
+
+void NullRenderer::touchFrame(AVFrame* frame)
+{
+    const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get((enum AVPixelFormat)frame->format);
+    if (desc == nullptr) {
+        return;
+    }
+
+    uint32_t checksum = m_Checksum;
+
+    for (int plane = 0; plane < AV_NUM_DATA_POINTERS && frame->data[plane] != nullptr; plane++) {
+        int height = frame->height;
+        if (plane == 1 || plane == 2) {
+            height = AV_CEIL_RSHIFT(height, desc->log2_chroma_h);
+        }
+
+        int rowBytes = SDL_abs(frame->linesize[plane]);
+        for (int y = 0; y < height; y++) {
+            const uint8_t* row = frame->data[plane] + y * frame->linesize[plane];
+            for (int x = 0; x < rowBytes; x++) {
+                checksum += row[x];
+            }
+        }
+    }
+
+    m_Checksum = checksum;
+}
+
+void NullRenderer::renderFrame(AVFrame* frame)
+{
+    m_RenderedFrames++;
+
+    if (!m_Readback) {
+        return;
+    }
+
+    uint64_t startTimeUs = StreamUtils::getMicroseconds();
+
+    if (frame->hw_frames_ctx != nullptr) {
+        // Read the frame back into system memory like
+        // SdlRenderer does for hardware decoders.
+        AVFrame* swFrame = av_frame_alloc();
+        if (swFrame == nullptr) {
+            return;
+        }
+
+        int err = av_hwframe_transfer_data(swFrame, frame, 0);
+        if (err != 0) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                         "av_hwframe_transfer_data() failed: %d",
+                         err);
+            av_frame_free(&swFrame);
+            return;
+        }
+
+        touchFrame(swFrame);
+        av_frame_free(&swFrame);
+    }
+    else {
+        touchFrame(frame);
+    }
+
+    m_ReadbackTime.add((uint32_t)(StreamUtils::getMicroseconds() - startTimeUs));
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "renderer.h"
+
+// Discards frames instead of displaying them, so decoding and pacing
+// can be benchmarked without a GPU or display. Selected by setting
+// NULL_RENDERER=1, or NULL_RENDERER=readback to also read back
+// hardware frames and touch every pixel like a real renderer would.
+class NullRenderer : public IFFmpegRenderer {
+public:
+    NullRenderer();
+    virtual ~NullRenderer() override;
+    virtual bool initialize(PDECODER_PARAMETERS params) override;
+    virtual bool prepareDecoderContext(AVCodecContext* context, AVDictionary** options) override;
+    virtual void renderFrame(AVFrame* frame) override;
+    virtual bool isPixelFormatSupported(int videoFormat, enum AVPixelFormat pixelFormat) override;
+    virtual bool notifyWindowChanged() override;
+
+    static bool isRequested();
+
+private:
+    void touchFrame(AVFrame* frame);
+
+    bool m_Readback;
+    uint32_t m_Checksum;
+    uint32_t m_RenderedFrames;
+    LatencyHistogram m_ReadbackTime;
+};
@@ -0,0 +1,360 @@
+#include "drmvsyncsource.h"
+#include "streaming/streamutils.h"
+#include "streaming/tracer.h"
+
+#include <SDL_syswm.h>
+
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/eventfd.h>
+
+// Long enough for a V-blank at any refresh rate we'd pace at
+#define VBLANK_PROBE_TIMEOUT_MS 250
+
+#define MAX_DRM_DEVICES 16
+
+DrmVsyncSource::DrmVsyncSource(Pacer* pacer) :
+    m_Pacer(pacer),
+    m_Thread(nullptr),
+    m_DrmFd(-1),
+    m_StopFd(-1),
+    m_CrtcIndex(-1),
+    m_VblankPending(false),
+    m_VblankSec(0),
+    m_VblankUsec(0),
+    m_Predictor(nullptr)
+{
+    SDL_AtomicSet(&m_Stopping, 0);
+}
+
+DrmVsyncSource::~DrmVsyncSource()
+{
+    if (m_Thread != nullptr) {
+        uint64_t stop = 1;
+
+        SDL_AtomicSet(&m_Stopping, 1);
+
+        // Wake the thread up if it's waiting for a V-blank
+        if (write(m_StopFd, &stop, sizeof(stop)) < 0) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                         "Failed to stop DRM V-sync thread: %d",
+                         errno);
+        }
+
+        SDL_WaitThread(m_Thread, nullptr);
+    }
+
+    if (m_DrmFd != -1) {
+        close(m_DrmFd);
+    }
+
+    if (m_StopFd != -1) {
+        close(m_StopFd);
+    }
+
+    delete m_Predictor;
+}
+
+bool DrmVsyncSource::initialize(SDL_Window* window, int displayFps)
+{
+    const char* device = SDL_getenv("DRM_DEV");
+    char devicePath[64];
+
+    m_DisplayFps = displayFps;
+    m_Predictor = new VsyncPredictor(displayFps);
+
+    m_StopFd = eventfd(0, EFD_CLOEXEC);
+    if (m_StopFd < 0) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "eventfd() failed: %d",
+                     errno);
+        return false;
+    }
+
+    if (device == nullptr) {
+        if (!findDevice(window, devicePath, sizeof(devicePath))) {
+            return false;
+        }
+
+        device = devicePath;
+    }
+
+    m_DrmFd = open(device, O_RDWR | O_CLOEXEC);
+    if (m_DrmFd < 0) {
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                    "Failed to open DRM device for V-sync: %d",
+                    errno);
+        return false;
+    }
+
+    if (!findCrtc(window)) {
+        return false;
+    }
+
+    // Make sure the driver supports V-blank waits before we rely on them
+    uint64_t vblankUs;
+    if (!waitForVblank(VBLANK_PROBE_TIMEOUT_MS, &vblankUs)) {
+        return false;
+    }
+
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                "Using DRM V-sync on %s CRTC %d",
+                device,
+                m_CrtcIndex);
+
+    m_Thread = SDL_CreateThread(vsyncThread, "DRMVsync", this);
+    if (m_Thread == nullptr) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "Unable to create DRM V-sync thread: %s",
+                     SDL_GetError());
+        return false;
+    }
+
+    return true;
+}
+
+void DrmVsyncSource::vblankHandler(int, unsigned int,
+                                   unsigned int tvSec, unsigned int tvUsec,
+                                   void* userData)
+{
+    DrmVsyncSource* me = reinterpret_cast<DrmVsyncSource*>(userData);
+
+    me->m_VblankPending = false;
+    me->m_VblankSec = tvSec;
+    me->m_VblankUsec = tvUsec;
+}
+
+// Under KMSDRM, SDL knows the device. Otherwise we can only be sure
+// when there's just one device with a display controller.
+bool DrmVsyncSource::findDevice(SDL_Window* window, char* path, size_t pathLength)
+{
+#if SDL_VERSION_ATLEAST(2, 0, 15) && defined(SDL_VIDEO_DRIVER_KMSDRM)
+    SDL_SysWMinfo info;
+
+    SDL_VERSION(&info.version);
+
+    if (SDL_GetWindowWMInfo(window, &info) && info.subsystem == SDL_SYSWM_KMSDRM) {
+        SDL_snprintf(path, pathLength, DRM_DEV_NAME, DRM_DIR_NAME, info.info.kmsdrm.dev_index);
+        return true;
+    }
+#else
+    (void)window;
+#endif
+
+    drmDevicePtr devices[MAX_DRM_DEVICES];
+    int deviceCount = drmGetDevices2(0, devices, MAX_DRM_DEVICES);
+    if (deviceCount < 0) {
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                    "drmGetDevices2() failed: %d",
+                    deviceCount);
+        return false;
+    }
+
+    int primaryCount = 0;
+    for (int i = 0; i < deviceCount; i++) {
+        if (devices[i]->available_nodes & (1 << DRM_NODE_PRIMARY)) {
+            if (primaryCount++ == 0) {
+                SDL_strlcpy(path, devices[i]->nodes[DRM_NODE_PRIMARY], pathLength);
+            }
+        }
+    }
+
+    drmFreeDevices(devices, deviceCount);
+
+    if (primaryCount != 1) {
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                    "Found %d DRM devices and can't tell which one has the window",
+                    primaryCount);
+        return false;
+    }
+
+    return true;
+}
+
+// An active CRTC is only used if it's the only one, or the only one
+// with the same resolution and refresh rate as the window's display
+bool DrmVsyncSource::findCrtc(SDL_Window* window)
+{
+    SDL_DisplayMode mode;
+
+    if (SDL_GetCurrentDisplayMode(SDL_GetWindowDisplayIndex(window), &mode) != 0) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "SDL_GetCurrentDisplayMode() failed: %s",
+                     SDL_GetError());
+        return false;
+    }
+
+    drmModeRes* resources = drmModeGetResources(m_DrmFd);
+    if (resources == nullptr) {
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                    "drmModeGetResources() failed: %d",
+                    errno);
+        return false;
+    }
+
+    int activeCount = 0;
+    int activeIndex = -1;
+    int matchingCount = 0;
+    int matchingIndex = -1;
+    for (int i = 0; i < resources->count_crtcs; i++) {
+        drmModeCrtc* crtc = drmModeGetCrtc(m_DrmFd, resources->crtcs[i]);
+        if (crtc == nullptr) {
+            continue;
+        }
+
+        if (crtc->mode_valid) {
+            activeCount++;
+            activeIndex = i;
+
+            if (crtc->mode.hdisplay == mode.w &&
+                    crtc->mode.vdisplay == mode.h &&
+                    SDL_abs((int)crtc->mode.vrefresh - mode.refresh_rate) <= 1) {
+                matchingCount++;
+                matchingIndex = i;
+            }
+        }
+
+        drmModeFreeCrtc(crtc);
+    }
+
+    drmModeFreeResources(resources);
+
+    if (activeCount == 1) {
+        m_CrtcIndex = activeIndex;
+    }
+    else if (matchingCount == 1) {
+        m_CrtcIndex = matchingIndex;
+    }
+    else {
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                    "Found %d active CRTCs (%d matching %dx%d %d Hz) and can't tell which one has the window",
+                    activeCount,
+                    matchingCount,
+                    mode.w,
+                    mode.h,
+                    mode.refresh_rate);
+        return false;
+    }
+
+    return true;
+}
+
+// Returns the time of the V-blank on StreamUtils' clock. Returns false
+// if the wait times out, or is interrupted because we're stopping.
+bool DrmVsyncSource::waitForVblank(int timeoutMs, uint64_t* vblankUs)
+{
+    // A request that timed out is still pending, so keep waiting on it
+    if (!m_VblankPending) {
+        drmVBlank vbl = {};
+
+        vbl.request.type = (drmVBlankSeqType)(DRM_VBLANK_RELATIVE | DRM_VBLANK_EVENT);
+        if (m_CrtcIndex == 1) {
+            vbl.request.type = (drmVBlankSeqType)(vbl.request.type | DRM_VBLANK_SECONDARY);
+        }
+        else if (m_CrtcIndex > 1) {
+            vbl.request.type = (drmVBlankSeqType)(vbl.request.type |
+                                                  ((m_CrtcIndex << DRM_VBLANK_HIGH_CRTC_SHIFT) & DRM_VBLANK_HIGH_CRTC_MASK));
+        }
+        vbl.request.sequence = 1;
+        vbl.request.signal = (unsigned long)this;
+
+        int err = drmWaitVBlank(m_DrmFd, &vbl);
+        if (err != 0) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                         "drmWaitVBlank() failed: %d",
+                         errno);
+            return false;
+        }
+
+        m_VblankPending = true;
+    }
+
+    drmEventContext eventContext = {};
+    eventContext.version = 2;
+    eventContext.vblank_handler = vblankHandler;
+
+    while (m_VblankPending) {
+        struct pollfd fds[2] = {
+            { m_DrmFd, POLLIN, 0 },
+            { m_StopFd, POLLIN, 0 },
+        };
+
+        int ret = poll(fds, 2, timeoutMs);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                         "poll() failed: %d",
+                         errno);
+            return false;
+        }
+        else if (ret == 0) {
+            SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                        "Timed out waiting for V-blank");
+            return false;
+        }
+        else if (fds[1].revents != 0) {
+            return false;
+        }
+
+        if (drmHandleEvent(m_DrmFd, &eventContext) != 0) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                         "drmHandleEvent() failed: %d",
+                         errno);
+            return false;
+        }
+    }
+
+    // V-blank timestamps are on CLOCK_MONOTONIC, which may not be
+    // the clock SDL uses, so only how long ago it was carries over
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    int64_t ageUs = ((int64_t)now.tv_sec - m_VblankSec) * 1000000 +
+                    (now.tv_nsec / 1000 - m_VblankUsec);
+    *vblankUs = StreamUtils::getMicroseconds() - SDL_max(ageUs, (int64_t)0);
+
+    return true;
+}
+
+int DrmVsyncSource::vsyncThread(void* context)
+{
+    DrmVsyncSource* me = reinterpret_cast<DrmVsyncSource*>(context);
+
+    Tracer::setThreadName("DRMVsync");
+
+#if SDL_VERSION_ATLEAST(2, 0, 9)
+    SDL_SetThreadPriority(SDL_THREAD_PRIORITY_TIME_CRITICAL);
+#else
+    SDL_SetThreadPriority(SDL_THREAD_PRIORITY_HIGH);
+#endif
+
+    while (SDL_AtomicGet(&me->m_Stopping) == 0) {
+        uint64_t vblankUs;
+        if (!me->waitForVblank(-1, &vblankUs)) {
+            if (SDL_AtomicGet(&me->m_Stopping) == 0) {
+                SDL_Delay(10);
+            }
+            continue;
+        }
+
+        // The kernel's timestamps are exact, so this only smooths out
+        // the period the display actually runs at
+        me->m_Predictor->addTimestamp(vblankUs);
+
+        // Skip past this V-blank, even if it's predicted slightly late
+        double periodUs = me->m_Predictor->getPeriodUs();
+        me->m_Pacer->vsyncCallback(me->m_Predictor->getNextVsync(vblankUs + (uint64_t)(periodUs / 2)),
+                                   (uint32_t)periodUs);
+    }
+
+    return 0;
+}
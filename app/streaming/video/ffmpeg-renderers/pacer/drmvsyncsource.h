@@ -0,0 +1,53 @@
+#pragma once
+
+#include "pacer.h"
+#include "vsyncpredictor.h"
+
+// Waits for V-blank on the display's CRTC with V-blank events from
+// drmWaitVBlank(). This doesn't need DRM master, so it also works under
+// X11 and Wayland as long as we can open the DRM device. The events are
+// polled for along with a stop eventfd, so we can't get stuck if the
+// CRTC stops scanning out.
+//
+// Waiting on the wrong display would pace us to the wrong V-sync, so
+// this refuses to initialize unless it can tell which device (DRM_DEV
+// overrides it) and CRTC drive the window.
+class DrmVsyncSource : public IVsyncSource
+{
+public:
+    DrmVsyncSource(Pacer* pacer);
+
+    virtual ~DrmVsyncSource();
+
+    virtual bool initialize(SDL_Window* window, int displayFps);
+
+private:
+    static int vsyncThread(void* context);
+
+    bool findDevice(SDL_Window* window, char* path, size_t pathLength);
+
+    bool findCrtc(SDL_Window* window);
+
+    static void vblankHandler(int fd, unsigned int sequence,
+                              unsigned int tvSec, unsigned int tvUsec,
+                              void* userData);
+
+    bool waitForVblank(int timeoutMs, uint64_t* vblankUs);
+
+    Pacer* m_Pacer;
+    SDL_Thread* m_Thread;
+    SDL_atomic_t m_Stopping;
+    int m_DisplayFps;
+    int m_DrmFd;
+    int m_StopFd;
+    int m_CrtcIndex;
+
+    // Only one V-blank event is requested at a time, so one that
+    // arrives late can't be mistaken for a newer V-blank
+    bool m_VblankPending;
+    unsigned int m_VblankSec;
+    unsigned int m_VblankUsec;
+
+    // Only used on our thread
+    VsyncPredictor* m_Predictor;
+};
@@ -1,4 +1,7 @@
 #include "dxvsyncsource.h"
+#include "vsyncpredictor.h"
+#include "streaming/streamutils.h"
+#include "streaming/tracer.h"
 
 // Useful references:
 // https://bugs.chromium.org/p/chromium/issues/detail?id=467617
@@ -76,6 +79,8 @@ int DxVsyncSource::vsyncThread(void* context)
 {
     DxVsyncSource* me = reinterpret_cast<DxVsyncSource*>(context);
 
+    Tracer::setThreadName("DXVsync");
+
 #if SDL_VERSION_ATLEAST(2, 0, 9)
     SDL_SetThreadPriority(SDL_THREAD_PRIORITY_TIME_CRITICAL);
 #else
@@ -87,6 +92,9 @@ int DxVsyncSource::vsyncThread(void* context)
     DEVMODEA monitorMode;
     monitorMode.dmSize = sizeof(monitorMode);
 
+    // Measures the real V-sync period from our wake-ups
+    VsyncPredictor predictor(me->m_DisplayFps);
+
     while (SDL_AtomicGet(&me->m_Stopping) == 0) {
         D3DKMT_WAITFORVERTICALBLANKEVENT waitForVblankEventParams;
         NTSTATUS status;
@@ -144,6 +152,10 @@ int DxVsyncSource::vsyncThread(void* context)
             }
 
             lastMonitor = currentMonitor;
+
+            if (monitorMode.dmDisplayFrequency > 1) {
+                predictor = VsyncPredictor(monitorMode.dmDisplayFrequency);
+            }
         }
 
         waitForVblankEventParams.hAdapter = openAdapterParams.hAdapter;
@@ -159,7 +171,13 @@ int DxVsyncSource::vsyncThread(void* context)
             continue;
         }
 
-        me->m_Pacer->vsyncCallback(1000 / me->m_DisplayFps);
+        uint64_t vsyncUs = StreamUtils::getMicroseconds();
+        predictor.addTimestamp(vsyncUs);
+
+        // Skip past this V-blank, even if it's predicted slightly late
+        double periodUs = predictor.getPeriodUs();
+        me->m_Pacer->vsyncCallback(predictor.getNextVsync(vsyncUs + (uint64_t)(periodUs / 2)),
+                                   (uint32_t)periodUs);
     }
 
     if (openAdapterParams.hAdapter != 0) {
@@ -0,0 +1,94 @@
+#include "jitterbuffer.h"
+
+#include <math.h>
+
+// Weight of each new interval in the moving averages
+#define INTERVAL_GAIN (1.0 / 16)
+#define JITTER_GAIN (1.0 / 16)
+
+// Gaps longer than this many frame intervals are stalls, which
+// shouldn't throw off the average frame interval
+#define MAX_INTERVAL_FRAMES 4
+
+// Late frames pull the schedule this much toward themselves, so it
+// catches up if the average interval is a little short
+#define SCHEDULE_GAIN (1.0 / 64)
+
+// Frames count for about this long before they fade out
+#define HISTORY_SECONDS 10
+
+JitterBuffer::JitterBuffer(int frameRate, double maxDropRate)
+    : m_MaxDropRate(maxDropRate),
+      m_NominalIntervalUs(1000000.0 / frameRate),
+      m_IntervalUs(m_NominalIntervalUs),
+      m_HistoryDecay(1.0 / (frameRate * HISTORY_SECONDS)),
+      m_ExpectedArrivalUs(0),
+      m_LastArrivalUs(0),
+      m_JitterUs(0),
+      m_TotalCount(0)
+{
+    SDL_zero(m_DepthCounts);
+}
+
+void JitterBuffer::addArrival(uint64_t timeUs)
+{
+    if (m_LastArrivalUs == 0) {
+        m_ExpectedArrivalUs = timeUs + m_IntervalUs;
+        m_LastArrivalUs = timeUs;
+        return;
+    }
+
+    double intervalUs = timeUs - m_LastArrivalUs;
+    m_JitterUs += (fabs(intervalUs - m_IntervalUs) - m_JitterUs) * JITTER_GAIN;
+
+    // The host may render slower than the stream frame rate,
+    // but frames can't come in faster than it on average
+    intervalUs = SDL_min(intervalUs, m_NominalIntervalUs * MAX_INTERVAL_FRAMES);
+    m_IntervalUs += (intervalUs - m_IntervalUs) * INTERVAL_GAIN;
+    m_IntervalUs = SDL_max(m_IntervalUs, m_NominalIntervalUs);
+    m_LastArrivalUs = timeUs;
+
+    double delayUs = timeUs - m_ExpectedArrivalUs;
+    if (delayUs < 0) {
+        // Early frames are on the fastest schedule we know of
+        m_ExpectedArrivalUs = timeUs;
+        delayUs = 0;
+    }
+    else {
+        m_ExpectedArrivalUs += delayUs * SCHEDULE_GAIN;
+    }
+    m_ExpectedArrivalUs += m_IntervalUs;
+
+    // A frame less than half an interval late usually
+    // still makes the V-sync it was meant for
+    int depth = 1 + (int)(delayUs / m_IntervalUs + 0.5);
+    depth = SDL_min(depth, MAX_JITTER_BUFFER_FRAMES);
+
+    for (int i = 1; i <= MAX_JITTER_BUFFER_FRAMES; i++) {
+        m_DepthCounts[i] -= m_DepthCounts[i] * m_HistoryDecay;
+    }
+    m_TotalCount -= m_TotalCount * m_HistoryDecay;
+
+    m_DepthCounts[depth]++;
+    m_TotalCount++;
+}
+
+int JitterBuffer::getDepth() const
+{
+    // Find the smallest depth that the allowed fraction
+    // of frames needing more would fit under
+    double needMore = m_TotalCount;
+    for (int depth = 1; depth < MAX_JITTER_BUFFER_FRAMES; depth++) {
+        needMore -= m_DepthCounts[depth];
+        if (needMore <= m_TotalCount * m_MaxDropRate) {
+            return depth;
+        }
+    }
+
+    return MAX_JITTER_BUFFER_FRAMES;
+}
+
+uint32_t JitterBuffer::getJitterUs() const
+{
+    return (uint32_t)m_JitterUs;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <SDL.h>
+
+#define MAX_JITTER_BUFFER_FRAMES 4
+
+// Picks how many frames Pacer keeps queued for V-sync from how late
+// decoded frames arrive. A frame that arrives a frame interval late
+// misses its V-sync unless a frame is queued ahead of it, and the
+// frames that pile up behind it are eventually dropped to get the
+// latency back down. The depth is the smallest one that would have
+// covered all but the given fraction of recent frames.
+//
+// All times are passed in and the clock is never read here, so it can
+// be driven by simulated frame arrivals.
+class JitterBuffer
+{
+public:
+    JitterBuffer(int frameRate, double maxDropRate);
+
+    void addArrival(uint64_t timeUs);
+
+    int getDepth() const;
+
+    // Average difference between frame intervals, like RTP's
+    // interarrival jitter
+    uint32_t getJitterUs() const;
+
+private:
+    double m_MaxDropRate;
+    double m_NominalIntervalUs;
+    double m_IntervalUs;
+    double m_HistoryDecay;
+
+    // When the next frame would arrive if it were on time
+    double m_ExpectedArrivalUs;
+    uint64_t m_LastArrivalUs;
+
+    double m_JitterUs;
+
+    // Recent frames by the depth each would have needed,
+    // fading out with each frame that arrives
+    double m_DepthCounts[MAX_JITTER_BUFFER_FRAMES + 1];
+    double m_TotalCount;
+};
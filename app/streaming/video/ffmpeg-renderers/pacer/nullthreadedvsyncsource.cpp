@@ -1,4 +1,6 @@
 #include "nullthreadedvsyncsource.h"
+#include "streaming/streamutils.h"
+#include "streaming/tracer.h"
 
 NullThreadedVsyncSource::NullThreadedVsyncSource(Pacer* pacer) :
     m_Pacer(pacer),
@@ -33,14 +35,18 @@ int NullThreadedVsyncSource::vsyncThread(void* context)
 {
     NullThreadedVsyncSource* me = reinterpret_cast<NullThreadedVsyncSource*>(context);
 
+    Tracer::setThreadName("NullVsync");
+
 #if SDL_VERSION_ATLEAST(2, 0, 9)
     SDL_SetThreadPriority(SDL_THREAD_PRIORITY_TIME_CRITICAL);
 #else
     SDL_SetThreadPriority(SDL_THREAD_PRIORITY_HIGH);
 #endif
 
+    uint32_t periodUs = 1000000 / me->m_DisplayFps;
+
     while (SDL_AtomicGet(&me->m_Stopping) == 0) {
-        me->m_Pacer->vsyncCallback(1000 / me->m_DisplayFps);
+        me->m_Pacer->vsyncCallback(StreamUtils::getMicroseconds() + periodUs, periodUs);
     }
 
     return 0;
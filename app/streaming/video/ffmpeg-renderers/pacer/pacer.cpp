@@ -1,7 +1,13 @@
 #include "pacer.h"
 #include "streaming/streamutils.h"
+#include "streaming/tracer.h"
 
 #include "nullthreadedvsyncsource.h"
+#include "timervsyncsource.h"
+
+#ifdef HAVE_DRM
+#include "drmvsyncsource.h"
+#endif
 
 #ifdef Q_OS_WIN32
 #define WIN32_LEAN_AND_MEAN
@@ -14,6 +20,15 @@
 // if the V-Sync source or renderer is blocked for a while.
 #define MAX_QUEUED_FRAMES 8
 
+// Room left above the pacing queue depth for frames that come in
+// bursts, while the queue is seen to drain back down
+#define PACING_QUEUE_BURST_FRAMES 2
+
+// Fraction of frames the adaptive pacing queue may drop for
+// coming in too late or too bunched up
+#define LOWEST_LATENCY_DROP_RATE 0.01
+#define SMOOTHEST_DROP_RATE 0.001
+
 // We may be woken up slightly late so don't go all the way
 // up to the next V-sync since we may accidentally step into
 // the next V-sync period. It also takes some amount of time
@@ -21,40 +36,148 @@
 // V-sync happens.
 #define TIMER_SLACK_MS 3
 
-Pacer::Pacer(IFFmpegRenderer* renderer, PVIDEO_STATS videoStats) :
+// With just-in-time rendering, the render cost estimate covers the
+// time to render, so this only needs to cover waking up late
+#define JIT_WAKEUP_MARGIN_US 1000
+
+Pacer::Pacer(IFFmpegRenderer* renderer, FrameGraph* frameGraph) :
+    m_RenderQueue(MAX_QUEUED_FRAMES),
+    m_PacingQueue(MAX_QUEUED_FRAMES),
+    m_RenderReclaimQueue(MAX_QUEUED_FRAMES),
+    m_PacingReclaimQueue(MAX_QUEUED_FRAMES),
+    m_RenderQueueNotEmpty(SDL_CreateSemaphore(0)),
+    m_PacingQueueNotEmpty(SDL_CreateSemaphore(0)),
     m_RenderThread(nullptr),
-    m_Stopping(false),
+    m_JitEnabled(false),
+    m_JitVsyncLock(0),
+    m_JitVsyncUs(0),
+    m_JitPeriodUs(0),
+    m_RenderCost(TIMER_SLACK_MS * 1000 - JIT_WAKEUP_MARGIN_US, renderer->isPresentVsyncBlocked()),
+    m_TargetVsyncUs(0),
+    m_TargetPeriodUs(0),
+    m_LastDeadlineUs(0),
+    m_LastFixedDeadlineUs(0),
+    m_JitterBuffer(nullptr),
     m_VsyncSource(nullptr),
     m_VsyncRenderer(renderer),
+    m_PresentTimeReported(false),
     m_MaxVideoFps(0),
     m_DisplayFps(0),
-    m_VideoStats(videoStats)
+    m_FrameGraph(frameGraph)
 {
+    SDL_AtomicSet(&m_Stopping, 0);
+    SDL_AtomicSet(&m_JitterBufferDepth, 1);
 
+    // The renderer only updates stats while rendering a frame
+    m_VsyncRenderer->setVideoStats(m_RenderStats.get());
 }
 
 Pacer::~Pacer()
 {
-    // Stop V-sync callbacks
+    // Stop the render thread first, since it reports
+    // presented frames to the V-sync source
+    SDL_AtomicSet(&m_Stopping, 1);
+    if (m_RenderThread != nullptr) {
+        SDL_SemPost(m_RenderQueueNotEmpty);
+        SDL_WaitThread(m_RenderThread, nullptr);
+    }
+
+    // Stop V-sync callbacks. Frames it queues for rendering
+    // from now on are freed below.
+    if (m_PresentTimeReported) {
+        m_VsyncRenderer->setVsyncSource(nullptr);
+    }
     delete m_VsyncSource;
     m_VsyncSource = nullptr;
 
-    // Stop the render thread
-    m_Stopping = true;
-    if (m_RenderThread != nullptr) {
-        m_RenderQueueNotEmpty.wakeAll();
-        SDL_WaitThread(m_RenderThread, nullptr);
+    // Delete any remaining unconsumed frames. No other thread
+    // can touch the queues anymore.
+    freeQueuedFrames(m_RenderQueue);
+    freeQueuedFrames(m_PacingQueue);
+    freeQueuedFrames(m_RenderReclaimQueue);
+    freeQueuedFrames(m_PacingReclaimQueue);
+
+    SDL_DestroySemaphore(m_RenderQueueNotEmpty);
+    SDL_DestroySemaphore(m_PacingQueueNotEmpty);
+
+    delete m_JitterBuffer;
+}
+
+bool Pacer::pushFrame(SpscRing<AVFrame*>& queue, AVFrame* frame)
+{
+    AVFrame** slot = queue.beginPush();
+    if (slot == nullptr) {
+        return false;
+    }
+
+    *slot = frame;
+    queue.commitPush();
+    return true;
+}
+
+// Producers may also pop to drop the oldest frame, so this is
+// the only way frames are taken off the queues
+AVFrame* Pacer::popFrame(SpscRing<AVFrame*>& queue)
+{
+    AVFrame* frame;
+    if (!queue.tryPop(frame)) {
+        return nullptr;
     }
 
-    // Delete any remaining unconsumed frames
-    while (!m_RenderQueue.isEmpty()) {
-        AVFrame* frame = m_RenderQueue.dequeue();
+    return frame;
+}
+
+// Called on the queue's producer thread. If the queue is full, the
+// consumer is stalled and the oldest frame is dropped to make room.
+void Pacer::pushNewestFrame(SpscRing<AVFrame*>& queue, SpscRing<AVFrame*>* reclaimQueue,
+                            VideoStatsChannel& stats, AVFrame* frame)
+{
+    while (!pushFrame(queue, frame)) {
+        AVFrame* oldestFrame = popFrame(queue);
+        if (oldestFrame != nullptr) {
+            dropFrame(reclaimQueue, stats, oldestFrame);
+        }
+    }
+}
+
+void Pacer::reclaimFrame(SpscRing<AVFrame*>& reclaimQueue, AVFrame* frame)
+{
+    // If frames aren't being submitted, free it ourselves
+    if (!pushFrame(reclaimQueue, frame)) {
         av_frame_free(&frame);
     }
-    while (!m_PacingQueue.isEmpty()) {
-        AVFrame* frame = m_PacingQueue.dequeue();
+}
+
+// Frames dropped on the thread calling submitFrame() have
+// no reclaim queue and are freed right away
+void Pacer::dropFrame(SpscRing<AVFrame*>* reclaimQueue, VideoStatsChannel& stats, AVFrame* frame)
+{
+    if (m_FrameGraph != nullptr) {
+        m_FrameGraph->addDroppedFrame((int)(intptr_t)frame->opaque);
+    }
+
+    if (reclaimQueue != nullptr) {
+        reclaimFrame(*reclaimQueue, frame);
+    }
+    else {
         av_frame_free(&frame);
     }
+    stats.get()->pacerDroppedFrames++;
+}
+
+void Pacer::freeQueuedFrames(SpscRing<AVFrame*>& queue)
+{
+    AVFrame* frame;
+    while ((frame = popFrame(queue)) != nullptr) {
+        av_frame_free(&frame);
+    }
+}
+
+void Pacer::collectVideoStats(VIDEO_STATS& dst)
+{
+    m_RenderStats.collect(dst);
+    m_VsyncStats.collect(dst);
+    m_SubmitStats.collect(dst);
 }
 
 void Pacer::renderOnMainThread()
@@ -64,60 +187,64 @@ void Pacer::renderOnMainThread()
         return;
     }
 
-    m_FrameQueueLock.lock();
-
-    if (!m_RenderQueue.isEmpty()) {
-        // Releases m_FrameQueueLock
-        renderLastFrameAndUnlock();
-    }
-    else {
-        m_FrameQueueLock.unlock();
-    }
+    renderLastFrame();
 }
 
 int Pacer::renderThread(void* context)
 {
     Pacer* me = reinterpret_cast<Pacer*>(context);
 
+    Tracer::setThreadName("PacerRender");
+
     if (SDL_SetThreadPriority(SDL_THREAD_PRIORITY_HIGH) < 0) {
         SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
                     "Unable to set render thread to high priority: %s",
                     SDL_GetError());
     }
 
-    while (!me->m_Stopping) {
-        // Acquire the frame queue lock to protect the queue and
-        // the not empty condition
-        me->m_FrameQueueLock.lock();
-
+    for (;;) {
         // Wait for a frame to be ready to render
-        while (!me->m_Stopping && me->m_RenderQueue.isEmpty()) {
-            me->m_RenderQueueNotEmpty.wait(&me->m_FrameQueueLock);
-        }
+        SDL_SemWait(me->m_RenderQueueNotEmpty);
 
-        if (me->m_Stopping) {
+        if (SDL_AtomicGet(&me->m_Stopping)) {
             // Exit this thread
-            me->m_FrameQueueLock.unlock();
             break;
         }
 
-        // Render the latest frame and discard the others
-        // NB: m_FrameQueueLock still held here!
-        me->renderLastFrameAndUnlock();
+        if (me->m_JitEnabled) {
+            SDL_AtomicLock(&me->m_JitVsyncLock);
+            uint64_t nextVsyncUs = me->m_JitVsyncUs;
+            uint32_t periodUs = me->m_JitPeriodUs;
+            me->m_JitVsyncUs = 0;
+            SDL_AtomicUnlock(&me->m_JitVsyncLock);
+
+            // We may have been woken for a V-sync we already handled
+            if (nextVsyncUs != 0) {
+                me->renderJustInTime(nextVsyncUs, periodUs);
+            }
+            continue;
+        }
+
+        // Render the latest frame and discard the others. This does
+        // nothing if we already rendered the frame we were woken for.
+        me->renderLastFrame();
     }
 
+    // Let the renderer unbind anything tied to this thread
+    me->m_VsyncRenderer->cleanupRenderContext();
+
     return 0;
 }
 
-void Pacer::enqueueFrameForRenderingAndUnlock(AVFrame *frame)
+// Called on the thread producing the render queue, which drops
+// frames to the given reclaim queue and stats
+void Pacer::enqueueFrameForRendering(SpscRing<AVFrame*>* reclaimQueue,
+                                     VideoStatsChannel& stats, AVFrame* frame)
 {
-    dropFrameForEnqueue(m_RenderQueue);
-    m_RenderQueue.enqueue(frame);
-
-    m_FrameQueueLock.unlock();
+    pushNewestFrame(m_RenderQueue, reclaimQueue, stats, frame);
 
     if (m_RenderThread != nullptr) {
-        m_RenderQueueNotEmpty.wakeOne();
+        SDL_SemPost(m_RenderQueueNotEmpty);
     }
     else {
         SDL_Event event;
@@ -125,61 +252,88 @@ void Pacer::enqueueFrameForRenderingAndUnlock(AVFrame *frame)
         // For main thread rendering, we'll push an event to trigger a callback
         event.type = SDL_USEREVENT;
         event.user.code = SDL_CODE_FRAME_READY;
+        event.user.data1 = (void*)(uintptr_t)StreamUtils::getMicroseconds();
         SDL_PushEvent(&event);
     }
 }
 
-// Caller must hold m_FrameQueueLock
-void Pacer::renderLastFrameAndUnlock()
+// Called on the thread consuming the render queue
+void Pacer::renderLastFrame()
 {
-    // Dequeue the most recent frame for rendering and free the others.
-    AVFrame* lastFrame = nullptr;
-    while (!m_RenderQueue.isEmpty()) {
-        if (lastFrame != nullptr) {
-            // Don't hold the frame queue lock across av_frame_free(),
-            // since it could need to talk to the GPU driver. This is safe
-            // because we're guaranteed that the queue will not shrink during
-            // this time (and so dequeue() below will always get something).
-            m_FrameQueueLock.unlock();
-            av_frame_free(&lastFrame);
-            m_VideoStats->pacerDroppedFrames++;
-            m_FrameQueueLock.lock();
-        }
-
-        lastFrame = m_RenderQueue.dequeue();
+    // Dequeue the most recent frame for rendering and drop the others
+    AVFrame* lastFrame = popFrame(m_RenderQueue);
+    if (lastFrame == nullptr) {
+        return;
     }
 
-    // Release the frame queue lock before rendering
-    m_FrameQueueLock.unlock();
+    AVFrame* frame;
+    while ((frame = popFrame(m_RenderQueue)) != nullptr) {
+        dropFrame(&m_RenderReclaimQueue, m_RenderStats, lastFrame);
+        lastFrame = frame;
+    }
 
-    // Render and free the mot current frame
+    // Render and free the most current frame
     renderFrame(lastFrame);
 }
 
 // Called in an arbitrary thread by the IVsyncSource on V-sync
 // or an event synchronized with V-sync
-void Pacer::vsyncCallback(int timeUntilNextVsyncMillis)
+void Pacer::vsyncCallback(uint64_t nextVsyncUs, uint32_t periodUs)
 {
     // Make sure initialize() has been called
     SDL_assert(m_MaxVideoFps != 0);
 
-    SDL_assert(timeUntilNextVsyncMillis >= TIMER_SLACK_MS);
+    SDL_assert(periodUs >= TIMER_SLACK_MS * 1000);
+
+    // We don't know which frame we'll pick yet
+    TraceScope trace("Pacer::vsyncCallback", -1);
+
+    if (m_JitEnabled) {
+        // The render thread waits until just before this V-sync to pick
+        // a frame, so we don't hold up the V-sync source meanwhile
+        SDL_AtomicLock(&m_JitVsyncLock);
+        m_JitVsyncUs = nextVsyncUs;
+        m_JitPeriodUs = periodUs;
+        SDL_AtomicUnlock(&m_JitVsyncLock);
+
+        SDL_SemPost(m_RenderQueueNotEmpty);
+        return;
+    }
+
+    AVFrame* frame = selectPacedFrame(nextVsyncUs - TIMER_SLACK_MS * 1000,
+                                      &m_PacingReclaimQueue, m_VsyncStats);
+    if (frame != nullptr) {
+        // Place the frame on the render queue
+        enqueueFrameForRendering(&m_PacingReclaimQueue, m_VsyncStats, frame);
+    }
 
-    m_FrameQueueLock.lock();
+    m_VsyncStats.publish();
+}
+
+// Called on the thread consuming the pacing queue, which is the V-sync
+// thread or the render thread with just-in-time rendering. Frames it drops
+// go to the given reclaim queue and stats. Returns nullptr if no frame
+// arrived by the deadline.
+AVFrame* Pacer::selectPacedFrame(uint64_t deadlineUs, SpscRing<AVFrame*>* reclaimQueue,
+                                 VideoStatsChannel& stats)
+{
+    // Frames we keep queued to absorb late frames. This is one frame
+    // unless the jitter buffer finds that too few.
+    int queueDepth = SDL_AtomicGet(&m_JitterBufferDepth);
 
     // If the queue length history entries are large, be strict
     // about dropping excess frames.
-    int frameDropTarget = 1;
+    int frameDropTarget = queueDepth;
 
     // If we may get more frames per second than we can display, use
     // frame history to drop frames only if consistently above the
-    // one queued frame mark.
+    // queue depth.
     if (m_MaxVideoFps >= m_DisplayFps) {
         for (int queueHistoryEntry : m_PacingQueueHistory) {
-            if (queueHistoryEntry <= 1) {
+            if (queueHistoryEntry <= queueDepth) {
                 // Be lenient as long as the queue length
                 // resolves before the end of frame history
-                frameDropTarget = 3;
+                frameDropTarget = queueDepth + PACING_QUEUE_BURST_FRAMES;
                 break;
             }
         }
@@ -189,57 +343,182 @@ void Pacer::vsyncCallback(int timeUntilNextVsyncMillis)
             m_PacingQueueHistory.dequeue();
         }
 
-        m_PacingQueueHistory.enqueue(m_PacingQueue.count());
+        m_PacingQueueHistory.enqueue(m_PacingQueue.size());
     }
 
     // Catch up if we're several frames ahead
-    while (m_PacingQueue.count() > frameDropTarget) {
-        AVFrame* frame = m_PacingQueue.dequeue();
-
-        // Drop the lock while we call av_frame_free()
-        m_FrameQueueLock.unlock();
-        m_VideoStats->pacerDroppedFrames++;
-        av_frame_free(&frame);
-        m_FrameQueueLock.lock();
+    AVFrame* frame;
+    while (m_PacingQueue.size() > frameDropTarget && (frame = popFrame(m_PacingQueue)) != nullptr) {
+        dropFrame(reclaimQueue, stats, frame);
     }
 
-    if (m_PacingQueue.isEmpty()) {
-        // Wait for a frame to arrive or our V-sync timeout to expire
-        if (!m_PacingQueueNotEmpty.wait(&m_FrameQueueLock, timeUntilNextVsyncMillis - TIMER_SLACK_MS)) {
-            // Wait timed out - unlock and bail
-            m_FrameQueueLock.unlock();
-            return;
+    // Wait for a frame to arrive or our deadline to pass
+    while ((frame = popFrame(m_PacingQueue)) == nullptr) {
+        uint64_t now = StreamUtils::getMicroseconds();
+        Uint32 timeoutMs = now < deadlineUs ? (Uint32)((deadlineUs - now) / 1000) : 0;
+        if (timeoutMs == 0 || SDL_SemWaitTimeout(m_PacingQueueNotEmpty, timeoutMs) != 0) {
+            // Wait timed out - bail
+            return nullptr;
         }
     }
 
-    // Place the first frame on the render queue
-    enqueueFrameForRenderingAndUnlock(m_PacingQueue.dequeue());
+    return frame;
+}
+
+// Called on the render thread with just-in-time rendering, for each V-sync
+void Pacer::renderJustInTime(uint64_t nextVsyncUs, uint32_t periodUs)
+{
+    TraceScope trace("Pacer::renderJustInTime", -1);
+
+    uint64_t vsyncUs = StreamUtils::getMicroseconds();
+    uint32_t renderCostUs = m_RenderCost.getEstimateUs();
+
+    m_RenderStats.get()->renderBudgetUs = renderCostUs;
+
+    // Where we'd stop waiting for a frame with a fixed slack
+    uint64_t fixedDeadlineUs = nextVsyncUs - TIMER_SLACK_MS * 1000;
+
+    // Hold off picking a frame until the last moment we can still
+    // render it in time, so newer frames can make this V-sync
+    uint64_t deadlineUs;
+    if (vsyncUs + renderCostUs + JIT_WAKEUP_MARGIN_US < nextVsyncUs) {
+        deadlineUs = nextVsyncUs - renderCostUs - JIT_WAKEUP_MARGIN_US;
+    }
+    else {
+        deadlineUs = vsyncUs;
+    }
+
+    // SDL_Delay() may return late, but the wake-up margin covers that
+    if (deadlineUs > vsyncUs + 1000) {
+        SDL_Delay((Uint32)((deadlineUs - vsyncUs) / 1000));
+    }
+
+    uint64_t lastDeadlineUs = m_LastDeadlineUs;
+    uint64_t lastFixedDeadlineUs = m_LastFixedDeadlineUs;
+    m_LastDeadlineUs = deadlineUs;
+    m_LastFixedDeadlineUs = fixedDeadlineUs;
+
+    AVFrame* frame = selectPacedFrame(deadlineUs, &m_RenderReclaimQueue, m_RenderStats);
+    if (frame == nullptr) {
+        m_RenderStats.publish();
+        return;
+    }
+
+    // Count frames that make a different V-sync than they would have
+    // with a fixed slack. The frame may have been pending since before
+    // the last deadline if that was earlier than the fixed one.
+    uint64_t frameReadyUs = (uint64_t)frame->pkt_dts;
+    if (frameReadyUs > fixedDeadlineUs) {
+        m_RenderStats.get()->jitEarlierFrames++;
+        m_RenderStats.get()->jitSavedUs += periodUs;
+    }
+    else if (frameReadyUs > lastDeadlineUs && frameReadyUs <= lastFixedDeadlineUs) {
+        m_RenderStats.get()->jitLaterFrames++;
+        m_RenderStats.get()->jitSavedUs -= periodUs;
+    }
+
+    m_TargetVsyncUs = nextVsyncUs;
+    m_TargetPeriodUs = periodUs;
+    renderFrame(frame);
 }
 
-bool Pacer::initialize(SDL_Window* window, int maxVideoFps, bool enablePacing)
+bool Pacer::initialize(SDL_Window* window, int maxVideoFps, bool enablePacing,
+                       StreamingPreferences::PacingBuffer pacingBuffer)
 {
     m_MaxVideoFps = maxVideoFps;
-    m_DisplayFps = StreamUtils::getDisplayRefreshRate(window);
+
+    // The null renderer may run without a window when benchmarking
+    if (window != nullptr) {
+        m_DisplayFps = StreamUtils::getDisplayRefreshRate(window);
+    }
+    else {
+        m_DisplayFps = maxVideoFps;
+    }
 
     if (enablePacing) {
         SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
                     "Frame pacing active: target %d Hz with %d FPS stream",
                     m_DisplayFps, m_MaxVideoFps);
 
+        bool vsyncSourceInitialized = false;
+
+        // This must be set before the V-sync source starts calling us.
+        // Just-in-time rendering needs a render thread to wait on.
+        m_JitEnabled = m_VsyncRenderer->isRenderThreadSupported() &&
+                qgetenv("PACER_JIT") == "1";
+
     #if defined(Q_OS_WIN32)
         // Don't use D3DKMTWaitForVerticalBlankEvent() on Windows 7, because
         // it blocks during other concurrent DX operations (like actually rendering).
-        if (IsWindows8OrGreater()) {
+        if (window != nullptr && IsWindows8OrGreater()) {
             m_VsyncSource = new DxVsyncSource(this);
         }
+    #elif defined(Q_OS_LINUX)
+        if (window != nullptr) {
+            // Renderers that know when frames reach the display, like from
+            // DRM page-flip events, drive the predictor with the exact time
+            if (m_VsyncRenderer->isPresentTimeReported()) {
+                m_VsyncSource = new TimerVsyncSource(this);
+                m_PresentTimeReported = true;
+            }
+
+        #ifdef HAVE_DRM
+            // The DRM device may not be accessible in a desktop session
+            if (m_VsyncSource == nullptr) {
+                m_VsyncSource = new DrmVsyncSource(this);
+                vsyncSourceInitialized = m_VsyncSource->initialize(window, m_DisplayFps);
+                if (!vsyncSourceInitialized) {
+                    delete m_VsyncSource;
+                    m_VsyncSource = nullptr;
+                }
+            }
+        #endif
+
+            // Otherwise predict V-sync from when frames are presented,
+            // which only lines up with V-sync if presenting waits for it
+            if (m_VsyncSource == nullptr) {
+                if (m_VsyncRenderer->isPresentVsyncBlocked()) {
+                    m_VsyncSource = new TimerVsyncSource(this);
+                }
+                else {
+                    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                                "No V-sync source, so frames will be rendered as they arrive");
+                }
+            }
+        }
     #else
         // Platforms without a VsyncSource will just render frames
         // immediately like they used to.
     #endif
 
-        if (m_VsyncSource != nullptr && !m_VsyncSource->initialize(window, m_DisplayFps)) {
+        if (m_VsyncSource != nullptr && !vsyncSourceInitialized &&
+                !m_VsyncSource->initialize(window, m_DisplayFps)) {
             return false;
         }
+
+        if (m_PresentTimeReported) {
+            m_VsyncRenderer->setVsyncSource(m_VsyncSource);
+        }
+
+        // Without a V-sync source, there's no V-sync to render just in time for
+        if (m_VsyncSource == nullptr) {
+            m_JitEnabled = false;
+        }
+        if (m_JitEnabled) {
+            SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                        "Just-in-time frame rendering enabled");
+        }
+
+        // Without a V-sync source, frames aren't queued for pacing
+        if (m_VsyncSource != nullptr && pacingBuffer != StreamingPreferences::PB_FIXED) {
+            m_JitterBuffer = new JitterBuffer(m_MaxVideoFps,
+                                              pacingBuffer == StreamingPreferences::PB_SMOOTHEST ?
+                                                  SMOOTHEST_DROP_RATE : LOWEST_LATENCY_DROP_RATE);
+            SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                        "Adaptive pacing queue depth enabled (%s)",
+                        pacingBuffer == StreamingPreferences::PB_SMOOTHEST ?
+                            "smoothest" : "lowest latency");
+        }
     }
     else {
         SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
@@ -256,21 +535,44 @@ bool Pacer::initialize(SDL_Window* window, int maxVideoFps, bool enablePacing)
 
 void Pacer::renderFrame(AVFrame* frame)
 {
+    int frameNumber = (int)(intptr_t)frame->opaque;
+    TraceScope trace("Pacer::renderFrame", frameNumber);
+
     // Count time spent in Pacer's queues
-    Uint32 beforeRender = SDL_GetTicks();
-    m_VideoStats->totalPacerTime += beforeRender - frame->pkt_dts;
+    uint64_t beforeRender = StreamUtils::getMicroseconds();
+    m_RenderStats.get()->pacerTime.add((uint32_t)(beforeRender - frame->pkt_dts));
+    if (m_FrameGraph != nullptr) {
+        m_FrameGraph->addStageTime(frameNumber, FrameGraph::StageQueue, (uint32_t)(beforeRender - frame->pkt_dts));
+    }
 
     // Render it
+    Tracer::begin("IFFmpegRenderer::renderFrame", frameNumber);
     m_VsyncRenderer->renderFrame(frame);
-    Uint32 afterRender = SDL_GetTicks();
+    Tracer::end("IFFmpegRenderer::renderFrame", frameNumber);
+    uint64_t afterRender = StreamUtils::getMicroseconds();
 
-    m_VideoStats->totalRenderTime += afterRender - beforeRender;
-    m_VideoStats->renderedFrames++;
-    av_frame_free(&frame);
+    m_RenderStats.get()->renderTime.add((uint32_t)(afterRender - beforeRender));
+    if (m_FrameGraph != nullptr) {
+        m_FrameGraph->addStageTime(frameNumber, FrameGraph::StageRender, (uint32_t)(afterRender - beforeRender));
+    }
+    m_RenderStats.get()->renderedFrames++;
 
-    // Drop frames if we have too many queued up for a while
-    m_FrameQueueLock.lock();
+    if (m_VsyncSource != nullptr && !m_PresentTimeReported) {
+        m_VsyncSource->framePresented(afterRender);
+    }
 
+    // Only frames rendered just in time have a V-sync to make
+    if (m_TargetVsyncUs != 0) {
+        if (!m_RenderCost.addRender(beforeRender, afterRender, m_TargetVsyncUs, m_TargetPeriodUs)) {
+            m_RenderStats.get()->jitMissedVsyncs++;
+        }
+
+        m_TargetVsyncUs = 0;
+    }
+
+    reclaimFrame(m_RenderReclaimQueue, frame);
+
+    // Drop frames if we have too many queued up for a while
     int frameDropTarget = 0;
     for (int queueHistoryEntry : m_RenderQueueHistory) {
         if (queueHistoryEntry == 0) {
@@ -286,29 +588,15 @@ void Pacer::renderFrame(AVFrame* frame)
         m_RenderQueueHistory.dequeue();
     }
 
-    m_RenderQueueHistory.enqueue(m_RenderQueue.count());
+    m_RenderQueueHistory.enqueue(m_RenderQueue.size());
 
     // Catch up if we're several frames ahead
-    while (m_RenderQueue.count() > frameDropTarget) {
-        AVFrame* frame = m_RenderQueue.dequeue();
-
-        // Drop the lock while we call av_frame_free()
-        m_FrameQueueLock.unlock();
-        m_VideoStats->pacerDroppedFrames++;
-        av_frame_free(&frame);
-        m_FrameQueueLock.lock();
+    AVFrame* droppedFrame;
+    while (m_RenderQueue.size() > frameDropTarget && (droppedFrame = popFrame(m_RenderQueue)) != nullptr) {
+        dropFrame(&m_RenderReclaimQueue, m_RenderStats, droppedFrame);
     }
 
-    m_FrameQueueLock.unlock();
-}
-
-void Pacer::dropFrameForEnqueue(QQueue<AVFrame*>& queue)
-{
-    SDL_assert(queue.size() <= MAX_QUEUED_FRAMES);
-    if (queue.size() == MAX_QUEUED_FRAMES) {
-        AVFrame* frame = queue.dequeue();
-        av_frame_free(&frame);
-    }
+    m_RenderStats.publish();
 }
 
 void Pacer::submitFrame(AVFrame* frame)
@@ -316,15 +604,27 @@ void Pacer::submitFrame(AVFrame* frame)
     // Make sure initialize() has been called
     SDL_assert(m_MaxVideoFps != 0);
 
-    // Queue the frame and possibly wake up the render thread
-    m_FrameQueueLock.lock();
+    // Queue the frame and possibly wake up the render thread. If the
+    // queue is full, the oldest frame is dropped to make room.
     if (m_VsyncSource != nullptr) {
-        dropFrameForEnqueue(m_PacingQueue);
-        m_PacingQueue.enqueue(frame);
-        m_FrameQueueLock.unlock();
-        m_PacingQueueNotEmpty.wakeOne();
+        if (m_JitterBuffer != nullptr) {
+            m_JitterBuffer->addArrival(frame->pkt_dts);
+            SDL_AtomicSet(&m_JitterBufferDepth, m_JitterBuffer->getDepth());
+            m_SubmitStats.get()->jitterBufferDepth = m_JitterBuffer->getDepth();
+            m_SubmitStats.get()->arrivalJitterUs = m_JitterBuffer->getJitterUs();
+        }
+
+        pushNewestFrame(m_PacingQueue, nullptr, m_SubmitStats, frame);
+        SDL_SemPost(m_PacingQueueNotEmpty);
     }
     else {
-        enqueueFrameForRenderingAndUnlock(frame);
+        enqueueFrameForRendering(nullptr, m_SubmitStats, frame);
     }
+
+    // Now that the frame is on its way, free what the
+    // other threads are done with
+    freeQueuedFrames(m_RenderReclaimQueue);
+    freeQueuedFrames(m_PacingReclaimQueue);
+
+    m_SubmitStats.publish();
 }
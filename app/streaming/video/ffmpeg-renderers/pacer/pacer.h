@@ -2,56 +2,128 @@
 
 #include "../../decoder.h"
 #include "../renderer.h"
+#include "../../spscring.h"
+#include "../../videostatschannel.h"
+#include "rendercostmodel.h"
+#include "jitterbuffer.h"
 
 #include <QQueue>
-#include <QMutex>
-#include <QWaitCondition>
 
 class IVsyncSource {
 public:
     virtual ~IVsyncSource() {}
     virtual bool initialize(SDL_Window* window, int displayFps) = 0;
+
+    // Called on the render thread after each frame is presented.
+    // With V-sync on, this is shortly after a V-blank.
+    virtual void framePresented(uint64_t) {}
 };
 
+// Frames move between threads through lock-free rings, which assume
+// a single producer and a single consumer at a time. submitFrame()
+// must only be called from one thread at a time, and frames the other
+// threads are done with are freed on that thread too, so the V-sync
+// and render threads never wait on av_frame_free().
 class Pacer
 {
 public:
-    Pacer(IFFmpegRenderer* renderer, PVIDEO_STATS videoStats);
+    Pacer(IFFmpegRenderer* renderer, FrameGraph* frameGraph);
 
     ~Pacer();
 
     void submitFrame(AVFrame* frame);
 
-    bool initialize(SDL_Window* window, int maxVideoFps, bool enablePacing);
+    bool initialize(SDL_Window* window, int maxVideoFps, bool enablePacing,
+                    StreamingPreferences::PacingBuffer pacingBuffer);
 
-    void vsyncCallback(int timeUntilNextVsyncMillis);
+    // Called by the IVsyncSource at V-sync with the time of the next
+    // V-sync and the V-sync period, both on StreamUtils' clock
+    void vsyncCallback(uint64_t nextVsyncUs, uint32_t periodUs);
 
     void renderOnMainThread();
 
+    // Adds stats from the threads Pacer runs on to dst. Must be
+    // called on the thread that owns dst.
+    void collectVideoStats(VIDEO_STATS& dst);
+
 private:
     static int renderThread(void* context);
 
-    void enqueueFrameForRenderingAndUnlock(AVFrame* frame);
+    static bool pushFrame(SpscRing<AVFrame*>& queue, AVFrame* frame);
+
+    void pushNewestFrame(SpscRing<AVFrame*>& queue, SpscRing<AVFrame*>* reclaimQueue,
+                         VideoStatsChannel& stats, AVFrame* frame);
+
+    static AVFrame* popFrame(SpscRing<AVFrame*>& queue);
+
+    static void reclaimFrame(SpscRing<AVFrame*>& reclaimQueue, AVFrame* frame);
+
+    static void freeQueuedFrames(SpscRing<AVFrame*>& queue);
+
+    void dropFrame(SpscRing<AVFrame*>* reclaimQueue, VideoStatsChannel& stats, AVFrame* frame);
+
+    void enqueueFrameForRendering(SpscRing<AVFrame*>* reclaimQueue,
+                                  VideoStatsChannel& stats, AVFrame* frame);
+
+    AVFrame* selectPacedFrame(uint64_t deadlineUs, SpscRing<AVFrame*>* reclaimQueue,
+                              VideoStatsChannel& stats);
 
-    void renderLastFrameAndUnlock();
+    void renderJustInTime(uint64_t nextVsyncUs, uint32_t periodUs);
+
+    void renderLastFrame();
 
     void renderFrame(AVFrame* frame);
 
-    void dropFrameForEnqueue(QQueue<AVFrame*>& queue);
+    SpscRing<AVFrame*> m_RenderQueue;
+    SpscRing<AVFrame*> m_PacingQueue;
 
-    QQueue<AVFrame*> m_RenderQueue;
-    QQueue<AVFrame*> m_PacingQueue;
-    QQueue<int> m_PacingQueueHistory;
+    // Frames the render and V-sync threads are done with,
+    // waiting to be freed by the thread calling submitFrame()
+    SpscRing<AVFrame*> m_RenderReclaimQueue;
+    SpscRing<AVFrame*> m_PacingReclaimQueue;
+
+    // Only touched by the render thread and the thread consuming
+    // the pacing queue respectively
     QQueue<int> m_RenderQueueHistory;
-    QMutex m_FrameQueueLock;
-    QWaitCondition m_RenderQueueNotEmpty;
-    QWaitCondition m_PacingQueueNotEmpty;
+    QQueue<int> m_PacingQueueHistory;
+
+    // Posted once per frame pushed, so they may be signalled
+    // while the queue is already empty again
+    SDL_sem* m_RenderQueueNotEmpty;
+    SDL_sem* m_PacingQueueNotEmpty;
+
     SDL_Thread* m_RenderThread;
-    bool m_Stopping;
+    SDL_atomic_t m_Stopping;
+
+    // Just-in-time rendering, which PACER_JIT=1 enables. The V-sync
+    // thread hands the next V-sync to the render thread, which owns
+    // everything else.
+    bool m_JitEnabled;
+    SDL_SpinLock m_JitVsyncLock;
+    uint64_t m_JitVsyncUs;
+    uint32_t m_JitPeriodUs;
+    RenderCostModel m_RenderCost;
+    uint64_t m_TargetVsyncUs;
+    uint32_t m_TargetPeriodUs;
+    uint64_t m_LastDeadlineUs;
+    uint64_t m_LastFixedDeadlineUs;
+
+    // Adaptive pacing queue depth, measured on the thread calling
+    // submitFrame() and used on the V-sync thread
+    JitterBuffer* m_JitterBuffer;
+    SDL_atomic_t m_JitterBufferDepth;
 
     IVsyncSource* m_VsyncSource;
     IFFmpegRenderer* m_VsyncRenderer;
+    bool m_PresentTimeReported;
     int m_MaxVideoFps;
     int m_DisplayFps;
-    PVIDEO_STATS m_VideoStats;
+
+    // Stats from the render thread (including the renderer's own),
+    // the V-sync thread and the thread calling submitFrame()
+    VideoStatsChannel m_RenderStats;
+    VideoStatsChannel m_VsyncStats;
+    VideoStatsChannel m_SubmitStats;
+
+    FrameGraph* m_FrameGraph;
 };
@@ -0,0 +1,62 @@
+#include "rendercostmodel.h"
+
+#include <math.h>
+
+// Weight of each new render time in the moving averages
+#define RENDER_TIME_GAIN (1.0 / 16)
+
+// Budget this many average deviations over the average render time
+#define RENDER_TIME_DEVIATIONS 2
+
+// Each missed V-sync adds this much extra margin, up to the limit
+#define MISSED_VSYNC_PENALTY_US 1000
+#define MAX_PENALTY_US 8000
+
+// The extra margin shrinks by this fraction with each V-sync that is met
+#define PENALTY_DECAY (1.0 / 64)
+
+RenderCostModel::RenderCostModel(uint32_t initialCostUs, bool presentWaitsForVsync)
+    : m_PresentWaitsForVsync(presentWaitsForVsync),
+      m_MeanUs(initialCostUs),
+      m_DeviationUs(0),
+      m_PenaltyUs(0)
+{
+}
+
+bool RenderCostModel::addRender(uint64_t startUs, uint64_t endUs, uint64_t vsyncUs, uint32_t periodUs)
+{
+    bool missed;
+
+    if (m_PresentWaitsForVsync) {
+        // Presenting returns around the V-blank the frame made, which
+        // may be a little after the predicted one. A missed V-blank
+        // holds it up for another period.
+        missed = endUs > vsyncUs + periodUs / 2;
+    }
+    else {
+        addRenderTime((uint32_t)(endUs - startUs));
+        missed = endUs > vsyncUs;
+    }
+
+    if (missed) {
+        m_PenaltyUs = SDL_min(m_PenaltyUs + MISSED_VSYNC_PENALTY_US, MAX_PENALTY_US);
+    }
+    else {
+        m_PenaltyUs -= m_PenaltyUs * PENALTY_DECAY;
+    }
+
+    return !missed;
+}
+
+void RenderCostModel::addRenderTime(uint32_t renderTimeUs)
+{
+    double errorUs = renderTimeUs - m_MeanUs;
+
+    m_MeanUs += errorUs * RENDER_TIME_GAIN;
+    m_DeviationUs += (fabs(errorUs) - m_DeviationUs) * RENDER_TIME_GAIN;
+}
+
+uint32_t RenderCostModel::getEstimateUs() const
+{
+    return (uint32_t)(m_MeanUs + m_DeviationUs * RENDER_TIME_DEVIATIONS + m_PenaltyUs);
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <SDL.h>
+
+// Learns how long before V-sync a frame must start rendering to make
+// it, so Pacer can wait for newer frames until the last safe moment.
+//
+// Renderers that wait for V-sync when presenting take until the V-blank
+// no matter how cheap the frame was, so their render times say nothing
+// about the cost and only the renders of other renderers are measured.
+// Missed V-syncs raise the estimate for any renderer, and that extra
+// margin wears off while V-syncs are met.
+//
+// All times are passed in and the clock is never read here, so it can
+// be driven by a simulated clock and renderer.
+class RenderCostModel
+{
+public:
+    RenderCostModel(uint32_t initialCostUs, bool presentWaitsForVsync);
+
+    // Returns false if the render missed the V-sync it was meant for
+    bool addRender(uint64_t startUs, uint64_t endUs, uint64_t vsyncUs, uint32_t periodUs);
+
+    uint32_t getEstimateUs() const;
+
+private:
+    void addRenderTime(uint32_t renderTimeUs);
+
+    bool m_PresentWaitsForVsync;
+    double m_MeanUs;
+    double m_DeviationUs;
+    double m_PenaltyUs;
+};
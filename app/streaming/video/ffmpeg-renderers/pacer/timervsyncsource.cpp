@@ -0,0 +1,92 @@
+#include "timervsyncsource.h"
+#include "streaming/streamutils.h"
+#include "streaming/tracer.h"
+
+TimerVsyncSource::TimerVsyncSource(Pacer* pacer) :
+    m_Pacer(pacer),
+    m_Thread(nullptr),
+    m_Predictor(nullptr),
+    m_PredictorLock(0)
+{
+    SDL_AtomicSet(&m_Stopping, 0);
+}
+
+TimerVsyncSource::~TimerVsyncSource()
+{
+    if (m_Thread != nullptr) {
+        SDL_AtomicSet(&m_Stopping, 1);
+        SDL_WaitThread(m_Thread, nullptr);
+    }
+
+    delete m_Predictor;
+}
+
+bool TimerVsyncSource::initialize(SDL_Window*, int displayFps)
+{
+    m_DisplayFps = displayFps;
+    m_Predictor = new VsyncPredictor(displayFps);
+
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                "Predicting V-sync from frame presentation times");
+
+    m_Thread = SDL_CreateThread(vsyncThread, "TimerVsync", this);
+    if (m_Thread == nullptr) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "Unable to create timer V-sync thread: %s",
+                     SDL_GetError());
+        return false;
+    }
+
+    return true;
+}
+
+void TimerVsyncSource::framePresented(uint64_t presentTimeUs)
+{
+    SDL_AtomicLock(&m_PredictorLock);
+    m_Predictor->addTimestamp(presentTimeUs);
+    SDL_AtomicUnlock(&m_PredictorLock);
+}
+
+int TimerVsyncSource::vsyncThread(void* context)
+{
+    TimerVsyncSource* me = reinterpret_cast<TimerVsyncSource*>(context);
+
+    Tracer::setThreadName("TimerVsync");
+
+#if SDL_VERSION_ATLEAST(2, 0, 9)
+    SDL_SetThreadPriority(SDL_THREAD_PRIORITY_TIME_CRITICAL);
+#else
+    SDL_SetThreadPriority(SDL_THREAD_PRIORITY_HIGH);
+#endif
+
+    uint64_t lastVsyncUs = 0;
+    bool wasLocked = false;
+
+    while (SDL_AtomicGet(&me->m_Stopping) == 0) {
+        uint64_t now = StreamUtils::getMicroseconds();
+
+        SDL_AtomicLock(&me->m_PredictorLock);
+        double periodUs = me->m_Predictor->getPeriodUs();
+
+        // Don't fire twice for the same V-sync if we woke up early
+        uint64_t nextVsyncUs = me->m_Predictor->getNextVsync(SDL_max(now, lastVsyncUs + (uint64_t)(periodUs / 2)));
+        bool locked = me->m_Predictor->isLocked();
+        SDL_AtomicUnlock(&me->m_PredictorLock);
+
+        if (locked && !wasLocked) {
+            SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                        "Predicted V-sync locked at %.3f Hz",
+                        1000000.0 / periodUs);
+        }
+        wasLocked = locked;
+
+        if (nextVsyncUs > now) {
+            SDL_Delay((Uint32)((nextVsyncUs - now) / 1000));
+        }
+        lastVsyncUs = nextVsyncUs;
+
+        me->m_Pacer->vsyncCallback(nextVsyncUs + (uint64_t)periodUs, (uint32_t)periodUs);
+    }
+
+    return 0;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "pacer.h"
+#include "vsyncpredictor.h"
+
+// Calls Pacer on a timer that is kept in step with V-sync by
+// learning when frames are presented. Used when the platform has
+// no way to wait for V-sync directly, but the renderer either waits
+// for V-sync when presenting or reports when frames are displayed.
+// Otherwise the timer would only learn its own wake-ups.
+class TimerVsyncSource : public IVsyncSource
+{
+public:
+    TimerVsyncSource(Pacer* pacer);
+
+    virtual ~TimerVsyncSource();
+
+    virtual bool initialize(SDL_Window* window, int displayFps);
+
+    virtual void framePresented(uint64_t presentTimeUs);
+
+private:
+    static int vsyncThread(void* context);
+
+    Pacer* m_Pacer;
+    SDL_Thread* m_Thread;
+    SDL_atomic_t m_Stopping;
+    int m_DisplayFps;
+
+    // Fed on the render thread and read on ours
+    VsyncPredictor* m_Predictor;
+    SDL_SpinLock m_PredictorLock;
+};
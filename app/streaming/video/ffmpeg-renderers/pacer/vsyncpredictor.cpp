@@ -0,0 +1,113 @@
+#include "vsyncpredictor.h"
+
+#include <algorithm>
+
+#include <math.h>
+#include <string.h>
+
+// How much of each timestamp's error is corrected in the phase
+// and in the period. Larger values track faster but follow jitter.
+#define PHASE_GAIN 0.1
+#define PERIOD_GAIN 0.01
+
+// Timestamps can only be late, never early, so the V-blank is closer
+// to the earliest ones than to the average the phase tracks. This low
+// percentile of recent errors is used, which ignores a few stray ones.
+#define VSYNC_ERROR_PERCENTILE 10
+
+// Timestamps further than this from the prediction are ignored, since
+// a frame that was presented late says nothing about the V-blank
+#define MAX_ERROR_FRACTION 0.25
+
+// If this many timestamps in a row are ignored, the phase must have
+// moved (like after a mode change), so start over from the latest one
+#define MAX_REJECTED_SAMPLES 8
+
+#define LOCKED_SAMPLES 16
+
+// The display's real rate may be slightly off its advertised rate
+#define MAX_PERIOD_DEVIATION 0.05
+
+VsyncPredictor::VsyncPredictor(int displayFps)
+    : m_NominalPeriodUs(1000000.0 / displayFps),
+      m_PeriodUs(m_NominalPeriodUs),
+      m_AnchorUs(0),
+      m_VsyncOffsetUs(0),
+      m_ErrorCount(0),
+      m_NextError(0),
+      m_HasAnchor(false),
+      m_MatchedSamples(0),
+      m_RejectedSamples(0)
+{
+    SDL_assert(displayFps > 0);
+}
+
+void VsyncPredictor::addTimestamp(uint64_t timeUs)
+{
+    if (!m_HasAnchor || m_RejectedSamples >= MAX_REJECTED_SAMPLES) {
+        m_AnchorUs = (double)timeUs;
+        m_VsyncOffsetUs = 0;
+        m_ErrorCount = 0;
+        m_NextError = 0;
+        m_HasAnchor = true;
+        m_MatchedSamples = 0;
+        m_RejectedSamples = 0;
+        return;
+    }
+
+    double elapsedUs = (double)timeUs - m_AnchorUs;
+    double periods = floor(elapsedUs / m_PeriodUs + 0.5);
+    if (periods < 1) {
+        // Already accounted for by the anchor
+        return;
+    }
+
+    double errorUs = elapsedUs - periods * m_PeriodUs;
+    if (fabs(errorUs) > m_PeriodUs * MAX_ERROR_FRACTION) {
+        m_RejectedSamples++;
+        return;
+    }
+
+    m_RejectedSamples = 0;
+    if (m_MatchedSamples < LOCKED_SAMPLES) {
+        m_MatchedSamples++;
+    }
+
+    // The error built up over all the periods since the anchor
+    m_PeriodUs += errorUs / periods * PERIOD_GAIN;
+    m_PeriodUs = SDL_max(m_PeriodUs, m_NominalPeriodUs * (1 - MAX_PERIOD_DEVIATION));
+    m_PeriodUs = SDL_min(m_PeriodUs, m_NominalPeriodUs * (1 + MAX_PERIOD_DEVIATION));
+
+    m_AnchorUs += periods * m_PeriodUs + errorUs * PHASE_GAIN;
+
+    m_Errors[m_NextError] = errorUs;
+    m_NextError = (m_NextError + 1) % VSYNC_PREDICTOR_ERRORS;
+    m_ErrorCount = SDL_min(m_ErrorCount + 1, VSYNC_PREDICTOR_ERRORS);
+
+    double sortedErrors[VSYNC_PREDICTOR_ERRORS];
+    memcpy(sortedErrors, m_Errors, m_ErrorCount * sizeof(double));
+    std::sort(sortedErrors, sortedErrors + m_ErrorCount);
+    m_VsyncOffsetUs = sortedErrors[m_ErrorCount * VSYNC_ERROR_PERCENTILE / 100];
+}
+
+uint64_t VsyncPredictor::getNextVsync(uint64_t timeUs) const
+{
+    if (!m_HasAnchor) {
+        // Any phase is as good as another until we have a timestamp
+        return timeUs + (uint64_t)m_PeriodUs;
+    }
+
+    double vsyncUs = m_AnchorUs + m_VsyncOffsetUs;
+    double periods = floor(((double)timeUs - vsyncUs) / m_PeriodUs) + 1;
+    return (uint64_t)(vsyncUs + periods * m_PeriodUs);
+}
+
+double VsyncPredictor::getPeriodUs() const
+{
+    return m_PeriodUs;
+}
+
+bool VsyncPredictor::isLocked() const
+{
+    return m_MatchedSamples >= LOCKED_SAMPLES;
+}
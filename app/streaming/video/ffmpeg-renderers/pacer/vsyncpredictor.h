@@ -0,0 +1,49 @@
+#pragma once
+
+#include <SDL.h>
+
+#define VSYNC_PREDICTOR_ERRORS 32
+
+// Estimates the display's V-sync period and phase from timestamps that
+// land shortly after a V-blank, like the time a frame finished
+// presenting with V-sync enabled. Missed V-blanks are fine, since each
+// timestamp is matched to the closest predicted V-sync.
+//
+// All times are passed in and the clock is never read here, so it can
+// be driven by a virtual clock to measure its accuracy.
+class VsyncPredictor
+{
+public:
+    explicit VsyncPredictor(int displayFps);
+
+    void addTimestamp(uint64_t timeUs);
+
+    // Returns the first predicted V-sync after timeUs
+    uint64_t getNextVsync(uint64_t timeUs) const;
+
+    double getPeriodUs() const;
+
+    // True once enough timestamps have agreed with the prediction
+    bool isLocked() const;
+
+private:
+    double m_NominalPeriodUs;
+    double m_PeriodUs;
+
+    // Average time of a recent timestamp, which the period is
+    // measured from
+    double m_AnchorUs;
+
+    // From the average timestamp to the V-blank, usually negative
+    double m_VsyncOffsetUs;
+
+    // Recent differences between the timestamps and the average
+    double m_Errors[VSYNC_PREDICTOR_ERRORS];
+    int m_ErrorCount;
+    int m_NextError;
+
+    bool m_HasAnchor;
+
+    int m_MatchedSamples;
+    int m_RejectedSamples;
+};
@@ -9,9 +9,22 @@ extern "C" {
 #include <libavcodec/avcodec.h>
 }
 
+#ifdef HAVE_EGL
+// Keep Xlib's macros out of everything that includes this
+#define MESA_EGL_NO_X11_HEADERS
+#define EGL_NO_X11
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+// Most planes a frame can be exported as
+#define EGL_MAX_PLANES 4
+#endif
+
 #define RENDERER_ATTRIBUTE_FULLSCREEN_ONLY 0x01
 #define RENDERER_ATTRIBUTE_1080P_MAX 0x02
 
+class IVsyncSource;
+
 class IFFmpegRenderer : public Overlay::IOverlayRenderer {
 public:
     virtual bool initialize(PDECODER_PARAMETERS params) = 0;
@@ -59,11 +72,107 @@ public:
         }
     }
 
+    // Called on the main thread after the window is resized. Renderers
+    // that return true must pick up the new size on their next
+    // renderFrame() call. If that fails, they can push an
+    // SDL_RENDER_TARGETS_RESET event to recreate the decoder.
+    virtual bool notifyWindowChanged() {
+        // Recreate the renderer by default
+        return false;
+    }
+
     virtual bool isPixelFormatSupported(int videoFormat, enum AVPixelFormat pixelFormat) {
         // By default, we only support the preferred pixel format
         return getPreferredPixelFormat(videoFormat) == pixelFormat;
     }
 
+    // Called on the decode thread to let the renderer supply the memory
+    // a software decoder writes into. Returning false falls back to the
+    // decoder's own frame pool.
+    virtual bool getFrameBuffer(AVCodecContext*, AVFrame*) {
+        // Use the frame pool by default
+        return false;
+    }
+
+    // Frontend renderers that return true are given hardware frames
+    // that have already been read back into system memory, if the
+    // decoder can do it ahead of rendering.
+    virtual bool needsHwFrameReadback() {
+        // Hardware frames are rendered as-is by default
+        return false;
+    }
+
+    // Called on the read-back thread to let the backend renderer supply
+    // the memory hardware frames are read back into. Returning nullptr
+    // uses ordinary heap memory.
+    virtual AVBufferRef* allocateReadbackBuffer(int) {
+        // Use the heap by default
+        return nullptr;
+    }
+
+    // Called on the read-back thread to copy a hardware frame into
+    // swFrame, which already has its buffers. Returning false uses
+    // av_hwframe_transfer_data() instead.
+    virtual bool transferHwFrame(AVFrame*, AVFrame*) {
+        // Let FFmpeg do it by default
+        return false;
+    }
+
+    // Renderers that present asynchronously and find out when each
+    // frame reaches the display return true. They report that time to
+    // the V-sync source given to setVsyncSource() instead of Pacer.
+    virtual bool isPresentTimeReported() {
+        // Pacer reports when renderFrame() returns by default
+        return false;
+    }
+
+    // Renderers that return true wait for V-sync when presenting, so
+    // when renderFrame() returns tracks when V-sync happens
+    virtual bool isPresentVsyncBlocked() {
+        return false;
+    }
+
+    // Called before the first frame is rendered, and with nullptr
+    // before the V-sync source is destroyed
+    virtual void setVsyncSource(IVsyncSource*) {
+        // Nothing
+    }
+
+    // Stats the renderer may update while rendering a frame
+    virtual void setVideoStats(PVIDEO_STATS) {
+        // Nothing
+    }
+
+#ifdef HAVE_EGL
+    // Backend renderers that return true can hand their frames to an
+    // OpenGL frontend as EGLImages, which avoids reading them back.
+    virtual bool canExportEGL() {
+        return false;
+    }
+
+    // Called once the frontend has an EGL display. Returns false if
+    // frames can't be exported to it.
+    virtual bool initializeEGL(EGLDisplay) {
+        return false;
+    }
+
+    // Returns the number of images created, one for each plane of the
+    // frame, or -1 on failure. They must be freed with freeEGLImages().
+    virtual ssize_t exportEGLImages(AVFrame*, EGLDisplay, EGLImage[EGL_MAX_PLANES]) {
+        return -1;
+    }
+
+    virtual void freeEGLImages(EGLDisplay, EGLImage[EGL_MAX_PLANES], ssize_t) {
+        // Nothing
+    }
+#endif
+
+    // Called on the render thread before it exits, so renderers can
+    // release state that is bound to that thread
+    virtual void cleanupRenderContext() {
+        // Nothing
+    }
+
     // IOverlayRenderer
     virtual void notifyOverlayUpdated(Overlay::OverlayType) override {
         // Nothing
@@ -2,18 +2,37 @@
 
 #include "streaming/session.h"
 #include "streaming/streamutils.h"
+#include "streaming/video/planecopy.h"
 #include "path.h"
 
 #include <QDir>
 
 #include <Limelight.h>
 
+extern "C" {
+#include <libavutil/imgutils.h>
+}
+
 SdlRenderer::SdlRenderer()
     : m_Renderer(nullptr),
       m_Texture(nullptr),
       m_SwPixelFormat(AV_PIX_FMT_NONE),
-      m_FontData(Path::readDataFile("ModeSeven.ttf"))
+      m_VideoWidth(0),
+      m_VideoHeight(0),
+      m_FontData(Path::readDataFile("ModeSeven.ttf")),
+      m_VideoStats(nullptr),
+      m_DirectTextureHeight(0),
+      m_DirectFrameWidth(0),
+      m_DirectFrameHeight(0),
+      m_DirectTexturesEnabled(qgetenv("DIRECT_TEXTURE") != "0"),
+      m_ToneMapEnabled(qgetenv("HDR_TONEMAP") == "1")
 {
+    SDL_AtomicSet(&m_WindowChanged, 0);
+    SDL_AtomicSet(&m_DirectTexturesReady, 0);
+    SDL_zero(m_DirectTextures);
+    SDL_zero(m_OverlayAtlases);
+    SDL_zero(m_OverlayTextures);
+
     SDL_assert(TTF_WasInit() == 0);
     if (TTF_Init() != 0) {
         SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
@@ -21,20 +40,10 @@ SdlRenderer::SdlRenderer()
                     TTF_GetError());
         return;
     }
-
-    SDL_zero(m_OverlayFonts);
-    SDL_zero(m_OverlaySurfaces);
-    SDL_zero(m_OverlayTextures);
 }
 
 SdlRenderer::~SdlRenderer()
 {
-    for (int i = 0; i < Overlay::OverlayMax; i++) {
-        if (m_OverlayFonts[i] != nullptr) {
-            TTF_CloseFont(m_OverlayFonts[i]);
-        }
-    }
-
     TTF_Quit();
     SDL_assert(TTF_WasInit() == 0);
 
@@ -42,18 +51,16 @@ SdlRenderer::~SdlRenderer()
         if (m_OverlayTextures[i] != nullptr) {
             SDL_DestroyTexture(m_OverlayTextures[i]);
         }
-    }
 
-    for (int i = 0; i < Overlay::OverlayMax; i++) {
-        if (m_OverlaySurfaces[i] != nullptr) {
-            SDL_FreeSurface(m_OverlaySurfaces[i]);
-        }
+        delete m_OverlayAtlases[i];
     }
 
     if (m_Texture != nullptr) {
         SDL_DestroyTexture(m_Texture);
     }
 
+    destroyDirectTextures();
+
     if (m_Renderer != nullptr) {
         SDL_DestroyRenderer(m_Renderer);
     }
@@ -71,19 +78,25 @@ bool SdlRenderer::prepareDecoderContext(AVCodecContext*, AVDictionary**)
 
 void SdlRenderer::notifyOverlayUpdated(Overlay::OverlayType type)
 {
-    // Construct the required font to render the overlay
-    if (m_OverlayFonts[type] == nullptr) {
+    // The frame graph is redrawn with every frame
+    if (type == Overlay::OverlayFrameGraph) {
+        return;
+    }
+
+    GlyphAtlas* atlas = (GlyphAtlas*)SDL_AtomicGetPtr((void**)&m_OverlayAtlases[type]);
+
+    // Rasterize the glyphs of the overlay font once
+    if (atlas == nullptr) {
         if (m_FontData.isEmpty()) {
             SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
                          "SDL overlay font failed to load");
             return;
         }
 
-        // m_FontData must stay around until the font is closed
-        m_OverlayFonts[type] = TTF_OpenFontRW(SDL_RWFromConstMem(m_FontData.constData(), m_FontData.size()),
-                                              1,
-                                              Session::get()->getOverlayManager().getOverlayFontSize(type));
-        if (m_OverlayFonts[type] == nullptr) {
+        TTF_Font* font = TTF_OpenFontRW(SDL_RWFromConstMem(m_FontData.constData(), m_FontData.size()),
+                                        1,
+                                        Session::get()->getOverlayManager().getOverlayFontSize(type));
+        if (font == nullptr) {
             SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
                         "TTF_OpenFont() failed: %s",
                         TTF_GetError());
@@ -91,22 +104,28 @@ void SdlRenderer::notifyOverlayUpdated(Overlay::OverlayType type)
             // Can't proceed without a font
             return;
         }
-    }
 
-    SDL_Surface* oldSurface = (SDL_Surface*)SDL_AtomicGetPtr((void**)&m_OverlaySurfaces[type]);
+        atlas = new GlyphAtlas();
+        bool ok = atlas->initialize(font);
+        TTF_CloseFont(font);
 
-    // Free the old surface
-    if (oldSurface != nullptr && SDL_AtomicCASPtr((void**)&m_OverlaySurfaces[type], oldSurface, nullptr)) {
-        SDL_FreeSurface(oldSurface);
+        if (!ok) {
+            delete atlas;
+            return;
+        }
+
+        // Another thread may have beaten us to it
+        if (!SDL_AtomicCASPtr((void**)&m_OverlayAtlases[type], nullptr, atlas)) {
+            delete atlas;
+            atlas = (GlyphAtlas*)SDL_AtomicGetPtr((void**)&m_OverlayAtlases[type]);
+        }
     }
 
     if (Session::get()->getOverlayManager().isOverlayEnabled(type)) {
-        // The _Wrapped variant is required for line breaks to work
-        SDL_Surface* surface = TTF_RenderText_Blended_Wrapped(m_OverlayFonts[type],
-                                                              Session::get()->getOverlayManager().getOverlayText(type),
-                                                              Session::get()->getOverlayManager().getOverlayColor(type),
-                                                              1000);
-        SDL_AtomicSetPtr((void**)&m_OverlaySurfaces[type], surface);
+        m_OverlayLayouts[type].update(atlas, Session::get()->getOverlayManager().getOverlayText(type), 1000);
+    }
+    else {
+        m_OverlayLayouts[type].update(nullptr, nullptr, 0);
     }
 }
 
@@ -136,6 +155,9 @@ bool SdlRenderer::isPixelFormatSupported(int, AVPixelFormat pixelFormat)
     case AV_PIX_FMT_YUV420P:
     case AV_PIX_FMT_NV12:
     case AV_PIX_FMT_NV21:
+    // Converted to 8-bit when rendering
+    case AV_PIX_FMT_YUV420P10:
+    case AV_PIX_FMT_P010:
         return true;
 
     default:
@@ -149,7 +171,9 @@ bool SdlRenderer::initialize(PDECODER_PARAMETERS params)
 
     if (params->videoFormat == VIDEO_FORMAT_H265_MAIN10) {
         // SDL doesn't support rendering YUV 10-bit textures yet
-        return false;
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                    "Converting 10-bit frames to 8-bit for display%s",
+                    m_ToneMapEnabled ? " with HDR tone mapping" : "");
     }
 
     if ((SDL_GetWindowFlags(params->window) & SDL_WINDOW_FULLSCREEN_DESKTOP) == SDL_WINDOW_FULLSCREEN) {
@@ -177,18 +201,9 @@ bool SdlRenderer::initialize(PDECODER_PARAMETERS params)
         return false;
     }
 
-    // Calculate the video region size, scaling to fill the output size while
-    // preserving the aspect ratio of the video stream.
-    SDL_Rect src, dst;
-    src.x = src.y = 0;
-    src.w = params->width;
-    src.h = params->height;
-    dst.x = dst.y = 0;
-    SDL_GetRendererOutputSize(m_Renderer, &dst.w, &dst.h);
-    StreamUtils::scaleSourceToDestinationSurface(&src, &dst);
-
-    // Ensure the viewport is set to the desired video region
-    SDL_RenderSetViewport(m_Renderer, &dst);
+    m_VideoWidth = params->width;
+    m_VideoHeight = params->height;
+    updateViewport();
 
     // Draw a black frame until the video stream starts rendering
     SDL_SetRenderDrawColor(m_Renderer, 0, 0, 0, SDL_ALPHA_OPAQUE);
@@ -207,49 +222,399 @@ bool SdlRenderer::initialize(PDECODER_PARAMETERS params)
     return true;
 }
 
+void SdlRenderer::updateViewport()
+{
+    // Calculate the video region size, scaling to fill the output size while
+    // preserving the aspect ratio of the video stream.
+    SDL_Rect src, dst;
+    src.x = src.y = 0;
+    src.w = m_VideoWidth;
+    src.h = m_VideoHeight;
+    dst.x = dst.y = 0;
+    SDL_GetRendererOutputSize(m_Renderer, &dst.w, &dst.h);
+    StreamUtils::scaleSourceToDestinationSurface(&src, &dst);
+
+    // Ensure the viewport is set to the desired video region
+    SDL_RenderSetViewport(m_Renderer, &dst);
+}
+
+bool SdlRenderer::notifyWindowChanged()
+{
+    // SDL resizes the backbuffer itself, so renderFrame() just needs
+    // to recompute the viewport. Renderers that lose their state in
+    // the process will send SDL_RENDER_TARGETS_RESET.
+    SDL_AtomicSet(&m_WindowChanged, 1);
+    return true;
+}
+
+bool SdlRenderer::isPresentVsyncBlocked()
+{
+    SDL_RendererInfo info;
+
+    // SDL may not have been able to enable V-sync
+    return SDL_GetRendererInfo(m_Renderer, &info) == 0 &&
+            (info.flags & SDL_RENDERER_PRESENTVSYNC);
+}
+
+void SdlRenderer::setVideoStats(PVIDEO_STATS videoStats)
+{
+    m_VideoStats = videoStats;
+}
+
+bool SdlRenderer::needsHwFrameReadback()
+{
+    // SDL textures can only be updated from system memory
+    return true;
+}
+
+void SdlRenderer::createDirectTextures(AVFrame* frame)
+{
+    // Leave room for the padding the decoder adds to the frame
+    // and place the planes at the offsets SDL uses for YV12.
+    int textureWidth = FFALIGN(frame->width, 128);
+    int textureHeight = FFALIGN(frame->height, 64) + 64;
+
+    for (int i = 0; i < DIRECT_TEXTURE_COUNT; i++) {
+        PDIRECT_TEXTURE directTexture = &m_DirectTextures[i];
+
+        directTexture->texture = SDL_CreateTexture(m_Renderer,
+                                                   SDL_PIXELFORMAT_YV12,
+                                                   SDL_TEXTUREACCESS_STREAMING,
+                                                   textureWidth,
+                                                   textureHeight);
+        if (directTexture->texture == nullptr) {
+            SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                        "SDL_CreateTexture() failed: %s",
+                        SDL_GetError());
+            destroyDirectTextures();
+            return;
+        }
+
+        // Most SDL backends keep the pixels of locked YUV textures in system
+        // memory and upload them on unlock, so the texture stays locked while
+        // the decoder owns it. That isn't guaranteed, so make sure relocking
+        // hands back the same memory before the decoder ever sees it.
+        uint8_t* pixels;
+        int pitch;
+        if (SDL_LockTexture(directTexture->texture, nullptr,
+                            (void**)&directTexture->pixels,
+                            &directTexture->pitch) < 0) {
+            SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                        "SDL_LockTexture() failed: %s",
+                        SDL_GetError());
+            destroyDirectTextures();
+            return;
+        }
+
+        SDL_UnlockTexture(directTexture->texture);
+
+        if (SDL_LockTexture(directTexture->texture, nullptr, (void**)&pixels, &pitch) < 0 ||
+                pixels != directTexture->pixels || pitch != directTexture->pitch) {
+            SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                        "SDL doesn't keep locked texture memory in place. Falling back to copying frames.");
+            destroyDirectTextures();
+            return;
+        }
+    }
+
+    m_DirectTextureHeight = textureHeight;
+    m_DirectFrameWidth = frame->width;
+    m_DirectFrameHeight = frame->height;
+
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                "Created %d direct decode textures (%dx%d, pitch %d)",
+                DIRECT_TEXTURE_COUNT,
+                textureWidth,
+                textureHeight,
+                m_DirectTextures[0].pitch);
+
+    SDL_AtomicSet(&m_DirectTexturesReady, 1);
+}
+
+void SdlRenderer::destroyDirectTextures()
+{
+    SDL_AtomicSet(&m_DirectTexturesReady, 0);
+
+    for (int i = 0; i < DIRECT_TEXTURE_COUNT; i++) {
+        // The codec context must be freed before the renderer
+        SDL_assert(SDL_AtomicGet(&m_DirectTextures[i].inUse) == 0);
+
+        if (m_DirectTextures[i].texture != nullptr) {
+            SDL_DestroyTexture(m_DirectTextures[i].texture);
+            m_DirectTextures[i].texture = nullptr;
+        }
+
+        m_DirectTextures[i].pixels = nullptr;
+    }
+}
+
+void SdlRenderer::releaseDirectTexture(void* opaque, uint8_t*)
+{
+    auto directTexture = (PDIRECT_TEXTURE)opaque;
+
+    SDL_AtomicSet(&directTexture->inUse, 0);
+}
+
+// Called on the decoder thread, so this must not touch the SDL renderer
+bool SdlRenderer::getFrameBuffer(AVCodecContext* context, AVFrame* frame)
+{
+    if (!SDL_AtomicGet(&m_DirectTexturesReady) ||
+            frame->format != AV_PIX_FMT_YUV420P ||
+            frame->width != m_DirectFrameWidth ||
+            frame->height != m_DirectFrameHeight) {
+        return false;
+    }
+
+    PDIRECT_TEXTURE directTexture = nullptr;
+    for (int i = 0; i < DIRECT_TEXTURE_COUNT; i++) {
+        if (SDL_AtomicCAS(&m_DirectTextures[i].inUse, 0, 1)) {
+            directTexture = &m_DirectTextures[i];
+            break;
+        }
+    }
+
+    // All textures are queued for rendering or used as reference frames
+    if (directTexture == nullptr) {
+        return false;
+    }
+
+    int width = frame->width;
+    int height = frame->height;
+    int linesizeAlign[AV_NUM_DATA_POINTERS];
+    int linesizes[4];
+    avcodec_align_dimensions2(context, &width, &height, linesizeAlign);
+    av_image_fill_linesizes(linesizes, AV_PIX_FMT_YUV420P, width);
+
+    int pitch = directTexture->pitch;
+    uint8_t* planes[3];
+    planes[0] = directTexture->pixels;
+    planes[2] = planes[0] + pitch * m_DirectTextureHeight;
+    planes[1] = planes[2] + (pitch / 2) * (m_DirectTextureHeight / 2);
+
+    // Keep some rows of slack at the bottom for decoder overreads
+    bool compatible = height < m_DirectTextureHeight;
+    for (int i = 0; i < 3 && compatible; i++) {
+        int planePitch = i == 0 ? pitch : pitch / 2;
+        int align = SDL_max(linesizeAlign[i], 1);
+
+        compatible = planePitch >= linesizes[i] &&
+                     planePitch % align == 0 &&
+                     (uintptr_t)planes[i] % align == 0;
+    }
+
+    if (!compatible) {
+        // This won't change for this stream, so stop trying
+        SDL_AtomicSet(&directTexture->inUse, 0);
+        SDL_AtomicSet(&m_DirectTexturesReady, 0);
+
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                    "Texture layout doesn't meet decoder alignment requirements (pitch: %d, alignment: %d). Falling back to copying frames.",
+                    pitch,
+                    linesizeAlign[0]);
+        return false;
+    }
+
+    int size = pitch * m_DirectTextureHeight * 3 / 2;
+    frame->buf[0] = av_buffer_create(directTexture->pixels, size,
+                                     releaseDirectTexture, directTexture, 0);
+    if (frame->buf[0] == nullptr) {
+        SDL_AtomicSet(&directTexture->inUse, 0);
+        return false;
+    }
+
+    for (int i = 0; i < 3; i++) {
+        frame->data[i] = planes[i];
+        frame->linesize[i] = i == 0 ? pitch : pitch / 2;
+    }
+
+    frame->extended_data = frame->data;
+    return true;
+}
+
+SdlRenderer::PDIRECT_TEXTURE SdlRenderer::findDirectTexture(AVFrame* frame)
+{
+    if (frame->buf[0] == nullptr) {
+        return nullptr;
+    }
+
+    for (int i = 0; i < DIRECT_TEXTURE_COUNT; i++) {
+        if (m_DirectTextures[i].pixels != nullptr &&
+                frame->buf[0]->data == m_DirectTextures[i].pixels) {
+            return &m_DirectTextures[i];
+        }
+    }
+
+    return nullptr;
+}
+
+// SDL can't upload 10-bit YUV, so dither the frame down to 8 bits
+// while writing it into the locked texture
+void SdlRenderer::uploadHighBitDepthFrame(AVFrame* frame, uint8_t* pixels, int pitch)
+{
+    bool toneMap = m_ToneMapEnabled && frame->color_trc == AVCOL_TRC_SMPTE2084;
+    int chromaWidth = (frame->width + 1) / 2;
+    int chromaHeight = (frame->height + 1) / 2;
+
+    if (frame->format == AV_PIX_FMT_YUV420P10) {
+        // 10-bit values in the low bits to YV12 (Y, V, U planes)
+        int chromaPitch = (pitch + 1) / 2;
+        uint8_t* planeV = pixels + pitch * frame->height;
+        uint8_t* planeU = planeV + chromaPitch * chromaHeight;
+
+        if (toneMap) {
+            uint8_t* const dst[3] = { pixels, planeU, planeV };
+            const int dstPitch[3] = { pitch, chromaPitch, chromaPitch };
+            const uint16_t* const src[3] = { (const uint16_t*)frame->data[0],
+                                             (const uint16_t*)frame->data[1],
+                                             (const uint16_t*)frame->data[2] };
+
+            PlaneCopy::toneMapFrame(dst, dstPitch, 1, src, frame->linesize, 1,
+                                    frame->width, frame->height, 0,
+                                    frame->color_range == AVCOL_RANGE_JPEG);
+            return;
+        }
+
+        PlaneCopy::ditherPlane(pixels, pitch,
+                               (const uint16_t*)frame->data[0], frame->linesize[0],
+                               frame->width, frame->height, 2);
+        PlaneCopy::ditherPlane(planeU, chromaPitch,
+                               (const uint16_t*)frame->data[1], frame->linesize[1],
+                               chromaWidth, chromaHeight, 2);
+        PlaneCopy::ditherPlane(planeV, chromaPitch,
+                               (const uint16_t*)frame->data[2], frame->linesize[2],
+                               chromaWidth, chromaHeight, 2);
+    }
+    else {
+        // 10-bit values in the high bits to NV12
+        SDL_assert(frame->format == AV_PIX_FMT_P010);
+
+        if (toneMap) {
+            uint8_t* planeUV = pixels + pitch * frame->height;
+            uint8_t* const dst[3] = { pixels, planeUV, planeUV + 1 };
+            const int dstPitch[3] = { pitch, pitch, pitch };
+            const uint16_t* const src[3] = { (const uint16_t*)frame->data[0],
+                                             (const uint16_t*)frame->data[1],
+                                             (const uint16_t*)frame->data[1] + 1 };
+            const int srcPitch[3] = { frame->linesize[0], frame->linesize[1], frame->linesize[1] };
+
+            PlaneCopy::toneMapFrame(dst, dstPitch, 2, src, srcPitch, 2,
+                                    frame->width, frame->height, 6,
+                                    frame->color_range == AVCOL_RANGE_JPEG);
+            return;
+        }
+
+        PlaneCopy::ditherPlane(pixels, pitch,
+                               (const uint16_t*)frame->data[0], frame->linesize[0],
+                               frame->width, frame->height, 8);
+        PlaneCopy::ditherPlane(pixels + pitch * frame->height, pitch,
+                               (const uint16_t*)frame->data[1], frame->linesize[1],
+                               chromaWidth * 2, chromaHeight, 8);
+    }
+}
+
 void SdlRenderer::renderOverlay(Overlay::OverlayType type)
 {
-    if (Session::get()->getOverlayManager().isOverlayEnabled(type)) {
-        // If a new surface has been created for updated overlay data, convert it into a texture.
-        // NB: We have to do this conversion at render-time because we can only interact
-        // with the renderer on a single thread.
-        SDL_Surface* surface = (SDL_Surface*)SDL_AtomicGetPtr((void**)&m_OverlaySurfaces[type]);
-        if (surface != nullptr && SDL_AtomicCASPtr((void**)&m_OverlaySurfaces[type], surface, nullptr)) {
-            if (m_OverlayTextures[type] != nullptr) {
-                SDL_DestroyTexture(m_OverlayTextures[type]);
-            }
-
-            if (type == Overlay::OverlayStatusUpdate) {
-                // Bottom Left
-                SDL_Rect viewportRect;
-                SDL_RenderGetViewport(m_Renderer, &viewportRect);
-                m_OverlayRects[type].x = 0;
-                m_OverlayRects[type].y = viewportRect.h - surface->h;
-            }
-            else if (type == Overlay::OverlayDebug) {
-                // Top left
-                m_OverlayRects[type].x = 0;
-                m_OverlayRects[type].y = 0;
-            }
-
-            m_OverlayRects[type].w = surface->w;
-            m_OverlayRects[type].h = surface->h;
-
-            m_OverlayTextures[type] = SDL_CreateTextureFromSurface(m_Renderer, surface);
-            SDL_FreeSurface(surface);
+    // There's no session when replaying a decode capture
+    if (Session::get() == nullptr) {
+        return;
+    }
+
+    if (!Session::get()->getOverlayManager().isOverlayEnabled(type)) {
+        return;
+    }
+
+    if (type == Overlay::OverlayFrameGraph) {
+        renderFrameGraph();
+        return;
+    }
+
+    GlyphAtlas* atlas = (GlyphAtlas*)SDL_AtomicGetPtr((void**)&m_OverlayAtlases[type]);
+    if (atlas == nullptr) {
+        return;
+    }
+
+    // The atlas is uploaded once, on the render thread because
+    // we can only interact with the renderer on a single thread.
+    // Glyphs are white, so the overlay color comes from modulation.
+    if (m_OverlayTextures[type] == nullptr) {
+        m_OverlayTextures[type] = SDL_CreateTextureFromSurface(m_Renderer, atlas->getSurface());
+        if (m_OverlayTextures[type] == nullptr) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                         "SDL_CreateTextureFromSurface() failed: %s",
+                         SDL_GetError());
+            return;
         }
 
-        // If we have an overlay texture, render it too
-        if (m_OverlayTextures[type] != nullptr) {
-            SDL_RenderCopy(m_Renderer, m_OverlayTextures[type], nullptr, &m_OverlayRects[type]);
+        SDL_Color color = Session::get()->getOverlayManager().getOverlayColor(type);
+        SDL_SetTextureBlendMode(m_OverlayTextures[type], SDL_BLENDMODE_BLEND);
+        SDL_SetTextureColorMod(m_OverlayTextures[type], color.r, color.g, color.b);
+        SDL_SetTextureAlphaMod(m_OverlayTextures[type], color.a);
+    }
+
+    GlyphLayout* layout = &m_OverlayLayouts[type];
+    layout->acquire();
+
+    int y = 0;
+    if (type == Overlay::OverlayStatusUpdate) {
+        // Bottom left
+        SDL_Rect viewportRect;
+        SDL_RenderGetViewport(m_Renderer, &viewportRect);
+        y = viewportRect.h - layout->getHeight();
+    }
+
+    // One copy per glyph, all from the same texture
+    const GlyphAtlas::GLYPH_QUAD* quads = layout->getQuads();
+    for (int i = 0; i < layout->getQuadCount(); i++) {
+        SDL_Rect dst = quads[i].dst;
+        dst.y += y;
+        SDL_RenderCopy(m_Renderer, m_OverlayTextures[type], &quads[i].src, &dst);
+    }
+}
+
+void SdlRenderer::renderFrameGraph()
+{
+    SDL_Texture*& texture = m_OverlayTextures[Overlay::OverlayFrameGraph];
+
+    if (texture == nullptr) {
+        texture = SDL_CreateTexture(m_Renderer, SDL_PIXELFORMAT_ARGB8888,
+                                    SDL_TEXTUREACCESS_STREAMING,
+                                    FRAME_GRAPH_WIDTH, FRAME_GRAPH_HEIGHT);
+        if (texture == nullptr) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                         "SDL_CreateTexture() failed: %s",
+                         SDL_GetError());
+            return;
         }
+
+        SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
     }
+
+    void* pixels;
+    int pitch;
+    if (SDL_LockTexture(texture, nullptr, &pixels, &pitch) == 0) {
+        Session::get()->getOverlayManager().getFrameGraph().draw(pixels, pitch, SDL_PIXELFORMAT_ARGB8888);
+        SDL_UnlockTexture(texture);
+    }
+
+    SDL_Rect viewportRect;
+    SDL_RenderGetViewport(m_Renderer, &viewportRect);
+
+    SDL_Rect dst = FrameGraph::getDestination(viewportRect.w, viewportRect.h);
+    SDL_RenderCopy(m_Renderer, texture, nullptr, &dst);
 }
 
 void SdlRenderer::renderFrame(AVFrame* frame)
 {
     int err;
     AVFrame* swFrame = nullptr;
+    PDIRECT_TEXTURE directTexture;
+    SDL_Texture* texture = m_Texture;
+    SDL_Rect srcRect;
+    uint64_t uploadStartTimeUs;
+
+    if (SDL_AtomicCAS(&m_WindowChanged, 1, 0)) {
+        updateViewport();
+    }
 
     if (frame->hw_frames_ctx != nullptr) {
         // If we are acting as the frontend for a hardware
@@ -289,6 +654,8 @@ void SdlRenderer::renderFrame(AVFrame* frame)
         // so anything other than width, height, and format must
         // be set *after* calling av_hwframe_transfer_data().
         swFrame->colorspace = frame->colorspace;
+        swFrame->color_range = frame->color_range;
+        swFrame->color_trc = frame->color_trc;
 
         frame = swFrame;
     }
@@ -308,6 +675,12 @@ void SdlRenderer::renderFrame(AVFrame* frame)
         case AV_PIX_FMT_NV21:
             sdlFormat = SDL_PIXELFORMAT_NV21;
             break;
+        case AV_PIX_FMT_YUV420P10:
+            sdlFormat = SDL_PIXELFORMAT_YV12;
+            break;
+        case AV_PIX_FMT_P010:
+            sdlFormat = SDL_PIXELFORMAT_NV12;
+            break;
         default:
             SDL_assert(false);
             goto Exit;
@@ -316,6 +689,9 @@ void SdlRenderer::renderFrame(AVFrame* frame)
         switch (frame->colorspace)
         {
         case AVCOL_SPC_BT709:
+        // Tone mapped frames are BT.709. SDL has no BT.2020
+        // conversion for the others, so use the closest one.
+        case AVCOL_SPC_BT2020_NCL:
             SDL_SetYUVConversionMode(SDL_YUV_CONVERSION_BT709);
             break;
         case AVCOL_SPC_BT470BG:
@@ -336,9 +712,34 @@ void SdlRenderer::renderFrame(AVFrame* frame)
                          SDL_GetError());
             goto Exit;
         }
+
+        texture = m_Texture;
+
+        // Software decoders can write straight into texture memory. This must
+        // happen after the conversion mode is set above for it to apply.
+        if (m_DirectTexturesEnabled && swFrame == nullptr && frame->format == AV_PIX_FMT_YUV420P) {
+            createDirectTextures(frame);
+        }
     }
 
-    if (frame->format == AV_PIX_FMT_YUV420P) {
+    srcRect.x = srcRect.y = 0;
+    srcRect.w = frame->width;
+    srcRect.h = frame->height;
+
+    uploadStartTimeUs = StreamUtils::getMicroseconds();
+
+    directTexture = findDirectTexture(frame);
+    if (directTexture != nullptr) {
+        // The frame is already in the texture's staging memory,
+        // so unlocking it is all that's needed to upload it.
+        SDL_UnlockTexture(directTexture->texture);
+        texture = directTexture->texture;
+
+        if (m_VideoStats != nullptr) {
+            m_VideoStats->directTextureFrames++;
+        }
+    }
+    else if (frame->format == AV_PIX_FMT_YUV420P) {
         SDL_UpdateYUVTexture(m_Texture, nullptr,
                              frame->data[0],
                              frame->linesize[0],
@@ -348,7 +749,7 @@ void SdlRenderer::renderFrame(AVFrame* frame)
                              frame->linesize[2]);
     }
     else {
-        char* pixels;
+        uint8_t* pixels;
         int pitch;
 
         err = SDL_LockTexture(m_Texture, nullptr, (void**)&pixels, &pitch);
@@ -359,20 +760,36 @@ void SdlRenderer::renderFrame(AVFrame* frame)
             goto Exit;
         }
 
-        memcpy(pixels,
-               frame->data[0],
-               frame->linesize[0] * frame->height);
-        memcpy(pixels + (frame->linesize[0] * frame->height),
-               frame->data[1],
-               frame->linesize[1] * frame->height / 2);
+        if (frame->format == AV_PIX_FMT_YUV420P10 || frame->format == AV_PIX_FMT_P010) {
+            uploadHighBitDepthFrame(frame, pixels, pitch);
+        }
+        else {
+            // The texture pitch rarely matches the frame's, so copy
+            // only the visible part of each row. SDL places the
+            // interleaved chroma plane right after the luma plane
+            // with the same pitch.
+            PlaneCopy::copyPlane(pixels, pitch,
+                                 frame->data[0], frame->linesize[0],
+                                 frame->width, frame->height);
+            PlaneCopy::copyPlane(pixels + pitch * frame->height, pitch,
+                                 frame->data[1], frame->linesize[1],
+                                 ((frame->width + 1) / 2) * 2, (frame->height + 1) / 2);
+        }
 
         SDL_UnlockTexture(m_Texture);
     }
 
+    if (m_VideoStats != nullptr) {
+        if (directTexture == nullptr) {
+            m_VideoStats->totalBytesUploaded += frame->width * frame->height * 3 / 2;
+        }
+        m_VideoStats->uploadTime.add((uint32_t)(StreamUtils::getMicroseconds() - uploadStartTimeUs));
+    }
+
     SDL_RenderClear(m_Renderer);
 
     // Draw the video content itself
-    SDL_RenderCopy(m_Renderer, m_Texture, nullptr, nullptr);
+    SDL_RenderCopy(m_Renderer, texture, &srcRect, nullptr);
 
     // Draw the overlays
     for (int i = 0; i < Overlay::OverlayMax; i++) {
@@ -381,6 +798,28 @@ void SdlRenderer::renderFrame(AVFrame* frame)
 
     SDL_RenderPresent(m_Renderer);
 
+    if (directTexture != nullptr) {
+        // The decoder may still read this frame as a reference, so
+        // relocking must hand back the same staging memory.
+        uint8_t* pixels;
+        int pitch;
+
+        if (SDL_LockTexture(directTexture->texture, nullptr, (void**)&pixels, &pitch) < 0) {
+            pixels = nullptr;
+        }
+
+        if (pixels != directTexture->pixels || pitch != directTexture->pitch) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                         "Direct decode texture moved after relocking. Falling back to copying frames.");
+            SDL_AtomicSet(&m_DirectTexturesReady, 0);
+
+            // Frames still pointing at the old memory no longer match
+            // this texture, so they're copied like any other frame.
+            directTexture->pixels = pixels;
+            directTexture->pitch = pitch;
+        }
+    }
+
 Exit:
     if (swFrame != nullptr) {
         av_frame_free(&swFrame);
@@ -1,9 +1,14 @@
 #pragma once
 
 #include "renderer.h"
+#include "streaming/video/glyphatlas.h"
 
 #include <SDL_ttf.h>
 
+// Number of textures the decoder can write into directly. Frames
+// that arrive while all of them are in use take the copy path.
+#define DIRECT_TEXTURE_COUNT 6
+
 class SdlRenderer : public IFFmpegRenderer {
 public:
     SdlRenderer();
@@ -14,17 +19,56 @@ public:
     virtual void notifyOverlayUpdated(Overlay::OverlayType) override;
     virtual bool isRenderThreadSupported() override;
     virtual bool isPixelFormatSupported(int videoFormat, enum AVPixelFormat pixelFormat) override;
+    virtual bool notifyWindowChanged() override;
+    virtual bool getFrameBuffer(AVCodecContext* context, AVFrame* frame) override;
+    virtual bool needsHwFrameReadback() override;
+    virtual void setVideoStats(PVIDEO_STATS videoStats) override;
+    virtual bool isPresentVsyncBlocked() override;
 
 private:
+    typedef struct _DIRECT_TEXTURE {
+        SDL_Texture* texture;
+        uint8_t* pixels;
+        int pitch;
+        SDL_atomic_t inUse;
+    } DIRECT_TEXTURE, *PDIRECT_TEXTURE;
+
     void renderOverlay(Overlay::OverlayType type);
 
+    void renderFrameGraph();
+
+    void updateViewport();
+
+    void createDirectTextures(AVFrame* frame);
+
+    void destroyDirectTextures();
+
+    PDIRECT_TEXTURE findDirectTexture(AVFrame* frame);
+
+    static void releaseDirectTexture(void* opaque, uint8_t* data);
+
+    void uploadHighBitDepthFrame(AVFrame* frame, uint8_t* pixels, int pitch);
+
     SDL_Renderer* m_Renderer;
     SDL_Texture* m_Texture;
     int m_SwPixelFormat;
+    int m_VideoWidth;
+    int m_VideoHeight;
+    SDL_atomic_t m_WindowChanged;
     QByteArray m_FontData;
-    TTF_Font* m_OverlayFonts[Overlay::OverlayMax];
-    SDL_Surface* m_OverlaySurfaces[Overlay::OverlayMax];
+    GlyphAtlas* m_OverlayAtlases[Overlay::OverlayMax];
+    GlyphLayout m_OverlayLayouts[Overlay::OverlayMax];
     SDL_Texture* m_OverlayTextures[Overlay::OverlayMax];
-    SDL_Rect m_OverlayRects[Overlay::OverlayMax];
+    PVIDEO_STATS m_VideoStats;
+    DIRECT_TEXTURE m_DirectTextures[DIRECT_TEXTURE_COUNT];
+    int m_DirectTextureHeight;
+    int m_DirectFrameWidth;
+    int m_DirectFrameHeight;
+    bool m_DirectTexturesEnabled;
+    SDL_atomic_t m_DirectTexturesReady;
+
+    // Tone mapping on the CPU can't keep up with most streams,
+    // so it's only done when HDR_TONEMAP=1 is set
+    bool m_ToneMapEnabled;
 };
 
@@ -1,20 +1,41 @@
 #include <QString>
+#include <QVector>
 
 #include "vaapi.h"
 #include "utils.h"
 #include <streaming/streamutils.h>
+#include <streaming/session.h>
 
 #include <SDL_syswm.h>
 
 #include <unistd.h>
 #include <fcntl.h>
 
+#ifdef HAVE_VAAPI_EGL_EXPORT
+#include <va/va_drmcommon.h>
+
+#ifndef DRM_FORMAT_MOD_INVALID
+#define DRM_FORMAT_MOD_INVALID ((1ULL << 56) - 1)
+#endif
+#endif
+
 VAAPIRenderer::VAAPIRenderer()
     : m_HwContext(nullptr),
       m_DrmFd(-1),
-      m_BlacklistedForDirectRendering(false)
+      m_BlacklistedForDirectRendering(false),
+      m_Window(nullptr),
+      m_FrameGraphSubpicture(VA_INVALID_ID),
+      m_FrameGraphFormat(SDL_PIXELFORMAT_UNKNOWN),
+      m_FrameGraphUnsupported(false)
+#ifdef HAVE_VAAPI_EGL_EXPORT
+      , m_eglCreateImageKHR(nullptr),
+      m_eglDestroyImageKHR(nullptr),
+      m_EGLHasModifiers(false)
+#endif
 {
-
+    SDL_AtomicSet(&m_WindowChanged, 0);
+    SDL_zero(m_FrameGraphImage);
+    m_FrameGraphImage.image_id = VA_INVALID_ID;
 }
 
 VAAPIRenderer::~VAAPIRenderer()
@@ -26,6 +47,14 @@ VAAPIRenderer::~VAAPIRenderer()
         // Hold onto this VADisplay since we'll need it to uninitialize VAAPI
         VADisplay display = vaDeviceContext->display;
 
+        if (m_FrameGraphSubpicture != VA_INVALID_ID) {
+            vaDestroySubpicture(display, m_FrameGraphSubpicture);
+        }
+
+        if (m_FrameGraphImage.image_id != VA_INVALID_ID) {
+            vaDestroyImage(display, m_FrameGraphImage.image_id);
+        }
+
         av_buffer_unref(&m_HwContext);
 
         if (display) {
@@ -168,6 +197,7 @@ VAAPIRenderer::initialize(PDECODER_PARAMETERS params)
 
     m_VideoWidth = params->width;
     m_VideoHeight = params->height;
+    m_Window = params->window;
 
     SDL_GetWindowSize(params->window, &m_DisplayWidth, &m_DisplayHeight);
 
@@ -381,6 +411,14 @@ int VAAPIRenderer::getDecoderColorspace()
     return COLORSPACE_REC_601;
 }
 
+bool
+VAAPIRenderer::notifyWindowChanged()
+{
+    // renderFrame() will scale to the new window size
+    SDL_AtomicSet(&m_WindowChanged, 1);
+    return true;
+}
+
 void
 VAAPIRenderer::renderFrame(AVFrame* frame)
 {
@@ -388,6 +426,10 @@ VAAPIRenderer::renderFrame(AVFrame* frame)
     AVHWDeviceContext* deviceContext = (AVHWDeviceContext*)m_HwContext->data;
     AVVAAPIDeviceContext* vaDeviceContext = (AVVAAPIDeviceContext*)deviceContext->hwctx;
 
+    if (SDL_AtomicCAS(&m_WindowChanged, 1, 0)) {
+        SDL_GetWindowSize(m_Window, &m_DisplayWidth, &m_DisplayHeight);
+    }
+
     SDL_Rect src, dst;
     src.x = src.y = 0;
     src.w = m_VideoWidth;
@@ -421,6 +463,28 @@ VAAPIRenderer::renderFrame(AVFrame* frame)
             break;
         }
 
+        // The subpicture is placed in video coordinates and scaled along with the video
+        bool frameGraph = Session::get() != nullptr &&
+                Session::get()->getOverlayManager().isOverlayEnabled(Overlay::OverlayFrameGraph) &&
+                updateFrameGraph(vaDeviceContext->display);
+        if (frameGraph) {
+            SDL_Rect graphRect = FrameGraph::getDestination(m_VideoWidth, m_VideoHeight);
+            VAStatus status = vaAssociateSubpicture(vaDeviceContext->display,
+                                                    m_FrameGraphSubpicture,
+                                                    &surface, 1,
+                                                    0, 0,
+                                                    FRAME_GRAPH_WIDTH, FRAME_GRAPH_HEIGHT,
+                                                    graphRect.x, graphRect.y,
+                                                    graphRect.w, graphRect.h,
+                                                    0);
+            if (status != VA_STATUS_SUCCESS) {
+                SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                             "vaAssociateSubpicture() failed: %d",
+                             status);
+                frameGraph = false;
+            }
+        }
+
         vaPutSurface(vaDeviceContext->display,
                      surface,
                      m_XWindow,
@@ -429,6 +493,11 @@ VAAPIRenderer::renderFrame(AVFrame* frame)
                      dst.x, dst.y,
                      dst.w, dst.h,
                      NULL, 0, flags);
+
+        // The decoder reuses this surface, so don't leave the graph on it
+        if (frameGraph) {
+            vaDeassociateSubpicture(vaDeviceContext->display, m_FrameGraphSubpicture, &surface, 1);
+        }
 #endif
     }
     else if (m_WindowSystem == SDL_SYSWM_WAYLAND) {
@@ -442,3 +511,220 @@ VAAPIRenderer::renderFrame(AVFrame* frame)
         SDL_assert(false);
     }
 }
+
+bool
+VAAPIRenderer::updateFrameGraph(VADisplay display)
+{
+    VAStatus status;
+
+    if (m_FrameGraphUnsupported) {
+        return false;
+    }
+
+    if (m_FrameGraphSubpicture == VA_INVALID_ID) {
+        // Find an RGB subpicture format with alpha
+        int maxFormats = vaMaxNumSubpictureFormats(display);
+        QVector<VAImageFormat> formats(maxFormats);
+        QVector<unsigned int> formatFlags(maxFormats);
+        unsigned int formatCount = maxFormats;
+
+        status = vaQuerySubpictureFormats(display, formats.data(), formatFlags.data(), &formatCount);
+        if (status != VA_STATUS_SUCCESS) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                         "vaQuerySubpictureFormats() failed: %d",
+                         status);
+            m_FrameGraphUnsupported = true;
+            return false;
+        }
+
+        VAImageFormat* format = nullptr;
+        for (unsigned int i = 0; i < formatCount && format == nullptr; i++) {
+            // These name the byte order in memory
+            switch (formats[i].fourcc) {
+            case VA_FOURCC_BGRA:
+                m_FrameGraphFormat = SDL_PIXELFORMAT_BGRA32;
+                format = &formats[i];
+                break;
+            case VA_FOURCC_RGBA:
+                m_FrameGraphFormat = SDL_PIXELFORMAT_RGBA32;
+                format = &formats[i];
+                break;
+            case VA_FOURCC_ARGB:
+                m_FrameGraphFormat = SDL_PIXELFORMAT_ARGB32;
+                format = &formats[i];
+                break;
+            case VA_FOURCC_ABGR:
+                m_FrameGraphFormat = SDL_PIXELFORMAT_ABGR32;
+                format = &formats[i];
+                break;
+            }
+        }
+
+        if (format == nullptr) {
+            SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                        "No RGBA subpicture format for the frame graph");
+            m_FrameGraphUnsupported = true;
+            return false;
+        }
+
+        status = vaCreateImage(display, format, FRAME_GRAPH_WIDTH, FRAME_GRAPH_HEIGHT, &m_FrameGraphImage);
+        if (status != VA_STATUS_SUCCESS) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                         "vaCreateImage() failed: %d",
+                         status);
+            m_FrameGraphImage.image_id = VA_INVALID_ID;
+            m_FrameGraphUnsupported = true;
+            return false;
+        }
+
+        status = vaCreateSubpicture(display, m_FrameGraphImage.image_id, &m_FrameGraphSubpicture);
+        if (status != VA_STATUS_SUCCESS) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                         "vaCreateSubpicture() failed: %d",
+                         status);
+            m_FrameGraphSubpicture = VA_INVALID_ID;
+            m_FrameGraphUnsupported = true;
+            return false;
+        }
+    }
+
+    void* data;
+    status = vaMapBuffer(display, m_FrameGraphImage.buf, &data);
+    if (status != VA_STATUS_SUCCESS) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "vaMapBuffer() failed: %d",
+                     status);
+        return false;
+    }
+
+    Session::get()->getOverlayManager().getFrameGraph().draw((uint8_t*)data + m_FrameGraphImage.offsets[0],
+                                                             m_FrameGraphImage.pitches[0],
+                                                             m_FrameGraphFormat);
+
+    vaUnmapBuffer(display, m_FrameGraphImage.buf);
+    return true;
+}
+
+#ifdef HAVE_VAAPI_EGL_EXPORT
+
+bool
+VAAPIRenderer::canExportEGL()
+{
+    return true;
+}
+
+bool
+VAAPIRenderer::initializeEGL(EGLDisplay display)
+{
+    const char* extensions = eglQueryString(display, EGL_EXTENSIONS);
+    if (extensions == nullptr || strstr(extensions, "EGL_EXT_image_dma_buf_import") == nullptr) {
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                    "EGL_EXT_image_dma_buf_import is not supported");
+        return false;
+    }
+
+    m_eglCreateImageKHR = (PFNEGLCREATEIMAGEKHRPROC)eglGetProcAddress("eglCreateImageKHR");
+    m_eglDestroyImageKHR = (PFNEGLDESTROYIMAGEKHRPROC)eglGetProcAddress("eglDestroyImageKHR");
+    if (m_eglCreateImageKHR == nullptr || m_eglDestroyImageKHR == nullptr) {
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                    "EGL_KHR_image_base is not supported");
+        return false;
+    }
+
+    // Without this, we can only import linear surfaces
+    m_EGLHasModifiers = strstr(extensions, "EGL_EXT_image_dma_buf_import_modifiers") != nullptr;
+
+    return true;
+}
+
+ssize_t
+VAAPIRenderer::exportEGLImages(AVFrame* frame, EGLDisplay display, EGLImage images[EGL_MAX_PLANES])
+{
+    VASurfaceID surface = (VASurfaceID)(uintptr_t)frame->data[3];
+    AVHWDeviceContext* deviceContext = (AVHWDeviceContext*)m_HwContext->data;
+    AVVAAPIDeviceContext* vaDeviceContext = (AVVAAPIDeviceContext*)deviceContext->hwctx;
+    VADRMPRIMESurfaceDescriptor descriptor;
+
+    // Export each plane as its own layer so we can sample it as an R or RG texture
+    VAStatus status = vaExportSurfaceHandle(vaDeviceContext->display,
+                                            surface,
+                                            VA_SURFACE_ATTRIB_MEM_TYPE_DRM_PRIME_2,
+                                            VA_EXPORT_SURFACE_READ_ONLY | VA_EXPORT_SURFACE_SEPARATE_LAYERS,
+                                            &descriptor);
+    if (status != VA_STATUS_SUCCESS) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "vaExportSurfaceHandle() failed: %d",
+                     status);
+        return -1;
+    }
+
+    // Wait for the decoder to finish writing the surface
+    vaSyncSurface(vaDeviceContext->display, surface);
+
+    ssize_t count = 0;
+    for (uint32_t i = 0; i < descriptor.num_layers; i++) {
+        const auto& layer = descriptor.layers[i];
+        const auto& object = descriptor.objects[layer.object_index[0]];
+
+        if (count == EGL_MAX_PLANES) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                         "Too many layers in exported surface: %u",
+                         descriptor.num_layers);
+            freeEGLImages(display, images, count);
+            count = -1;
+            break;
+        }
+
+        // The first layer is luma and the rest are 4:2:0 chroma
+        EGLint attribs[] = {
+            EGL_LINUX_DRM_FOURCC_EXT, (EGLint)layer.drm_format,
+            EGL_WIDTH, i == 0 ? frame->width : (frame->width + 1) / 2,
+            EGL_HEIGHT, i == 0 ? frame->height : (frame->height + 1) / 2,
+            EGL_DMA_BUF_PLANE0_FD_EXT, object.fd,
+            EGL_DMA_BUF_PLANE0_OFFSET_EXT, (EGLint)layer.offset[0],
+            EGL_DMA_BUF_PLANE0_PITCH_EXT, (EGLint)layer.pitch[0],
+            EGL_NONE, EGL_NONE,
+            EGL_NONE, EGL_NONE,
+            EGL_NONE
+        };
+
+        if (m_EGLHasModifiers && object.drm_format_modifier != DRM_FORMAT_MOD_INVALID) {
+            attribs[12] = EGL_DMA_BUF_PLANE0_MODIFIER_LO_EXT;
+            attribs[13] = (EGLint)(object.drm_format_modifier & 0xFFFFFFFF);
+            attribs[14] = EGL_DMA_BUF_PLANE0_MODIFIER_HI_EXT;
+            attribs[15] = (EGLint)(object.drm_format_modifier >> 32);
+        }
+
+        images[count] = m_eglCreateImageKHR(display, EGL_NO_CONTEXT, EGL_LINUX_DMA_BUF_EXT, nullptr, attribs);
+        if (images[count] == EGL_NO_IMAGE_KHR) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                         "eglCreateImageKHR() failed for layer %u (format %x): %x",
+                         i,
+                         layer.drm_format,
+                         eglGetError());
+            freeEGLImages(display, images, count);
+            count = -1;
+            break;
+        }
+
+        count++;
+    }
+
+    // The images hold their own references to the buffers
+    for (uint32_t i = 0; i < descriptor.num_objects; i++) {
+        close(descriptor.objects[i].fd);
+    }
+
+    return count;
+}
+
+void
+VAAPIRenderer::freeEGLImages(EGLDisplay display, EGLImage images[EGL_MAX_PLANES], ssize_t count)
+{
+    for (ssize_t i = 0; i < count; i++) {
+        m_eglDestroyImageKHR(display, images[i]);
+        images[i] = EGL_NO_IMAGE_KHR;
+    }
+}
+
+#endif
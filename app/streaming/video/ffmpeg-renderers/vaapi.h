@@ -28,6 +28,11 @@ extern "C" {
 #include <libavutil/hwcontext_vaapi.h>
 }
 
+// vaExportSurfaceHandle() was added in VA-API 1.1
+#if defined(HAVE_EGL) && VA_CHECK_VERSION(1, 1, 0)
+#define HAVE_VAAPI_EGL_EXPORT
+#endif
+
 class VAAPIRenderer : public IFFmpegRenderer
 {
 public:
@@ -39,10 +44,19 @@ public:
     virtual bool needsTestFrame() override;
     virtual bool isDirectRenderingSupported() override;
     virtual int getDecoderColorspace() override;
+    virtual bool notifyWindowChanged() override;
+
+#ifdef HAVE_VAAPI_EGL_EXPORT
+    virtual bool canExportEGL() override;
+    virtual bool initializeEGL(EGLDisplay display) override;
+    virtual ssize_t exportEGLImages(AVFrame* frame, EGLDisplay display, EGLImage images[EGL_MAX_PLANES]) override;
+    virtual void freeEGLImages(EGLDisplay display, EGLImage images[EGL_MAX_PLANES], ssize_t count) override;
+#endif
 
 private:
     bool validateDriver(VADisplay display);
     VADisplay openDisplay(SDL_Window* window);
+    bool updateFrameGraph(VADisplay display);
 
     int m_WindowSystem;
     AVBufferRef* m_HwContext;
@@ -57,4 +71,18 @@ private:
     int m_VideoHeight;
     int m_DisplayWidth;
     int m_DisplayHeight;
+    SDL_Window* m_Window;
+    SDL_atomic_t m_WindowChanged;
+
+    // The frame graph is blended over the video as a subpicture
+    VAImage m_FrameGraphImage;
+    VASubpictureID m_FrameGraphSubpicture;
+    Uint32 m_FrameGraphFormat;
+    bool m_FrameGraphUnsupported;
+
+#ifdef HAVE_VAAPI_EGL_EXPORT
+    PFNEGLCREATEIMAGEKHRPROC m_eglCreateImageKHR;
+    PFNEGLDESTROYIMAGEKHRPROC m_eglDestroyImageKHR;
+    bool m_EGLHasModifiers;
+#endif
 };
@@ -1,5 +1,6 @@
 #include "vdpau.h"
 #include <streaming/streamutils.h>
+#include <streaming/session.h>
 
 #include <SDL_syswm.h>
 
@@ -27,9 +28,12 @@ VDPAURenderer::VDPAURenderer()
       m_PresentationQueueTarget(0),
       m_PresentationQueue(0),
       m_VideoMixer(0),
-      m_NextSurfaceIndex(0)
+      m_NextSurfaceIndex(0),
+      m_FrameGraphSurface(0),
+      m_Window(nullptr)
 {
     SDL_zero(m_OutputSurface);
+    SDL_AtomicSet(&m_WindowChanged, 0);
 }
 
 VDPAURenderer::~VDPAURenderer()
@@ -46,10 +50,10 @@ VDPAURenderer::~VDPAURenderer()
         m_VdpPresentationQueueTargetDestroy(m_PresentationQueueTarget);
     }
 
-    for (int i = 0; i < OUTPUT_SURFACE_COUNT; i++) {
-        if (m_OutputSurface[i] != 0) {
-            m_VdpOutputSurfaceDestroy(m_OutputSurface[i]);
-        }
+    destroyOutputSurfaces();
+
+    if (m_FrameGraphSurface != 0) {
+        m_VdpBitmapSurfaceDestroy(m_FrameGraphSurface);
     }
 
     // This must be done last as it frees VDPAU context required to call
@@ -138,7 +142,12 @@ bool VDPAURenderer::initialize(PDECODER_PARAMETERS params)
     GET_PROC_ADDRESS(VDP_FUNC_ID_OUTPUT_SURFACE_QUERY_CAPABILITIES, &m_VdpOutputSurfaceQueryCapabilities);
     GET_PROC_ADDRESS(VDP_FUNC_ID_VIDEO_SURFACE_GET_PARAMETERS, &m_VdpVideoSurfaceGetParameters);
     GET_PROC_ADDRESS(VDP_FUNC_ID_GET_INFORMATION_STRING, &m_VdpGetInformationString);
+    GET_PROC_ADDRESS(VDP_FUNC_ID_BITMAP_SURFACE_CREATE, &m_VdpBitmapSurfaceCreate);
+    GET_PROC_ADDRESS(VDP_FUNC_ID_BITMAP_SURFACE_DESTROY, &m_VdpBitmapSurfaceDestroy);
+    GET_PROC_ADDRESS(VDP_FUNC_ID_BITMAP_SURFACE_PUT_BITS_NATIVE, &m_VdpBitmapSurfacePutBitsNative);
+    GET_PROC_ADDRESS(VDP_FUNC_ID_OUTPUT_SURFACE_RENDER_BITMAP_SURFACE, &m_VdpOutputSurfaceRenderBitmapSurface);
 
+    m_Window = params->window;
     SDL_GetWindowSize(params->window, (int*)&m_DisplayWidth, (int*)&m_DisplayHeight);
 
     SDL_VERSION(&info.version);
@@ -223,7 +232,30 @@ bool VDPAURenderer::initialize(PDECODER_PARAMETERS params)
         return false;
     }
 
-    // Create the output surfaces
+    if (!createOutputSurfaces()) {
+        return false;
+    }
+
+    status = m_VdpPresentationQueueCreate(m_Device, m_PresentationQueueTarget,
+                                          &m_PresentationQueue);
+    if (status != VDP_STATUS_OK) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "VdpPresentationQueueCreate() failed: %s",
+                     m_VdpGetErrorString(status));
+        return false;
+    }
+
+    // Set the background to opaque black
+    VdpColor color = {0.0, 0.0, 0.0, 1.0};
+    m_VdpPresentationQueueSetBackgroundColor(m_PresentationQueue, &color);
+
+    return true;
+}
+
+bool VDPAURenderer::createOutputSurfaces()
+{
+    VdpStatus status;
+
     for (int i = 0; i < OUTPUT_SURFACE_COUNT; i++) {
         // It seems there's some lazy freeing going on or something in VDPAU
         // because we can get VDP_STATUS_RESOURCES, then wait a bit and it'll
@@ -246,23 +278,28 @@ bool VDPAURenderer::initialize(PDECODER_PARAMETERS params)
             SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
                          "VdpOutputSurfaceCreate() failed: %s",
                          m_VdpGetErrorString(status));
+            m_OutputSurface[i] = 0;
             return false;
         }
     }
 
-    status = m_VdpPresentationQueueCreate(m_Device, m_PresentationQueueTarget,
-                                          &m_PresentationQueue);
-    if (status != VDP_STATUS_OK) {
-        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
-                     "VdpPresentationQueueCreate() failed: %s",
-                     m_VdpGetErrorString(status));
-        return false;
-    }
+    return true;
+}
 
-    // Set the background to opaque black
-    VdpColor color = {0.0, 0.0, 0.0, 1.0};
-    m_VdpPresentationQueueSetBackgroundColor(m_PresentationQueue, &color);
+void VDPAURenderer::destroyOutputSurfaces()
+{
+    for (int i = 0; i < OUTPUT_SURFACE_COUNT; i++) {
+        if (m_OutputSurface[i] != 0) {
+            m_VdpOutputSurfaceDestroy(m_OutputSurface[i]);
+            m_OutputSurface[i] = 0;
+        }
+    }
+}
 
+bool VDPAURenderer::notifyWindowChanged()
+{
+    // renderFrame() will recreate the output surfaces at the new size
+    SDL_AtomicSet(&m_WindowChanged, 1);
     return true;
 }
 
@@ -305,6 +342,25 @@ void VDPAURenderer::renderFrame(AVFrame* frame)
     VdpStatus status;
     VdpVideoSurface videoSurface = (VdpVideoSurface)(uintptr_t)frame->data[3];
 
+    if (SDL_AtomicCAS(&m_WindowChanged, 1, 0)) {
+        // Wait for the presentation queue to be done with our old surfaces
+        for (int i = 0; i < OUTPUT_SURFACE_COUNT; i++) {
+            VdpTime pts;
+            m_VdpPresentationQueueBlockUntilSurfaceIdle(m_PresentationQueue, m_OutputSurface[i], &pts);
+        }
+
+        destroyOutputSurfaces();
+
+        SDL_GetWindowSize(m_Window, (int*)&m_DisplayWidth, (int*)&m_DisplayHeight);
+        if (!createOutputSurfaces()) {
+            // Recreate the whole decoder and renderer
+            SDL_Event event;
+            event.type = SDL_RENDER_TARGETS_RESET;
+            SDL_PushEvent(&event);
+            return;
+        }
+    }
+
     // This is safe without locking because this is always called on the main thread
     VdpOutputSurface chosenSurface = m_OutputSurface[m_NextSurfaceIndex];
     m_NextSurfaceIndex = (m_NextSurfaceIndex + 1) % OUTPUT_SURFACE_COUNT;
@@ -395,6 +451,10 @@ void VDPAURenderer::renderFrame(AVFrame* frame)
         return;
     }
 
+    if (Session::get() != nullptr && Session::get()->getOverlayManager().isOverlayEnabled(Overlay::OverlayFrameGraph)) {
+        renderFrameGraph(chosenSurface, dst);
+    }
+
     // Queue the frame for display immediately
     status = m_VdpPresentationQueueDisplay(m_PresentationQueue, chosenSurface, 0, 0, 0);
     if (status != VDP_STATUS_OK) {
@@ -404,3 +464,63 @@ void VDPAURenderer::renderFrame(AVFrame* frame)
         return;
     }
 }
+
+void VDPAURenderer::renderFrameGraph(VdpOutputSurface outputSurface, const SDL_Rect& viewport)
+{
+    VdpStatus status;
+
+    if (m_FrameGraphSurface == 0) {
+        status = m_VdpBitmapSurfaceCreate(m_Device, VDP_RGBA_FORMAT_B8G8R8A8,
+                                          FRAME_GRAPH_WIDTH, FRAME_GRAPH_HEIGHT,
+                                          VDP_TRUE, &m_FrameGraphSurface);
+        if (status != VDP_STATUS_OK) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                         "VdpBitmapSurfaceCreate() failed: %s",
+                         m_VdpGetErrorString(status));
+            m_FrameGraphSurface = 0;
+            return;
+        }
+    }
+
+    // B8G8R8A8 is ARGB in a native-endian 32-bit word
+    Session::get()->getOverlayManager().getFrameGraph().draw(m_FrameGraphPixels,
+                                                             FRAME_GRAPH_WIDTH * sizeof(Uint32),
+                                                             SDL_PIXELFORMAT_ARGB8888);
+
+    const void* const data[] = { m_FrameGraphPixels };
+    const uint32_t pitches[] = { FRAME_GRAPH_WIDTH * sizeof(Uint32) };
+    status = m_VdpBitmapSurfacePutBitsNative(m_FrameGraphSurface, data, pitches, nullptr);
+    if (status != VDP_STATUS_OK) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "VdpBitmapSurfacePutBitsNative() failed: %s",
+                     m_VdpGetErrorString(status));
+        return;
+    }
+
+    SDL_Rect dst = FrameGraph::getDestination(viewport.w, viewport.h);
+    VdpRect destRect;
+    destRect.x0 = viewport.x + dst.x;
+    destRect.y0 = viewport.y + dst.y;
+    destRect.x1 = destRect.x0 + dst.w;
+    destRect.y1 = destRect.y0 + dst.h;
+
+    // Standard alpha blending over the video
+    VdpOutputSurfaceRenderBlendState blendState = {};
+    blendState.struct_version = VDP_OUTPUT_SURFACE_RENDER_BLEND_STATE_VERSION;
+    blendState.blend_factor_source_color = VDP_OUTPUT_SURFACE_RENDER_BLEND_FACTOR_SRC_ALPHA;
+    blendState.blend_factor_destination_color = VDP_OUTPUT_SURFACE_RENDER_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+    blendState.blend_factor_source_alpha = VDP_OUTPUT_SURFACE_RENDER_BLEND_FACTOR_ONE;
+    blendState.blend_factor_destination_alpha = VDP_OUTPUT_SURFACE_RENDER_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+    blendState.blend_equation_color = VDP_OUTPUT_SURFACE_RENDER_BLEND_EQUATION_ADD;
+    blendState.blend_equation_alpha = VDP_OUTPUT_SURFACE_RENDER_BLEND_EQUATION_ADD;
+
+    status = m_VdpOutputSurfaceRenderBitmapSurface(outputSurface, &destRect,
+                                                   m_FrameGraphSurface, nullptr,
+                                                   nullptr, &blendState,
+                                                   VDP_OUTPUT_SURFACE_RENDER_ROTATE_0);
+    if (status != VDP_STATUS_OK) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "VdpOutputSurfaceRenderBitmapSurface() failed: %s",
+                     m_VdpGetErrorString(status));
+    }
+}
@@ -18,10 +18,17 @@ public:
     virtual void renderFrame(AVFrame* frame) override;
     virtual bool needsTestFrame() override;
     virtual int getDecoderColorspace() override;
+    virtual bool notifyWindowChanged() override;
 
 private:
+    bool createOutputSurfaces();
+    void destroyOutputSurfaces();
+    void renderFrameGraph(VdpOutputSurface outputSurface, const SDL_Rect& viewport);
+
     uint32_t m_VideoWidth, m_VideoHeight;
     uint32_t m_DisplayWidth, m_DisplayHeight;
+    SDL_Window* m_Window;
+    SDL_atomic_t m_WindowChanged;
     AVBufferRef* m_HwContext;
     VdpPresentationQueueTarget m_PresentationQueueTarget;
     VdpPresentationQueue m_PresentationQueue;
@@ -37,6 +44,9 @@ private:
     static const VdpRGBAFormat k_OutputFormats8Bit[OUTPUT_SURFACE_FORMAT_COUNT];
     static const VdpRGBAFormat k_OutputFormats10Bit[OUTPUT_SURFACE_FORMAT_COUNT];
 
+    VdpBitmapSurface m_FrameGraphSurface;
+    Uint32 m_FrameGraphPixels[FRAME_GRAPH_WIDTH * FRAME_GRAPH_HEIGHT];
+
     VdpGetErrorString* m_VdpGetErrorString;
     VdpPresentationQueueTargetDestroy* m_VdpPresentationQueueTargetDestroy;
     VdpVideoMixerCreate* m_VdpVideoMixerCreate;
@@ -52,6 +62,10 @@ private:
     VdpOutputSurfaceQueryCapabilities* m_VdpOutputSurfaceQueryCapabilities;
     VdpVideoSurfaceGetParameters* m_VdpVideoSurfaceGetParameters;
     VdpGetInformationString* m_VdpGetInformationString;
+    VdpBitmapSurfaceCreate* m_VdpBitmapSurfaceCreate;
+    VdpBitmapSurfaceDestroy* m_VdpBitmapSurfaceDestroy;
+    VdpBitmapSurfacePutBitsNative* m_VdpBitmapSurfacePutBitsNative;
+    VdpOutputSurfaceRenderBitmapSurface* m_VdpOutputSurfaceRenderBitmapSurface;
 
     // X11 stuff
     VdpPresentationQueueTargetCreateX11* m_VdpPresentationQueueTargetCreateX11;
@@ -2,11 +2,19 @@
 #include "ffmpeg.h"
 #include "streaming/streamutils.h"
 #include "streaming/session.h"
+#include "streaming/tracer.h"
 
 #include <h264_stream.h>
 
+extern "C" {
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+}
+
 #include "ffmpeg-renderers/sdlvid.h"
+#include "ffmpeg-renderers/glvid.h"
 #include "ffmpeg-renderers/cuda.h"
+#include "ffmpeg-renderers/null.h"
 
 #ifdef Q_OS_WIN32
 #include "ffmpeg-renderers/dxva2.h"
@@ -39,6 +47,21 @@
 
 #define FAILED_DECODES_RESET_THRESHOLD 20
 
+// Number of decode units that can be waiting for the decode thread.
+// This can be overridden with DECODE_QUEUE_DEPTH. A depth of 0 disables
+// the decode thread and decodes on the caller's thread.
+#define DEFAULT_DECODE_QUEUE_DEPTH 3
+#define MAX_DECODE_QUEUE_DEPTH 16
+
+// Decode units are assembled into pooled buffers of this size
+// (plus padding). The pool is replaced by a larger one if a
+// decode unit doesn't fit.
+#define INITIAL_DECODE_BUFFER_SIZE (1024 * 1024)
+
+// Planes in pooled frame buffers start on a cache line boundary,
+// which also satisfies the alignment required by FFmpeg's SIMD code.
+#define FRAME_POOL_ALIGNMENT 64
+
 bool FFmpegVideoDecoder::isHardwareAccelerated()
 {
     return m_HwDecodeCfg != nullptr ||
@@ -71,6 +94,14 @@ int FFmpegVideoDecoder::getDecoderColorspace()
     return m_FrontendRenderer->getDecoderColorspace();
 }
 
+bool FFmpegVideoDecoder::notifyWindowChanged()
+{
+    // Only the renderer drawing to the window cares about its size.
+    // The codec context and hardware device are left alone, so no
+    // IDR frame is needed to resume decoding.
+    return m_FrontendRenderer->notifyWindowChanged();
+}
+
 QSize FFmpegVideoDecoder::getDecoderMaxResolution()
 {
     if (m_BackendRenderer->getRendererAttributes() & RENDERER_ATTRIBUTE_1080P_MAX) {
@@ -82,6 +113,101 @@ QSize FFmpegVideoDecoder::getDecoderMaxResolution()
     }
 }
 
+AVBufferRef* FFmpegVideoDecoder::ffFramePoolAlloc(void* opaque, int size)
+{
+    FFmpegVideoDecoder* decoder = (FFmpegVideoDecoder*)opaque;
+
+    // This only happens while the pool is filling up
+    decoder->m_DecodeStats.get()->frameBufferAllocations++;
+
+    return av_buffer_alloc(size);
+}
+
+int FFmpegVideoDecoder::ffGetBuffer2(AVCodecContext* context, AVFrame* frame, int flags)
+{
+    FFmpegVideoDecoder* decoder = (FFmpegVideoDecoder*)context->opaque;
+    const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get((enum AVPixelFormat)frame->format);
+
+    // Leave anything unusual to FFmpeg
+    if (desc == nullptr || (desc->flags & AV_PIX_FMT_FLAG_HWACCEL) || frame->width <= 0 || frame->height <= 0) {
+        return avcodec_default_get_buffer2(context, frame, flags);
+    }
+
+    // Frame threads would call us concurrently with the decoding thread
+    SDL_assert(!(context->active_thread_type & FF_THREAD_FRAME));
+
+    // Decode straight into the renderer's memory if it can take it
+    if (decoder->m_FrontendRenderer->getFrameBuffer(context, frame)) {
+        return 0;
+    }
+
+    // Pad the dimensions as the decoder requires for motion compensation
+    int width = frame->width;
+    int height = frame->height;
+    int linesizeAlign[AV_NUM_DATA_POINTERS];
+    avcodec_align_dimensions2(context, &width, &height, linesizeAlign);
+
+    int linesizes[4];
+    if (av_image_fill_linesizes(linesizes, (enum AVPixelFormat)frame->format, width) < 0) {
+        return avcodec_default_get_buffer2(context, frame, flags);
+    }
+
+    // Lay out all planes in a single buffer
+    int planeCount = av_pix_fmt_count_planes((enum AVPixelFormat)frame->format);
+    int planeOffsets[4];
+    int size = 0;
+    for (int i = 0; i < planeCount; i++) {
+        int planeHeight = height;
+        if (i == 1 || i == 2) {
+            planeHeight = AV_CEIL_RSHIFT(height, desc->log2_chroma_h);
+        }
+
+        linesizes[i] = FFALIGN(linesizes[i], FRAME_POOL_ALIGNMENT);
+        planeOffsets[i] = size;
+        size += FFALIGN(linesizes[i] * planeHeight + FRAME_POOL_ALIGNMENT, FRAME_POOL_ALIGNMENT);
+    }
+
+    // Leave room to align the start of the buffer
+    size += FRAME_POOL_ALIGNMENT;
+
+    // Recreate the pool if the stream dimensions or format changed.
+    // Buffers from the old pool remain valid until they are released.
+    if (size != decoder->m_FramePoolSize) {
+        if (decoder->m_FramePool != nullptr) {
+            av_buffer_pool_uninit(&decoder->m_FramePool);
+        }
+
+        decoder->m_FramePool = av_buffer_pool_init2(size, decoder, ffFramePoolAlloc, nullptr);
+        if (decoder->m_FramePool == nullptr) {
+            decoder->m_FramePoolSize = 0;
+            return AVERROR(ENOMEM);
+        }
+
+        decoder->m_FramePoolSize = size;
+
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                    "Frame buffer pool size: %d bytes",
+                    size);
+    }
+
+    frame->buf[0] = av_buffer_pool_get(decoder->m_FramePool);
+    if (frame->buf[0] == nullptr) {
+        return AVERROR(ENOMEM);
+    }
+
+    uint8_t* base = (uint8_t*)FFALIGN((uintptr_t)frame->buf[0]->data, FRAME_POOL_ALIGNMENT);
+    for (int i = 0; i < planeCount; i++) {
+        frame->data[i] = base + planeOffsets[i];
+        frame->linesize[i] = linesizes[i];
+    }
+    frame->extended_data = frame->data;
+
+    // Published by the decoding thread along with the rest of its stats
+    decoder->m_DecodeStats.get()->frameBufferRequests++;
+
+    return 0;
+}
+
 enum AVPixelFormat FFmpegVideoDecoder::ffGetFormat(AVCodecContext* context,
                                                    const enum AVPixelFormat* pixFmts)
 {
@@ -114,12 +240,24 @@ enum AVPixelFormat FFmpegVideoDecoder::ffGetFormat(AVCodecContext* context,
 
 FFmpegVideoDecoder::FFmpegVideoDecoder(bool testOnly)
     : m_VideoDecoderCtx(nullptr),
-      m_DecodeBuffer(1024 * 1024, 0),
+      m_DecodeBufferPool(nullptr),
+      m_DecodeBufferPoolSize(0),
+      m_FramePool(nullptr),
+      m_FramePoolSize(0),
+      m_DecodeQueue(nullptr),
+      m_DecodeQueueFreeSlots(nullptr),
+      m_DecodeQueueReadySlots(nullptr),
+      m_DecodeThread(nullptr),
+      m_DecodeQueueDepth(DEFAULT_DECODE_QUEUE_DEPTH),
+      m_DecodeQueueBlockOnOverflow(false),
       m_HwDecodeCfg(nullptr),
       m_BackendRenderer(nullptr),
       m_FrontendRenderer(nullptr),
       m_ConsecutiveFailedDecodes(0),
       m_Pacer(nullptr),
+      m_FrameGraph(nullptr),
+      m_FrameReadback(nullptr),
+      m_CaptureWriter(nullptr),
       m_FramesIn(0),
       m_FramesOut(0),
       m_LastFrameNumber(0),
@@ -130,6 +268,11 @@ FFmpegVideoDecoder::FFmpegVideoDecoder(bool testOnly)
 {
     av_init_packet(&m_Pkt);
 
+    SDL_AtomicSet(&m_DecodeThreadStopping, 0);
+    SDL_AtomicSet(&m_DecodeThreadNeedsIdr, 0);
+
+    SDL_zero(m_InlineDecodeUnit);
+
     SDL_zero(m_ActiveWndVideoStats);
     SDL_zero(m_LastWndVideoStats);
     SDL_zero(m_GlobalVideoStats);
@@ -154,8 +297,62 @@ IFFmpegRenderer* FFmpegVideoDecoder::getBackendRenderer()
     return m_BackendRenderer;
 }
 
+void FFmpegVideoDecoder::getVideoStats(VIDEO_STATS& stats)
+{
+    // Called on the thread that submits decode units
+    collectVideoStats(m_ActiveWndVideoStats);
+
+    SDL_zero(stats);
+    addVideoStats(m_GlobalVideoStats, stats);
+    addVideoStats(m_ActiveWndVideoStats, stats);
+}
+
+QString FFmpegVideoDecoder::getDecoderName()
+{
+    if (m_VideoDecoderCtx == nullptr) {
+        return QString();
+    }
+
+    QString name = m_VideoDecoderCtx->codec->name;
+    if (m_HwDecodeCfg != nullptr) {
+        name += QString(" (%1)").arg(av_hwdevice_get_type_name(m_HwDecodeCfg->device_type));
+    }
+
+    return name;
+}
+
+QString FFmpegVideoDecoder::getHwaccelName()
+{
+    if (m_HwDecodeCfg == nullptr) {
+        return QString();
+    }
+
+    return av_hwdevice_get_type_name(m_HwDecodeCfg->device_type);
+}
+
 void FFmpegVideoDecoder::reset()
 {
+    // The decode thread submits frames to Pacer, so it
+    // must be stopped before Pacer is destroyed.
+    stopDecodeThread();
+
+    av_buffer_unref(&m_InlineDecodeUnit.buffer);
+
+    delete m_CaptureWriter;
+    m_CaptureWriter = nullptr;
+
+    // Any buffers still referenced by the decoder will be
+    // freed when they are released back to the pool.
+    if (m_DecodeBufferPool != nullptr) {
+        av_buffer_pool_uninit(&m_DecodeBufferPool);
+        m_DecodeBufferPoolSize = 0;
+    }
+
+    // This submits frames to Pacer and holds hardware frames
+    // that must be freed before the codec context.
+    delete m_FrameReadback;
+    m_FrameReadback = nullptr;
+
     delete m_Pacer;
     m_Pacer = nullptr;
 
@@ -166,7 +363,14 @@ void FFmpegVideoDecoder::reset()
     // need to delete in the renderer destructor.
     avcodec_free_context(&m_VideoDecoderCtx);
 
-    if (!m_TestOnly) {
+    // Frames still held elsewhere will be freed when they are released
+    if (m_FramePool != nullptr) {
+        av_buffer_pool_uninit(&m_FramePool);
+        m_FramePoolSize = 0;
+    }
+
+    // There's no session when replaying a decode capture
+    if (!m_TestOnly && Session::get() != nullptr) {
         Session::get()->getOverlayManager().setOverlayRenderer(nullptr);
     }
 
@@ -190,17 +394,113 @@ void FFmpegVideoDecoder::reset()
 
 bool FFmpegVideoDecoder::createFrontendRenderer(PDECODER_PARAMETERS params)
 {
-    if (m_BackendRenderer->isDirectRenderingSupported()) {
+    if (m_HwDecodeCfg != nullptr && NullRenderer::isRequested()) {
+        // Decode into the hwaccel's surfaces as usual, but hand
+        // them to the null renderer instead of displaying them.
+        m_FrontendRenderer = new NullRenderer();
+        if (!m_FrontendRenderer->initialize(params)) {
+            return false;
+        }
+    }
+    else if (m_BackendRenderer->isDirectRenderingSupported()) {
         // The backend renderer can render to the display
         m_FrontendRenderer = m_BackendRenderer;
     }
     else {
         // The backend renderer cannot directly render to the display, so
-        // we will create an SDL renderer to draw the frames.
-        m_FrontendRenderer = new SdlRenderer();
-        if (!m_FrontendRenderer->initialize(params)) {
+        // we will create an OpenGL or SDL renderer to draw the frames.
+        if (GLRenderer::isRequested()) {
+            m_FrontendRenderer = new GLRenderer(m_BackendRenderer);
+            if (!m_FrontendRenderer->initialize(params)) {
+                SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                            "Falling back to SDL renderer");
+
+                // SdlRenderer expects TTF to be shut down
+                delete m_FrontendRenderer;
+                m_FrontendRenderer = nullptr;
+            }
+        }
+
+        if (m_FrontendRenderer == nullptr) {
+            m_FrontendRenderer = new SdlRenderer();
+            if (!m_FrontendRenderer->initialize(params)) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+bool FFmpegVideoDecoder::decodeTestFrame(AVCodecContext* context, int videoFormat)
+{
+    AVPacket pkt;
+    int err;
+
+    av_init_packet(&pkt);
+
+    switch (videoFormat) {
+    case VIDEO_FORMAT_H264:
+        pkt.data = (uint8_t*)k_H264TestFrame;
+        pkt.size = sizeof(k_H264TestFrame);
+        break;
+    case VIDEO_FORMAT_H265:
+        pkt.data = (uint8_t*)k_HEVCMainTestFrame;
+        pkt.size = sizeof(k_HEVCMainTestFrame);
+        break;
+    case VIDEO_FORMAT_H265_MAIN10:
+        pkt.data = (uint8_t*)k_HEVCMain10TestFrame;
+        pkt.size = sizeof(k_HEVCMain10TestFrame);
+        break;
+    default:
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "No test frame for format: %x",
+                     videoFormat);
+        return false;
+    }
+
+    AVFrame* frame = av_frame_alloc();
+    if (!frame) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "Failed to allocate frame");
+        return false;
+    }
+
+    // Some decoders won't output on the first frame, so we'll submit
+    // a few test frames if we get an EAGAIN error.
+    for (int retries = 0; retries < 5; retries++) {
+        // Most FFmpeg decoders process input using a "push" model.
+        // We'll see those fail here if the format is not supported.
+        err = avcodec_send_packet(context, &pkt);
+        if (err < 0) {
+            av_frame_free(&frame);
+            char errorstring[512];
+            av_strerror(err, errorstring, sizeof(errorstring));
+            SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                        "Test decode failed: %s", errorstring);
             return false;
         }
+
+        // A few FFmpeg decoders (h264_mmal) process here using a "pull" model.
+        // Those decoders will fail here if the format is not supported.
+        err = avcodec_receive_frame(context, frame);
+        if (err == AVERROR(EAGAIN)) {
+            // Wait a little while to let the hardware work
+            SDL_Delay(100);
+        }
+        else {
+            // Done!
+            break;
+        }
+    }
+
+    av_frame_free(&frame);
+    if (err < 0) {
+        char errorstring[512];
+        av_strerror(err, errorstring, sizeof(errorstring));
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                    "Test decode failed: %s", errorstring);
+        return false;
     }
 
     return true;
@@ -221,10 +521,28 @@ bool FFmpegVideoDecoder::completeInitialization(AVCodec* decoder, PDECODER_PARAM
 
     // Don't bother initializing Pacer if we're not actually going to render
     if (!testFrame) {
-        m_Pacer = new Pacer(m_FrontendRenderer, &m_ActiveWndVideoStats);
-        if (!m_Pacer->initialize(params->window, params->frameRate, params->enableFramePacing)) {
+        // There's no session when replaying a decode capture
+        if (Session::get() != nullptr) {
+            m_FrameGraph = &Session::get()->getOverlayManager().getFrameGraph();
+            m_FrameGraph->setFrameRate(params->frameRate);
+        }
+
+        m_Pacer = new Pacer(m_FrontendRenderer, m_FrameGraph);
+        if (!m_Pacer->initialize(params->window, params->frameRate, params->enableFramePacing,
+                                 params->pacingBuffer)) {
             return false;
         }
+
+        // Read back hardware frames ahead of the renderer if it can't use them
+        if (m_HwDecodeCfg != nullptr &&
+                m_FrontendRenderer != m_BackendRenderer &&
+                m_FrontendRenderer->needsHwFrameReadback() &&
+                FrameReadback::isRequested()) {
+            m_FrameReadback = new FrameReadback(m_BackendRenderer, m_Pacer);
+            if (!m_FrameReadback->initialize()) {
+                return false;
+            }
+        }
     }
 
     m_VideoDecoderCtx = avcodec_alloc_context3(decoder);
@@ -276,6 +594,16 @@ bool FFmpegVideoDecoder::completeInitialization(AVCodec* decoder, PDECODER_PARAM
     // Nobody must override our ffGetFormat
     SDL_assert(m_VideoDecoderCtx->get_format == ffGetFormat);
 
+    // Software decoders get frame buffers from our pool, unless the
+    // backend renderer brought its own allocator. Set FRAME_POOL=0
+    // to use FFmpeg's allocator instead.
+    if (m_HwDecodeCfg == nullptr &&
+            (decoder->capabilities & AV_CODEC_CAP_DR1) &&
+            m_VideoDecoderCtx->get_buffer2 == avcodec_default_get_buffer2 &&
+            qgetenv("FRAME_POOL") != "0") {
+        m_VideoDecoderCtx->get_buffer2 = ffGetBuffer2;
+    }
+
     // Stash a pointer to this object in the context
     SDL_assert(m_VideoDecoderCtx->opaque == nullptr);
     m_VideoDecoderCtx->opaque = this;
@@ -295,67 +623,7 @@ bool FFmpegVideoDecoder::completeInitialization(AVCodec* decoder, PDECODER_PARAM
     // now to see if things will actually work when the video stream
     // comes in.
     if (testFrame) {
-        switch (params->videoFormat) {
-        case VIDEO_FORMAT_H264:
-            m_Pkt.data = (uint8_t*)k_H264TestFrame;
-            m_Pkt.size = sizeof(k_H264TestFrame);
-            break;
-        case VIDEO_FORMAT_H265:
-            m_Pkt.data = (uint8_t*)k_HEVCMainTestFrame;
-            m_Pkt.size = sizeof(k_HEVCMainTestFrame);
-            break;
-        case VIDEO_FORMAT_H265_MAIN10:
-            m_Pkt.data = (uint8_t*)k_HEVCMain10TestFrame;
-            m_Pkt.size = sizeof(k_HEVCMain10TestFrame);
-            break;
-        default:
-            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
-                         "No test frame for format: %x",
-                         params->videoFormat);
-            return false;
-        }
-
-        AVFrame* frame = av_frame_alloc();
-        if (!frame) {
-            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
-                         "Failed to allocate frame");
-            return false;
-        }
-
-        // Some decoders won't output on the first frame, so we'll submit
-        // a few test frames if we get an EAGAIN error.
-        for (int retries = 0; retries < 5; retries++) {
-            // Most FFmpeg decoders process input using a "push" model.
-            // We'll see those fail here if the format is not supported.
-            err = avcodec_send_packet(m_VideoDecoderCtx, &m_Pkt);
-            if (err < 0) {
-                av_frame_free(&frame);
-                char errorstring[512];
-                av_strerror(err, errorstring, sizeof(errorstring));
-                SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
-                            "Test decode failed: %s", errorstring);
-                return false;
-            }
-
-            // A few FFmpeg decoders (h264_mmal) process here using a "pull" model.
-            // Those decoders will fail here if the format is not supported.
-            err = avcodec_receive_frame(m_VideoDecoderCtx, frame);
-            if (err == AVERROR(EAGAIN)) {
-                // Wait a little while to let the hardware work
-                SDL_Delay(100);
-            }
-            else {
-                // Done!
-                break;
-            }
-        }
-
-        av_frame_free(&frame);
-        if (err < 0) {
-            char errorstring[512];
-            av_strerror(err, errorstring, sizeof(errorstring));
-            SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
-                        "Test decode failed: %s", errorstring);
+        if (!decodeTestFrame(m_VideoDecoderCtx, params->videoFormat)) {
             return false;
         }
     }
@@ -371,24 +639,165 @@ bool FFmpegVideoDecoder::completeInitialization(AVCodec* decoder, PDECODER_PARAM
         }
 
         // Tell overlay manager to use this frontend renderer
-        Session::get()->getOverlayManager().setOverlayRenderer(m_FrontendRenderer);
+        if (Session::get() != nullptr) {
+            Session::get()->getOverlayManager().setOverlayRenderer(m_FrontendRenderer);
+        }
+
+        if (!startDecodeThread()) {
+            return false;
+        }
+
+        // Record the incoming stream for offline decoder benchmarking
+        if (qgetenv("DECODE_CAPTURE") == "1") {
+            m_CaptureWriter = new DecodeCaptureWriter();
+            if (!m_CaptureWriter->open(params)) {
+                delete m_CaptureWriter;
+                m_CaptureWriter = nullptr;
+            }
+        }
     }
 
     return true;
 }
 
+bool FFmpegVideoDecoder::startDecodeThread()
+{
+    SDL_assert(m_DecodeThread == nullptr);
+
+    QByteArray depthEnv = qgetenv("DECODE_QUEUE_DEPTH");
+    if (!depthEnv.isEmpty()) {
+        bool ok;
+        int depth = depthEnv.toInt(&ok);
+        if (ok && depth >= 0 && depth <= MAX_DECODE_QUEUE_DEPTH) {
+            m_DecodeQueueDepth = depth;
+        }
+        else {
+            SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                        "Ignoring invalid DECODE_QUEUE_DEPTH: %s",
+                        depthEnv.constData());
+        }
+    }
+
+    // By default, we drop the incoming frame and ask for an IDR frame
+    // when the queue is full. Blocking instead will apply backpressure
+    // to the caller, which avoids the IDR frame but can delay packet
+    // processing while the decoder catches up.
+    m_DecodeQueueBlockOnOverflow = qgetenv("DECODE_QUEUE_OVERFLOW") == "block";
+
+    if (m_DecodeQueueDepth == 0) {
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                    "Decode thread disabled");
+        return true;
+    }
+
+    m_DecodeQueue = new SpscRing<QUEUED_DECODE_UNIT>(m_DecodeQueueDepth);
+    m_DecodeQueueFreeSlots = SDL_CreateSemaphore(m_DecodeQueueDepth);
+    m_DecodeQueueReadySlots = SDL_CreateSemaphore(0);
+    if (m_DecodeQueueFreeSlots == nullptr || m_DecodeQueueReadySlots == nullptr) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "SDL_CreateSemaphore() failed: %s",
+                     SDL_GetError());
+        return false;
+    }
+
+    SDL_AtomicSet(&m_DecodeThreadStopping, 0);
+    SDL_AtomicSet(&m_DecodeThreadNeedsIdr, 0);
+
+    m_DecodeThread = SDL_CreateThread(FFmpegVideoDecoder::decodeThread, "VideoDecode", this);
+    if (m_DecodeThread == nullptr) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "Unable to create decode thread: %s",
+                     SDL_GetError());
+        return false;
+    }
+
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                "Decode thread started: queue depth %d (%s on overflow)",
+                m_DecodeQueueDepth,
+                m_DecodeQueueBlockOnOverflow ? "block" : "drop");
+
+    return true;
+}
+
+void FFmpegVideoDecoder::stopDecodeThread()
+{
+    if (m_DecodeThread != nullptr) {
+        SDL_AtomicSet(&m_DecodeThreadStopping, 1);
+        SDL_SemPost(m_DecodeQueueReadySlots);
+        SDL_WaitThread(m_DecodeThread, nullptr);
+        m_DecodeThread = nullptr;
+
+        // Release the buffers of any decode units left in the queue
+        PQUEUED_DECODE_UNIT qdu;
+        while ((qdu = m_DecodeQueue->beginPop()) != nullptr) {
+            av_buffer_unref(&qdu->buffer);
+            m_DecodeQueue->commitPop();
+        }
+    }
+
+    if (m_DecodeQueueFreeSlots != nullptr) {
+        SDL_DestroySemaphore(m_DecodeQueueFreeSlots);
+        m_DecodeQueueFreeSlots = nullptr;
+    }
+
+    if (m_DecodeQueueReadySlots != nullptr) {
+        SDL_DestroySemaphore(m_DecodeQueueReadySlots);
+        m_DecodeQueueReadySlots = nullptr;
+    }
+
+    delete m_DecodeQueue;
+    m_DecodeQueue = nullptr;
+}
+
+int FFmpegVideoDecoder::decodeThread(void* context)
+{
+    FFmpegVideoDecoder* me = reinterpret_cast<FFmpegVideoDecoder*>(context);
+
+    Tracer::setThreadName("VideoDecode");
+
+    if (SDL_SetThreadPriority(SDL_THREAD_PRIORITY_HIGH) < 0) {
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                    "Unable to set decode thread to high priority: %s",
+                    SDL_GetError());
+    }
+
+    for (;;) {
+        SDL_SemWait(me->m_DecodeQueueReadySlots);
+
+        if (SDL_AtomicGet(&me->m_DecodeThreadStopping)) {
+            // Anything left in the queue is discarded
+            break;
+        }
+
+        PQUEUED_DECODE_UNIT qdu = me->m_DecodeQueue->beginPop();
+        SDL_assert(qdu != nullptr);
+
+        Tracer::endAsync("DecodeQueue", qdu->frameNumber);
+
+        uint32_t queueTimeUs = (uint32_t)(StreamUtils::getMicroseconds() - qdu->enqueueTimeUs);
+        me->m_DecodeStats.get()->decodeQueueTime.add(queueTimeUs);
+        if (me->m_FrameGraph != nullptr) {
+            me->m_FrameGraph->addStageTime(qdu->frameNumber, FrameGraph::StageQueue, queueTimeUs);
+        }
+
+        if (me->decodeQueuedUnit(qdu) == DR_NEED_IDR) {
+            // We can't return this to the caller anymore, so
+            // the next call to submitDecodeUnit() will do it.
+            SDL_AtomicSet(&me->m_DecodeThreadNeedsIdr, 1);
+        }
+
+        me->m_DecodeStats.publish();
+
+        me->m_DecodeQueue->commitPop();
+        SDL_SemPost(me->m_DecodeQueueFreeSlots);
+    }
+
+    return 0;
+}
+
 void FFmpegVideoDecoder::addVideoStats(VIDEO_STATS& src, VIDEO_STATS& dst)
 {
-    dst.receivedFrames += src.receivedFrames;
-    dst.decodedFrames += src.decodedFrames;
-    dst.renderedFrames += src.renderedFrames;
-    dst.totalFrames += src.totalFrames;
-    dst.networkDroppedFrames += src.networkDroppedFrames;
-    dst.pacerDroppedFrames += src.pacerDroppedFrames;
-    dst.totalReassemblyTime += src.totalReassemblyTime;
-    dst.totalDecodeTime += src.totalDecodeTime;
-    dst.totalPacerTime += src.totalPacerTime;
-    dst.totalRenderTime += src.totalRenderTime;
+    VideoStatsChannel::addCounters(src, dst);
 
     Uint32 now = SDL_GetTicks();
 
@@ -404,6 +813,32 @@ void FFmpegVideoDecoder::addVideoStats(VIDEO_STATS& src, VIDEO_STATS& dst)
     dst.receivedFps = (float)dst.receivedFrames / ((float)(now - dst.measurementStartTimestamp) / 1000);
     dst.decodedFps = (float)dst.decodedFrames / ((float)(now - dst.measurementStartTimestamp) / 1000);
     dst.renderedFps = (float)dst.renderedFrames / ((float)(now - dst.measurementStartTimestamp) / 1000);
+    dst.copiedBytesPerSec = (float)dst.totalBytesCopied / ((float)(now - dst.measurementStartTimestamp) / 1000);
+    dst.uploadedBytesPerSec = (float)dst.totalBytesUploaded / ((float)(now - dst.measurementStartTimestamp) / 1000);
+}
+
+void FFmpegVideoDecoder::collectVideoStats(VIDEO_STATS& dst)
+{
+    m_DecodeStats.collect(dst);
+
+    if (m_FrameReadback != nullptr) {
+        m_FrameReadback->collectVideoStats(dst);
+    }
+
+    if (m_Pacer != nullptr) {
+        m_Pacer->collectVideoStats(dst);
+    }
+}
+
+int FFmpegVideoDecoder::stringifyLatencyHistogram(const LatencyHistogram& histogram, const char* name, char* output)
+{
+    return sprintf(output,
+                   "%s: %.2f/%.2f/%.2f/%.2f ms\n",
+                   name,
+                   histogram.percentileUs(50) / 1000.0f,
+                   histogram.percentileUs(95) / 1000.0f,
+                   histogram.percentileUs(99) / 1000.0f,
+                   histogram.maxUs() / 1000.0f);
 }
 
 void FFmpegVideoDecoder::stringifyVideoStats(VIDEO_STATS& stats, char* output)
@@ -429,23 +864,76 @@ void FFmpegVideoDecoder::stringifyVideoStats(VIDEO_STATS& stats, char* output)
         offset += sprintf(&output[offset],
                           "Frames dropped by your network connection: %.2f%%\n"
                           "Frames dropped due to network jitter: %.2f%%\n"
-                          "Average receive time: %.2f ms\n"
-                          "Average decoding time: %.2f ms\n"
-                          "Average frame queue delay: %.2f ms\n"
-                          "Average rendering time (including monitor V-sync latency): %.2f ms\n",
+                          "Latency p50/p95/p99/max:\n",
                           (float)stats.networkDroppedFrames / stats.totalFrames * 100,
-                          (float)stats.pacerDroppedFrames / stats.decodedFrames * 100,
-                          (float)stats.totalReassemblyTime / stats.receivedFrames,
-                          (float)stats.totalDecodeTime / stats.decodedFrames,
-                          (float)stats.totalPacerTime / stats.renderedFrames,
-                          (float)stats.totalRenderTime / stats.renderedFrames);
+                          (float)stats.pacerDroppedFrames / stats.decodedFrames * 100);
+        offset += stringifyLatencyHistogram(stats.reassemblyTime, "Receive time", &output[offset]);
+        if (stats.decodeQueueTime.count() != 0) {
+            offset += stringifyLatencyHistogram(stats.decodeQueueTime, "Decode queue delay", &output[offset]);
+        }
+        offset += stringifyLatencyHistogram(stats.decodeTime, "Decoding time", &output[offset]);
+        offset += stringifyLatencyHistogram(stats.pacerTime, "Frame queue delay", &output[offset]);
+        if (stats.jitterBufferDepth != 0) {
+            offset += sprintf(&output[offset],
+                              "Frame queue depth: %u (%.2f ms arrival jitter)\n",
+                              stats.jitterBufferDepth,
+                              stats.arrivalJitterUs / 1000.0f);
+        }
+        offset += stringifyLatencyHistogram(stats.renderTime, "Rendering time (including monitor V-sync latency)", &output[offset]);
+
+        if (stats.renderBudgetUs != 0) {
+            offset += sprintf(&output[offset],
+                              "Just-in-time render budget: %.2f ms\n"
+                              "Frames shown a V-sync sooner/later: %u/%u (%.2f ms saved per frame)\n"
+                              "Missed V-syncs: %u\n",
+                              stats.renderBudgetUs / 1000.0f,
+                              stats.jitEarlierFrames,
+                              stats.jitLaterFrames,
+                              stats.jitSavedUs / 1000.0f / stats.renderedFrames,
+                              stats.jitMissedVsyncs);
+        }
+    }
+
+    if (stats.copiedBytesPerSec > 0) {
+        offset += sprintf(&output[offset],
+                          "Decode unit copy rate: %.2f MB/s\n",
+                          stats.copiedBytesPerSec / (1024 * 1024));
+    }
+
+    if (stats.readbackTime.count() != 0) {
+        offset += stringifyLatencyHistogram(stats.readbackTime, "Frame read-back time", &output[offset]);
+    }
+
+    if (stats.uploadTime.count() != 0) {
+        offset += sprintf(&output[offset],
+                          "Frame upload copy rate: %.2f MB/s\n"
+                          "Frames decoded directly into textures: %.2f%%\n",
+                          stats.uploadedBytesPerSec / (1024 * 1024),
+                          (float)stats.directTextureFrames / stats.uploadTime.count() * 100);
+        offset += stringifyLatencyHistogram(stats.uploadTime, "Frame upload time", &output[offset]);
+    }
+
+    if (stats.frameBufferRequests != 0) {
+        offset += sprintf(&output[offset],
+                          "Frame buffer allocations: %u for %u frames\n",
+                          stats.frameBufferAllocations,
+                          stats.frameBufferRequests);
+    }
+
+    if (stats.receivedFrames != 0 && (stats.maxDecodeQueueDepth != 0 || stats.decodeQueueDroppedFrames != 0)) {
+        offset += sprintf(&output[offset],
+                          "Decode queue depth: %.2f average, %u max\n"
+                          "Frames dropped by decode queue: %.2f%%\n",
+                          (float)stats.totalDecodeQueueDepth / stats.receivedFrames,
+                          stats.maxDecodeQueueDepth,
+                          (float)stats.decodeQueueDroppedFrames / stats.receivedFrames * 100);
     }
 }
 
 void FFmpegVideoDecoder::logVideoStats(VIDEO_STATS& stats, const char* title)
 {
     if (stats.renderedFps > 0 || stats.renderedFrames != 0) {
-        char videoStatsStr[512];
+        char videoStatsStr[2048];
         stringifyVideoStats(stats, videoStatsStr);
 
         SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
@@ -456,6 +944,31 @@ void FFmpegVideoDecoder::logVideoStats(VIDEO_STATS& stats, const char* title)
     }
 }
 
+IFFmpegRenderer* FFmpegVideoDecoder::createSoftwareRenderer()
+{
+    if (NullRenderer::isRequested()) {
+        return new NullRenderer();
+    }
+
+    if (GLRenderer::isRequested()) {
+        return new GLRenderer();
+    }
+
+    return new SdlRenderer();
+}
+
+void FFmpegVideoDecoder::addSoftwareDecoderCandidates(QVector<DECODER_CANDIDATE>& candidates,
+                                                      AVCodec* decoder)
+{
+    addDecoderCandidate(candidates, decoder, nullptr, createSoftwareRenderer);
+
+    // Fall back to the SDL renderer if we can't get an OpenGL context
+    if (!NullRenderer::isRequested() && GLRenderer::isRequested()) {
+        addDecoderCandidate(candidates, decoder, nullptr,
+                            []() -> IFFmpegRenderer* { return new SdlRenderer(); });
+    }
+}
+
 IFFmpegRenderer* FFmpegVideoDecoder::createHwAccelRenderer(const AVCodecHWConfig* hwDecodeCfg, int pass)
 {
     if (!(hwDecodeCfg->methods & AV_CODEC_HW_CONFIG_METHOD_HW_DEVICE_CTX)) {
@@ -547,6 +1060,26 @@ bool FFmpegVideoDecoder::tryInitializeRenderer(AVCodec* decoder,
     return false;
 }
 
+bool FFmpegVideoDecoder::initializeProbedRenderer(PDECODER_CANDIDATE candidate,
+                                                  PDECODER_PARAMETERS params)
+{
+    m_BackendRenderer = candidate->createRendererFunc();
+    m_HwDecodeCfg = candidate->hwConfig;
+
+    // The probe already decoded a test frame through this kind
+    // of renderer, so we can initialize it for real right away.
+    if (m_BackendRenderer != nullptr &&
+            m_BackendRenderer->initialize(params) &&
+            completeInitialization(candidate->decoder, params, false)) {
+        return true;
+    }
+
+    SDL_LogCritical(SDL_LOG_CATEGORY_APPLICATION,
+                    "Decoder failed to initialize after successful probe");
+    reset();
+    return false;
+}
+
 bool FFmpegVideoDecoder::initialize(PDECODER_PARAMETERS params)
 {
     // Increase log level until the first frame is decoded
@@ -567,7 +1100,7 @@ bool FFmpegVideoDecoder::initialize(PDECODER_PARAMETERS params)
 
             if (customAvcDecoder != nullptr &&
                     tryInitializeRenderer(customAvcDecoder, params, nullptr,
-                                          []() -> IFFmpegRenderer* { return new SdlRenderer(); })) {
+                                          createSoftwareRenderer)) {
                 SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
                             "Using custom H.264 decoder (H264_DECODER_HINT): %s",
                             decoderString.constData());
@@ -588,7 +1121,7 @@ bool FFmpegVideoDecoder::initialize(PDECODER_PARAMETERS params)
 
             if (customHevcDecoder != nullptr &&
                     tryInitializeRenderer(customHevcDecoder, params, nullptr,
-                                          []() -> IFFmpegRenderer* { return new SdlRenderer(); })) {
+                                          createSoftwareRenderer)) {
                 SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
                             "Using custom HEVC decoder (HEVC_DECODER_HINT): %s",
                             decoderString.constData());
@@ -622,6 +1155,9 @@ bool FFmpegVideoDecoder::initialize(PDECODER_PARAMETERS params)
         return false;
     }
 
+    // Build the list of decoders to try in order of preference
+    QVector<DECODER_CANDIDATE> candidates;
+
     // Look for a hardware decoder first unless software-only
     if (params->vds != StreamingPreferences::VDS_FORCE_SOFTWARE) {
         // Look for the first matching hwaccel hardware decoder (pass 0)
@@ -632,11 +1168,8 @@ bool FFmpegVideoDecoder::initialize(PDECODER_PARAMETERS params)
                 break;
             }
 
-            // Initialize the hardware codec and submit a test frame if the renderer needs it
-            if (tryInitializeRenderer(decoder, params, config,
-                                      [config]() -> IFFmpegRenderer* { return createHwAccelRenderer(config, 0); })) {
-                return true;
-            }
+            addDecoderCandidate(candidates, decoder, config,
+                                [config]() -> IFFmpegRenderer* { return createHwAccelRenderer(config, 0); });
         }
 
         // Continue with special non-hwaccel hardware decoders
@@ -645,10 +1178,9 @@ bool FFmpegVideoDecoder::initialize(PDECODER_PARAMETERS params)
         // MMAL is the decoder for the Raspberry Pi
         if (params->videoFormat & VIDEO_FORMAT_MASK_H264) {
             AVCodec* mmalDecoder = avcodec_find_decoder_by_name("h264_mmal");
-            if (mmalDecoder != nullptr &&
-                    tryInitializeRenderer(mmalDecoder, params, nullptr,
-                                          []() -> IFFmpegRenderer* { return new MmalRenderer(); })) {
-                return true;
+            if (mmalDecoder != nullptr) {
+                addDecoderCandidate(candidates, mmalDecoder, nullptr,
+                                    []() -> IFFmpegRenderer* { return new MmalRenderer(); });
             }
         }
 #endif
@@ -665,10 +1197,9 @@ bool FFmpegVideoDecoder::initialize(PDECODER_PARAMETERS params)
                 rkmppDecoder = avcodec_find_decoder_by_name("hevc_rkmpp");
             }
 
-            if (rkmppDecoder != nullptr &&
-                    tryInitializeRenderer(rkmppDecoder, params, nullptr,
-                                          []() -> IFFmpegRenderer* { return new DrmRenderer(); })) {
-                return true;
+            if (rkmppDecoder != nullptr) {
+                addDecoderCandidate(candidates, rkmppDecoder, nullptr,
+                                    []() -> IFFmpegRenderer* { return new DrmRenderer(); });
             }
         }
 #endif
@@ -684,10 +1215,8 @@ bool FFmpegVideoDecoder::initialize(PDECODER_PARAMETERS params)
                 nvmpiDecoder = avcodec_find_decoder_by_name("hevc_nvmpi");
             }
 
-            if (nvmpiDecoder != nullptr &&
-                    tryInitializeRenderer(nvmpiDecoder, params, nullptr,
-                                          []() -> IFFmpegRenderer* { return new SdlRenderer(); })) {
-                return true;
+            if (nvmpiDecoder != nullptr) {
+                addSoftwareDecoderCandidates(candidates, nvmpiDecoder);
             }
         }
 
@@ -701,10 +1230,8 @@ bool FFmpegVideoDecoder::initialize(PDECODER_PARAMETERS params)
                 v4l2Decoder = avcodec_find_decoder_by_name("hevc_v4l2m2m");
             }
 
-            if (v4l2Decoder != nullptr &&
-                    tryInitializeRenderer(v4l2Decoder, params, nullptr,
-                                          []() -> IFFmpegRenderer* { return new SdlRenderer(); })) {
-                return true;
+            if (v4l2Decoder != nullptr) {
+                addSoftwareDecoderCandidates(candidates, v4l2Decoder);
             }
         }
 #endif
@@ -718,19 +1245,36 @@ bool FFmpegVideoDecoder::initialize(PDECODER_PARAMETERS params)
                 break;
             }
 
-            // Initialize the hardware codec and submit a test frame if the renderer needs it
-            if (tryInitializeRenderer(decoder, params, config,
-                                      [config]() -> IFFmpegRenderer* { return createHwAccelRenderer(config, 1); })) {
-                return true;
-            }
+            addDecoderCandidate(candidates, decoder, config,
+                                [config]() -> IFFmpegRenderer* { return createHwAccelRenderer(config, 1); });
+        }
+
+        // Find out which hwaccels work up front, so we don't wait on
+        // each one that doesn't in turn below. Test-only decoders skip
+        // this since they'd have to decode their test frame again.
+        if (!m_TestOnly && qgetenv("DECODER_PROBE_PARALLEL") != "0") {
+            probeDecoderCandidates(candidates, params);
         }
     }
 
     // Fallback to software if no matching hardware decoder was found
     // and if software fallback is allowed
     if (params->vds != StreamingPreferences::VDS_FORCE_HARDWARE) {
-        if (tryInitializeRenderer(decoder, params, nullptr,
-                                  []() -> IFFmpegRenderer* { return new SdlRenderer(); })) {
+        addSoftwareDecoderCandidates(candidates, decoder);
+    }
+
+    for (DECODER_CANDIDATE& candidate : candidates) {
+        if (candidate.probeResult == DECODER_PROBE_FAILED) {
+            // Don't bother with the full initialization
+            continue;
+        }
+        else if (candidate.probeResult == DECODER_PROBE_PASSED) {
+            if (initializeProbedRenderer(&candidate, params)) {
+                return true;
+            }
+        }
+        else if (tryInitializeRenderer(candidate.decoder, params, candidate.hwConfig,
+                                       candidate.createRendererFunc)) {
             return true;
         }
     }
@@ -739,7 +1283,225 @@ bool FFmpegVideoDecoder::initialize(PDECODER_PARAMETERS params)
     return false;
 }
 
-void FFmpegVideoDecoder::writeBuffer(PLENTRY entry, int& offset)
+void FFmpegVideoDecoder::addDecoderCandidate(QVector<DECODER_CANDIDATE>& candidates,
+                                             AVCodec* decoder,
+                                             const AVCodecHWConfig* hwConfig,
+                                             std::function<IFFmpegRenderer*()> createRendererFunc)
+{
+    // createHwAccelRenderer() can't use anything else
+    if (hwConfig != nullptr && !(hwConfig->methods & AV_CODEC_HW_CONFIG_METHOD_HW_DEVICE_CTX)) {
+        return;
+    }
+
+    // HWACCEL_HINT restricts us to a single hwaccel type (vaapi, cuda, etc)
+    QByteArray hwaccelHint = qgetenv("HWACCEL_HINT");
+    if (hwConfig != nullptr && !hwaccelHint.isEmpty() &&
+            hwaccelHint != av_hwdevice_get_type_name(hwConfig->device_type)) {
+        return;
+    }
+
+    DECODER_CANDIDATE candidate;
+
+    candidate.decoder = decoder;
+    candidate.hwConfig = hwConfig;
+    candidate.createRendererFunc = createRendererFunc;
+    candidate.probeRenderer = nullptr;
+    candidate.probeContext = nullptr;
+    candidate.probeOptions = nullptr;
+    candidate.probeVideoFormat = 0;
+    candidate.probeThread = nullptr;
+    candidate.probeResult = DECODER_PROBE_NOT_RUN;
+
+    candidates.append(candidate);
+}
+
+void FFmpegVideoDecoder::probeDecoderCandidates(QVector<DECODER_CANDIDATE>& candidates,
+                                                PDECODER_PARAMETERS params)
+{
+    QVector<PDECODER_CANDIDATE> probes;
+
+    // Only hwaccels are probed, since the other hardware decoders have
+    // renderers that can't share the window with another renderer.
+    // Each hwaccel is listed in both passes, but only has a renderer
+    // in one of them.
+    for (int i = 0; i < candidates.count(); i++) {
+        PDECODER_CANDIDATE candidate = &candidates[i];
+
+        if (candidate->hwConfig == nullptr) {
+            continue;
+        }
+
+        candidate->probeRenderer = candidate->createRendererFunc();
+        if (candidate->probeRenderer == nullptr) {
+            candidate->probeResult = DECODER_PROBE_FAILED;
+            continue;
+        }
+
+        probes.append(candidate);
+    }
+
+    // Probing is only a win if there's something to do in parallel.
+    // Otherwise, the full initialization will test the decoder itself.
+    if (probes.count() < 2) {
+        for (PDECODER_CANDIDATE candidate : probes) {
+            cleanupDecoderProbe(candidate);
+        }
+        return;
+    }
+
+    Uint32 startTime = SDL_GetTicks();
+
+    // Renderers may touch the window, so they're set up on this thread
+    // and only the test frames are decoded in parallel.
+    for (PDECODER_CANDIDATE candidate : probes) {
+        if (!startDecoderProbe(candidate, params)) {
+            cleanupDecoderProbe(candidate);
+            continue;
+        }
+
+        candidate->probeThread = SDL_CreateThread(FFmpegVideoDecoder::decoderProbeThread,
+                                                  "DecoderProbe",
+                                                  candidate);
+        if (candidate->probeThread == nullptr) {
+            // We'll just try this one the slow way
+            SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                        "Unable to create decoder probe thread: %s",
+                        SDL_GetError());
+            cleanupDecoderProbe(candidate);
+        }
+    }
+
+    for (PDECODER_CANDIDATE candidate : probes) {
+        if (candidate->probeThread != nullptr) {
+            SDL_WaitThread(candidate->probeThread, nullptr);
+            candidate->probeThread = nullptr;
+
+            SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                        "Decoder probe for %s (%s): %s",
+                        candidate->decoder->name,
+                        av_hwdevice_get_type_name(candidate->hwConfig->device_type),
+                        candidate->probeResult == DECODER_PROBE_PASSED ? "passed" : "failed");
+        }
+
+        // The full initialization uses a new renderer, just
+        // like it would after a test frame
+        cleanupDecoderProbe(candidate);
+    }
+
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                "Probed %d hardware decoders in %u ms",
+                probes.count(),
+                SDL_GetTicks() - startTime);
+}
+
+bool FFmpegVideoDecoder::startDecoderProbe(PDECODER_CANDIDATE candidate,
+                                           PDECODER_PARAMETERS params)
+{
+    if (!candidate->probeRenderer->initialize(params)) {
+        candidate->probeResult = DECODER_PROBE_FAILED;
+        return false;
+    }
+
+    // Set up the codec context like completeInitialization() would,
+    // so the probe decodes on the renderer's own device
+    AVCodecContext* context = avcodec_alloc_context3(candidate->decoder);
+    if (!context) {
+        return false;
+    }
+
+    candidate->probeContext = context;
+
+    context->flags |= AV_CODEC_FLAG_LOW_DELAY;
+    context->err_recognition = AV_EF_EXPLODE;
+    context->thread_count = 1;
+    context->width = params->width;
+    context->height = params->height;
+    context->get_format = ffProbeGetFormat;
+
+    if (!candidate->probeRenderer->prepareDecoderContext(context, &candidate->probeOptions)) {
+        candidate->probeResult = DECODER_PROBE_FAILED;
+        return false;
+    }
+
+    // Nobody must override our ffProbeGetFormat
+    SDL_assert(context->get_format == ffProbeGetFormat);
+
+    // Renderers with their own frame allocator expect to find us in the
+    // context, so those are left to the full initialization to test.
+    if (context->get_buffer2 != avcodec_default_get_buffer2) {
+        return false;
+    }
+
+    SDL_assert(context->opaque == nullptr);
+    context->opaque = (void*)candidate->hwConfig;
+
+    candidate->probeVideoFormat = params->videoFormat;
+    return true;
+}
+
+void FFmpegVideoDecoder::cleanupDecoderProbe(PDECODER_CANDIDATE candidate)
+{
+    // The codec context may reference objects owned by the
+    // renderer, so it must be freed first.
+    avcodec_free_context(&candidate->probeContext);
+    av_dict_free(&candidate->probeOptions);
+
+    delete candidate->probeRenderer;
+    candidate->probeRenderer = nullptr;
+}
+
+int FFmpegVideoDecoder::decoderProbeThread(void* context)
+{
+    PDECODER_CANDIDATE candidate = (PDECODER_CANDIDATE)context;
+
+    candidate->probeResult =
+            avcodec_open2(candidate->probeContext, candidate->decoder, &candidate->probeOptions) >= 0 &&
+            decodeTestFrame(candidate->probeContext, candidate->probeVideoFormat) ?
+                DECODER_PROBE_PASSED : DECODER_PROBE_FAILED;
+
+    return 0;
+}
+
+enum AVPixelFormat FFmpegVideoDecoder::ffProbeGetFormat(AVCodecContext* context,
+                                                        const enum AVPixelFormat* pixFmts)
+{
+    const AVCodecHWConfig* hwConfig = (const AVCodecHWConfig*)context->opaque;
+
+    for (const enum AVPixelFormat* p = pixFmts; *p != -1; p++) {
+        if (*p == hwConfig->pix_fmt) {
+            return *p;
+        }
+    }
+
+    return AV_PIX_FMT_NONE;
+}
+
+AVBufferRef* FFmpegVideoDecoder::allocateDecodeBuffer(int requiredSize)
+{
+    if (requiredSize > m_DecodeBufferPoolSize) {
+        // Buffers from the old pool remain valid until they are released
+        if (m_DecodeBufferPool != nullptr) {
+            av_buffer_pool_uninit(&m_DecodeBufferPool);
+        }
+
+        // Leave some headroom so a slightly larger frame doesn't
+        // immediately cause us to replace the pool again.
+        m_DecodeBufferPoolSize = qMax(INITIAL_DECODE_BUFFER_SIZE, requiredSize + requiredSize / 2);
+        m_DecodeBufferPool = av_buffer_pool_init(m_DecodeBufferPoolSize + AV_INPUT_BUFFER_PADDING_SIZE, nullptr);
+        if (m_DecodeBufferPool == nullptr) {
+            m_DecodeBufferPoolSize = 0;
+            return nullptr;
+        }
+
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                    "Decode buffer pool size: %d bytes",
+                    m_DecodeBufferPoolSize);
+    }
+
+    return av_buffer_pool_get(m_DecodeBufferPool);
+}
+
+void FFmpegVideoDecoder::writeBuffer(uint8_t* buffer, PLENTRY entry, int& offset)
 {
     if (m_NeedsSpsFixup && entry->bufferType == BUFFER_TYPE_SPS) {
         const char naluHeader[] = {0x00, 0x00, 0x00, 0x01};
@@ -764,18 +1526,18 @@ void FFmpegVideoDecoder::writeBuffer(PLENTRY entry, int& offset)
         // Copy the modified NALU data. This assumes a 3 byte prefix and
         // begins writing from the 2nd byte, so we must write the data
         // first, then go back and write the Annex B prefix.
-        offset += write_nal_unit(stream, (uint8_t*)&m_DecodeBuffer.data()[initialOffset + 3],
+        offset += write_nal_unit(stream, &buffer[initialOffset + 3],
                                  MAX_SPS_EXTRA_SIZE + entry->length - sizeof(naluHeader));
 
         // Copy the NALU prefix over from the original SPS
-        memcpy(&m_DecodeBuffer.data()[initialOffset], naluHeader, sizeof(naluHeader));
+        memcpy(&buffer[initialOffset], naluHeader, sizeof(naluHeader));
         offset += sizeof(naluHeader);
 
         h264_free(stream);
     }
     else {
         // Write the buffer as-is
-        memcpy(&m_DecodeBuffer.data()[offset],
+        memcpy(&buffer[offset],
                entry->data,
                entry->length);
         offset += entry->length;
@@ -785,10 +1547,15 @@ void FFmpegVideoDecoder::writeBuffer(PLENTRY entry, int& offset)
 int FFmpegVideoDecoder::submitDecodeUnit(PDECODE_UNIT du)
 {
     PLENTRY entry = du->bufferList;
-    int err;
+    PQUEUED_DECODE_UNIT qdu;
+    int ret = DR_OK;
 
     SDL_assert(!m_TestOnly);
 
+    if (m_CaptureWriter != nullptr) {
+        m_CaptureWriter->writeDecodeUnit(du);
+    }
+
     if (!m_LastFrameNumber) {
         m_ActiveWndVideoStats.measurementStartTimestamp = SDL_GetTicks();
         m_LastFrameNumber = du->frameNumber;
@@ -802,8 +1569,11 @@ int FFmpegVideoDecoder::submitDecodeUnit(PDECODE_UNIT du)
 
     // Flip stats windows roughly every second
     if (SDL_TICKS_PASSED(SDL_GetTicks(), m_ActiveWndVideoStats.measurementStartTimestamp + 1000)) {
+        // Pick up what the other threads recorded in this window
+        collectVideoStats(m_ActiveWndVideoStats);
+
         // Update overlay stats if it's enabled
-        if (Session::get()->getOverlayManager().isOverlayEnabled(Overlay::OverlayDebug)) {
+        if (Session::get() != nullptr && Session::get()->getOverlayManager().isOverlayEnabled(Overlay::OverlayDebug)) {
             VIDEO_STATS lastTwoWndStats = {};
             addVideoStats(m_LastWndVideoStats, lastTwoWndStats);
             addVideoStats(m_ActiveWndVideoStats, lastTwoWndStats);
@@ -824,35 +1594,120 @@ int FFmpegVideoDecoder::submitDecodeUnit(PDECODE_UNIT du)
     m_ActiveWndVideoStats.receivedFrames++;
     m_ActiveWndVideoStats.totalFrames++;
 
+    if (m_DecodeThread != nullptr) {
+        // Report any decode failure from the decode thread
+        if (SDL_AtomicCAS(&m_DecodeThreadNeedsIdr, 1, 0)) {
+            ret = DR_NEED_IDR;
+        }
+
+        if (m_DecodeQueueBlockOnOverflow) {
+            SDL_SemWait(m_DecodeQueueFreeSlots);
+        }
+        else if (SDL_SemTryWait(m_DecodeQueueFreeSlots) != 0) {
+            // The decoder has fallen behind. Drop this frame and
+            // request an IDR frame to resynchronize once it catches up.
+            m_ActiveWndVideoStats.decodeQueueDroppedFrames++;
+            return DR_NEED_IDR;
+        }
+
+        qdu = m_DecodeQueue->beginPush();
+        SDL_assert(qdu != nullptr);
+    }
+    else {
+        qdu = &m_InlineDecodeUnit;
+    }
+
     int requiredBufferSize = du->fullLength;
     if (du->frameType == FRAME_TYPE_IDR) {
         // Add some extra space in case we need to do an SPS fixup
         requiredBufferSize += MAX_SPS_EXTRA_SIZE;
     }
 
-    // Ensure the decoder buffer is large enough
-    m_DecodeBuffer.reserve(requiredBufferSize + AV_INPUT_BUFFER_PADDING_SIZE);
+    // Assemble the decode unit directly into a refcounted buffer that
+    // we can hand to FFmpeg without it needing to make its own copy.
+    SDL_assert(qdu->buffer == nullptr);
+    qdu->buffer = allocateDecodeBuffer(requiredBufferSize);
+    if (qdu->buffer == nullptr) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "Failed to allocate decode buffer");
+        if (m_DecodeThread != nullptr) {
+            // Give back the slot we reserved
+            SDL_SemPost(m_DecodeQueueFreeSlots);
+        }
+        return DR_NEED_IDR;
+    }
 
     int offset = 0;
     while (entry != nullptr) {
-        writeBuffer(entry, offset);
+        writeBuffer(qdu->buffer->data, entry, offset);
         entry = entry->next;
     }
 
-    m_Pkt.data = reinterpret_cast<uint8_t*>(m_DecodeBuffer.data());
-    m_Pkt.size = offset;
+    // FFmpeg requires the padding to be zeroed
+    memset(&qdu->buffer->data[offset], 0, AV_INPUT_BUFFER_PADDING_SIZE);
+
+    m_ActiveWndVideoStats.totalBytesCopied += offset;
 
-    m_ActiveWndVideoStats.totalReassemblyTime += LiGetMillis() - du->receiveTimeMs;
+    qdu->length = offset;
+    qdu->frameNumber = du->frameNumber;
+    qdu->frameType = du->frameType;
+    qdu->presentationTimeMs = du->presentationTimeMs;
+    qdu->enqueueTimeUs = StreamUtils::getMicroseconds();
+
+    // The receive time is only tracked with millisecond resolution
+    uint32_t receiveTimeUs = (uint32_t)(LiGetMillis() - du->receiveTimeMs) * 1000;
+    m_ActiveWndVideoStats.reassemblyTime.add(receiveTimeUs);
+    if (m_FrameGraph != nullptr) {
+        m_FrameGraph->addStageTime(du->frameNumber, FrameGraph::StageNetwork, receiveTimeUs);
+    }
 
-    Uint32 beforeDecode = SDL_GetTicks();
+    if (m_DecodeThread != nullptr) {
+        Tracer::beginAsync("DecodeQueue", qdu->frameNumber);
+
+        m_DecodeQueue->commitPush();
+        SDL_SemPost(m_DecodeQueueReadySlots);
+
+        uint32_t queueDepth = m_DecodeQueue->size();
+        m_ActiveWndVideoStats.totalDecodeQueueDepth += queueDepth;
+        m_ActiveWndVideoStats.maxDecodeQueueDepth = qMax(m_ActiveWndVideoStats.maxDecodeQueueDepth, queueDepth);
+
+        return ret;
+    }
+    else {
+        ret = decodeQueuedUnit(qdu);
+        m_DecodeStats.publish();
+        return ret;
+    }
+}
+
+int FFmpegVideoDecoder::decodeQueuedUnit(PQUEUED_DECODE_UNIT qdu)
+{
+    TraceScope trace("Decode", qdu->frameNumber);
+    int err;
+
+    // Ownership of the buffer reference moves to the packet. FFmpeg will
+    // take its own reference rather than copying the data.
+    m_Pkt.buf = qdu->buffer;
+    m_Pkt.data = qdu->buffer->data;
+    m_Pkt.size = qdu->length;
+    qdu->buffer = nullptr;
+
+    uint64_t beforeDecode = StreamUtils::getMicroseconds();
 
     err = avcodec_send_packet(m_VideoDecoderCtx, &m_Pkt);
+
+    // Drop our reference. The buffer returns to the pool once
+    // the decoder is finished with it too.
+    av_packet_unref(&m_Pkt);
+
     if (err < 0) {
         char errorstring[512];
         av_strerror(err, errorstring, sizeof(errorstring));
         SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
                     "avcodec_send_packet() failed: %s", errorstring);
 
+        m_DecodeStats.get()->decodeErrors++;
+
         // If we've failed a bunch of decodes in a row, the decoder/renderer is
         // clearly unhealthy, so let's generate a synthetic reset event to trigger
         // the event loop to destroy and recreate the decoder.
@@ -890,23 +1745,34 @@ int FFmpegVideoDecoder::submitDecodeUnit(PDECODE_UNIT du)
         av_log_set_level(AV_LOG_INFO);
 
         // Store the presentation time
-        frame->pts = du->presentationTimeMs;
+        frame->pts = qdu->presentationTimeMs;
+
+        // Store the frame number for tracing
+        frame->opaque = (void*)(intptr_t)qdu->frameNumber;
 
         // Capture a frame timestamp to measuring pacing delay
-        frame->pkt_dts = SDL_GetTicks();
+        frame->pkt_dts = StreamUtils::getMicroseconds();
 
         // Count time in avcodec_send_packet() and avcodec_receive_frame()
-        // as time spent decoding
-        m_ActiveWndVideoStats.totalDecodeTime += SDL_GetTicks() - beforeDecode;
-
-        // Also count the frame-to-frame delay if the decoder is delaying frames
-        // until a subsequent frame is submitted.
-        m_ActiveWndVideoStats.totalDecodeTime += (m_FramesIn - m_FramesOut) * (1000 / m_StreamFps);
+        // as time spent decoding. Also count the frame-to-frame delay if
+        // the decoder is delaying frames until a subsequent frame is submitted.
+        uint32_t decodeTimeUs = (uint32_t)(frame->pkt_dts - beforeDecode) +
+                (m_FramesIn - m_FramesOut) * (1000000 / m_StreamFps);
+        m_DecodeStats.get()->decodeTime.add(decodeTimeUs);
+        if (m_FrameGraph != nullptr) {
+            m_FrameGraph->addStageTime(qdu->frameNumber, FrameGraph::StageDecode, decodeTimeUs);
+        }
 
-        m_ActiveWndVideoStats.decodedFrames++;
+        m_DecodeStats.get()->decodedFrames++;
 
-        // Queue the frame for rendering (or render now if pacer is disabled)
-        m_Pacer->submitFrame(frame);
+        if (m_FrameReadback != nullptr && frame->hw_frames_ctx != nullptr) {
+            // Read back the frame before it goes to Pacer
+            m_FrameReadback->submitFrame(frame);
+        }
+        else {
+            // Queue the frame for rendering (or render now if pacer is disabled)
+            m_Pacer->submitFrame(frame);
+        }
     }
     else {
         av_frame_free(&frame);
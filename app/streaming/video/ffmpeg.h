@@ -2,14 +2,50 @@
 
 #include <functional>
 
+#include <QVector>
+
 #include "decoder.h"
+#include "decodecapture.h"
 #include "ffmpeg-renderers/renderer.h"
 #include "ffmpeg-renderers/pacer/pacer.h"
+#include "framereadback.h"
+#include "videostatschannel.h"
+#include "spscring.h"
 
 extern "C" {
 #include <libavcodec/avcodec.h>
 }
 
+typedef struct _QUEUED_DECODE_UNIT {
+    AVBufferRef* buffer;
+    int length;
+    int frameNumber;
+    int frameType;
+    unsigned int presentationTimeMs;
+    uint64_t enqueueTimeUs;
+} QUEUED_DECODE_UNIT, *PQUEUED_DECODE_UNIT;
+
+enum DECODER_PROBE_RESULT {
+    DECODER_PROBE_NOT_RUN,
+    DECODER_PROBE_PASSED,
+    DECODER_PROBE_FAILED
+};
+
+typedef struct _DECODER_CANDIDATE {
+    AVCodec* decoder;
+    const AVCodecHWConfig* hwConfig;
+    std::function<IFFmpegRenderer*()> createRendererFunc;
+
+    // Only valid while the probe is running
+    IFFmpegRenderer* probeRenderer;
+    AVCodecContext* probeContext;
+    AVDictionary* probeOptions;
+    int probeVideoFormat;
+    SDL_Thread* probeThread;
+
+    DECODER_PROBE_RESULT probeResult;
+} DECODER_CANDIDATE, *PDECODER_CANDIDATE;
+
 class FFmpegVideoDecoder : public IVideoDecoder {
 public:
     FFmpegVideoDecoder(bool testOnly);
@@ -22,18 +58,32 @@ public:
     virtual QSize getDecoderMaxResolution() override;
     virtual int submitDecodeUnit(PDECODE_UNIT du) override;
     virtual void renderFrameOnMainThread() override;
+    virtual bool notifyWindowChanged() override;
 
     virtual IFFmpegRenderer* getBackendRenderer();
 
+    // Stats for all frames submitted so far, including the current window
+    void getVideoStats(VIDEO_STATS& stats);
+
+    // Name of the decoder and hwaccel in use
+    QString getDecoderName();
+
+    // Name of the hwaccel in use, or empty if there isn't one
+    QString getHwaccelName();
+
 private:
     bool completeInitialization(AVCodec* decoder, PDECODER_PARAMETERS params, bool testFrame);
 
     void stringifyVideoStats(VIDEO_STATS& stats, char* output);
 
+    int stringifyLatencyHistogram(const LatencyHistogram& histogram, const char* name, char* output);
+
     void logVideoStats(VIDEO_STATS& stats, const char* title);
 
     void addVideoStats(VIDEO_STATS& src, VIDEO_STATS& dst);
 
+    void collectVideoStats(VIDEO_STATS& dst);
+
     bool createFrontendRenderer(PDECODER_PARAMETERS params);
 
     bool tryInitializeRenderer(AVCodec* decoder,
@@ -41,28 +91,98 @@ private:
                                const AVCodecHWConfig* hwConfig,
                                std::function<IFFmpegRenderer*()> createRendererFunc);
 
+    bool initializeProbedRenderer(PDECODER_CANDIDATE candidate,
+                                  PDECODER_PARAMETERS params);
+
+    // Renderer for decoders that output frames in system memory
+    static IFFmpegRenderer* createSoftwareRenderer();
+
+    // Adds a candidate for each renderer we can use with a decoder
+    // that outputs frames in system memory, in order of preference
+    static void addSoftwareDecoderCandidates(QVector<DECODER_CANDIDATE>& candidates,
+                                             AVCodec* decoder);
+
     static IFFmpegRenderer* createHwAccelRenderer(const AVCodecHWConfig* hwDecodeCfg, int pass);
 
+    static void addDecoderCandidate(QVector<DECODER_CANDIDATE>& candidates,
+                                    AVCodec* decoder,
+                                    const AVCodecHWConfig* hwConfig,
+                                    std::function<IFFmpegRenderer*()> createRendererFunc);
+
+    static void probeDecoderCandidates(QVector<DECODER_CANDIDATE>& candidates,
+                                       PDECODER_PARAMETERS params);
+
+    static bool startDecoderProbe(PDECODER_CANDIDATE candidate,
+                                  PDECODER_PARAMETERS params);
+
+    static void cleanupDecoderProbe(PDECODER_CANDIDATE candidate);
+
+    static int decoderProbeThread(void* context);
+
+    static bool decodeTestFrame(AVCodecContext* context, int videoFormat);
+
     void reset();
 
-    void writeBuffer(PLENTRY entry, int& offset);
+    bool startDecodeThread();
+
+    void stopDecodeThread();
+
+    static int decodeThread(void* context);
+
+    int decodeQueuedUnit(PQUEUED_DECODE_UNIT qdu);
+
+    AVBufferRef* allocateDecodeBuffer(int requiredSize);
+
+    void writeBuffer(uint8_t* buffer, PLENTRY entry, int& offset);
+
+    static
+    AVBufferRef* ffFramePoolAlloc(void* opaque, int size);
+
+    static
+    int ffGetBuffer2(AVCodecContext* context, AVFrame* frame, int flags);
 
     static
     enum AVPixelFormat ffGetFormat(AVCodecContext* context,
                                    const enum AVPixelFormat* pixFmts);
 
+    static
+    enum AVPixelFormat ffProbeGetFormat(AVCodecContext* context,
+                                        const enum AVPixelFormat* pixFmts);
+
     AVPacket m_Pkt;
     AVCodecContext* m_VideoDecoderCtx;
-    QByteArray m_DecodeBuffer;
+    QUEUED_DECODE_UNIT m_InlineDecodeUnit;
+    AVBufferPool* m_DecodeBufferPool;
+    int m_DecodeBufferPoolSize;
+    AVBufferPool* m_FramePool;
+    int m_FramePoolSize;
+    SpscRing<QUEUED_DECODE_UNIT>* m_DecodeQueue;
+    SDL_sem* m_DecodeQueueFreeSlots;
+    SDL_sem* m_DecodeQueueReadySlots;
+    SDL_Thread* m_DecodeThread;
+    SDL_atomic_t m_DecodeThreadStopping;
+    SDL_atomic_t m_DecodeThreadNeedsIdr;
+    int m_DecodeQueueDepth;
+    bool m_DecodeQueueBlockOnOverflow;
     const AVCodecHWConfig* m_HwDecodeCfg;
     IFFmpegRenderer* m_BackendRenderer;
     IFFmpegRenderer* m_FrontendRenderer;
     int m_ConsecutiveFailedDecodes;
     Pacer* m_Pacer;
+    FrameGraph* m_FrameGraph;
+    FrameReadback* m_FrameReadback;
+    DecodeCaptureWriter* m_CaptureWriter;
+    // Only touched by the thread calling submitDecodeUnit(). Other
+    // threads record their stats through a VideoStatsChannel.
     VIDEO_STATS m_ActiveWndVideoStats;
     VIDEO_STATS m_LastWndVideoStats;
     VIDEO_STATS m_GlobalVideoStats;
 
+    // Stats from whichever thread decodes, including the frame buffer
+    // callbacks. We never enable frame threading, so FFmpeg only calls
+    // those from inside avcodec_send_packet() on that same thread.
+    VideoStatsChannel m_DecodeStats;
+
     int m_FramesIn;
     int m_FramesOut;
 
@@ -0,0 +1,149 @@
+#include "framegraph.h"
+
+// The graph is drawn at 1:1 up to this viewport height
+#define FRAME_GRAPH_BASE_VIEWPORT_HEIGHT 720
+
+FrameGraph::FrameGraph()
+{
+    SDL_zero(m_Samples);
+    for (int i = 0; i < FRAME_GRAPH_WIDTH; i++) {
+        SDL_AtomicSet(&m_Samples[i].frameNumber, -1);
+    }
+
+    SDL_AtomicSet(&m_LastFrameNumber, 0);
+    setFrameRate(60);
+}
+
+void FrameGraph::setFrameRate(int frameRate)
+{
+    SDL_AtomicSet(&m_ScaleUs, 2 * 1000000 / frameRate);
+}
+
+FrameGraph::FRAME_SAMPLE* FrameGraph::getSample(int frameNumber)
+{
+    return &m_Samples[(unsigned int)frameNumber % FRAME_GRAPH_WIDTH];
+}
+
+void FrameGraph::addStageTime(int frameNumber, Stage stage, uint32_t timeUs)
+{
+    FRAME_SAMPLE* sample = getSample(frameNumber);
+
+    if (stage == StageNetwork) {
+        // Take over the slot from the frame that scrolled off the graph.
+        // A reader may catch it half reset, which only affects one column.
+        SDL_AtomicSet(&sample->frameNumber, -1);
+        for (int i = 0; i < StageMax; i++) {
+            SDL_AtomicSet(&sample->stageTimesUs[i], 0);
+        }
+        SDL_AtomicSet(&sample->dropped, 0);
+        SDL_AtomicSet(&sample->stageTimesUs[StageNetwork], (int)timeUs);
+        SDL_AtomicSet(&sample->frameNumber, frameNumber);
+        return;
+    }
+
+    if (SDL_AtomicGet(&sample->frameNumber) != frameNumber) {
+        // The network stage wasn't recorded for this frame
+        return;
+    }
+
+    // Frames can wait in more than one queue
+    SDL_AtomicAdd(&sample->stageTimesUs[stage], (int)timeUs);
+
+    if (stage == StageRender && frameNumber > SDL_AtomicGet(&m_LastFrameNumber)) {
+        SDL_AtomicSet(&m_LastFrameNumber, frameNumber);
+    }
+}
+
+void FrameGraph::addDroppedFrame(int frameNumber)
+{
+    FRAME_SAMPLE* sample = getSample(frameNumber);
+
+    if (SDL_AtomicGet(&sample->frameNumber) != frameNumber) {
+        return;
+    }
+
+    SDL_AtomicSet(&sample->dropped, 1);
+
+    if (frameNumber > SDL_AtomicGet(&m_LastFrameNumber)) {
+        SDL_AtomicSet(&m_LastFrameNumber, frameNumber);
+    }
+}
+
+void FrameGraph::draw(void* pixels, int pitch, Uint32 format)
+{
+    SDL_PixelFormat* pixelFormat = SDL_AllocFormat(format);
+    if (pixelFormat == nullptr) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "SDL_AllocFormat() failed: %s",
+                     SDL_GetError());
+        return;
+    }
+
+    const Uint32 background = SDL_MapRGBA(pixelFormat, 0x00, 0x00, 0x00, 0xA0);
+    const Uint32 guide = SDL_MapRGBA(pixelFormat, 0xFF, 0xFF, 0xFF, 0xC0);
+    const Uint32 dropped = SDL_MapRGBA(pixelFormat, 0xFF, 0x20, 0x20, 0xFF);
+    const Uint32 stageColors[StageMax] = {
+        SDL_MapRGBA(pixelFormat, 0x40, 0x80, 0xFF, 0xFF),
+        SDL_MapRGBA(pixelFormat, 0x40, 0xD0, 0x40, 0xFF),
+        SDL_MapRGBA(pixelFormat, 0xD0, 0xD0, 0x00, 0xFF),
+        SDL_MapRGBA(pixelFormat, 0xFF, 0x80, 0x00, 0xFF),
+    };
+    SDL_FreeFormat(pixelFormat);
+
+    int scaleUs = SDL_AtomicGet(&m_ScaleUs);
+    int lastFrameNumber = SDL_AtomicGet(&m_LastFrameNumber);
+
+    for (int x = 0; x < FRAME_GRAPH_WIDTH; x++) {
+        // Newest frame on the right
+        int frameNumber = lastFrameNumber - (FRAME_GRAPH_WIDTH - 1 - x);
+        Uint32 column[FRAME_GRAPH_HEIGHT];
+
+        for (int y = 0; y < FRAME_GRAPH_HEIGHT; y++) {
+            column[y] = background;
+        }
+
+        FRAME_SAMPLE* sample = getSample(frameNumber);
+        if (frameNumber >= 0 && SDL_AtomicGet(&sample->frameNumber) == frameNumber) {
+            if (SDL_AtomicGet(&sample->dropped)) {
+                for (int y = 0; y < FRAME_GRAPH_HEIGHT; y++) {
+                    column[y] = dropped;
+                }
+            }
+            else {
+                // Stack the stages from the bottom up
+                int top = FRAME_GRAPH_HEIGHT;
+                for (int stage = 0; stage < StageMax && top > 0; stage++) {
+                    int64_t timeUs = (uint32_t)SDL_AtomicGet(&sample->stageTimesUs[stage]);
+                    int height = (int)((timeUs * FRAME_GRAPH_HEIGHT + scaleUs / 2) / scaleUs);
+                    for (int y = SDL_max(top - height, 0); y < top; y++) {
+                        column[y] = stageColors[stage];
+                    }
+                    top -= height;
+                }
+            }
+        }
+
+        // Dotted line at one frame interval
+        if (x % 2 == 0) {
+            column[FRAME_GRAPH_HEIGHT / 2] = guide;
+        }
+
+        for (int y = 0; y < FRAME_GRAPH_HEIGHT; y++) {
+            ((Uint32*)((Uint8*)pixels + y * pitch))[x] = column[y];
+        }
+    }
+}
+
+SDL_Rect FrameGraph::getDestination(int viewportWidth, int viewportHeight)
+{
+    int scale = SDL_max(viewportHeight / FRAME_GRAPH_BASE_VIEWPORT_HEIGHT, 1);
+    SDL_Rect rect;
+
+    // Bottom right, clear of the text overlays on the left
+    rect.w = FRAME_GRAPH_WIDTH * scale;
+    rect.h = FRAME_GRAPH_HEIGHT * scale;
+    rect.x = SDL_max(viewportWidth - rect.w, 0);
+    rect.y = SDL_max(viewportHeight - rect.h, 0);
+
+    return rect;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <SDL.h>
+
+// Frames shown in the graph, one pixel column each
+#define FRAME_GRAPH_WIDTH 240
+#define FRAME_GRAPH_HEIGHT 120
+
+// Per-frame time spent in each stage of the video pipeline, drawn as
+// a scrolling graph of stacked bars. Stages are recorded by whichever
+// thread handles the frame at the time, keyed by frame number.
+class FrameGraph
+{
+public:
+    enum Stage {
+        // Receiving and reassembling the frame (blue)
+        StageNetwork,
+
+        // Decoding it (green)
+        StageDecode,
+
+        // Waiting in the decode and pacing queues (yellow)
+        StageQueue,
+
+        // Rendering it (orange)
+        StageRender,
+
+        StageMax
+    };
+
+    FrameGraph();
+
+    // Scales the graph to twice the frame interval
+    void setFrameRate(int frameRate);
+
+    // The network stage comes first and starts a new frame
+    void addStageTime(int frameNumber, Stage stage, uint32_t timeUs);
+
+    // Frames the pacer dropped are drawn as red columns
+    void addDroppedFrame(int frameNumber);
+
+    // Draws the graph into FRAME_GRAPH_WIDTH by FRAME_GRAPH_HEIGHT
+    // pixels of any 32-bit SDL pixel format
+    void draw(void* pixels, int pitch, Uint32 format);
+
+    // Where the graph goes in a viewport of the given size,
+    // scaled up in whole steps on large viewports
+    static SDL_Rect getDestination(int viewportWidth, int viewportHeight);
+
+private:
+    typedef struct _FRAME_SAMPLE {
+        SDL_atomic_t frameNumber;
+        SDL_atomic_t stageTimesUs[StageMax];
+        SDL_atomic_t dropped;
+    } FRAME_SAMPLE;
+
+    FRAME_SAMPLE* getSample(int frameNumber);
+
+    FRAME_SAMPLE m_Samples[FRAME_GRAPH_WIDTH];
+    SDL_atomic_t m_LastFrameNumber;
+    SDL_atomic_t m_ScaleUs;
+};
@@ -0,0 +1,251 @@
+#include "framereadback.h"
+#include "streaming/streamutils.h"
+#include "streaming/tracer.h"
+
+extern "C" {
+#include <libavutil/hwcontext.h>
+#include <libavutil/imgutils.h>
+}
+
+// Same alignment as decoder frame pool buffers, which keeps
+// the plane copy kernels on their aligned paths
+#define READBACK_FRAME_ALIGNMENT 64
+
+FrameReadback::FrameReadback(IFFmpegRenderer* backendRenderer, Pacer* pacer)
+    : m_BackendRenderer(backendRenderer),
+      m_Pacer(pacer),
+      m_Queue(READBACK_QUEUE_DEPTH),
+      m_QueueFreeSlots(nullptr),
+      m_QueueReadySlots(nullptr),
+      m_Thread(nullptr),
+      m_FramePool(nullptr),
+      m_FramePoolSize(0)
+{
+    SDL_AtomicSet(&m_Stopping, 0);
+}
+
+FrameReadback::~FrameReadback()
+{
+    if (m_Thread != nullptr) {
+        SDL_AtomicSet(&m_Stopping, 1);
+        SDL_SemPost(m_QueueReadySlots);
+        SDL_WaitThread(m_Thread, nullptr);
+    }
+
+    // Free any hardware frames left in the queue
+    AVFrame** slot;
+    while ((slot = m_Queue.beginPop()) != nullptr) {
+        av_frame_free(slot);
+        m_Queue.commitPop();
+    }
+
+    if (m_QueueFreeSlots != nullptr) {
+        SDL_DestroySemaphore(m_QueueFreeSlots);
+    }
+
+    if (m_QueueReadySlots != nullptr) {
+        SDL_DestroySemaphore(m_QueueReadySlots);
+    }
+
+    // Frames still held by Pacer or the renderer will be
+    // freed when they are released
+    if (m_FramePool != nullptr) {
+        av_buffer_pool_uninit(&m_FramePool);
+    }
+}
+
+bool FrameReadback::isRequested()
+{
+    return qgetenv("READBACK_THREAD") != "0";
+}
+
+bool FrameReadback::initialize()
+{
+    m_QueueFreeSlots = SDL_CreateSemaphore(READBACK_QUEUE_DEPTH);
+    m_QueueReadySlots = SDL_CreateSemaphore(0);
+    if (m_QueueFreeSlots == nullptr || m_QueueReadySlots == nullptr) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "SDL_CreateSemaphore() failed: %s",
+                     SDL_GetError());
+        return false;
+    }
+
+    m_Thread = SDL_CreateThread(FrameReadback::readbackThread, "FrameReadback", this);
+    if (m_Thread == nullptr) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "Unable to create read-back thread: %s",
+                     SDL_GetError());
+        return false;
+    }
+
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                "Frame read-back thread started");
+
+    return true;
+}
+
+void FrameReadback::submitFrame(AVFrame* frame)
+{
+    SDL_SemWait(m_QueueFreeSlots);
+
+    AVFrame** slot = m_Queue.beginPush();
+    SDL_assert(slot != nullptr);
+
+    *slot = frame;
+    m_Queue.commitPush();
+
+    SDL_SemPost(m_QueueReadySlots);
+}
+
+void FrameReadback::collectVideoStats(VIDEO_STATS& dst)
+{
+    m_VideoStats.collect(dst);
+}
+
+int FrameReadback::readbackThread(void* context)
+{
+    FrameReadback* me = reinterpret_cast<FrameReadback*>(context);
+
+    Tracer::setThreadName("FrameReadback");
+
+    if (SDL_SetThreadPriority(SDL_THREAD_PRIORITY_HIGH) < 0) {
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                    "Unable to set read-back thread to high priority: %s",
+                    SDL_GetError());
+    }
+
+    for (;;) {
+        SDL_SemWait(me->m_QueueReadySlots);
+
+        if (SDL_AtomicGet(&me->m_Stopping)) {
+            // Anything left in the queue is freed by our destructor
+            break;
+        }
+
+        AVFrame** slot = me->m_Queue.beginPop();
+        SDL_assert(slot != nullptr);
+
+        AVFrame* hwFrame = *slot;
+        me->m_Queue.commitPop();
+        SDL_SemPost(me->m_QueueFreeSlots);
+
+        AVFrame* swFrame = me->readbackFrame(hwFrame);
+        me->m_VideoStats.publish();
+
+        // Release the hardware surface back to the decoder
+        av_frame_free(&hwFrame);
+
+        if (swFrame != nullptr) {
+            me->m_Pacer->submitFrame(swFrame);
+        }
+    }
+
+    return 0;
+}
+
+AVBufferRef* FrameReadback::poolAlloc(void* opaque, int size)
+{
+    FrameReadback* me = reinterpret_cast<FrameReadback*>(opaque);
+
+    // The backend renderer may have memory it can copy into faster
+    AVBufferRef* buffer = me->m_BackendRenderer->allocateReadbackBuffer(size);
+    if (buffer == nullptr) {
+        buffer = av_buffer_alloc(size);
+    }
+
+    return buffer;
+}
+
+AVFrame* FrameReadback::allocateFrame(enum AVPixelFormat format, int width, int height)
+{
+    int size = av_image_get_buffer_size(format, width, height, READBACK_FRAME_ALIGNMENT);
+    if (size < 0) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "av_image_get_buffer_size() failed: %d",
+                     size);
+        return nullptr;
+    }
+
+    // Leave room to align the start of the buffer
+    size += READBACK_FRAME_ALIGNMENT;
+
+    // Recreate the pool if the stream dimensions or format changed.
+    // Buffers from the old pool remain valid until they are released.
+    if (size != m_FramePoolSize) {
+        if (m_FramePool != nullptr) {
+            av_buffer_pool_uninit(&m_FramePool);
+        }
+
+        m_FramePool = av_buffer_pool_init2(size, this, poolAlloc, nullptr);
+        if (m_FramePool == nullptr) {
+            m_FramePoolSize = 0;
+            return nullptr;
+        }
+
+        m_FramePoolSize = size;
+
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                    "Read-back buffer pool size: %d bytes",
+                    size);
+    }
+
+    AVFrame* frame = av_frame_alloc();
+    if (frame == nullptr) {
+        return nullptr;
+    }
+
+    frame->buf[0] = av_buffer_pool_get(m_FramePool);
+    if (frame->buf[0] == nullptr) {
+        av_frame_free(&frame);
+        return nullptr;
+    }
+
+    uint8_t* base = (uint8_t*)FFALIGN((uintptr_t)frame->buf[0]->data, READBACK_FRAME_ALIGNMENT);
+    av_image_fill_arrays(frame->data, frame->linesize, base,
+                         format, width, height, READBACK_FRAME_ALIGNMENT);
+    frame->extended_data = frame->data;
+    frame->format = format;
+    frame->width = width;
+    frame->height = height;
+
+    return frame;
+}
+
+AVFrame* FrameReadback::readbackFrame(AVFrame* hwFrame)
+{
+    int frameNumber = (int)(intptr_t)hwFrame->opaque;
+    TraceScope trace("FrameReadback", frameNumber);
+
+    uint64_t beforeReadback = StreamUtils::getMicroseconds();
+
+    // Read back in the native format of the hardware frames
+    auto hwFrameCtx = (AVHWFramesContext*)hwFrame->hw_frames_ctx->data;
+    AVFrame* swFrame = allocateFrame(hwFrameCtx->sw_format, hwFrame->width, hwFrame->height);
+    if (swFrame == nullptr) {
+        return nullptr;
+    }
+
+    if (!m_BackendRenderer->transferHwFrame(swFrame, hwFrame)) {
+        int err = av_hwframe_transfer_data(swFrame, hwFrame, 0);
+        if (err != 0) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                         "av_hwframe_transfer_data() failed: %d",
+                         err);
+            av_frame_free(&swFrame);
+            return nullptr;
+        }
+    }
+
+    // av_hwframe_transfer_data() can nuke frame metadata,
+    // so it must be copied *after* the transfer. This also
+    // carries over the frame number and decode timestamp.
+    av_frame_copy_props(swFrame, hwFrame);
+
+    uint64_t afterReadback = StreamUtils::getMicroseconds();
+    m_VideoStats.get()->readbackTime.add((uint32_t)(afterReadback - beforeReadback));
+
+    // Keep read-back time out of the frame queue delay stat
+    swFrame->pkt_dts = afterReadback;
+
+    return swFrame;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "decoder.h"
+#include "spscring.h"
+#include "videostatschannel.h"
+#include "ffmpeg-renderers/pacer/pacer.h"
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+// Two frames can wait for read-back while a third is being read back,
+// which is enough to keep the decoder from ever waiting on us unless
+// read-back is slower than the stream frame rate.
+#define READBACK_QUEUE_DEPTH 2
+
+// Reads hardware frames back into system memory on a dedicated thread,
+// for frontend renderers that can't draw hardware frames themselves.
+// Read-back of the next frame overlaps with rendering of the current
+// one instead of adding to its latency. Frames are read back into
+// buffers from a pool, so steady state read-back doesn't allocate.
+class FrameReadback
+{
+public:
+    FrameReadback(IFFmpegRenderer* backendRenderer, Pacer* pacer);
+    ~FrameReadback();
+
+    bool initialize();
+
+    // Takes ownership of the hardware frame. Blocks while the
+    // queue is full.
+    void submitFrame(AVFrame* frame);
+
+    // Adds stats from the read-back thread to dst. Must be called
+    // on the thread that owns dst.
+    void collectVideoStats(VIDEO_STATS& dst);
+
+    // Set READBACK_THREAD=0 to read back frames on the render thread
+    static bool isRequested();
+
+private:
+    static int readbackThread(void* context);
+
+    static AVBufferRef* poolAlloc(void* opaque, int size);
+
+    AVFrame* allocateFrame(enum AVPixelFormat format, int width, int height);
+
+    AVFrame* readbackFrame(AVFrame* hwFrame);
+
+    IFFmpegRenderer* m_BackendRenderer;
+    Pacer* m_Pacer;
+    VideoStatsChannel m_VideoStats;
+    SpscRing<AVFrame*> m_Queue;
+    SDL_sem* m_QueueFreeSlots;
+    SDL_sem* m_QueueReadySlots;
+    SDL_Thread* m_Thread;
+    SDL_atomic_t m_Stopping;
+    AVBufferPool* m_FramePool;
+    int m_FramePoolSize;
+};
@@ -0,0 +1,196 @@
+#include "glyphatlas.h"
+
+// Glyphs per row of the atlas
+#define ATLAS_COLUMNS 16
+
+// Keeps linear filtering from bleeding neighbouring glyphs together
+#define GLYPH_PADDING 1
+
+GlyphAtlas::GlyphAtlas()
+    : m_Surface(nullptr),
+      m_LineHeight(0)
+{
+    SDL_zero(m_GlyphRects);
+}
+
+GlyphAtlas::~GlyphAtlas()
+{
+    if (m_Surface != nullptr) {
+        SDL_FreeSurface(m_Surface);
+    }
+}
+
+bool GlyphAtlas::initialize(TTF_Font* font)
+{
+    int cellWidth = 0;
+    for (int i = 0; i < k_GlyphCount; i++) {
+        int advance;
+        if (TTF_GlyphMetrics(font, (Uint16)(k_FirstGlyph + i), nullptr, nullptr, nullptr, nullptr, &advance) == 0) {
+            m_GlyphRects[i].w = advance;
+            cellWidth = SDL_max(cellWidth, advance);
+        }
+    }
+
+    int cellHeight = TTF_FontHeight(font);
+    m_LineHeight = TTF_FontLineSkip(font);
+
+    int rows = (k_GlyphCount + ATLAS_COLUMNS - 1) / ATLAS_COLUMNS;
+    m_Surface = SDL_CreateRGBSurfaceWithFormat(0,
+                                               ATLAS_COLUMNS * (cellWidth + GLYPH_PADDING),
+                                               rows * (cellHeight + GLYPH_PADDING),
+                                               32, SDL_PIXELFORMAT_ARGB8888);
+    if (m_Surface == nullptr) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "SDL_CreateRGBSurfaceWithFormat() failed: %s",
+                     SDL_GetError());
+        return false;
+    }
+
+    // Transparent white, so filtering at glyph edges doesn't darken them
+    SDL_FillRect(m_Surface, nullptr, SDL_MapRGBA(m_Surface->format, 255, 255, 255, 0));
+
+    const SDL_Color white = { 255, 255, 255, 255 };
+    for (int i = 0; i < k_GlyphCount; i++) {
+        SDL_Rect* rect = &m_GlyphRects[i];
+        rect->x = (i % ATLAS_COLUMNS) * (cellWidth + GLYPH_PADDING);
+        rect->y = (i / ATLAS_COLUMNS) * (cellHeight + GLYPH_PADDING);
+        rect->h = cellHeight;
+
+        char text[2] = { (char)(k_FirstGlyph + i), 0 };
+        SDL_Surface* glyph = TTF_RenderText_Blended(font, text, white);
+        if (glyph == nullptr) {
+            // Spaces may not render anything, but still take up room
+            continue;
+        }
+
+        // Copy the coverage as-is rather than blending it onto the fill
+        SDL_Rect dst = *rect;
+        SDL_SetSurfaceBlendMode(glyph, SDL_BLENDMODE_NONE);
+        SDL_BlitSurface(glyph, nullptr, m_Surface, &dst);
+        SDL_FreeSurface(glyph);
+    }
+
+    return true;
+}
+
+SDL_Surface* GlyphAtlas::getSurface()
+{
+    return m_Surface;
+}
+
+int GlyphAtlas::layoutText(const char* text, int wrapWidth,
+                           GLYPH_QUAD* quads, int maxQuads,
+                           int* width, int* height)
+{
+    int quadCount = 0;
+    int x = 0, y = 0;
+
+    *width = 0;
+
+    for (const char* c = text; *c != 0; c++) {
+        if (*c == '\n') {
+            x = 0;
+            y += m_LineHeight;
+            continue;
+        }
+
+        if (*c < k_FirstGlyph || *c > k_LastGlyph) {
+            continue;
+        }
+
+        const SDL_Rect* glyph = &m_GlyphRects[*c - k_FirstGlyph];
+        if (x > 0 && x + glyph->w > wrapWidth) {
+            x = 0;
+            y += m_LineHeight;
+        }
+
+        // Spaces only move the pen
+        if (*c != ' ') {
+            if (quadCount == maxQuads) {
+                break;
+            }
+
+            quads[quadCount].src = *glyph;
+            quads[quadCount].dst.x = x;
+            quads[quadCount].dst.y = y;
+            quads[quadCount].dst.w = glyph->w;
+            quads[quadCount].dst.h = glyph->h;
+            quadCount++;
+        }
+
+        x += glyph->w;
+        *width = SDL_max(*width, x);
+    }
+
+    *height = *text != 0 ? y + m_LineHeight : 0;
+
+    return quadCount;
+}
+
+GlyphLayout::GlyphLayout()
+    : m_Lock(0),
+      m_Pending(new LAYOUT()),
+      m_Active(new LAYOUT()),
+      m_Updated(false)
+{
+}
+
+GlyphLayout::~GlyphLayout()
+{
+    delete m_Pending;
+    delete m_Active;
+}
+
+void GlyphLayout::update(GlyphAtlas* atlas, const char* text, int wrapWidth)
+{
+    // Laying out is quick enough to do under the lock,
+    // which keeps concurrent updates of one overlay safe
+    SDL_AtomicLock(&m_Lock);
+    if (atlas != nullptr && text != nullptr) {
+        m_Pending->quadCount = atlas->layoutText(text, wrapWidth,
+                                                 m_Pending->quads, GLYPH_LAYOUT_MAX_QUADS,
+                                                 &m_Pending->width, &m_Pending->height);
+    }
+    else {
+        m_Pending->quadCount = m_Pending->width = m_Pending->height = 0;
+    }
+    m_Updated = true;
+    SDL_AtomicUnlock(&m_Lock);
+}
+
+bool GlyphLayout::acquire()
+{
+    bool updated;
+
+    SDL_AtomicLock(&m_Lock);
+    updated = m_Updated;
+    if (updated) {
+        PLAYOUT layout = m_Active;
+        m_Active = m_Pending;
+        m_Pending = layout;
+        m_Updated = false;
+    }
+    SDL_AtomicUnlock(&m_Lock);
+
+    return updated;
+}
+
+const GlyphAtlas::GLYPH_QUAD* GlyphLayout::getQuads()
+{
+    return m_Active->quads;
+}
+
+int GlyphLayout::getQuadCount()
+{
+    return m_Active->quadCount;
+}
+
+int GlyphLayout::getWidth()
+{
+    return m_Active->width;
+}
+
+int GlyphLayout::getHeight()
+{
+    return m_Active->height;
+}
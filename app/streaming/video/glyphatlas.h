@@ -0,0 +1,84 @@
+#pragma once
+
+#include <SDL.h>
+#include <SDL_ttf.h>
+
+// Enough quads for the longest overlay text
+#define GLYPH_LAYOUT_MAX_QUADS 2048
+
+// Printable ASCII glyphs of a font, rendered once into a single
+// surface. Text is then drawn as one textured quad per character,
+// so changing it costs a layout pass instead of rasterizing the
+// whole string again.
+class GlyphAtlas
+{
+public:
+    typedef struct _GLYPH_QUAD {
+        // Glyph in the atlas surface
+        SDL_Rect src;
+
+        // Where it goes, relative to the top left of the text
+        SDL_Rect dst;
+    } GLYPH_QUAD;
+
+    GlyphAtlas();
+    ~GlyphAtlas();
+
+    bool initialize(TTF_Font* font);
+
+    // White glyphs, with coverage in the alpha channel
+    SDL_Surface* getSurface();
+
+    // Lays out text with line breaks at newlines and before characters
+    // that would go past wrapWidth. Characters the atlas doesn't have
+    // are skipped. Returns the number of quads, and the size of the
+    // text in width and height.
+    int layoutText(const char* text, int wrapWidth,
+                   GLYPH_QUAD* quads, int maxQuads,
+                   int* width, int* height);
+
+private:
+    static const char k_FirstGlyph = ' ';
+    static const char k_LastGlyph = '~';
+    static const int k_GlyphCount = k_LastGlyph - k_FirstGlyph + 1;
+
+    SDL_Surface* m_Surface;
+    SDL_Rect m_GlyphRects[k_GlyphCount];
+    int m_LineHeight;
+};
+
+// Hands text laid out on the thread that updates an overlay
+// to the thread that draws it
+class GlyphLayout
+{
+public:
+    GlyphLayout();
+    ~GlyphLayout();
+
+    // Lays out text for the next acquire(). A null atlas or text
+    // leaves nothing to draw.
+    void update(GlyphAtlas* atlas, const char* text, int wrapWidth);
+
+    // Picks up the latest update on the render thread. Returns
+    // true if the quads changed since the last call.
+    bool acquire();
+
+    // Only valid on the render thread after acquire()
+    const GlyphAtlas::GLYPH_QUAD* getQuads();
+    int getQuadCount();
+    int getWidth();
+    int getHeight();
+
+private:
+    typedef struct _LAYOUT {
+        GlyphAtlas::GLYPH_QUAD quads[GLYPH_LAYOUT_MAX_QUADS];
+        int quadCount;
+        int width;
+        int height;
+    } LAYOUT, *PLAYOUT;
+
+    SDL_SpinLock m_Lock;
+    PLAYOUT m_Pending;
+    PLAYOUT m_Active;
+    bool m_Updated;
+};
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <SDL.h>
+
+// Values below this are stored exactly. Above it, each power of two
+// is split into SUB_BUCKETS buckets, so the error is under 6.25%.
+#define LATENCY_HISTOGRAM_SUB_BUCKETS 16
+#define LATENCY_HISTOGRAM_LINEAR_LIMIT (2 * LATENCY_HISTOGRAM_SUB_BUCKETS)
+
+// Anything at or above 2^20 us (about 1 second) lands in the last bucket
+#define LATENCY_HISTOGRAM_MAX_POWER 20
+#define LATENCY_HISTOGRAM_BUCKETS ((LATENCY_HISTOGRAM_MAX_POWER - 3) * LATENCY_HISTOGRAM_SUB_BUCKETS)
+
+// Fixed-bucket histogram of latencies in microseconds.
+//
+// This must stay trivially copyable, since it lives inside
+// VIDEO_STATS which is zeroed and copied with SDL_zero()
+// and SDL_memcpy().
+class LatencyHistogram
+{
+public:
+    void add(uint32_t us)
+    {
+        m_Buckets[getBucketIndex(us)]++;
+        m_Count++;
+        m_TotalUs += us;
+        if (us > m_MaxUs) {
+            m_MaxUs = us;
+        }
+    }
+
+    void merge(const LatencyHistogram& other)
+    {
+        // Most stats windows only touch a few of the histograms
+        if (other.m_Count == 0) {
+            return;
+        }
+
+        for (int i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++) {
+            m_Buckets[i] += other.m_Buckets[i];
+        }
+        m_Count += other.m_Count;
+        m_TotalUs += other.m_TotalUs;
+        if (other.m_MaxUs > m_MaxUs) {
+            m_MaxUs = other.m_MaxUs;
+        }
+    }
+
+    void reset()
+    {
+        if (m_Count != 0) {
+            SDL_zerop(this);
+        }
+    }
+
+    uint32_t count() const
+    {
+        return m_Count;
+    }
+
+    uint32_t maxUs() const
+    {
+        return m_MaxUs;
+    }
+
+    float meanUs() const
+    {
+        return m_Count != 0 ? (float)m_TotalUs / m_Count : 0.0f;
+    }
+
+    // Returns the midpoint of the bucket containing the given
+    // percentile (0-100), clamped to the largest value seen.
+    uint32_t percentileUs(float percentile) const
+    {
+        if (m_Count == 0) {
+            return 0;
+        }
+
+        uint64_t target = (uint64_t)(m_Count * percentile / 100.0f + 0.5f);
+        if (target == 0) {
+            target = 1;
+        }
+
+        uint64_t seen = 0;
+        int i;
+        for (i = 0; i < LATENCY_HISTOGRAM_BUCKETS - 1; i++) {
+            seen += m_Buckets[i];
+            if (seen >= target) {
+                break;
+            }
+        }
+
+        // The last bucket is unbounded
+        if (i == LATENCY_HISTOGRAM_BUCKETS - 1) {
+            return m_MaxUs;
+        }
+
+        return SDL_min(getBucketMidpoint(i), m_MaxUs);
+    }
+
+private:
+    static int getBucketIndex(uint32_t us)
+    {
+        if (us < LATENCY_HISTOGRAM_LINEAR_LIMIT) {
+            return us;
+        }
+
+        int power = SDL_MostSignificantBitIndex32(us);
+        if (power >= LATENCY_HISTOGRAM_MAX_POWER) {
+            return LATENCY_HISTOGRAM_BUCKETS - 1;
+        }
+
+        // The top bit is implied, so the next 4 bits pick the sub-bucket
+        int subBucket = (us >> (power - 4)) & (LATENCY_HISTOGRAM_SUB_BUCKETS - 1);
+        return (power - 3) * LATENCY_HISTOGRAM_SUB_BUCKETS + subBucket;
+    }
+
+    static uint32_t getBucketMidpoint(int index)
+    {
+        if (index < LATENCY_HISTOGRAM_LINEAR_LIMIT) {
+            return index;
+        }
+
+        int power = index / LATENCY_HISTOGRAM_SUB_BUCKETS + 3;
+        int subBucket = index % LATENCY_HISTOGRAM_SUB_BUCKETS;
+        uint32_t lowerBound = (uint32_t)(LATENCY_HISTOGRAM_SUB_BUCKETS + subBucket) << (power - 4);
+        return lowerBound + ((1U << (power - 4)) / 2);
+    }
+
+    uint32_t m_Buckets[LATENCY_HISTOGRAM_BUCKETS];
+    uint32_t m_Count;
+    uint64_t m_TotalUs;
+    uint32_t m_MaxUs;
+};
@@ -29,6 +29,11 @@ int OverlayManager::getOverlayFontSize(OverlayType type)
     return m_Overlays[type].fontSize;
 }
 
+FrameGraph& OverlayManager::getFrameGraph()
+{
+    return m_FrameGraph;
+}
+
 void OverlayManager::setOverlayTextUpdated(OverlayType type)
 {
     // Only update the overlay state if it's enabled. If it's not enabled,
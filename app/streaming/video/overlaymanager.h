@@ -4,11 +4,16 @@
 
 #include <SDL.h>
 
+#include "framegraph.h"
+
 namespace Overlay {
 
 enum OverlayType {
     OverlayDebug,
     OverlayStatusUpdate,
+
+    // Drawn from getFrameGraph() rather than text
+    OverlayFrameGraph,
     OverlayMax
 };
 
@@ -31,6 +36,7 @@ public:
     void setOverlayState(OverlayType type, bool enabled);
     SDL_Color getOverlayColor(OverlayType type);
     int getOverlayFontSize(OverlayType type);
+    FrameGraph& getFrameGraph();
 
     void setOverlayRenderer(IOverlayRenderer* renderer);
 
@@ -38,8 +44,9 @@ public:
         bool enabled;
         int fontSize;
         SDL_Color color;
-        char text[512];
+        char text[2048];
     } m_Overlays[OverlayMax];
+    FrameGraph m_FrameGraph;
     IOverlayRenderer* m_Renderer;
 };
 
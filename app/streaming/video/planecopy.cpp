@@ -0,0 +1,809 @@
+#include "planecopy.h"
+
+#include <QByteArray>
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define HAVE_X86_KERNELS
+#include <immintrin.h>
+
+// GCC and Clang only allow these intrinsics in functions built for them.
+// MSVC allows them anywhere.
+#if defined(__GNUC__)
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_SSE2
+#define TARGET_AVX2
+#endif
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM64)
+#define HAVE_NEON_KERNELS
+#include <arm_neon.h>
+#endif
+
+// HDR content at this level is shown at SDR white
+#define TONE_MAP_REFERENCE_WHITE_NITS 203.0
+// Brightest HDR content we expect, shown at SDR white
+#define TONE_MAP_PEAK_NITS 1000.0
+
+// Steps in the tone mapping tables indexed by a signal from 0 to 1
+#define TONE_MAP_LUT_STEPS 4096
+
+typedef struct _TONE_MAP_LUTS {
+    // 10-bit codes to signals, for limited [0] and full [1] range
+    float luma[2][1024];
+    float chroma[2][1024];
+
+    // PQ signal to linear light, where 1.0 is SDR white
+    float eotf[TONE_MAP_LUT_STEPS + 1];
+
+    // PQ signal of a pixel's brightest component to the gain
+    // the curve applies to all three
+    float gain[TONE_MAP_LUT_STEPS + 1];
+
+    // Square root of linear SDR light to SDR signal, which keeps
+    // enough steps near black
+    float oetf[TONE_MAP_LUT_STEPS + 1];
+} TONE_MAP_LUTS, *PTONE_MAP_LUTS;
+
+// Pixels tone mapped at a time
+#define TONE_MAP_CHUNK_SIZE 256
+
+// R'G'B' values for each pixel of a chunk
+typedef struct _TONE_MAP_RGB {
+    float r[TONE_MAP_CHUNK_SIZE];
+    float g[TONE_MAP_CHUNK_SIZE];
+    float b[TONE_MAP_CHUNK_SIZE];
+} TONE_MAP_RGB, *PTONE_MAP_RGB;
+
+typedef struct _PLANE_COPY_KERNELS {
+    const char* name;
+    SDL_bool (*isSupported)(void);
+    void (*copyRow)(uint8_t* dst, const uint8_t* src, int bytes);
+    void (*interleaveRow)(uint8_t* dst, const uint8_t* srcU, const uint8_t* srcV, int width);
+    void (*deinterleaveRow)(uint8_t* dstU, uint8_t* dstV, const uint8_t* src, int width);
+    void (*narrowRow)(uint8_t* dst, const uint16_t* src, int width);
+
+    // Dither has at least 16 entries repeating every 8 samples
+    void (*ditherRow)(uint8_t* dst, const uint16_t* src, int width, int shift, const uint16_t* dither);
+
+    // Tone maps a row of luma samples using the R'G'B' offsets of their
+    // chroma samples. Writes dithered BT.709 luma to dst and R'G'B' to rgb.
+    void (*toneMapRow)(uint8_t* dst, PTONE_MAP_RGB rgb, const TONE_MAP_RGB* offsets,
+                       const uint16_t* src, int width, int shift, const float* lumaLut,
+                       const TONE_MAP_LUTS* luts, const uint16_t* dither);
+} PLANE_COPY_KERNELS, *PPLANE_COPY_KERNELS;
+
+static SDL_bool alwaysSupported(void)
+{
+    return SDL_TRUE;
+}
+
+static void copyRowScalar(uint8_t* dst, const uint8_t* src, int bytes)
+{
+    memcpy(dst, src, bytes);
+}
+
+static void interleaveRowScalar(uint8_t* dst, const uint8_t* srcU, const uint8_t* srcV, int width)
+{
+    for (int x = 0; x < width; x++) {
+        dst[x * 2] = srcU[x];
+        dst[x * 2 + 1] = srcV[x];
+    }
+}
+
+static void deinterleaveRowScalar(uint8_t* dstU, uint8_t* dstV, const uint8_t* src, int width)
+{
+    for (int x = 0; x < width; x++) {
+        dstU[x] = src[x * 2];
+        dstV[x] = src[x * 2 + 1];
+    }
+}
+
+static void narrowRowScalar(uint8_t* dst, const uint16_t* src, int width)
+{
+    for (int x = 0; x < width; x++) {
+        dst[x] = (uint8_t)(src[x] >> 8);
+    }
+}
+
+static void ditherRowScalar(uint8_t* dst, const uint16_t* src, int width, int shift, const uint16_t* dither)
+{
+    for (int x = 0; x < width; x++) {
+        int value = SDL_min(src[x] + dither[x & 7], 0xFFFF) >> shift;
+        dst[x] = (uint8_t)SDL_min(value, 0xFF);
+    }
+}
+
+// Clamps a signal to its index in the tone mapping tables
+static inline int toneMapIndex(float signal)
+{
+    return (int)(SDL_max(SDL_min(signal, 1.0f), 0.0f) * TONE_MAP_LUT_STEPS + 0.5f);
+}
+
+static void toneMapPixelsScalar(uint8_t* dst, PTONE_MAP_RGB rgb, const TONE_MAP_RGB* offsets,
+                                const uint16_t* src, int x, int width, int shift, const float* lumaLut,
+                                const TONE_MAP_LUTS* luts, const uint16_t* dither)
+{
+    for (; x < width; x++) {
+        float y = lumaLut[(src[x] >> shift) & 0x3FF];
+        int r = toneMapIndex(y + offsets->r[x]);
+        int g = toneMapIndex(y + offsets->g[x]);
+        int b = toneMapIndex(y + offsets->b[x]);
+
+        // PQ is monotonic, so the brightest signal is the brightest light
+        float gain = luts->gain[SDL_max(r, SDL_max(g, b))];
+        float linearR = luts->eotf[r] * gain;
+        float linearG = luts->eotf[g] * gain;
+        float linearB = luts->eotf[b] * gain;
+
+        // BT.2020 to BT.709 primaries. Colors outside BT.709 are clipped.
+        float outR = 1.6605f * linearR - 0.5876f * linearG - 0.0728f * linearB;
+        float outG = -0.1246f * linearR + 1.1329f * linearG - 0.0083f * linearB;
+        float outB = -0.0182f * linearR - 0.1006f * linearG + 1.1187f * linearB;
+
+        rgb->r[x] = luts->oetf[toneMapIndex(SDL_sqrtf(SDL_max(outR, 0.0f)))];
+        rgb->g[x] = luts->oetf[toneMapIndex(SDL_sqrtf(SDL_max(outG, 0.0f)))];
+        rgb->b[x] = luts->oetf[toneMapIndex(SDL_sqrtf(SDL_max(outB, 0.0f)))];
+
+        // Limited range BT.709 luma with 8 fractional bits
+        float luma = 0.2126f * rgb->r[x] + 0.7152f * rgb->g[x] + 0.0722f * rgb->b[x];
+        dst[x] = (uint8_t)(((int)(luma * (219 * 256) + 16 * 256) + dither[x & 7]) >> 8);
+    }
+}
+
+// SSE2 and NEON have no gathers for the table lookups, so they use this too
+static void toneMapRowScalar(uint8_t* dst, PTONE_MAP_RGB rgb, const TONE_MAP_RGB* offsets,
+                             const uint16_t* src, int width, int shift, const float* lumaLut,
+                             const TONE_MAP_LUTS* luts, const uint16_t* dither)
+{
+    toneMapPixelsScalar(dst, rgb, offsets, src, 0, width, shift, lumaLut, luts, dither);
+}
+
+#ifdef HAVE_X86_KERNELS
+
+TARGET_SSE2
+static void copyRowSse2(uint8_t* dst, const uint8_t* src, int bytes)
+{
+    int i = 0;
+
+    for (; i + 64 <= bytes; i += 64) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(src + i));
+        __m128i b = _mm_loadu_si128((const __m128i*)(src + i + 16));
+        __m128i c = _mm_loadu_si128((const __m128i*)(src + i + 32));
+        __m128i d = _mm_loadu_si128((const __m128i*)(src + i + 48));
+        _mm_storeu_si128((__m128i*)(dst + i), a);
+        _mm_storeu_si128((__m128i*)(dst + i + 16), b);
+        _mm_storeu_si128((__m128i*)(dst + i + 32), c);
+        _mm_storeu_si128((__m128i*)(dst + i + 48), d);
+    }
+
+    for (; i + 16 <= bytes; i += 16) {
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_loadu_si128((const __m128i*)(src + i)));
+    }
+
+    memcpy(dst + i, src + i, bytes - i);
+}
+
+TARGET_SSE2
+static void interleaveRowSse2(uint8_t* dst, const uint8_t* srcU, const uint8_t* srcV, int width)
+{
+    int x = 0;
+
+    for (; x + 16 <= width; x += 16) {
+        __m128i u = _mm_loadu_si128((const __m128i*)(srcU + x));
+        __m128i v = _mm_loadu_si128((const __m128i*)(srcV + x));
+        _mm_storeu_si128((__m128i*)(dst + x * 2), _mm_unpacklo_epi8(u, v));
+        _mm_storeu_si128((__m128i*)(dst + x * 2 + 16), _mm_unpackhi_epi8(u, v));
+    }
+
+    interleaveRowScalar(dst + x * 2, srcU + x, srcV + x, width - x);
+}
+
+TARGET_SSE2
+static void deinterleaveRowSse2(uint8_t* dstU, uint8_t* dstV, const uint8_t* src, int width)
+{
+    const __m128i lowBytes = _mm_set1_epi16(0x00FF);
+    int x = 0;
+
+    for (; x + 16 <= width; x += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(src + x * 2));
+        __m128i b = _mm_loadu_si128((const __m128i*)(src + x * 2 + 16));
+        __m128i u = _mm_packus_epi16(_mm_and_si128(a, lowBytes), _mm_and_si128(b, lowBytes));
+        __m128i v = _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8));
+        _mm_storeu_si128((__m128i*)(dstU + x), u);
+        _mm_storeu_si128((__m128i*)(dstV + x), v);
+    }
+
+    deinterleaveRowScalar(dstU + x, dstV + x, src + x * 2, width - x);
+}
+
+TARGET_SSE2
+static void narrowRowSse2(uint8_t* dst, const uint16_t* src, int width)
+{
+    int x = 0;
+
+    for (; x + 16 <= width; x += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(src + x));
+        __m128i b = _mm_loadu_si128((const __m128i*)(src + x + 8));
+        _mm_storeu_si128((__m128i*)(dst + x),
+                         _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8)));
+    }
+
+    narrowRowScalar(dst + x, src + x, width - x);
+}
+
+TARGET_SSE2
+static void ditherRowSse2(uint8_t* dst, const uint16_t* src, int width, int shift, const uint16_t* dither)
+{
+    const __m128i ditherValues = _mm_loadu_si128((const __m128i*)dither);
+    const __m128i shiftCount = _mm_cvtsi32_si128(shift);
+    int x = 0;
+
+    for (; x + 16 <= width; x += 16) {
+        __m128i a = _mm_adds_epu16(_mm_loadu_si128((const __m128i*)(src + x)), ditherValues);
+        __m128i b = _mm_adds_epu16(_mm_loadu_si128((const __m128i*)(src + x + 8)), ditherValues);
+        _mm_storeu_si128((__m128i*)(dst + x),
+                         _mm_packus_epi16(_mm_srl_epi16(a, shiftCount), _mm_srl_epi16(b, shiftCount)));
+    }
+
+    ditherRowScalar(dst + x, src + x, width - x, shift, dither);
+}
+
+TARGET_AVX2
+static void copyRowAvx2(uint8_t* dst, const uint8_t* src, int bytes)
+{
+    int i = 0;
+
+    for (; i + 128 <= bytes; i += 128) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(src + i));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(src + i + 32));
+        __m256i c = _mm256_loadu_si256((const __m256i*)(src + i + 64));
+        __m256i d = _mm256_loadu_si256((const __m256i*)(src + i + 96));
+        _mm256_storeu_si256((__m256i*)(dst + i), a);
+        _mm256_storeu_si256((__m256i*)(dst + i + 32), b);
+        _mm256_storeu_si256((__m256i*)(dst + i + 64), c);
+        _mm256_storeu_si256((__m256i*)(dst + i + 96), d);
+    }
+
+    for (; i + 32 <= bytes; i += 32) {
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_loadu_si256((const __m256i*)(src + i)));
+    }
+
+    // Avoid AVX to SSE transition stalls in the tail
+    _mm256_zeroupper();
+
+    memcpy(dst + i, src + i, bytes - i);
+}
+
+TARGET_AVX2
+static void interleaveRowAvx2(uint8_t* dst, const uint8_t* srcU, const uint8_t* srcV, int width)
+{
+    int x = 0;
+
+    for (; x + 32 <= width; x += 32) {
+        __m256i u = _mm256_loadu_si256((const __m256i*)(srcU + x));
+        __m256i v = _mm256_loadu_si256((const __m256i*)(srcV + x));
+
+        // Unpacking works within each 128-bit lane, so swap the
+        // middle lanes to put the output back in order.
+        __m256i lo = _mm256_unpacklo_epi8(u, v);
+        __m256i hi = _mm256_unpackhi_epi8(u, v);
+        _mm256_storeu_si256((__m256i*)(dst + x * 2), _mm256_permute2x128_si256(lo, hi, 0x20));
+        _mm256_storeu_si256((__m256i*)(dst + x * 2 + 32), _mm256_permute2x128_si256(lo, hi, 0x31));
+    }
+
+    _mm256_zeroupper();
+
+    interleaveRowSse2(dst + x * 2, srcU + x, srcV + x, width - x);
+}
+
+TARGET_AVX2
+static void deinterleaveRowAvx2(uint8_t* dstU, uint8_t* dstV, const uint8_t* src, int width)
+{
+    const __m256i lowBytes = _mm256_set1_epi16(0x00FF);
+    int x = 0;
+
+    for (; x + 32 <= width; x += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(src + x * 2));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(src + x * 2 + 32));
+
+        // Packing also works within lanes, leaving the 64-bit
+        // quarters in 0, 2, 1, 3 order.
+        __m256i u = _mm256_packus_epi16(_mm256_and_si256(a, lowBytes), _mm256_and_si256(b, lowBytes));
+        __m256i v = _mm256_packus_epi16(_mm256_srli_epi16(a, 8), _mm256_srli_epi16(b, 8));
+        _mm256_storeu_si256((__m256i*)(dstU + x), _mm256_permute4x64_epi64(u, 0xD8));
+        _mm256_storeu_si256((__m256i*)(dstV + x), _mm256_permute4x64_epi64(v, 0xD8));
+    }
+
+    _mm256_zeroupper();
+
+    deinterleaveRowSse2(dstU + x, dstV + x, src + x * 2, width - x);
+}
+
+TARGET_AVX2
+static void narrowRowAvx2(uint8_t* dst, const uint16_t* src, int width)
+{
+    int x = 0;
+
+    for (; x + 32 <= width; x += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(src + x));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(src + x + 16));
+        __m256i packed = _mm256_packus_epi16(_mm256_srli_epi16(a, 8), _mm256_srli_epi16(b, 8));
+        _mm256_storeu_si256((__m256i*)(dst + x), _mm256_permute4x64_epi64(packed, 0xD8));
+    }
+
+    _mm256_zeroupper();
+
+    narrowRowSse2(dst + x, src + x, width - x);
+}
+
+TARGET_AVX2
+static void ditherRowAvx2(uint8_t* dst, const uint16_t* src, int width, int shift, const uint16_t* dither)
+{
+    const __m256i ditherValues = _mm256_loadu_si256((const __m256i*)dither);
+    const __m128i shiftCount = _mm_cvtsi32_si128(shift);
+    int x = 0;
+
+    for (; x + 32 <= width; x += 32) {
+        __m256i a = _mm256_adds_epu16(_mm256_loadu_si256((const __m256i*)(src + x)), ditherValues);
+        __m256i b = _mm256_adds_epu16(_mm256_loadu_si256((const __m256i*)(src + x + 16)), ditherValues);
+        __m256i packed = _mm256_packus_epi16(_mm256_srl_epi16(a, shiftCount), _mm256_srl_epi16(b, shiftCount));
+        _mm256_storeu_si256((__m256i*)(dst + x), _mm256_permute4x64_epi64(packed, 0xD8));
+    }
+
+    _mm256_zeroupper();
+
+    ditherRowSse2(dst + x, src + x, width - x, shift, dither);
+}
+
+TARGET_AVX2
+static inline __m256i toneMapIndexAvx2(__m256 signal)
+{
+    signal = _mm256_max_ps(_mm256_min_ps(signal, _mm256_set1_ps(1.0f)), _mm256_setzero_ps());
+    return _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(signal, _mm256_set1_ps(TONE_MAP_LUT_STEPS)),
+                                             _mm256_set1_ps(0.5f)));
+}
+
+TARGET_AVX2
+static void toneMapRowAvx2(uint8_t* dst, PTONE_MAP_RGB rgb, const TONE_MAP_RGB* offsets,
+                           const uint16_t* src, int width, int shift, const float* lumaLut,
+                           const TONE_MAP_LUTS* luts, const uint16_t* dither)
+{
+    const __m256i ditherValues = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)dither));
+    const __m128i shiftCount = _mm_cvtsi32_si128(shift);
+    const __m256 zero = _mm256_setzero_ps();
+    int x = 0;
+
+    // Same steps as toneMapPixelsScalar(), 8 pixels at a time
+    for (; x + 8 <= width; x += 8) {
+        __m256i codes = _mm256_and_si256(_mm256_srl_epi32(_mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(src + x))), shiftCount),
+                                         _mm256_set1_epi32(0x3FF));
+        __m256 y = _mm256_i32gather_ps(lumaLut, codes, 4);
+        __m256i r = toneMapIndexAvx2(_mm256_add_ps(y, _mm256_loadu_ps(offsets->r + x)));
+        __m256i g = toneMapIndexAvx2(_mm256_add_ps(y, _mm256_loadu_ps(offsets->g + x)));
+        __m256i b = toneMapIndexAvx2(_mm256_add_ps(y, _mm256_loadu_ps(offsets->b + x)));
+
+        __m256 gain = _mm256_i32gather_ps(luts->gain, _mm256_max_epi32(r, _mm256_max_epi32(g, b)), 4);
+        __m256 linearR = _mm256_mul_ps(_mm256_i32gather_ps(luts->eotf, r, 4), gain);
+        __m256 linearG = _mm256_mul_ps(_mm256_i32gather_ps(luts->eotf, g, 4), gain);
+        __m256 linearB = _mm256_mul_ps(_mm256_i32gather_ps(luts->eotf, b, 4), gain);
+
+        __m256 outR = _mm256_sub_ps(_mm256_sub_ps(_mm256_mul_ps(_mm256_set1_ps(1.6605f), linearR),
+                                                  _mm256_mul_ps(_mm256_set1_ps(0.5876f), linearG)),
+                                    _mm256_mul_ps(_mm256_set1_ps(0.0728f), linearB));
+        __m256 outG = _mm256_sub_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(-0.1246f), linearR),
+                                                  _mm256_mul_ps(_mm256_set1_ps(1.1329f), linearG)),
+                                    _mm256_mul_ps(_mm256_set1_ps(0.0083f), linearB));
+        __m256 outB = _mm256_add_ps(_mm256_sub_ps(_mm256_mul_ps(_mm256_set1_ps(-0.0182f), linearR),
+                                                  _mm256_mul_ps(_mm256_set1_ps(0.1006f), linearG)),
+                                    _mm256_mul_ps(_mm256_set1_ps(1.1187f), linearB));
+
+        __m256 sdrR = _mm256_i32gather_ps(luts->oetf, toneMapIndexAvx2(_mm256_sqrt_ps(_mm256_max_ps(outR, zero))), 4);
+        __m256 sdrG = _mm256_i32gather_ps(luts->oetf, toneMapIndexAvx2(_mm256_sqrt_ps(_mm256_max_ps(outG, zero))), 4);
+        __m256 sdrB = _mm256_i32gather_ps(luts->oetf, toneMapIndexAvx2(_mm256_sqrt_ps(_mm256_max_ps(outB, zero))), 4);
+        _mm256_storeu_ps(rgb->r + x, sdrR);
+        _mm256_storeu_ps(rgb->g + x, sdrG);
+        _mm256_storeu_ps(rgb->b + x, sdrB);
+
+        __m256 luma = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(0.2126f), sdrR),
+                                                  _mm256_mul_ps(_mm256_set1_ps(0.7152f), sdrG)),
+                                    _mm256_mul_ps(_mm256_set1_ps(0.0722f), sdrB));
+        __m256i value = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(luma, _mm256_set1_ps(219 * 256)),
+                                                          _mm256_set1_ps(16 * 256)));
+        value = _mm256_srli_epi32(_mm256_add_epi32(value, ditherValues), 8);
+
+        __m128i packed = _mm_packus_epi32(_mm256_castsi256_si128(value), _mm256_extracti128_si256(value, 1));
+        _mm_storel_epi64((__m128i*)(dst + x), _mm_packus_epi16(packed, packed));
+    }
+
+    _mm256_zeroupper();
+
+    toneMapPixelsScalar(dst, rgb, offsets, src, x, width, shift, lumaLut, luts, dither);
+}
+
+#endif
+
+#ifdef HAVE_NEON_KERNELS
+
+static void copyRowNeon(uint8_t* dst, const uint8_t* src, int bytes)
+{
+    int i = 0;
+
+    for (; i + 64 <= bytes; i += 64) {
+        uint8x16_t a = vld1q_u8(src + i);
+        uint8x16_t b = vld1q_u8(src + i + 16);
+        uint8x16_t c = vld1q_u8(src + i + 32);
+        uint8x16_t d = vld1q_u8(src + i + 48);
+        vst1q_u8(dst + i, a);
+        vst1q_u8(dst + i + 16, b);
+        vst1q_u8(dst + i + 32, c);
+        vst1q_u8(dst + i + 48, d);
+    }
+
+    for (; i + 16 <= bytes; i += 16) {
+        vst1q_u8(dst + i, vld1q_u8(src + i));
+    }
+
+    memcpy(dst + i, src + i, bytes - i);
+}
+
+static void interleaveRowNeon(uint8_t* dst, const uint8_t* srcU, const uint8_t* srcV, int width)
+{
+    int x = 0;
+
+    for (; x + 16 <= width; x += 16) {
+        uint8x16x2_t uv;
+        uv.val[0] = vld1q_u8(srcU + x);
+        uv.val[1] = vld1q_u8(srcV + x);
+        vst2q_u8(dst + x * 2, uv);
+    }
+
+    interleaveRowScalar(dst + x * 2, srcU + x, srcV + x, width - x);
+}
+
+static void deinterleaveRowNeon(uint8_t* dstU, uint8_t* dstV, const uint8_t* src, int width)
+{
+    int x = 0;
+
+    for (; x + 16 <= width; x += 16) {
+        uint8x16x2_t uv = vld2q_u8(src + x * 2);
+        vst1q_u8(dstU + x, uv.val[0]);
+        vst1q_u8(dstV + x, uv.val[1]);
+    }
+
+    deinterleaveRowScalar(dstU + x, dstV + x, src + x * 2, width - x);
+}
+
+static void narrowRowNeon(uint8_t* dst, const uint16_t* src, int width)
+{
+    int x = 0;
+
+    for (; x + 16 <= width; x += 16) {
+        uint16x8_t a = vld1q_u16(src + x);
+        uint16x8_t b = vld1q_u16(src + x + 8);
+        vst1q_u8(dst + x, vcombine_u8(vshrn_n_u16(a, 8), vshrn_n_u16(b, 8)));
+    }
+
+    narrowRowScalar(dst + x, src + x, width - x);
+}
+
+static void ditherRowNeon(uint8_t* dst, const uint16_t* src, int width, int shift, const uint16_t* dither)
+{
+    const uint16x8_t ditherValues = vld1q_u16(dither);
+    const int16x8_t shiftCount = vdupq_n_s16((int16_t)-shift);
+    int x = 0;
+
+    for (; x + 16 <= width; x += 16) {
+        uint16x8_t a = vshlq_u16(vqaddq_u16(vld1q_u16(src + x), ditherValues), shiftCount);
+        uint16x8_t b = vshlq_u16(vqaddq_u16(vld1q_u16(src + x + 8), ditherValues), shiftCount);
+        vst1q_u8(dst + x, vcombine_u8(vqmovn_u16(a), vqmovn_u16(b)));
+    }
+
+    ditherRowScalar(dst + x, src + x, width - x, shift, dither);
+}
+
+#endif
+
+// 8x8 ordered dither matrix with values from 0 to 63
+static const uint8_t k_BayerMatrix[8][8] = {
+    {  0, 32,  8, 40,  2, 34, 10, 42 },
+    { 48, 16, 56, 24, 50, 18, 58, 26 },
+    { 12, 44,  4, 36, 14, 46,  6, 38 },
+    { 60, 28, 52, 20, 62, 30, 54, 22 },
+    {  3, 35, 11, 43,  1, 33,  9, 41 },
+    { 51, 19, 59, 27, 49, 17, 57, 25 },
+    { 15, 47,  7, 39, 13, 45,  5, 37 },
+    { 63, 31, 55, 23, 61, 29, 53, 21 },
+};
+
+
+// Ordered from slowest to fastest
+static const PLANE_COPY_KERNELS k_Kernels[] = {
+    { "scalar", alwaysSupported, copyRowScalar, interleaveRowScalar, deinterleaveRowScalar, narrowRowScalar, ditherRowScalar, toneMapRowScalar },
+#ifdef HAVE_X86_KERNELS
+    { "sse2", SDL_HasSSE2, copyRowSse2, interleaveRowSse2, deinterleaveRowSse2, narrowRowSse2, ditherRowSse2, toneMapRowScalar },
+    { "avx2", SDL_HasAVX2, copyRowAvx2, interleaveRowAvx2, deinterleaveRowAvx2, narrowRowAvx2, ditherRowAvx2, toneMapRowAvx2 },
+#endif
+#ifdef HAVE_NEON_KERNELS
+    { "neon", SDL_HasNEON, copyRowNeon, interleaveRowNeon, deinterleaveRowNeon, narrowRowNeon, ditherRowNeon, toneMapRowScalar },
+#endif
+};
+
+#define KERNEL_COUNT ((int)SDL_arraysize(k_Kernels))
+
+// Index of the selected kernel set plus one, so zero means none yet
+static SDL_atomic_t s_SelectedKernel;
+
+static int chooseKernel()
+{
+    QByteArray requested = qgetenv("PLANE_COPY_KERNEL");
+    int index = 0;
+
+    for (int i = 0; i < KERNEL_COUNT; i++) {
+        if (!k_Kernels[i].isSupported()) {
+            continue;
+        }
+
+        if (requested.isEmpty()) {
+            index = i;
+        }
+        else if (requested == k_Kernels[i].name) {
+            index = i;
+            break;
+        }
+    }
+
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                "Using %s plane copy kernels",
+                k_Kernels[index].name);
+    return index;
+}
+
+static const PLANE_COPY_KERNELS* getKernels()
+{
+    int index = SDL_AtomicGet(&s_SelectedKernel) - 1;
+
+    if (index < 0) {
+        // Racing threads will all choose the same kernels
+        index = chooseKernel();
+        SDL_AtomicSet(&s_SelectedKernel, index + 1);
+    }
+
+    return &k_Kernels[index];
+}
+
+static void buildToneMapLuts(PTONE_MAP_LUTS luts)
+{
+    // SMPTE ST 2084 (PQ) constants
+    const double m1 = 2610.0 / 16384;
+    const double m2 = 2523.0 / 4096 * 128;
+    const double c1 = 3424.0 / 4096;
+    const double c2 = 2413.0 / 4096 * 32;
+    const double c3 = 2392.0 / 4096 * 32;
+
+    const double peak = TONE_MAP_PEAK_NITS / TONE_MAP_REFERENCE_WHITE_NITS;
+
+    for (int i = 0; i < 1024; i++) {
+        luts->luma[0][i] = (i - 64) / 876.0f;
+        luts->luma[1][i] = i / 1023.0f;
+        luts->chroma[0][i] = (i - 512) / 896.0f;
+        luts->chroma[1][i] = (i - 512) / 1023.0f;
+    }
+
+    for (int i = 0; i <= TONE_MAP_LUT_STEPS; i++) {
+        double signal = (double)i / TONE_MAP_LUT_STEPS;
+        double p = SDL_pow(signal, 1 / m2);
+        double x = 10000 * SDL_pow(SDL_max(p - c1, 0.0) / (c2 - c3 * p), 1 / m1) / TONE_MAP_REFERENCE_WHITE_NITS;
+
+        luts->eotf[i] = (float)x;
+
+        // Extended Reinhard curve x * (1 + x / peak^2) / (1 + x) divided by x
+        luts->gain[i] = (float)((1 + x / (peak * peak)) / (1 + x));
+
+        // SDR display gamma
+        luts->oetf[i] = (float)SDL_pow(signal, 2 / 2.4);
+    }
+}
+
+static TONE_MAP_LUTS s_ToneMapLuts;
+static SDL_atomic_t s_ToneMapLutsReady;
+static SDL_SpinLock s_ToneMapLutsLock;
+
+static const TONE_MAP_LUTS* getToneMapLuts()
+{
+    if (SDL_AtomicGet(&s_ToneMapLutsReady) == 0) {
+        SDL_AtomicLock(&s_ToneMapLutsLock);
+        if (SDL_AtomicGet(&s_ToneMapLutsReady) == 0) {
+            buildToneMapLuts(&s_ToneMapLuts);
+            SDL_AtomicSet(&s_ToneMapLutsReady, 1);
+        }
+        SDL_AtomicUnlock(&s_ToneMapLutsLock);
+    }
+
+    return &s_ToneMapLuts;
+}
+
+void PlaneCopy::copyPlane(uint8_t* dst, int dstPitch,
+                          const uint8_t* src, int srcPitch,
+                          int widthBytes, int height)
+{
+    const PLANE_COPY_KERNELS* kernels = getKernels();
+
+    // Copy everything at once if there's no padding to skip
+    if (dstPitch == widthBytes && srcPitch == widthBytes) {
+        kernels->copyRow(dst, src, widthBytes * height);
+        return;
+    }
+
+    for (int y = 0; y < height; y++) {
+        kernels->copyRow(dst + y * dstPitch, src + y * srcPitch, widthBytes);
+    }
+}
+
+void PlaneCopy::interleavePlanes(uint8_t* dstUV, int dstPitch,
+                                 const uint8_t* srcU, int srcUPitch,
+                                 const uint8_t* srcV, int srcVPitch,
+                                 int width, int height)
+{
+    const PLANE_COPY_KERNELS* kernels = getKernels();
+
+    for (int y = 0; y < height; y++) {
+        kernels->interleaveRow(dstUV + y * dstPitch,
+                               srcU + y * srcUPitch,
+                               srcV + y * srcVPitch,
+                               width);
+    }
+}
+
+void PlaneCopy::deinterleavePlane(uint8_t* dstU, int dstUPitch,
+                                  uint8_t* dstV, int dstVPitch,
+                                  const uint8_t* srcUV, int srcPitch,
+                                  int width, int height)
+{
+    const PLANE_COPY_KERNELS* kernels = getKernels();
+
+    for (int y = 0; y < height; y++) {
+        kernels->deinterleaveRow(dstU + y * dstUPitch,
+                                 dstV + y * dstVPitch,
+                                 srcUV + y * srcPitch,
+                                 width);
+    }
+}
+
+void PlaneCopy::narrowPlane(uint8_t* dst, int dstPitch,
+                            const uint16_t* src, int srcPitch,
+                            int width, int height)
+{
+    const PLANE_COPY_KERNELS* kernels = getKernels();
+
+    for (int y = 0; y < height; y++) {
+        kernels->narrowRow(dst + y * dstPitch,
+                           (const uint16_t*)((const uint8_t*)src + y * srcPitch),
+                           width);
+    }
+}
+
+void PlaneCopy::ditherPlane(uint8_t* dst, int dstPitch,
+                            const uint16_t* src, int srcPitch,
+                            int width, int height, int shift)
+{
+    const PLANE_COPY_KERNELS* kernels = getKernels();
+    uint16_t dither[32];
+
+    SDL_assert(shift >= 2 && shift <= 8);
+
+    for (int y = 0; y < height; y++) {
+        // Scale the matrix to one step of the output
+        for (int i = 0; i < (int)SDL_arraysize(dither); i++) {
+            dither[i] = (uint16_t)((k_BayerMatrix[y & 7][i & 7] << shift) >> 6);
+        }
+
+        kernels->ditherRow(dst + y * dstPitch,
+                           (const uint16_t*)((const uint8_t*)src + y * srcPitch),
+                           width, shift, dither);
+    }
+}
+
+void PlaneCopy::toneMapFrame(uint8_t* const dst[3], const int dstPitch[3], int dstUVStep,
+                             const uint16_t* const src[3], const int srcPitch[3], int srcUVStep,
+                             int width, int height, int shift, bool fullRange)
+{
+    const PLANE_COPY_KERNELS* kernels = getKernels();
+    const TONE_MAP_LUTS* luts = getToneMapLuts();
+    const float* lumaLut = luts->luma[fullRange ? 1 : 0];
+    const float* chromaLut = luts->chroma[fullRange ? 1 : 0];
+    TONE_MAP_RGB offsets;
+    TONE_MAP_RGB rows[2];
+    uint16_t dither[2][32];
+
+    // Each chroma sample is shared by a 2x2 block of luma samples.
+    // Odd heights repeat the last row.
+    for (int cy = 0; cy < (height + 1) / 2; cy++) {
+        const uint16_t* srcU = (const uint16_t*)((const uint8_t*)src[1] + cy * srcPitch[1]);
+        const uint16_t* srcV = (const uint16_t*)((const uint8_t*)src[2] + cy * srcPitch[2]);
+        uint8_t* dstU = dst[1] + cy * dstPitch[1];
+        uint8_t* dstV = dst[2] + cy * dstPitch[2];
+        int ys[2] = { cy * 2, SDL_min(cy * 2 + 1, height - 1) };
+
+        for (int i = 0; i < 2; i++) {
+            for (int j = 0; j < (int)SDL_arraysize(dither[i]); j++) {
+                dither[i][j] = (uint16_t)((k_BayerMatrix[ys[i] & 7][j & 7] << 8) >> 6);
+            }
+        }
+
+        // Chunks are a multiple of 8 samples to keep the dither pattern aligned
+        for (int x = 0; x < width; x += TONE_MAP_CHUNK_SIZE) {
+            int count = SDL_min(width - x, TONE_MAP_CHUNK_SIZE);
+
+            // BT.2020 non-constant luminance Y'CbCr to R'G'B' offsets
+            for (int i = 0; i < count; i += 2) {
+                int cx = (x + i) / 2;
+                float cb = chromaLut[(srcU[cx * srcUVStep] >> shift) & 0x3FF];
+                float cr = chromaLut[(srcV[cx * srcUVStep] >> shift) & 0x3FF];
+
+                offsets.r[i] = offsets.r[i + 1] = 1.4746f * cr;
+                offsets.g[i] = offsets.g[i + 1] = -0.16455f * cb - 0.57135f * cr;
+                offsets.b[i] = offsets.b[i + 1] = 1.8814f * cb;
+            }
+
+            for (int i = 0; i < 2; i++) {
+                const uint16_t* srcY = (const uint16_t*)((const uint8_t*)src[0] + ys[i] * srcPitch[0]);
+
+                kernels->toneMapRow(dst[0] + ys[i] * dstPitch[0] + x, &rows[i], &offsets,
+                                    srcY + x, count, shift, lumaLut, luts, dither[i]);
+            }
+
+            // Chroma of each block's average color. Odd widths repeat the last column.
+            for (int i = 0; i < count; i += 2) {
+                int cx = (x + i) / 2;
+                int next = SDL_min(i + 1, count - 1);
+                float r = rows[0].r[i] + rows[0].r[next] + rows[1].r[i] + rows[1].r[next];
+                float g = rows[0].g[i] + rows[0].g[next] + rows[1].g[i] + rows[1].g[next];
+                float b = rows[0].b[i] + rows[0].b[next] + rows[1].b[i] + rows[1].b[next];
+                float luma = 0.2126f * r + 0.7152f * g + 0.0722f * b;
+                int ditherValue = k_BayerMatrix[cy & 7][cx & 7] * 4;
+
+                dstU[cx * dstUVStep] = (uint8_t)(((int)((b - luma) * (224 * 256 / (4 * 1.8556f)) + 128 * 256) + ditherValue) >> 8);
+                dstV[cx * dstUVStep] = (uint8_t)(((int)((r - luma) * (224 * 256 / (4 * 1.5748f)) + 128 * 256) + ditherValue) >> 8);
+            }
+        }
+    }
+}
+
+int PlaneCopy::getKernelCount()
+{
+    return KERNEL_COUNT;
+}
+
+const char* PlaneCopy::getKernelName(int index)
+{
+    SDL_assert(index >= 0 && index < KERNEL_COUNT);
+    return k_Kernels[index].name;
+}
+
+bool PlaneCopy::isKernelSupported(int index)
+{
+    SDL_assert(index >= 0 && index < KERNEL_COUNT);
+    return k_Kernels[index].isSupported();
+}
+
+int PlaneCopy::selectKernel(int index)
+{
+    SDL_assert(isKernelSupported(index));
+
+    int previousIndex = getSelectedKernel();
+    SDL_AtomicSet(&s_SelectedKernel, index + 1);
+    return previousIndex;
+}
+
+int PlaneCopy::getSelectedKernel()
+{
+    // Make sure a kernel has been chosen
+    getKernels();
+
+    return SDL_AtomicGet(&s_SelectedKernel) - 1;
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <SDL.h>
+
+// Row-by-row plane copy and conversion routines for uploading frames.
+// Source and destination pitches may differ, and only the visible
+// bytes of each row are touched. The fastest kernel set the CPU
+// supports is picked on first use, or the one named by the
+// PLANE_COPY_KERNEL environment variable.
+class PlaneCopy
+{
+public:
+    // Copies widthBytes of each row
+    static
+    void copyPlane(uint8_t* dst, int dstPitch,
+                   const uint8_t* src, int srcPitch,
+                   int widthBytes, int height);
+
+    // Separate U and V planes (YV12/I420) to an interleaved UV plane (NV12)
+    static
+    void interleavePlanes(uint8_t* dstUV, int dstPitch,
+                          const uint8_t* srcU, int srcUPitch,
+                          const uint8_t* srcV, int srcVPitch,
+                          int width, int height);
+
+    // Interleaved UV plane (NV12) to separate U and V planes (YV12/I420)
+    static
+    void deinterleavePlane(uint8_t* dstU, int dstUPitch,
+                           uint8_t* dstV, int dstVPitch,
+                           const uint8_t* srcUV, int srcPitch,
+                           int width, int height);
+
+    // 16-bit samples with the value in the high bits (P010) to 8-bit
+    // samples. The width is in samples and the pitches are in bytes.
+    static
+    void narrowPlane(uint8_t* dst, int dstPitch,
+                     const uint16_t* src, int srcPitch,
+                     int width, int height);
+
+    // 16-bit samples to 8-bit samples by adding ordered dither and
+    // shifting right by shift bits (2 for yuv420p10, 8 for P010)
+    static
+    void ditherPlane(uint8_t* dst, int dstPitch,
+                     const uint16_t* src, int srcPitch,
+                     int width, int height, int shift);
+
+    // 10-bit BT.2020 PQ (HDR10) YUV 4:2:0 to 8-bit limited range BT.709
+    // SDR YUV 4:2:0 with ordered dither. Each pixel is tone mapped in RGB
+    // by the gain of its brightest component (max-RGB), which keeps hues.
+    // Samples hold the value shifted left by shift bits (0 for yuv420p10,
+    // 6 for P010). Chroma samples are dstUVStep and srcUVStep samples
+    // apart, so an interleaved plane is passed as U and U + 1 with a step
+    // of 2. Source samples are read as full range if fullRange is true.
+    static
+    void toneMapFrame(uint8_t* const dst[3], const int dstPitch[3], int dstUVStep,
+                      const uint16_t* const src[3], const int srcPitch[3], int srcUVStep,
+                      int width, int height, int shift, bool fullRange);
+
+    // Kernel sets built into this binary, for benchmarking
+    static
+    int getKernelCount();
+
+    static
+    const char* getKernelName(int index);
+
+    static
+    bool isKernelSupported(int index);
+
+    // Returns the previously selected kernel set
+    static
+    int selectKernel(int index);
+
+    static
+    int getSelectedKernel();
+};
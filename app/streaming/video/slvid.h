@@ -20,6 +20,9 @@ public:
     // Unused since rendering is done directly from the decode thread
     virtual void renderFrameOnMainThread() {}
 
+    // Always full-screen
+    virtual bool notifyWindowChanged() { return false; }
+
 private:
     static void slLogCallback(void* context, ESLVideoLog logLevel, const char* message);
 
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <SDL.h>
+
+#include <vector>
+
+// Fixed-capacity ring buffer for a single producer thread and a
+// single consumer thread. Neither side takes a lock. The producer
+// fills the slot returned by beginPush() and publishes it with
+// commitPush(). The consumer reads the slot returned by beginPop()
+// and releases it back to the producer with commitPop().
+//
+// Rings of plain values may instead be drained with tryPop(), which
+// the producer may also call to drop the oldest item when the ring
+// is full. The consumer must then only use tryPop() too.
+//
+// Slots are constructed once up front and reused, so anything
+// stored in them (like buffers) stays allocated between uses.
+template <typename T>
+class SpscRing
+{
+public:
+    explicit SpscRing(int capacity)
+        : m_Slots(slotCount(capacity)),
+          m_SlotMask((uint32_t)m_Slots.size() - 1),
+          m_Capacity(capacity)
+    {
+        SDL_assert(capacity > 0);
+        SDL_AtomicSet(&m_Head, 0);
+        SDL_AtomicSet(&m_Tail, 0);
+    }
+
+    int capacity() const
+    {
+        return m_Capacity;
+    }
+
+    // Only exact when called from the producer or consumer thread
+    int size()
+    {
+        return (int)(getCounter(m_Tail) - getCounter(m_Head));
+    }
+
+    // Producer only. Returns nullptr if the ring is full.
+    T* beginPush()
+    {
+        uint32_t tail = getCounter(m_Tail);
+        if (tail - getCounter(m_Head) == (uint32_t)m_Capacity) {
+            return nullptr;
+        }
+
+        return &m_Slots[tail & m_SlotMask];
+    }
+
+    // Producer only. Publishes the slot returned by beginPush().
+    void commitPush()
+    {
+        // SDL_AtomicAdd() is a full barrier, so the slot contents
+        // are visible before the consumer can observe the new tail.
+        SDL_AtomicAdd(&m_Tail, 1);
+    }
+
+    // Consumer only. Returns nullptr if the ring is empty.
+    T* beginPop()
+    {
+        uint32_t head = getCounter(m_Head);
+        if (head == getCounter(m_Tail)) {
+            return nullptr;
+        }
+
+        return &m_Slots[head & m_SlotMask];
+    }
+
+    // Consumer only. Returns the slot from beginPop() to the producer.
+    void commitPop()
+    {
+        SDL_AtomicAdd(&m_Head, 1);
+    }
+
+    // Consumer or producer. Copies out the oldest item and releases its
+    // slot. Returns false if the ring is empty. If the other side takes
+    // the same item first, the copy is discarded and we try again.
+    bool tryPop(T& value)
+    {
+        for (;;) {
+            uint32_t head = getCounter(m_Head);
+            if (head == getCounter(m_Tail)) {
+                return false;
+            }
+
+            value = m_Slots[head & m_SlotMask];
+            if (SDL_AtomicCAS(&m_Head, (int)head, (int)(head + 1))) {
+                return true;
+            }
+        }
+    }
+
+private:
+    // Rounded up to a power of two, so the slot index stays
+    // continuous when the counters wrap around
+    static int slotCount(int capacity)
+    {
+        int count = 1;
+        while (count < capacity) {
+            count <<= 1;
+        }
+        return count;
+    }
+
+    static uint32_t getCounter(SDL_atomic_t& counter)
+    {
+        return (uint32_t)SDL_AtomicGet(&counter);
+    }
+
+    std::vector<T> m_Slots;
+    uint32_t m_SlotMask;
+    int m_Capacity;
+
+    // Free-running counters, read as unsigned so the occupancy is
+    // still tail - head after they wrap. Only m_Capacity slots are
+    // ever occupied, even if there are more of them.
+    SDL_atomic_t m_Head;
+    SDL_atomic_t m_Tail;
+};
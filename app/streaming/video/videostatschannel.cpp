@@ -0,0 +1,103 @@
+#include "videostatschannel.h"
+
+VideoStatsChannel::VideoStatsChannel()
+    : m_Lock(0)
+{
+    SDL_zero(m_Recorded);
+    SDL_zero(m_Published);
+}
+
+PVIDEO_STATS VideoStatsChannel::get()
+{
+    return &m_Recorded;
+}
+
+void VideoStatsChannel::publish()
+{
+    SDL_AtomicLock(&m_Lock);
+    addCounters(m_Recorded, m_Published);
+    SDL_AtomicUnlock(&m_Lock);
+
+    clearCounters(m_Recorded);
+}
+
+void VideoStatsChannel::collect(VIDEO_STATS& dst)
+{
+    SDL_AtomicLock(&m_Lock);
+    addCounters(m_Published, dst);
+    clearCounters(m_Published);
+    SDL_AtomicUnlock(&m_Lock);
+}
+
+void VideoStatsChannel::addCounters(const VIDEO_STATS& src, VIDEO_STATS& dst)
+{
+    dst.receivedFrames += src.receivedFrames;
+    dst.decodedFrames += src.decodedFrames;
+    dst.renderedFrames += src.renderedFrames;
+    dst.totalFrames += src.totalFrames;
+    dst.networkDroppedFrames += src.networkDroppedFrames;
+    dst.pacerDroppedFrames += src.pacerDroppedFrames;
+    dst.reassemblyTime.merge(src.reassemblyTime);
+    dst.decodeTime.merge(src.decodeTime);
+    dst.pacerTime.merge(src.pacerTime);
+    dst.renderTime.merge(src.renderTime);
+    dst.totalDecodeQueueDepth += src.totalDecodeQueueDepth;
+    dst.maxDecodeQueueDepth = SDL_max(dst.maxDecodeQueueDepth, src.maxDecodeQueueDepth);
+    dst.decodeQueueTime.merge(src.decodeQueueTime);
+    dst.decodeQueueDroppedFrames += src.decodeQueueDroppedFrames;
+    dst.decodeErrors += src.decodeErrors;
+    dst.totalBytesCopied += src.totalBytesCopied;
+    dst.frameBufferRequests += src.frameBufferRequests;
+    dst.frameBufferAllocations += src.frameBufferAllocations;
+    dst.directTextureFrames += src.directTextureFrames;
+    dst.totalBytesUploaded += src.totalBytesUploaded;
+    dst.uploadTime.merge(src.uploadTime);
+    dst.readbackTime.merge(src.readbackTime);
+    dst.jitEarlierFrames += src.jitEarlierFrames;
+    dst.jitLaterFrames += src.jitLaterFrames;
+    dst.jitMissedVsyncs += src.jitMissedVsyncs;
+    dst.jitSavedUs += src.jitSavedUs;
+
+    // These are the latest estimates, not sums
+    if (src.jitterBufferDepth != 0) {
+        dst.jitterBufferDepth = src.jitterBufferDepth;
+        dst.arrivalJitterUs = src.arrivalJitterUs;
+    }
+
+    if (src.renderBudgetUs != 0) {
+        dst.renderBudgetUs = src.renderBudgetUs;
+    }
+}
+
+void VideoStatsChannel::clearCounters(VIDEO_STATS& stats)
+{
+    stats.receivedFrames = 0;
+    stats.decodedFrames = 0;
+    stats.renderedFrames = 0;
+    stats.totalFrames = 0;
+    stats.networkDroppedFrames = 0;
+    stats.pacerDroppedFrames = 0;
+    stats.reassemblyTime.reset();
+    stats.decodeTime.reset();
+    stats.pacerTime.reset();
+    stats.renderTime.reset();
+    stats.totalDecodeQueueDepth = 0;
+    stats.maxDecodeQueueDepth = 0;
+    stats.decodeQueueTime.reset();
+    stats.decodeQueueDroppedFrames = 0;
+    stats.decodeErrors = 0;
+    stats.totalBytesCopied = 0;
+    stats.frameBufferRequests = 0;
+    stats.frameBufferAllocations = 0;
+    stats.directTextureFrames = 0;
+    stats.totalBytesUploaded = 0;
+    stats.uploadTime.reset();
+    stats.readbackTime.reset();
+    stats.jitEarlierFrames = 0;
+    stats.jitLaterFrames = 0;
+    stats.jitMissedVsyncs = 0;
+    stats.jitSavedUs = 0;
+    stats.jitterBufferDepth = 0;
+    stats.arrivalJitterUs = 0;
+    stats.renderBudgetUs = 0;
+}
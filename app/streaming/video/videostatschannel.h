@@ -0,0 +1,33 @@
+#pragma once
+
+#include "decoder.h"
+
+// Hands VIDEO_STATS from a thread that records them to the thread that
+// owns the stats windows, so no two threads touch the same stats. The
+// recording thread writes to get() and calls publish() once it's done
+// with a frame. The owning thread merges what was published with collect().
+class VideoStatsChannel
+{
+public:
+    VideoStatsChannel();
+
+    // Recording thread only
+    PVIDEO_STATS get();
+    void publish();
+
+    // Owning thread only
+    void collect(VIDEO_STATS& dst);
+
+    // Adds the counters and histograms in src to dst, and takes
+    // the latest estimates from src if it has any
+    static void addCounters(const VIDEO_STATS& src, VIDEO_STATS& dst);
+
+private:
+    // Zeroes what addCounters() adds up, without touching the
+    // histograms nothing was added to
+    static void clearCounters(VIDEO_STATS& stats);
+
+    VIDEO_STATS m_Recorded;
+    VIDEO_STATS m_Published;
+    SDL_SpinLock m_Lock;
+};